@@ -7,6 +7,9 @@
 #define CIRCUIT_H_
 
 #include "s2p.h"
+#include "uti.h"
+
+#include "stdio.h"
 
 
 struct Circuit_Component_Resistor_Ideal {
@@ -75,33 +78,100 @@ bool circuit_create_inductor_ideal(double inductance, struct Circuit_Component *
 bool circuit_create_resistor_ideal_parallel(double resistance, struct Circuit_Component *component_out);
 bool circuit_create_capacitor_ideal_parallel(double capacitance, struct Circuit_Component *component_out);
 bool circuit_create_inductor_ideal_parallel(double inductance, struct Circuit_Component *component_out);
+// the value of a lumped component (R, C or L), NULL for stages
+double *circuit_component_value(struct Circuit_Component *component);
 
+// standard part values, every series repeats in each decade
+typedef enum {
+    CIRCUIT_E_SERIES_NONE, // continuous values
+    CIRCUIT_E_SERIES_E12,
+    CIRCUIT_E_SERIES_E24,
+    CIRCUIT_E_SERIES_E96,
+} CIRCUIT_E_SERIES;
 
-struct Complex_2x2_SoA {
-    double* r11;
-    double* r12;
-    double* r21;
-    double* r22;
-    double* i11;
-    double* i12;
-    double* i21;
-    double* i22;
-    // count is implicit by the caller (i.e. n_frequencies)
+// The values a lumped component can be built with: an E-series or a list of parts (i.e. the stock of
+// a vendor, sorted ascending), the list wins if both are given.
+struct Circuit_Value_Grid {
+    CIRCUIT_E_SERIES series;
+    const double *parts;
+    size_t n_parts;
 };
 
+// nearest value of the grid (by ratio), the value itself for a continuous grid
+double circuit_value_grid_snap(const struct Circuit_Value_Grid *grid, double value);
+// the value steps grid values above (steps > 0) or below the snapped value, the ends of a part list stay
+double circuit_value_grid_step(const struct Circuit_Value_Grid *grid, double value, int steps);
+
+
+//
+// SoA kernels (circuit_kernels.c)
+//
+typedef enum {
+    CIRCUIT_KERNEL_SCALAR,
+    CIRCUIT_KERNEL_SSE2,
+    CIRCUIT_KERNEL_AVX2_FMA,
+} CIRCUIT_KERNEL;
+
+// best kernel supported by the cpu (cpuid). It is selected automatically on first use.
+CIRCUIT_KERNEL circuit_kernel_detect(void);
+// force a kernel kind (i.e. for tests or benchmarks), make sure the cpu supports it.
+// Not thread safe: call it before any simulation thread runs
+void circuit_kernel_select(CIRCUIT_KERNEL kernel);
+CIRCUIT_KERNEL circuit_kernel_selected_kind(void);
+const char* circuit_kernel_name(CIRCUIT_KERNEL kernel);
+
+// view of the SoA starting at frequency index offset
+struct Complex_2x2_SoA circuit_soa_offset(const struct Complex_2x2_SoA *soa, size_t offset);
+
+// T_f = T_x * T_y for n_f frequencies, tf may alias tx or ty
+void circuit_multiply_t_soa(struct Complex_2x2_SoA *tf, const struct Complex_2x2_SoA *tx, const struct Complex_2x2_SoA *ty, size_t n_f);
+void circuit_multiply_t_soa_scalar(struct Complex_2x2_SoA *tf, const struct Complex_2x2_SoA *tx, const struct Complex_2x2_SoA *ty, size_t n_f);
+void circuit_multiply_t_soa_sse2(struct Complex_2x2_SoA *tf, const struct Complex_2x2_SoA *tx, const struct Complex_2x2_SoA *ty, size_t n_f);
+void circuit_multiply_t_soa_avx2(struct Complex_2x2_SoA *tf, const struct Complex_2x2_SoA *tx, const struct Complex_2x2_SoA *ty, size_t n_f);
+
+// T_f = T_0 * T_1 * ... * T_(n_t - 1) for the frequencies offset .. offset + n_f - 1.
+// The product is accumulated in registers and T_f is written once. Rounds the same way as
+// chaining circuit_multiply_t_soa(). tf may alias any of ts.
+void circuit_cascade_t_soa(struct Complex_2x2_SoA *tf, const struct Complex_2x2_SoA *const *ts, size_t n_t, size_t offset, size_t n_f);
+void circuit_cascade_t_soa_scalar(struct Complex_2x2_SoA *tf, const struct Complex_2x2_SoA *const *ts, size_t n_t, size_t offset, size_t n_f);
+void circuit_cascade_t_soa_sse2(struct Complex_2x2_SoA *tf, const struct Complex_2x2_SoA *const *ts, size_t n_t, size_t offset, size_t n_f);
+void circuit_cascade_t_soa_avx2(struct Complex_2x2_SoA *tf, const struct Complex_2x2_SoA *const *ts, size_t n_t, size_t offset, size_t n_f);
+
+// S -> T and T -> S for n_f frequencies (output may alias input).
+// Denominators (s21 resp. t11) with |d|^2 < DBL_MIN count as zero and give T = |0 0; 0 s12|
+// resp. S = |0 t22; 0 0|, the same as mma_complex_divide_or_zero(). NaN stays NaN.
+void circuit_t_from_s_soa(struct Complex_2x2_SoA *t, const struct Complex_2x2_SoA *s, size_t n_f);
+void circuit_t_from_s_soa_scalar(struct Complex_2x2_SoA *t, const struct Complex_2x2_SoA *s, size_t n_f);
+void circuit_t_from_s_soa_sse2(struct Complex_2x2_SoA *t, const struct Complex_2x2_SoA *s, size_t n_f);
+void circuit_t_from_s_soa_avx2(struct Complex_2x2_SoA *t, const struct Complex_2x2_SoA *s, size_t n_f);
+void circuit_s_from_t_soa(struct Complex_2x2_SoA *s, const struct Complex_2x2_SoA *t, size_t n_f);
+void circuit_s_from_t_soa_scalar(struct Complex_2x2_SoA *s, const struct Complex_2x2_SoA *t, size_t n_f);
+void circuit_s_from_t_soa_sse2(struct Complex_2x2_SoA *s, const struct Complex_2x2_SoA *t, size_t n_f);
+void circuit_s_from_t_soa_avx2(struct Complex_2x2_SoA *s, const struct Complex_2x2_SoA *t, size_t n_f);
+
 struct Simulation_Component_Intermediate_State {
     struct Complex_2x2_SoA t;
     struct Complex_2x2_SoA s;
 };
 
+struct Simulation_Settings {
+    double f_min;
+    double f_max;
+    double z0_in;
+    double z0_out;
+    size_t n_frequencies;
+};
+
 struct Simulation_State {
 
     size_t n_components;
     struct Circuit_Component *components_cascade;
     struct Simulation_Component_Intermediate_State *intermediate_states;
+    bool *dirty; // components changed since their S and T parameters were calculated
 
     double z0_in;  // Source Impedance
     double z0_out; // Load Impedance
+    struct Simulation_Settings settings; // the settings of the last setup
 
     size_t n_frequencies;
     double *frequencies;
@@ -115,23 +185,100 @@ struct Simulation_State {
     double* stab_mu;
     double* stab_mu_prime;
 
+    // T of the full cascade in order ([T_in] T_0 ... T_(n-1) [T_out]) for circuit_cascade_t_soa()
+    const struct Complex_2x2_SoA **t_chain;
+    size_t n_chain;
+
+    // cached partial cascades for incremental re-simulation (n_components + 1 entries each)
+    // t_prefix[k] = T_in T_0 ... T_(k-1)        t_prefix[0] = T_in
+    // t_suffix[k] = T_k ... T_(n-1) T_out       t_suffix[n] = T_out
+    struct Complex_2x2_SoA *t_prefix;
+    struct Complex_2x2_SoA *t_suffix;
+    size_t prefix_valid_count; // t_prefix[0 .. prefix_valid_count) is up to date
+    size_t suffix_valid_from;  // t_suffix[suffix_valid_from .. n] is up to date
+
+    // last component passed to circuit_simulation_do_incremental()
+    struct Circuit_Component candidate;
+    size_t candidate_index;
+    struct Simulation_Component_Intermediate_State candidate_state;
+    bool candidate_valid;
+    // progress of circuit_simulation_continue_incremental()
+    size_t incremental_done; // frequencies 0 .. incremental_done are simulated
+    size_t incremental_prefix_valid_count;
+    size_t incremental_suffix_valid_from;
+    // precomputed T of the candidate (8 planes of n_frequencies, i.e. from a Circuit_T_Cache) or NULL
+    const double *candidate_t_planes;
+
+    uint64_t grid_hash; // of the frequencies, the key of responses cached for this grid
+
+    // all arrays above live in one cache line aligned arena, it is only reallocated when
+    // circuit_simulation_setup() is called for more components or frequencies than it holds
+    struct Uti_Block arena;
     bool memory_initalized;
-};
 
-struct Simulation_Settings {
-    double f_min;
-    double f_max;
-    double z0_in;
-    double z0_out;
-    size_t n_frequencies;
+    // run the chunks on the calling thread instead of the simulation worker pool, for callers that
+    // already run many simulations in parallel (the pool serializes concurrent runs)
+    bool single_threaded;
 };
 
 bool circuit_simulation_setup(struct Circuit_Component *component_cascade, size_t n_components, struct Simulation_State *sim_state, const struct Simulation_Settings *settings);
 bool circuit_simulation_do(struct Simulation_State *sim_state, bool print_stdout);
 bool circuit_simulation_destroy(struct Simulation_State *sim_state);
+bool circuit_simulation_matches_settings(const struct Simulation_State *sim_state, const struct Simulation_Settings *settings);
+// write the result of the last simulation as Touchstone file (# Hz S RI R 50) or as CSV with the stability factors
+bool circuit_simulation_write_touchstone(const struct Simulation_State *sim_state, const char *path);
+bool circuit_simulation_write_csv(const struct Simulation_State *sim_state, const char *path);
+// back the arenas allocated from now on by huge pages (if the system has them), for very large sweeps
+void circuit_simulation_set_huge_pages(bool huge_pages);
+
+// The simulation splits the frequencies into chunks and runs them on a persistent worker pool.
+// n_threads includes the calling thread, 0 means one per cpu (default). The pool is started on first use.
+void circuit_simulation_set_thread_count(size_t n_threads);
+size_t circuit_simulation_thread_count(void);
+
+// Incremental re-simulation:
+// Mark a component of the cascade as changed, the next circuit_simulation_do() recalculates only
+// the S and T parameters of the marked components.
+void circuit_simulation_mark_dirty(struct Simulation_State *sim_state, size_t component_index);
+// Simulate the cascade with component_index replaced by candidate, using the cached partial cascades
+// (one interpolation and two products per frequency). The cascade of the sim_state stays untouched
+// until circuit_simulation_accept_incremental() is called.
+bool circuit_simulation_do_incremental(struct Simulation_State *sim_state, size_t component_index, const struct Circuit_Component *candidate);
+// The same in steps for an early abort: begin, then continue until it returns true. Every step
+// simulates the next chunks of frequencies (one per thread) and tells how many are done so far. The
+// candidate can only be accepted once all frequencies are done, an unfinished candidate is simply
+// dropped by beginning the next one.
+void circuit_simulation_begin_incremental(struct Simulation_State *sim_state, size_t component_index, const struct Circuit_Component *candidate);
+bool circuit_simulation_continue_incremental(struct Simulation_State *sim_state, size_t *done_out);
+// begin with the T of the candidate already known (8 planes of n_frequencies in the order r11 r12 r21
+// r22 i11 i12 i21 i22), they have to stay valid until the candidate is accepted or dropped
+void circuit_simulation_begin_incremental_cached(struct Simulation_State *sim_state, size_t component_index, const struct Circuit_Component *candidate, const double *t_planes);
+void circuit_simulation_accept_incremental(struct Simulation_State *sim_state);
+
+// LRU cache of the T of lumped components (by kind and value) and stage settings on a frequency grid
+// (by grid_hash). A discrete search evaluates the same parts again and again, a hit saves the closed
+// form resp. the spline interpolation of the whole grid.
+struct Circuit_T_Cache;
+struct Circuit_T_Cache *circuit_t_cache_create(size_t capacity);
+// T planes of the component on the grid of sim_state, calculated on a miss. The planes stay valid
+// until the next call (which may evict them).
+const double *circuit_t_cache_get(struct Circuit_T_Cache *cache, const struct Circuit_Component *component, const struct Simulation_State *sim_state);
+void circuit_t_cache_stats(const struct Circuit_T_Cache *cache, size_t *hits, size_t *misses);
+void circuit_t_cache_destroy(struct Circuit_T_Cache *cache);
+// Gradient of a real loss L(S) with respect to the log of the component values, d L / d ln(value) for
+// the lumped components and 0 for the stages. ds holds dL/dRe(S) + j dL/dIm(S) of every frequency.
+// Needs the result of circuit_simulation_do() and brings all partial cascades up to date on the way,
+// so the gradient is one forward and one backward pass over the cascade.
+bool circuit_simulation_gradient(struct Simulation_State *sim_state, const struct Complex_2x2_SoA *ds, double *gradient_out);
+
+// S-parameters, plottables and stability factors of the frequencies offset .. offset + count - 1 from
+// t_result, for callers that assemble the cascade themselves
+void circuit_simulation_finish_results(struct Simulation_State *sim_state, size_t offset, size_t count);
 
 void circuit_update_s_and_t_paramas_of_component(struct Simulation_State* sim_state, size_t component_index);
 bool circuit_interpolate_sparams_circuit_component(struct Circuit_Component *component, double *frequencies, struct Complex_2x2_SoA *s_out, size_t n_frequencies);
+// closed form T of the lumped kinds (one reciprocal per frequency at most), false for stages
+bool circuit_t_params_circuit_component(struct Circuit_Component *component, double *frequencies, struct Complex_2x2_SoA *t_out, size_t n_frequencies);
 
 void calc_s_from_t_array(struct Complex_2x2_SoA *t, struct Complex_2x2_SoA *s_out, size_t length);
 void calc_t_from_s_array(struct Complex_2x2_SoA *s, struct Complex_2x2_SoA *t_out, size_t length);
@@ -163,6 +310,70 @@ struct Optimization_Goal {
     double (*value_map)(size_t, void*); // for example dB(...), mag(...), ...
 };
 
+// Batched evaluation of many cascades with the kinds of a template cascade (i.e. a generation of a
+// population optimizer or the samples of a tolerance analysis). The component values are stored as
+// SoA over the candidates, the frequency grid, the impedance steps and the T of every used stage
+// setting are shared by all of them. Each chunk of frequencies on the simulation pool passes all
+// candidates while its T planes are in cache, so the losses do not depend on the number of threads.
+struct Simulation_Batch {
+    struct Simulation_State grid; // frequencies, t_prefix[0] = T_in and t_suffix[n] = T_out
+    struct Circuit_Component *template_cascade; // copy, the stages share the S2P_Info of the caller
+    size_t n_components;
+    size_t max_candidates;
+    double *values;    // [component * max_candidates + candidate] R, C or L of the lumped components
+    size_t *settings;  // [component * max_candidates + candidate] selected setting of the stages
+    double ***stage_t; // [component][setting] 8 planes of n_frequencies, interpolated on first use
+    bool full_results;
+    double *s_results; // [candidate] 8 planes of n_frequencies, only with full_results
+};
+
+bool circuit_simulation_batch_setup(struct Simulation_Batch *batch, const struct Circuit_Component *template_cascade, size_t n_components,
+        const struct Simulation_Settings *sim_settings, size_t max_candidates, bool full_results);
+// copy the values and settings of a cascade (same kinds as the template) into the slot of a candidate and back
+void circuit_simulation_batch_set_cascade(struct Simulation_Batch *batch, size_t candidate, const struct Circuit_Component *component_cascade);
+void circuit_simulation_batch_get_cascade(const struct Simulation_Batch *batch, size_t candidate, struct Circuit_Component *component_cascade_out);
+// Losses of the candidates 0 .. n_candidates - 1, equal up to rounding to circuit_optimizer_evaluate_goal()
+// on a simulation of each (the T products are taken in another order and the losses summed per chunk),
+// bitwise the same on any number of threads. A candidate with non finite S somewhere (i.e. C = 0) gets
+// DBL_MAX, the hinges would ignore it. losses_out may be NULL when only the S results are needed.
+bool circuit_simulation_batch_run(struct Simulation_Batch *batch, size_t n_candidates, const struct Optimization_Goal *goals, size_t goal_count, double *losses_out);
+// S of a candidate of the last run (needs full_results)
+struct Complex_2x2_SoA circuit_simulation_batch_s_result(const struct Simulation_Batch *batch, size_t candidate);
+void circuit_simulation_batch_destroy(struct Simulation_Batch *batch);
+
+// Goals compiled for the grid of a sim_state, reused for every round: the frequency ranges are
+// resolved once and the target planes of s_result / stab_mu are bound directly. dB() and mag() goals
+// compare |S|^2 against a precomputed linear threshold and only take the log10 or sqrt of the
+// frequencies that can miss the goal. The terms are added in the same order as the hinge functions,
+// so the losses have the same bits as circuit_optimizer_evaluate_goal().
+typedef enum {
+    OPTIMIZATION_GOAL_KERNEL_VALUES,  // no value map on a double plane (mu, mu')
+    OPTIMIZATION_GOAL_KERNEL_DB,      // dB() of an S plane
+    OPTIMIZATION_GOAL_KERNEL_MAG,     // mag() of an S plane
+    OPTIMIZATION_GOAL_KERNEL_GENERIC, // any other value map on the plottables
+} OPTIMIZATION_GOAL_KERNEL;
+
+struct Optimization_Goal_Plan_Entry {
+    struct Optimization_Goal goal;
+    OPTIMIZATION_GOAL_KERNEL kernel;
+    size_t start; // frequencies start .. end - 1
+    size_t end;
+    const double *re; // S plane (re and im) or the values
+    const double *im;
+    void *plottable; // values of the generic kernel
+    double skip_below; // |S|^2 below (LESS_THAN) resp. above (MORE_THAN) gives a zero term for sure
+    double skip_above;
+};
+
+struct Optimization_Goal_Plan {
+    struct Optimization_Goal_Plan_Entry *entries;
+    size_t goal_count;
+    // the grid it was compiled for
+    const struct Simulation_State *sim_state;
+    const double *frequencies;
+    struct Simulation_Settings settings;
+};
+
 struct Optimizer_State {
     size_t iteration;
     size_t max_iterations;
@@ -171,13 +382,137 @@ struct Optimizer_State {
     struct Circuit_Component *best_component_cascade;
     struct Circuit_Component *temporary_component_cascade;
     size_t n_components;
+    bool simulation_prepared; // sim_state is set up on best_component_cascade
+    bool print_progress; // print the loss of every round (default)
+    struct Uti_Rng *rng; // random stream of the tweaks, NULL uses the global rand() (default)
+    bool early_abort; // stop simulating a candidate once its partial loss reaches the best (default)
+    struct Optimization_Goal_Plan goal_plan; // compiled on the first round and when the goals or the grid change
+    double *goal_losses; // scratch of the early abort, goal_plan.goal_count entries
+    const struct Circuit_Value_Grid *value_grids; // one per component, the tweaks stay on them, NULL is continuous (default)
+    struct Circuit_T_Cache *t_cache; // looks up the T of the tweaked component, NULL calculates it (default)
+    const char *checkpoint_path; // written every checkpoint_interval rounds, NULL for none (default)
+    size_t checkpoint_interval;
+    FILE *loss_log; // see circuit_optimizer_loss_log_open()
+    size_t loss_log_records; // rounds in the loss log
 };
 
+// The loss log is a header and one record per round, appended as the rounds go, so it can be mapped
+// and plotted while the optimizer runs. loss is the loss of the candidate, or the partial loss at which
+// it was dropped (never below best_loss then). Native byte order.
+#define OPTIMIZER_LOSS_LOG_MAGIC "IMPLOSS1"
+#define OPTIMIZER_LOSS_LOG_VERSION 1
+struct Optimizer_Loss_Log_Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+};
+struct Optimizer_Loss_Record {
+    uint64_t iteration;
+    double loss;
+    double best_loss;
+};
+
+// value maps for the goals, in double precision. The GUI versions they replace used sqrtf() and
+// log10f(), so every goal loss and dB plot moved by up to a float rounding step
+double mag(size_t i, void* x);
+double dB_from_squared(double x);
+double dB(size_t i, void* x);
+
 double circuit_optimizer_calculate_loss_hinge_lt(void* values, size_t value_count, double (*value_map)(size_t, void*), double goal);
 double circuit_optimizer_calculate_loss_hinge_gt(void* values, size_t value_count, double (*value_map)(size_t, void*), double goal);
 double circuit_optimizer_evaluate_goal(const struct Optimization_Goal* goal, struct Simulation_State* sim_state);
+// frequencies of the sim_state the goal looks at
+void circuit_optimizer_goal_frequency_range(const struct Optimization_Goal* goal, const struct Simulation_State* sim_state, size_t *start_out, size_t *count_out);
 
+bool circuit_optimizer_goal_plan_compile(struct Optimization_Goal_Plan *plan, const struct Optimization_Goal *goals, size_t goal_count, struct Simulation_State *sim_state);
+bool circuit_optimizer_goal_plan_matches(const struct Optimization_Goal_Plan *plan, const struct Optimization_Goal *goals, size_t goal_count, const struct Simulation_State *sim_state);
+// adds the hinge losses of the frequencies from .. to - 1 to goal_losses (one per goal, start at 0)
+void circuit_optimizer_goal_plan_accumulate(const struct Optimization_Goal_Plan *plan, size_t from, size_t to, double *goal_losses);
+// weighted sum of the goal losses
+double circuit_optimizer_goal_plan_total(const struct Optimization_Goal_Plan *plan, const double *goal_losses);
+void circuit_optimizer_goal_plan_destroy(struct Optimization_Goal_Plan *plan);
+
+size_t circuit_random_tweak_cascade(struct Circuit_Component *component_cascade, size_t n_components);
+size_t circuit_random_tweak_cascade_rng(struct Circuit_Component *component_cascade, size_t n_components, struct Uti_Rng *rng);
+// tweak that keeps the lumped values on their grid (one per component), rng NULL uses rand()
+size_t circuit_random_tweak_cascade_discrete(struct Circuit_Component *component_cascade, size_t n_components, const struct Circuit_Value_Grid *value_grids, struct Uti_Rng *rng);
 bool circuit_optimizer_setup(struct Optimizer_State* state, size_t max_iterations, struct Circuit_Component *intial_component_cascade, size_t n_components);
 bool circuit_optimizer_update_one_round(struct Optimizer_State* opt_state, struct Simulation_State* sim_state, const struct Simulation_Settings* sim_settings, const struct Optimization_Goal* goals, size_t goal_count, struct Circuit_Component *component_cascade, size_t n_components);
+void circuit_optimizer_destroy(struct Optimizer_State* state);
+
+// A checkpoint keeps what a random search needs to go on after the process died: the best cascade
+// (values and stage settings), the iteration, the best loss, the random stream and the length of the
+// loss log. It is replaced atomically, a crash leaves the last complete one.
+bool circuit_optimizer_checkpoint_write(const struct Optimizer_State *state, const char *path);
+// Resume into a state set up on the same circuit (the kinds and the stages have to match). The stream
+// of opt_state->rng is restored, so a search with its own rng continues exactly like an uninterrupted one.
+bool circuit_optimizer_checkpoint_read(struct Optimizer_State *state, const char *path);
+// Appends the rounds to the log at path. The log is cut back to the loss_log_records rounds of the
+// state, a fresh state starts a new log and a resumed one drops the rounds after its checkpoint.
+bool circuit_optimizer_loss_log_open(struct Optimizer_State *state, const char *path);
+void circuit_optimizer_loss_log_close(struct Optimizer_State *state);
+
+// Total loss of the goals and its gradient with respect to the S-parameters of every frequency
+// (dL/dRe(S) + j dL/dIm(S), ds has n_frequencies entries). S-parameter goals need the dB() or mag()
+// value map, the stability goals none.
+bool circuit_optimizer_loss_gradient(const struct Optimization_Goal *goals, size_t goal_count, struct Simulation_State *sim_state, struct Complex_2x2_SoA *ds, double *loss_out);
+// L-BFGS on the logs of the lumped component values with the analytic gradient of
+// circuit_simulation_gradient(), the stages keep their setting. Stops after max_evaluations
+// simulations, at zero loss or when the line search makes no progress. The cascade gets the best values.
+bool circuit_optimizer_gradient_descent(struct Circuit_Component *component_cascade, size_t n_components,
+        const struct Simulation_Settings *sim_settings, const struct Optimization_Goal *goals, size_t goal_count,
+        size_t max_evaluations, double *best_loss, size_t *evaluations);
+
+// Population optimizers, a whole generation is evaluated with one circuit_simulation_batch_run().
+// The lumped components are searched in ln(value), the stages by their setting. population_size 0
+// picks a default. The cascade gets the best circuit found, the result is the same for the same seed.
+bool circuit_optimizer_differential_evolution(struct Circuit_Component *component_cascade, size_t n_components,
+        const struct Simulation_Settings *sim_settings, const struct Optimization_Goal *goals, size_t goal_count,
+        size_t population_size, size_t max_generations, uint64_t seed, double *best_loss);
+bool circuit_optimizer_cma_es(struct Circuit_Component *component_cascade, size_t n_components,
+        const struct Simulation_Settings *sim_settings, const struct Optimization_Goal *goals, size_t goal_count,
+        size_t population_size, size_t max_generations, uint64_t seed, double *best_loss);
+
+// Exhaustive search over the stage settings (bias points), the lumped components stay as they are.
+// The T of every setting and the products of the passive parts between the stages are calculated
+// once for the grid. The combinations are enumerated depth first, so the product up to a stage is
+// shared by all combinations of the stages after it, and the last product of a combination is
+// dropped as soon as its partial loss reaches the best one. The cascade gets the best settings,
+// combinations gets the number of combinations (NULL is fine).
+bool circuit_optimizer_stage_settings_search(struct Circuit_Component *component_cascade, size_t n_components,
+        const struct Simulation_Settings *sim_settings, const struct Optimization_Goal *goals, size_t goal_count,
+        double *best_loss, size_t *combinations);
+
+// Parallel multi-start random search: n_searches searches with their own Simulation_State, random
+// stream and cascades run on a private thread pool. Search 0 starts at the given cascade, the others
+// at random variations of it. Every sync_interval rounds all searches continue from the best cascade
+// found so far. Searches only meet at these points, so the result depends on the seed and n_searches
+// but not on the timing of the threads. max_iterations counts the rounds of each search.
+// The best cascade is written back to component_cascade.
+bool circuit_optimizer_parallel_search(struct Circuit_Component *component_cascade, size_t n_components,
+        const struct Simulation_Settings *sim_settings, const struct Optimization_Goal *goals, size_t goal_count,
+        size_t max_iterations, size_t n_searches, size_t sync_interval, uint64_t seed, double *best_loss);
+
+// Background optimizer: runs circuit_optimizer_update_one_round() on its own thread with private copies
+// of the cascade, the goals and the settings. The best cascade so far is published as a snapshot that
+// can be read without locking (i.e. once per frame). Pausing and cancelling are cooperative, the
+// worker checks them between rounds.
+struct Optimizer_Snapshot {
+    struct Circuit_Component *cascade; // best cascade so far, n_components entries
+    size_t n_components;
+    double best_loss;
+    size_t iteration;
+    bool finished; // max_iterations reached, the loss is zero or the worker was cancelled
+};
+struct Optimizer_Worker;
+struct Optimizer_Worker *circuit_optimizer_worker_start(const struct Circuit_Component *component_cascade, size_t n_components,
+        const struct Simulation_Settings *sim_settings, const struct Optimization_Goal *goals, size_t goal_count, size_t max_iterations);
+void circuit_optimizer_worker_pause(struct Optimizer_Worker *worker, bool pause);
+void circuit_optimizer_worker_cancel(struct Optimizer_Worker *worker);
+// newest published snapshot, is_new tells if it changed since the last call. Only call it from one
+// thread, the snapshot stays valid until the next call.
+const struct Optimizer_Snapshot *circuit_optimizer_worker_snapshot(struct Optimizer_Worker *worker, bool *is_new);
+// cancels, waits for the thread and frees everything
+void circuit_optimizer_worker_destroy(struct Optimizer_Worker *worker);
 
 #endif //CIRCUIT_H_
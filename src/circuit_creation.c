@@ -11,18 +11,17 @@
 bool circuit_create_stage_archetype(char* device_settings_csv_file_name, char* dir, struct Circuit_Component_Stage *component_out) {
     // #model, file_name, drain_voltage(V), drain_current(A), temperature(K)
 
-    char *content;
-    size_t content_size;
+    struct Uti_File_View file;
     char full_path[2048];
     if (snprintf(full_path, 2048, "%s/%s", dir, device_settings_csv_file_name) > 2046) {
         printf("ERROR: snprintf overflow\n");
         return false;
     }
-    if (!uti_read_entire_file(full_path, &content, &content_size)) {
+    if (!uti_file_view_open(full_path, &file)) {
         return false;
     }
 
-    struct Uti_String_View dry_run_sv = uti_sv_from_parts(content, content_size);
+    struct Uti_String_View dry_run_sv = uti_sv_from_parts(file.content, file.size);
 
     // first pass dry run to get memory size
     size_t string_data_block_models_length = 0;
@@ -56,7 +55,7 @@ bool circuit_create_stage_archetype(char* device_settings_csv_file_name, char* d
     component_out->n_settings = length;
     component_out->selected_setting = 0;
 
-    struct Uti_String_View content_sv = uti_sv_from_parts(content, content_size);
+    struct Uti_String_View content_sv = uti_sv_from_parts(file.content, file.size);
     size_t i = 0;
     while (content_sv.length > 0) {
         struct Uti_String_View line = uti_sv_trim(uti_sv_chop_by_delim(&content_sv, '\n'));
@@ -84,17 +83,21 @@ bool circuit_create_stage_archetype(char* device_settings_csv_file_name, char* d
         cursor[model_sv.length] = '\0';
         cursor += model_sv.length + 1;
 
-        // load the s2p_info
-        char* file_dir = dir;
+        // the s2p files are loaded all at once below
         struct S2P_Info *info = &component_out->s2p_infos[i];
-        if (!read_s2p_file(file_name_cstr, file_dir, info))
-            return false;
-        if (!parse_s2p_file(info, true))
-            return false;
+        memset(info, 0, sizeof(*info));
+        s2p_set_file_path(info, file_name_cstr, dir);
+        uti_temp_reset();
         i++;
     }
 
     assert(i == length);
+    uti_file_view_close(&file);
+
+    // only the parsed data is kept, not the text of the whole device library
+    if (!s2p_load_files(component_out->s2p_infos, length, true, 0)) {
+        return false;
+    }
 
     return true;
 }
@@ -143,4 +146,100 @@ bool circuit_create_inductor_ideal_parallel(double inductance, struct Circuit_Co
     return true;
 }
 
+double *circuit_component_value(struct Circuit_Component *component) {
+    switch (component->kind) {
+    case CIRCUIT_COMPONENT_RESISTOR_IDEAL:          return &component->as.resistor_ideal.R;
+    case CIRCUIT_COMPONENT_CAPACITOR_IDEAL:         return &component->as.capacitor_ideal.C;
+    case CIRCUIT_COMPONENT_INDUCTOR_IDEAL:          return &component->as.inductor_ideal.L;
+    case CIRCUIT_COMPONENT_RESISTOR_IDEAL_PARALLEL: return &component->as.resistor_ideal_parallel.R;
+    case CIRCUIT_COMPONENT_CAPACITOR_IDEAL_PARALLEL:return &component->as.capacitor_ideal_parallel.C;
+    case CIRCUIT_COMPONENT_INDUCTOR_IDEAL_PARALLEL: return &component->as.inductor_ideal_parallel.L;
+    case CIRCUIT_COMPONENT_STAGE:                   return NULL;
+    default:
+        assert(false && "implement me (next component kind)");
+        return NULL;
+    }
+}
 
+// the significant digits of every series, one decade
+static const int e12_values[] = {10, 12, 15, 18, 22, 27, 33, 39, 47, 56, 68, 82};
+static const int e24_values[] = {
+    10, 11, 12, 13, 15, 16, 18, 20, 22, 24, 27, 30,
+    33, 36, 39, 43, 47, 51, 56, 62, 68, 75, 82, 91,
+};
+static const int e96_values[] = {
+    100, 102, 105, 107, 110, 113, 115, 118, 121, 124, 127, 130,
+    133, 137, 140, 143, 147, 150, 154, 158, 162, 165, 169, 174,
+    178, 182, 187, 191, 196, 200, 205, 210, 215, 221, 226, 232,
+    237, 243, 249, 255, 261, 267, 274, 280, 287, 294, 301, 309,
+    316, 324, 332, 340, 348, 357, 365, 374, 383, 392, 402, 412,
+    422, 432, 442, 453, 464, 475, 487, 499, 511, 523, 536, 549,
+    562, 576, 590, 604, 619, 634, 649, 665, 681, 698, 715, 732,
+    750, 768, 787, 806, 825, 845, 866, 887, 909, 931, 953, 976,
+};
+
+static const int *e_series_values(CIRCUIT_E_SERIES series, size_t *count, int *digits) {
+    switch (series) {
+    case CIRCUIT_E_SERIES_E12: *count = sizeof(e12_values) / sizeof(e12_values[0]); *digits = 2; return e12_values;
+    case CIRCUIT_E_SERIES_E24: *count = sizeof(e24_values) / sizeof(e24_values[0]); *digits = 2; return e24_values;
+    case CIRCUIT_E_SERIES_E96: *count = sizeof(e96_values) / sizeof(e96_values[0]); *digits = 3; return e96_values;
+    default:                   *count = 0; *digits = 0; return NULL;
+    }
+}
+
+// value of grid position index = decade * count + i. The digits are exact and 10^n is exact up to
+// 1e22, so one rounding makes 4.7e-9 the same double as the literal.
+static double e_series_value(const int *values, size_t count, int digits, long index) {
+    long decade = index >= 0 ? index / (long)count : -((-index + (long)count - 1) / (long)count);
+    double mantissa = (double)values[index - decade * (long)count];
+    long exponent = decade - (digits - 1);
+    return exponent >= 0 ? mantissa * pow(10.0, (double)exponent) : mantissa / pow(10.0, (double)-exponent);
+}
+
+// grid position nearest to value (by ratio)
+static long e_series_index(const int *values, size_t count, int digits, double value) {
+    long decade = (long)floor(log10(value));
+    long best = decade * (long)count;
+    double best_distance = INFINITY;
+    // the neighbouring decades catch the rounding of log10 and the way up to the next 1.0
+    for (long index = (decade - 1) * (long)count; index <= (decade + 2) * (long)count; index++) {
+        double distance = fabs(log(e_series_value(values, count, digits, index) / value));
+        if (distance < best_distance) {
+            best_distance = distance;
+            best = index;
+        }
+    }
+    return best;
+}
+
+// index of the part nearest to value (by ratio)
+static size_t parts_index(const double *parts, size_t n_parts, double value) {
+    size_t lo = 0, hi = n_parts;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (parts[mid] < value) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == n_parts) return n_parts - 1;
+    if (lo > 0 && value * value < parts[lo - 1] * parts[lo]) return lo - 1;
+    return lo;
+}
+
+double circuit_value_grid_snap(const struct Circuit_Value_Grid *grid, double value) {
+    return circuit_value_grid_step(grid, value, 0);
+}
+
+double circuit_value_grid_step(const struct Circuit_Value_Grid *grid, double value, int steps) {
+    if (!(value > 0.0) || !isfinite(value)) return value;
+    if (grid->parts && grid->n_parts > 0) {
+        long index = (long)parts_index(grid->parts, grid->n_parts, value) + steps;
+        if (index < 0) index = 0;
+        if (index >= (long)grid->n_parts) index = (long)grid->n_parts - 1;
+        return grid->parts[index];
+    }
+    size_t count;
+    int digits;
+    const int *values = e_series_values(grid->series, &count, &digits);
+    if (!values) return value;
+    return e_series_value(values, count, digits, e_series_index(values, count, digits, value) + steps);
+}
@@ -0,0 +1,599 @@
+// Copyright (C) 2026 Benjamin Froelich
+// This file is part of https://github.com/bbeni/impedancer
+// For conditions of distribution and use, see copyright notice in project root.
+/* SoA kernels of the simulation (hot loops over frequencies)
+   Every kernel has a scalar reference and if available x86 SIMD versions. The fastest
+   one supported by the cpu is picked on first use (see circuit_kernel_detect()).
+*/
+#include "circuit.h"
+
+#include "stdio.h"
+#include "assert.h"
+#include "float.h"
+#include "pthread.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CIRCUIT_KERNELS_X86
+#include <immintrin.h>
+#define CIRCUIT_TARGET_SSE2 __attribute__((target("sse2")))
+#define CIRCUIT_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+struct Complex_2x2_SoA circuit_soa_offset(const struct Complex_2x2_SoA *soa, size_t offset) {
+    struct Complex_2x2_SoA result;
+    result.r11 = soa->r11 + offset;
+    result.r12 = soa->r12 + offset;
+    result.r21 = soa->r21 + offset;
+    result.r22 = soa->r22 + offset;
+    result.i11 = soa->i11 + offset;
+    result.i12 = soa->i12 + offset;
+    result.i21 = soa->i21 + offset;
+    result.i22 = soa->i22 + offset;
+    return result;
+}
+
+//
+// T_f = T_x * T_y
+//
+// The product of one (or a vector of) frequencies is done on a register copy of the matrices,
+// so the multiply and the cascade kernels share the same operations and round the same way.
+//
+
+struct Circuit_T_Scalar {
+    double r11, r12, r21, r22, i11, i12, i21, i22;
+};
+
+static inline struct Circuit_T_Scalar circuit_t_load_scalar(const struct Complex_2x2_SoA *t, size_t i) {
+    struct Circuit_T_Scalar x = {t->r11[i], t->r12[i], t->r21[i], t->r22[i], t->i11[i], t->i12[i], t->i21[i], t->i22[i]};
+    return x;
+}
+
+static inline void circuit_t_store_scalar(struct Complex_2x2_SoA *t, size_t i, struct Circuit_T_Scalar x) {
+    t->r11[i] = x.r11; t->r12[i] = x.r12; t->r21[i] = x.r21; t->r22[i] = x.r22;
+    t->i11[i] = x.i11; t->i12[i] = x.i12; t->i21[i] = x.i21; t->i22[i] = x.i22;
+}
+
+static inline struct Circuit_T_Scalar circuit_t_multiply_scalar(struct Circuit_T_Scalar x, struct Circuit_T_Scalar y) {
+    // (A+iB)(C+iD) = (AC − BD) + i (AD + BC)
+    struct Circuit_T_Scalar f;
+    // AC - BD     real real - imag imag
+    f.r11 = x.r11 * y.r11 + x.r12 * y.r21  -  (x.i11 * y.i11 + x.i12 * y.i21);
+    f.r21 = x.r21 * y.r11 + x.r22 * y.r21  -  (x.i21 * y.i11 + x.i22 * y.i21);
+    f.r12 = x.r11 * y.r12 + x.r12 * y.r22  -  (x.i11 * y.i12 + x.i12 * y.i22);
+    f.r22 = x.r21 * y.r12 + x.r22 * y.r22  -  (x.i21 * y.i12 + x.i22 * y.i22);
+    // i (AD + BC) realx imagy + imagx realy
+    f.i11 = x.r11 * y.i11 + x.r12 * y.i21  +  (x.i11 * y.r11 + x.i12 * y.r21);
+    f.i21 = x.r21 * y.i11 + x.r22 * y.i21  +  (x.i21 * y.r11 + x.i22 * y.r21);
+    f.i12 = x.r11 * y.i12 + x.r12 * y.i22  +  (x.i11 * y.r12 + x.i12 * y.r22);
+    f.i22 = x.r21 * y.i12 + x.r22 * y.i22  +  (x.i21 * y.r12 + x.i22 * y.r22);
+    return f;
+}
+
+// all inputs of a frequency are loaded before anything is stored, so tf may alias tx or ty
+void circuit_multiply_t_soa_scalar(struct Complex_2x2_SoA *tf, const struct Complex_2x2_SoA *tx, const struct Complex_2x2_SoA *ty, size_t n_f) {
+    for (size_t i = 0; i < n_f; i++) {
+        struct Circuit_T_Scalar x = circuit_t_load_scalar(tx, i);
+        struct Circuit_T_Scalar y = circuit_t_load_scalar(ty, i);
+        circuit_t_store_scalar(tf, i, circuit_t_multiply_scalar(x, y));
+    }
+}
+
+void circuit_cascade_t_soa_scalar(struct Complex_2x2_SoA *tf, const struct Complex_2x2_SoA *const *ts, size_t n_t, size_t offset, size_t n_f) {
+    assert(n_t >= 1);
+    for (size_t i = offset; i < offset + n_f; i++) {
+        struct Circuit_T_Scalar acc = circuit_t_load_scalar(ts[0], i);
+        for (size_t k = 1; k < n_t; k++) {
+            acc = circuit_t_multiply_scalar(acc, circuit_t_load_scalar(ts[k], i));
+        }
+        circuit_t_store_scalar(tf, i, acc);
+    }
+}
+
+#ifdef CIRCUIT_KERNELS_X86
+
+// The cascade kernels read 8 planes of every component at once, too many streams for the hardware
+// prefetcher. Fetch the next cache lines of all of them ahead (once per 64 byte line).
+#define CIRCUIT_CASCADE_PREFETCH_DISTANCE 16
+// a macro: a plain helper is not inlined into the target() kernels and gcc drops the call
+#define CIRCUIT_T_PREFETCH(t, i) do { \
+    _mm_prefetch((const char*)&(t)->r11[(i)], _MM_HINT_T0); _mm_prefetch((const char*)&(t)->r12[(i)], _MM_HINT_T0); \
+    _mm_prefetch((const char*)&(t)->r21[(i)], _MM_HINT_T0); _mm_prefetch((const char*)&(t)->r22[(i)], _MM_HINT_T0); \
+    _mm_prefetch((const char*)&(t)->i11[(i)], _MM_HINT_T0); _mm_prefetch((const char*)&(t)->i12[(i)], _MM_HINT_T0); \
+    _mm_prefetch((const char*)&(t)->i21[(i)], _MM_HINT_T0); _mm_prefetch((const char*)&(t)->i22[(i)], _MM_HINT_T0); \
+} while (0)
+
+struct Circuit_T_Sse2 {
+    __m128d r11, r12, r21, r22, i11, i12, i21, i22;
+};
+
+CIRCUIT_TARGET_SSE2
+static inline struct Circuit_T_Sse2 circuit_t_load_sse2(const struct Complex_2x2_SoA *t, size_t i) {
+    struct Circuit_T_Sse2 x;
+    x.r11 = _mm_loadu_pd(&t->r11[i]); x.r12 = _mm_loadu_pd(&t->r12[i]);
+    x.r21 = _mm_loadu_pd(&t->r21[i]); x.r22 = _mm_loadu_pd(&t->r22[i]);
+    x.i11 = _mm_loadu_pd(&t->i11[i]); x.i12 = _mm_loadu_pd(&t->i12[i]);
+    x.i21 = _mm_loadu_pd(&t->i21[i]); x.i22 = _mm_loadu_pd(&t->i22[i]);
+    return x;
+}
+
+CIRCUIT_TARGET_SSE2
+static inline void circuit_t_store_sse2(struct Complex_2x2_SoA *t, size_t i, struct Circuit_T_Sse2 x) {
+    _mm_storeu_pd(&t->r11[i], x.r11); _mm_storeu_pd(&t->r12[i], x.r12);
+    _mm_storeu_pd(&t->r21[i], x.r21); _mm_storeu_pd(&t->r22[i], x.r22);
+    _mm_storeu_pd(&t->i11[i], x.i11); _mm_storeu_pd(&t->i12[i], x.i12);
+    _mm_storeu_pd(&t->i21[i], x.i21); _mm_storeu_pd(&t->i22[i], x.i22);
+}
+
+// same operations in the same order as the scalar version -> bit identical results
+CIRCUIT_TARGET_SSE2
+static inline struct Circuit_T_Sse2 circuit_t_multiply_sse2(struct Circuit_T_Sse2 x, struct Circuit_T_Sse2 y) {
+    struct Circuit_T_Sse2 f;
+    #define CIRCUIT_SSE2_DOT(a, b, c, d) _mm_add_pd(_mm_mul_pd((a), (b)), _mm_mul_pd((c), (d)))
+    f.r11 = _mm_sub_pd(CIRCUIT_SSE2_DOT(x.r11, y.r11, x.r12, y.r21), CIRCUIT_SSE2_DOT(x.i11, y.i11, x.i12, y.i21));
+    f.r21 = _mm_sub_pd(CIRCUIT_SSE2_DOT(x.r21, y.r11, x.r22, y.r21), CIRCUIT_SSE2_DOT(x.i21, y.i11, x.i22, y.i21));
+    f.r12 = _mm_sub_pd(CIRCUIT_SSE2_DOT(x.r11, y.r12, x.r12, y.r22), CIRCUIT_SSE2_DOT(x.i11, y.i12, x.i12, y.i22));
+    f.r22 = _mm_sub_pd(CIRCUIT_SSE2_DOT(x.r21, y.r12, x.r22, y.r22), CIRCUIT_SSE2_DOT(x.i21, y.i12, x.i22, y.i22));
+    f.i11 = _mm_add_pd(CIRCUIT_SSE2_DOT(x.r11, y.i11, x.r12, y.i21), CIRCUIT_SSE2_DOT(x.i11, y.r11, x.i12, y.r21));
+    f.i21 = _mm_add_pd(CIRCUIT_SSE2_DOT(x.r21, y.i11, x.r22, y.i21), CIRCUIT_SSE2_DOT(x.i21, y.r11, x.i22, y.r21));
+    f.i12 = _mm_add_pd(CIRCUIT_SSE2_DOT(x.r11, y.i12, x.r12, y.i22), CIRCUIT_SSE2_DOT(x.i11, y.r12, x.i12, y.r22));
+    f.i22 = _mm_add_pd(CIRCUIT_SSE2_DOT(x.r21, y.i12, x.r22, y.i22), CIRCUIT_SSE2_DOT(x.i21, y.r12, x.i22, y.r22));
+    #undef CIRCUIT_SSE2_DOT
+    return f;
+}
+
+CIRCUIT_TARGET_SSE2
+void circuit_multiply_t_soa_sse2(struct Complex_2x2_SoA *tf, const struct Complex_2x2_SoA *tx, const struct Complex_2x2_SoA *ty, size_t n_f) {
+    size_t i = 0;
+    for (; i + 2 <= n_f; i += 2) {
+        struct Circuit_T_Sse2 x = circuit_t_load_sse2(tx, i);
+        struct Circuit_T_Sse2 y = circuit_t_load_sse2(ty, i);
+        circuit_t_store_sse2(tf, i, circuit_t_multiply_sse2(x, y));
+    }
+
+    if (i < n_f) {
+        struct Complex_2x2_SoA tf_rest = circuit_soa_offset(tf, i);
+        struct Complex_2x2_SoA tx_rest = circuit_soa_offset(tx, i);
+        struct Complex_2x2_SoA ty_rest = circuit_soa_offset(ty, i);
+        circuit_multiply_t_soa_scalar(&tf_rest, &tx_rest, &ty_rest, n_f - i);
+    }
+}
+
+CIRCUIT_TARGET_SSE2
+void circuit_cascade_t_soa_sse2(struct Complex_2x2_SoA *tf, const struct Complex_2x2_SoA *const *ts, size_t n_t, size_t offset, size_t n_f) {
+    assert(n_t >= 1);
+    size_t i = offset;
+    for (; i + 2 <= offset + n_f; i += 2) {
+        struct Circuit_T_Sse2 acc = circuit_t_load_sse2(ts[0], i);
+        if (i % 8 == 0) {
+            for (size_t k = 0; k < n_t; k++) CIRCUIT_T_PREFETCH(ts[k], i + CIRCUIT_CASCADE_PREFETCH_DISTANCE);
+        }
+        for (size_t k = 1; k < n_t; k++) {
+            acc = circuit_t_multiply_sse2(acc, circuit_t_load_sse2(ts[k], i));
+        }
+        circuit_t_store_sse2(tf, i, acc);
+    }
+
+    if (i < offset + n_f) circuit_cascade_t_soa_scalar(tf, ts, n_t, i, offset + n_f - i);
+}
+
+struct Circuit_T_Avx2 {
+    __m256d r11, r12, r21, r22, i11, i12, i21, i22;
+};
+
+CIRCUIT_TARGET_AVX2
+static inline struct Circuit_T_Avx2 circuit_t_load_avx2(const struct Complex_2x2_SoA *t, size_t i) {
+    struct Circuit_T_Avx2 x;
+    x.r11 = _mm256_loadu_pd(&t->r11[i]); x.r12 = _mm256_loadu_pd(&t->r12[i]);
+    x.r21 = _mm256_loadu_pd(&t->r21[i]); x.r22 = _mm256_loadu_pd(&t->r22[i]);
+    x.i11 = _mm256_loadu_pd(&t->i11[i]); x.i12 = _mm256_loadu_pd(&t->i12[i]);
+    x.i21 = _mm256_loadu_pd(&t->i21[i]); x.i22 = _mm256_loadu_pd(&t->i22[i]);
+    return x;
+}
+
+CIRCUIT_TARGET_AVX2
+static inline void circuit_t_store_avx2(struct Complex_2x2_SoA *t, size_t i, struct Circuit_T_Avx2 x) {
+    _mm256_storeu_pd(&t->r11[i], x.r11); _mm256_storeu_pd(&t->r12[i], x.r12);
+    _mm256_storeu_pd(&t->r21[i], x.r21); _mm256_storeu_pd(&t->r22[i], x.r22);
+    _mm256_storeu_pd(&t->i11[i], x.i11); _mm256_storeu_pd(&t->i12[i], x.i12);
+    _mm256_storeu_pd(&t->i21[i], x.i21); _mm256_storeu_pd(&t->i22[i], x.i22);
+}
+
+// fused multiply add rounds differently than the scalar version (not bit identical, ~1 ulp)
+CIRCUIT_TARGET_AVX2
+static inline struct Circuit_T_Avx2 circuit_t_multiply_avx2(struct Circuit_T_Avx2 x, struct Circuit_T_Avx2 y) {
+    struct Circuit_T_Avx2 f;
+    // a*b + c*d with one rounding less
+    #define CIRCUIT_AVX2_DOT(a, b, c, d) _mm256_fmadd_pd((a), (b), _mm256_mul_pd((c), (d)))
+    f.r11 = _mm256_sub_pd(CIRCUIT_AVX2_DOT(x.r11, y.r11, x.r12, y.r21), CIRCUIT_AVX2_DOT(x.i11, y.i11, x.i12, y.i21));
+    f.r21 = _mm256_sub_pd(CIRCUIT_AVX2_DOT(x.r21, y.r11, x.r22, y.r21), CIRCUIT_AVX2_DOT(x.i21, y.i11, x.i22, y.i21));
+    f.r12 = _mm256_sub_pd(CIRCUIT_AVX2_DOT(x.r11, y.r12, x.r12, y.r22), CIRCUIT_AVX2_DOT(x.i11, y.i12, x.i12, y.i22));
+    f.r22 = _mm256_sub_pd(CIRCUIT_AVX2_DOT(x.r21, y.r12, x.r22, y.r22), CIRCUIT_AVX2_DOT(x.i21, y.i12, x.i22, y.i22));
+    f.i11 = _mm256_add_pd(CIRCUIT_AVX2_DOT(x.r11, y.i11, x.r12, y.i21), CIRCUIT_AVX2_DOT(x.i11, y.r11, x.i12, y.r21));
+    f.i21 = _mm256_add_pd(CIRCUIT_AVX2_DOT(x.r21, y.i11, x.r22, y.i21), CIRCUIT_AVX2_DOT(x.i21, y.r11, x.i22, y.r21));
+    f.i12 = _mm256_add_pd(CIRCUIT_AVX2_DOT(x.r11, y.i12, x.r12, y.i22), CIRCUIT_AVX2_DOT(x.i11, y.r12, x.i12, y.r22));
+    f.i22 = _mm256_add_pd(CIRCUIT_AVX2_DOT(x.r21, y.i12, x.r22, y.i22), CIRCUIT_AVX2_DOT(x.i21, y.r12, x.i22, y.r22));
+    #undef CIRCUIT_AVX2_DOT
+    return f;
+}
+
+CIRCUIT_TARGET_AVX2
+void circuit_multiply_t_soa_avx2(struct Complex_2x2_SoA *tf, const struct Complex_2x2_SoA *tx, const struct Complex_2x2_SoA *ty, size_t n_f) {
+    size_t i = 0;
+    for (; i + 4 <= n_f; i += 4) {
+        struct Circuit_T_Avx2 x = circuit_t_load_avx2(tx, i);
+        struct Circuit_T_Avx2 y = circuit_t_load_avx2(ty, i);
+        circuit_t_store_avx2(tf, i, circuit_t_multiply_avx2(x, y));
+    }
+
+    if (i < n_f) {
+        struct Complex_2x2_SoA tf_rest = circuit_soa_offset(tf, i);
+        struct Complex_2x2_SoA tx_rest = circuit_soa_offset(tx, i);
+        struct Complex_2x2_SoA ty_rest = circuit_soa_offset(ty, i);
+        circuit_multiply_t_soa_sse2(&tf_rest, &tx_rest, &ty_rest, n_f - i);
+    }
+}
+
+CIRCUIT_TARGET_AVX2
+void circuit_cascade_t_soa_avx2(struct Complex_2x2_SoA *tf, const struct Complex_2x2_SoA *const *ts, size_t n_t, size_t offset, size_t n_f) {
+    assert(n_t >= 1);
+    size_t i = offset;
+    for (; i + 4 <= offset + n_f; i += 4) {
+        struct Circuit_T_Avx2 acc = circuit_t_load_avx2(ts[0], i);
+        if (i % 8 == 0) {
+            for (size_t k = 0; k < n_t; k++) CIRCUIT_T_PREFETCH(ts[k], i + CIRCUIT_CASCADE_PREFETCH_DISTANCE);
+        }
+        for (size_t k = 1; k < n_t; k++) {
+            acc = circuit_t_multiply_avx2(acc, circuit_t_load_avx2(ts[k], i));
+        }
+        circuit_t_store_avx2(tf, i, acc);
+    }
+
+    if (i < offset + n_f) circuit_cascade_t_soa_sse2(tf, ts, n_t, i, offset + n_f - i);
+}
+
+#else // CIRCUIT_KERNELS_X86
+
+void circuit_multiply_t_soa_sse2(struct Complex_2x2_SoA *tf, const struct Complex_2x2_SoA *tx, const struct Complex_2x2_SoA *ty, size_t n_f) {
+    circuit_multiply_t_soa_scalar(tf, tx, ty, n_f);
+}
+
+void circuit_multiply_t_soa_avx2(struct Complex_2x2_SoA *tf, const struct Complex_2x2_SoA *tx, const struct Complex_2x2_SoA *ty, size_t n_f) {
+    circuit_multiply_t_soa_scalar(tf, tx, ty, n_f);
+}
+
+void circuit_cascade_t_soa_sse2(struct Complex_2x2_SoA *tf, const struct Complex_2x2_SoA *const *ts, size_t n_t, size_t offset, size_t n_f) {
+    circuit_cascade_t_soa_scalar(tf, ts, n_t, offset, n_f);
+}
+
+void circuit_cascade_t_soa_avx2(struct Complex_2x2_SoA *tf, const struct Complex_2x2_SoA *const *ts, size_t n_t, size_t offset, size_t n_f) {
+    circuit_cascade_t_soa_scalar(tf, ts, n_t, offset, n_f);
+}
+
+#endif // CIRCUIT_KERNELS_X86
+
+
+//
+// S <-> T conversion
+//
+// T = | 1/s21     -s22/s21          |        S = | t21/t11    t22 - t12 t21/t11 |
+//     | s11/s21   s12 - s11 s22/s21 |            | 1/t11      -t12/t11          |
+//
+// The reciprocal q = 1/s21 (or 1/t11) is calculated once per frequency. Denominators with
+// |d|^2 < CIRCUIT_MIN_DENOMINATOR (zero, or so small that the square underflows) get q = 0,
+// like mma_complex_divide_or_zero(). This is a select after an unconditional division, no branch.
+//
+
+#define CIRCUIT_MIN_DENOMINATOR DBL_MIN
+
+void circuit_t_from_s_soa_scalar(struct Complex_2x2_SoA *t, const struct Complex_2x2_SoA *s, size_t n_f) {
+    for (size_t i = 0; i < n_f; i++) {
+        double s11r = s->r11[i], s12r = s->r12[i], s21r = s->r21[i], s22r = s->r22[i];
+        double s11i = s->i11[i], s12i = s->i12[i], s21i = s->i21[i], s22i = s->i22[i];
+
+        double d = s21r * s21r + s21i * s21i;
+        double inv = 1.0 / d;
+        inv = d >= CIRCUIT_MIN_DENOMINATOR ? inv : 0.0;
+        double qr = s21r * inv;
+        double qi = -s21i * inv;
+
+        // t21 = s11 q
+        double t21r = s11r * qr - s11i * qi;
+        double t21i = s11r * qi + s11i * qr;
+
+        t->r11[i] = qr;
+        t->i11[i] = qi;
+        t->r12[i] = -(s22r * qr - s22i * qi);
+        t->i12[i] = -(s22r * qi + s22i * qr);
+        t->r21[i] = t21r;
+        t->i21[i] = t21i;
+        t->r22[i] = s12r - (t21r * s22r - t21i * s22i);
+        t->i22[i] = s12i - (t21r * s22i + t21i * s22r);
+    }
+}
+
+void circuit_s_from_t_soa_scalar(struct Complex_2x2_SoA *s, const struct Complex_2x2_SoA *t, size_t n_f) {
+    for (size_t i = 0; i < n_f; i++) {
+        double t11r = t->r11[i], t12r = t->r12[i], t21r = t->r21[i], t22r = t->r22[i];
+        double t11i = t->i11[i], t12i = t->i12[i], t21i = t->i21[i], t22i = t->i22[i];
+
+        double d = t11r * t11r + t11i * t11i;
+        double inv = 1.0 / d;
+        inv = d >= CIRCUIT_MIN_DENOMINATOR ? inv : 0.0;
+        double qr = t11r * inv;
+        double qi = -t11i * inv;
+
+        // s11 = t21 q
+        double s11r = t21r * qr - t21i * qi;
+        double s11i = t21r * qi + t21i * qr;
+
+        s->r11[i] = s11r;
+        s->i11[i] = s11i;
+        s->r12[i] = t22r - (t12r * s11r - t12i * s11i);
+        s->i12[i] = t22i - (t12r * s11i + t12i * s11r);
+        s->r21[i] = qr;
+        s->i21[i] = qi;
+        s->r22[i] = -(t12r * qr - t12i * qi);
+        s->i22[i] = -(t12r * qi + t12i * qr);
+    }
+}
+
+#ifdef CIRCUIT_KERNELS_X86
+
+// same operations in the same order as the scalar version -> bit identical results
+CIRCUIT_TARGET_SSE2
+void circuit_t_from_s_soa_sse2(struct Complex_2x2_SoA *t, const struct Complex_2x2_SoA *s, size_t n_f) {
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d min_denominator = _mm_set1_pd(CIRCUIT_MIN_DENOMINATOR);
+    const __m128d sign = _mm_set1_pd(-0.0);
+    size_t i = 0;
+    for (; i + 2 <= n_f; i += 2) {
+        struct Circuit_T_Sse2 x = circuit_t_load_sse2(s, i);
+
+        __m128d d = _mm_add_pd(_mm_mul_pd(x.r21, x.r21), _mm_mul_pd(x.i21, x.i21));
+        __m128d inv = _mm_and_pd(_mm_cmpge_pd(d, min_denominator), _mm_div_pd(one, d));
+        __m128d qr = _mm_mul_pd(x.r21, inv);
+        __m128d qi = _mm_mul_pd(_mm_xor_pd(x.i21, sign), inv);
+
+        __m128d t21r = _mm_sub_pd(_mm_mul_pd(x.r11, qr), _mm_mul_pd(x.i11, qi));
+        __m128d t21i = _mm_add_pd(_mm_mul_pd(x.r11, qi), _mm_mul_pd(x.i11, qr));
+
+        struct Circuit_T_Sse2 f;
+        f.r11 = qr;
+        f.i11 = qi;
+        f.r12 = _mm_xor_pd(_mm_sub_pd(_mm_mul_pd(x.r22, qr), _mm_mul_pd(x.i22, qi)), sign);
+        f.i12 = _mm_xor_pd(_mm_add_pd(_mm_mul_pd(x.r22, qi), _mm_mul_pd(x.i22, qr)), sign);
+        f.r21 = t21r;
+        f.i21 = t21i;
+        f.r22 = _mm_sub_pd(x.r12, _mm_sub_pd(_mm_mul_pd(t21r, x.r22), _mm_mul_pd(t21i, x.i22)));
+        f.i22 = _mm_sub_pd(x.i12, _mm_add_pd(_mm_mul_pd(t21r, x.i22), _mm_mul_pd(t21i, x.r22)));
+        circuit_t_store_sse2(t, i, f);
+    }
+
+    if (i < n_f) {
+        struct Complex_2x2_SoA t_rest = circuit_soa_offset(t, i);
+        struct Complex_2x2_SoA s_rest = circuit_soa_offset(s, i);
+        circuit_t_from_s_soa_scalar(&t_rest, &s_rest, n_f - i);
+    }
+}
+
+CIRCUIT_TARGET_SSE2
+void circuit_s_from_t_soa_sse2(struct Complex_2x2_SoA *s, const struct Complex_2x2_SoA *t, size_t n_f) {
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d min_denominator = _mm_set1_pd(CIRCUIT_MIN_DENOMINATOR);
+    const __m128d sign = _mm_set1_pd(-0.0);
+    size_t i = 0;
+    for (; i + 2 <= n_f; i += 2) {
+        struct Circuit_T_Sse2 x = circuit_t_load_sse2(t, i);
+
+        __m128d d = _mm_add_pd(_mm_mul_pd(x.r11, x.r11), _mm_mul_pd(x.i11, x.i11));
+        __m128d inv = _mm_and_pd(_mm_cmpge_pd(d, min_denominator), _mm_div_pd(one, d));
+        __m128d qr = _mm_mul_pd(x.r11, inv);
+        __m128d qi = _mm_mul_pd(_mm_xor_pd(x.i11, sign), inv);
+
+        __m128d s11r = _mm_sub_pd(_mm_mul_pd(x.r21, qr), _mm_mul_pd(x.i21, qi));
+        __m128d s11i = _mm_add_pd(_mm_mul_pd(x.r21, qi), _mm_mul_pd(x.i21, qr));
+
+        struct Circuit_T_Sse2 f;
+        f.r11 = s11r;
+        f.i11 = s11i;
+        f.r12 = _mm_sub_pd(x.r22, _mm_sub_pd(_mm_mul_pd(x.r12, s11r), _mm_mul_pd(x.i12, s11i)));
+        f.i12 = _mm_sub_pd(x.i22, _mm_add_pd(_mm_mul_pd(x.r12, s11i), _mm_mul_pd(x.i12, s11r)));
+        f.r21 = qr;
+        f.i21 = qi;
+        f.r22 = _mm_xor_pd(_mm_sub_pd(_mm_mul_pd(x.r12, qr), _mm_mul_pd(x.i12, qi)), sign);
+        f.i22 = _mm_xor_pd(_mm_add_pd(_mm_mul_pd(x.r12, qi), _mm_mul_pd(x.i12, qr)), sign);
+        circuit_t_store_sse2(s, i, f);
+    }
+
+    if (i < n_f) {
+        struct Complex_2x2_SoA s_rest = circuit_soa_offset(s, i);
+        struct Complex_2x2_SoA t_rest = circuit_soa_offset(t, i);
+        circuit_s_from_t_soa_scalar(&s_rest, &t_rest, n_f - i);
+    }
+}
+
+// the compiler may contract to fused multiply adds here (not bit identical, ~1 ulp)
+CIRCUIT_TARGET_AVX2
+void circuit_t_from_s_soa_avx2(struct Complex_2x2_SoA *t, const struct Complex_2x2_SoA *s, size_t n_f) {
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d min_denominator = _mm256_set1_pd(CIRCUIT_MIN_DENOMINATOR);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    size_t i = 0;
+    for (; i + 4 <= n_f; i += 4) {
+        struct Circuit_T_Avx2 x = circuit_t_load_avx2(s, i);
+
+        __m256d d = _mm256_add_pd(_mm256_mul_pd(x.r21, x.r21), _mm256_mul_pd(x.i21, x.i21));
+        __m256d inv = _mm256_and_pd(_mm256_cmp_pd(d, min_denominator, _CMP_GE_OQ), _mm256_div_pd(one, d));
+        __m256d qr = _mm256_mul_pd(x.r21, inv);
+        __m256d qi = _mm256_mul_pd(_mm256_xor_pd(x.i21, sign), inv);
+
+        __m256d t21r = _mm256_sub_pd(_mm256_mul_pd(x.r11, qr), _mm256_mul_pd(x.i11, qi));
+        __m256d t21i = _mm256_add_pd(_mm256_mul_pd(x.r11, qi), _mm256_mul_pd(x.i11, qr));
+
+        struct Circuit_T_Avx2 f;
+        f.r11 = qr;
+        f.i11 = qi;
+        f.r12 = _mm256_xor_pd(_mm256_sub_pd(_mm256_mul_pd(x.r22, qr), _mm256_mul_pd(x.i22, qi)), sign);
+        f.i12 = _mm256_xor_pd(_mm256_add_pd(_mm256_mul_pd(x.r22, qi), _mm256_mul_pd(x.i22, qr)), sign);
+        f.r21 = t21r;
+        f.i21 = t21i;
+        f.r22 = _mm256_sub_pd(x.r12, _mm256_sub_pd(_mm256_mul_pd(t21r, x.r22), _mm256_mul_pd(t21i, x.i22)));
+        f.i22 = _mm256_sub_pd(x.i12, _mm256_add_pd(_mm256_mul_pd(t21r, x.i22), _mm256_mul_pd(t21i, x.r22)));
+        circuit_t_store_avx2(t, i, f);
+    }
+
+    if (i < n_f) {
+        struct Complex_2x2_SoA t_rest = circuit_soa_offset(t, i);
+        struct Complex_2x2_SoA s_rest = circuit_soa_offset(s, i);
+        circuit_t_from_s_soa_sse2(&t_rest, &s_rest, n_f - i);
+    }
+}
+
+CIRCUIT_TARGET_AVX2
+void circuit_s_from_t_soa_avx2(struct Complex_2x2_SoA *s, const struct Complex_2x2_SoA *t, size_t n_f) {
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d min_denominator = _mm256_set1_pd(CIRCUIT_MIN_DENOMINATOR);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    size_t i = 0;
+    for (; i + 4 <= n_f; i += 4) {
+        struct Circuit_T_Avx2 x = circuit_t_load_avx2(t, i);
+
+        __m256d d = _mm256_add_pd(_mm256_mul_pd(x.r11, x.r11), _mm256_mul_pd(x.i11, x.i11));
+        __m256d inv = _mm256_and_pd(_mm256_cmp_pd(d, min_denominator, _CMP_GE_OQ), _mm256_div_pd(one, d));
+        __m256d qr = _mm256_mul_pd(x.r11, inv);
+        __m256d qi = _mm256_mul_pd(_mm256_xor_pd(x.i11, sign), inv);
+
+        __m256d s11r = _mm256_sub_pd(_mm256_mul_pd(x.r21, qr), _mm256_mul_pd(x.i21, qi));
+        __m256d s11i = _mm256_add_pd(_mm256_mul_pd(x.r21, qi), _mm256_mul_pd(x.i21, qr));
+
+        struct Circuit_T_Avx2 f;
+        f.r11 = s11r;
+        f.i11 = s11i;
+        f.r12 = _mm256_sub_pd(x.r22, _mm256_sub_pd(_mm256_mul_pd(x.r12, s11r), _mm256_mul_pd(x.i12, s11i)));
+        f.i12 = _mm256_sub_pd(x.i22, _mm256_add_pd(_mm256_mul_pd(x.r12, s11i), _mm256_mul_pd(x.i12, s11r)));
+        f.r21 = qr;
+        f.i21 = qi;
+        f.r22 = _mm256_xor_pd(_mm256_sub_pd(_mm256_mul_pd(x.r12, qr), _mm256_mul_pd(x.i12, qi)), sign);
+        f.i22 = _mm256_xor_pd(_mm256_add_pd(_mm256_mul_pd(x.r12, qi), _mm256_mul_pd(x.i12, qr)), sign);
+        circuit_t_store_avx2(s, i, f);
+    }
+
+    if (i < n_f) {
+        struct Complex_2x2_SoA s_rest = circuit_soa_offset(s, i);
+        struct Complex_2x2_SoA t_rest = circuit_soa_offset(t, i);
+        circuit_s_from_t_soa_sse2(&s_rest, &t_rest, n_f - i);
+    }
+}
+
+#else // CIRCUIT_KERNELS_X86
+
+void circuit_t_from_s_soa_sse2(struct Complex_2x2_SoA *t, const struct Complex_2x2_SoA *s, size_t n_f) {
+    circuit_t_from_s_soa_scalar(t, s, n_f);
+}
+
+void circuit_t_from_s_soa_avx2(struct Complex_2x2_SoA *t, const struct Complex_2x2_SoA *s, size_t n_f) {
+    circuit_t_from_s_soa_scalar(t, s, n_f);
+}
+
+void circuit_s_from_t_soa_sse2(struct Complex_2x2_SoA *s, const struct Complex_2x2_SoA *t, size_t n_f) {
+    circuit_s_from_t_soa_scalar(s, t, n_f);
+}
+
+void circuit_s_from_t_soa_avx2(struct Complex_2x2_SoA *s, const struct Complex_2x2_SoA *t, size_t n_f) {
+    circuit_s_from_t_soa_scalar(s, t, n_f);
+}
+
+#endif // CIRCUIT_KERNELS_X86
+
+
+//
+// dispatch
+//
+
+static void (*circuit_multiply_t_soa_selected)(struct Complex_2x2_SoA *, const struct Complex_2x2_SoA *, const struct Complex_2x2_SoA *, size_t) = NULL;
+static void (*circuit_cascade_t_soa_selected)(struct Complex_2x2_SoA *, const struct Complex_2x2_SoA *const *, size_t, size_t, size_t) = NULL;
+static void (*circuit_t_from_s_soa_selected)(struct Complex_2x2_SoA *, const struct Complex_2x2_SoA *, size_t) = NULL;
+static void (*circuit_s_from_t_soa_selected)(struct Complex_2x2_SoA *, const struct Complex_2x2_SoA *, size_t) = NULL;
+static CIRCUIT_KERNEL circuit_kernel_selected = CIRCUIT_KERNEL_SCALAR;
+// the simulation threads call the kernels concurrently, so the automatic selection runs exactly once
+static pthread_once_t circuit_kernel_once = PTHREAD_ONCE_INIT;
+
+CIRCUIT_KERNEL circuit_kernel_detect(void) {
+#ifdef CIRCUIT_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return CIRCUIT_KERNEL_AVX2_FMA;
+    if (__builtin_cpu_supports("sse2")) return CIRCUIT_KERNEL_SSE2;
+#endif
+    return CIRCUIT_KERNEL_SCALAR;
+}
+
+static void circuit_kernel_set(CIRCUIT_KERNEL kernel) {
+    switch (kernel) {
+    case CIRCUIT_KERNEL_SCALAR:
+        circuit_multiply_t_soa_selected = circuit_multiply_t_soa_scalar;
+        circuit_cascade_t_soa_selected = circuit_cascade_t_soa_scalar;
+        circuit_t_from_s_soa_selected = circuit_t_from_s_soa_scalar;
+        circuit_s_from_t_soa_selected = circuit_s_from_t_soa_scalar;
+    break;
+    case CIRCUIT_KERNEL_SSE2:
+        circuit_multiply_t_soa_selected = circuit_multiply_t_soa_sse2;
+        circuit_cascade_t_soa_selected = circuit_cascade_t_soa_sse2;
+        circuit_t_from_s_soa_selected = circuit_t_from_s_soa_sse2;
+        circuit_s_from_t_soa_selected = circuit_s_from_t_soa_sse2;
+    break;
+    case CIRCUIT_KERNEL_AVX2_FMA:
+        circuit_multiply_t_soa_selected = circuit_multiply_t_soa_avx2;
+        circuit_cascade_t_soa_selected = circuit_cascade_t_soa_avx2;
+        circuit_t_from_s_soa_selected = circuit_t_from_s_soa_avx2;
+        circuit_s_from_t_soa_selected = circuit_s_from_t_soa_avx2;
+    break;
+    default:
+        assert(false && "implement me (new kernel kind)");
+    break;
+    }
+    circuit_kernel_selected = kernel;
+}
+
+static void circuit_kernel_select_detected(void) {
+    circuit_kernel_set(circuit_kernel_detect());
+}
+
+void circuit_kernel_select(CIRCUIT_KERNEL kernel) {
+    // run the automatic selection first, so it never overrides this one later
+    pthread_once(&circuit_kernel_once, circuit_kernel_select_detected);
+    circuit_kernel_set(kernel);
+}
+
+CIRCUIT_KERNEL circuit_kernel_selected_kind(void) {
+    pthread_once(&circuit_kernel_once, circuit_kernel_select_detected);
+    return circuit_kernel_selected;
+}
+
+const char* circuit_kernel_name(CIRCUIT_KERNEL kernel) {
+    switch (kernel) {
+    case CIRCUIT_KERNEL_SCALAR:   return "scalar";
+    case CIRCUIT_KERNEL_SSE2:     return "SSE2";
+    case CIRCUIT_KERNEL_AVX2_FMA: return "AVX2/FMA";
+    default:                      return "unknown";
+    }
+}
+
+void circuit_multiply_t_soa(struct Complex_2x2_SoA *tf, const struct Complex_2x2_SoA *tx, const struct Complex_2x2_SoA *ty, size_t n_f) {
+    pthread_once(&circuit_kernel_once, circuit_kernel_select_detected);
+    circuit_multiply_t_soa_selected(tf, tx, ty, n_f);
+}
+
+void circuit_cascade_t_soa(struct Complex_2x2_SoA *tf, const struct Complex_2x2_SoA *const *ts, size_t n_t, size_t offset, size_t n_f) {
+    pthread_once(&circuit_kernel_once, circuit_kernel_select_detected);
+    circuit_cascade_t_soa_selected(tf, ts, n_t, offset, n_f);
+}
+
+void circuit_t_from_s_soa(struct Complex_2x2_SoA *t, const struct Complex_2x2_SoA *s, size_t n_f) {
+    pthread_once(&circuit_kernel_once, circuit_kernel_select_detected);
+    circuit_t_from_s_soa_selected(t, s, n_f);
+}
+
+void circuit_s_from_t_soa(struct Complex_2x2_SoA *s, const struct Complex_2x2_SoA *t, size_t n_f) {
+    pthread_once(&circuit_kernel_once, circuit_kernel_select_detected);
+    circuit_s_from_t_soa_selected(s, t, n_f);
+}
@@ -6,6 +6,8 @@
 #include <time.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 double rand_from(double min, double max) {
     double range = (max - min);
@@ -13,6 +15,22 @@ double rand_from(double min, double max) {
     return min + (rand() / div);
 }
 
+double mag(size_t i, void* x) {
+    struct Complex *s = (struct Complex *)x;
+    struct Complex si = s[i];
+    return sqrt(si.i * si.i + si.r * si.r);
+}
+
+double dB_from_squared(double x) {
+    return 10 * log10(x);
+}
+
+double dB(size_t i, void* x) {
+    struct Complex *s = (struct Complex *)x;
+    struct Complex si = s[i];
+    return dB_from_squared(si.i * si.i + si.r * si.r);
+}
+
 // values are assumed to be double if value_map is NULL
 double circuit_optimizer_calculate_loss_hinge_lt(void* values, size_t value_count, double (*value_map)(size_t, void*), double goal) {
     double loss = 0.0;
@@ -43,14 +61,10 @@ double circuit_optimizer_calculate_loss_hinge_gt(void* values, size_t value_coun
     return loss;
 }
 
-double circuit_optimizer_evaluate_goal(const struct Optimization_Goal* goal, struct Simulation_State* sim_state) {
-
-    double loss_value;
-    void *target_values;
+void circuit_optimizer_goal_frequency_range(const struct Optimization_Goal* goal, const struct Simulation_State* sim_state, size_t *start_out, size_t *count_out) {
     size_t start_index = 0;
     size_t count = sim_state->n_frequencies;
 
-    // find start and count
     assert(goal->f_min < goal->f_max);
     for (size_t i = 0; i < sim_state->n_frequencies; i++) {
         if (goal->f_min <= sim_state->frequencies[i]) {
@@ -71,28 +85,42 @@ double circuit_optimizer_evaluate_goal(const struct Optimization_Goal* goal, str
     assert(start_index < sim_state->n_frequencies);
     assert(count <= sim_state->n_frequencies - start_index);
     assert(count > 0);
+    *start_out = start_index;
+    *count_out = count;
+}
+
+// the values of the whole grid a goal looks at (Complex for S-parameters, double for the stability factors)
+static void *goal_target_values(const struct Optimization_Goal* goal, const struct Simulation_State* sim_state) {
+    switch(goal->target) {
+    case OPTIMIZATION_TARGET_S11:      return sim_state->s11_result_plottable;
+    case OPTIMIZATION_TARGET_S21:      return sim_state->s21_result_plottable;
+    case OPTIMIZATION_TARGET_S12:      return sim_state->s12_result_plottable;
+    case OPTIMIZATION_TARGET_S22:      return sim_state->s22_result_plottable;
+    case OPTIMIZATION_TARGET_MU:       return sim_state->stab_mu;
+    case OPTIMIZATION_TARGET_MU_PRIME: return sim_state->stab_mu_prime;
+    default:
+        assert(false && "wrong or implement me");
+        return NULL;
+    }
+}
+
+double circuit_optimizer_evaluate_goal(const struct Optimization_Goal* goal, struct Simulation_State* sim_state) {
+
+    double loss_value;
+    void *target_values;
+    size_t start_index;
+    size_t count;
+    circuit_optimizer_goal_frequency_range(goal, sim_state, &start_index, &count);
 
     switch(goal->target) {
     case OPTIMIZATION_TARGET_S11:
-        target_values = sim_state->s11_result_plottable + start_index;
-    break;
     case OPTIMIZATION_TARGET_S21:
-        target_values = sim_state->s21_result_plottable + start_index;
-    break;
     case OPTIMIZATION_TARGET_S12:
-        target_values = sim_state->s12_result_plottable + start_index;
-    break;
     case OPTIMIZATION_TARGET_S22:
-        target_values = sim_state->s22_result_plottable + start_index;
-    break;
-    case OPTIMIZATION_TARGET_MU:
-        target_values = sim_state->stab_mu + start_index;
-    break;
-    case OPTIMIZATION_TARGET_MU_PRIME:
-        target_values = sim_state->stab_mu_prime + start_index;
+        target_values = (struct Complex *)goal_target_values(goal, sim_state) + start_index;
     break;
     default:
-        assert(false && "wrong or implement me");
+        target_values = (double *)goal_target_values(goal, sim_state) + start_index;
     break;
     }
 
@@ -111,32 +139,179 @@ double circuit_optimizer_evaluate_goal(const struct Optimization_Goal* goal, str
     return loss_value;
 }
 
-void circuit_random_tweak_cascade(struct Circuit_Component *component_cascade, size_t n_components) {
-    double rand_double = rand_from(0.3, 1.3);
-    int index = rand() % n_components;
+//
+// goal plan
+//
+
+// relative margin of the thresholds, far above the rounding of log10() and sqrt()
+#define GOAL_PLAN_SKIP_MARGIN 1e-9
+
+static bool goals_equal(const struct Optimization_Goal *a, const struct Optimization_Goal *b) {
+    return a->type == b->type && a->target == b->target && a->goal_value == b->goal_value && a->f_min == b->f_min &&
+        a->f_max == b->f_max && a->weight == b->weight && a->active == b->active && a->value_map == b->value_map;
+}
+
+bool circuit_optimizer_goal_plan_compile(struct Optimization_Goal_Plan *plan, const struct Optimization_Goal *goals, size_t goal_count, struct Simulation_State *sim_state) {
+    circuit_optimizer_goal_plan_destroy(plan);
+    plan->entries = malloc(sizeof(*plan->entries) * max(goal_count, 1));
+    if (!plan->entries) {
+        printf("ERROR: circuit_optimizer_goal_plan_compile(): out of memory\n");
+        return false;
+    }
+    plan->goal_count = goal_count;
+    plan->sim_state = sim_state;
+    plan->frequencies = sim_state->frequencies;
+    plan->settings = sim_state->settings;
+
+    for (size_t i = 0; i < goal_count; i++) {
+        struct Optimization_Goal_Plan_Entry *entry = &plan->entries[i];
+        const struct Optimization_Goal *goal = &goals[i];
+        size_t count;
+        memset(entry, 0, sizeof(*entry));
+        entry->goal = *goal;
+        circuit_optimizer_goal_frequency_range(goal, sim_state, &entry->start, &count);
+        entry->end = entry->start + count;
+        entry->plottable = goal_target_values(goal, sim_state);
+
+        const struct Complex_2x2_SoA *s = &sim_state->s_result;
+        bool s_target = true;
+        switch (goal->target) {
+        case OPTIMIZATION_TARGET_S11: entry->re = s->r11; entry->im = s->i11; break;
+        case OPTIMIZATION_TARGET_S12: entry->re = s->r12; entry->im = s->i12; break;
+        case OPTIMIZATION_TARGET_S21: entry->re = s->r21; entry->im = s->i21; break;
+        case OPTIMIZATION_TARGET_S22: entry->re = s->r22; entry->im = s->i22; break;
+        default: entry->re = entry->plottable; s_target = false; break;
+        }
+
+        // the squared magnitude at the goal, nothing is skipped by default
+        double threshold = -1.0;
+        if (s_target && goal->value_map == dB) {
+            entry->kernel = OPTIMIZATION_GOAL_KERNEL_DB;
+            threshold = pow(10.0, goal->goal_value / 10.0);
+        } else if (s_target && goal->value_map == mag) {
+            entry->kernel = OPTIMIZATION_GOAL_KERNEL_MAG;
+            threshold = goal->goal_value >= 0.0 ? goal->goal_value * goal->goal_value : -1.0;
+        } else if (!s_target && goal->value_map == NULL) {
+            entry->kernel = OPTIMIZATION_GOAL_KERNEL_VALUES;
+        } else {
+            entry->kernel = OPTIMIZATION_GOAL_KERNEL_GENERIC;
+        }
+        entry->skip_below = threshold >= 0.0 ? threshold * (1.0 - GOAL_PLAN_SKIP_MARGIN) : 0.0;
+        entry->skip_above = threshold >= 0.0 ? threshold * (1.0 + GOAL_PLAN_SKIP_MARGIN) : INFINITY;
+        // |S| > 0 > goal: a MORE_THAN goal on mag() never misses
+        if (entry->kernel == OPTIMIZATION_GOAL_KERNEL_MAG && goal->goal_value < 0.0) entry->skip_above = -1.0;
+    }
+    return true;
+}
+
+bool circuit_optimizer_goal_plan_matches(const struct Optimization_Goal_Plan *plan, const struct Optimization_Goal *goals, size_t goal_count, const struct Simulation_State *sim_state) {
+    if (!plan->entries || plan->goal_count != goal_count || plan->sim_state != sim_state) return false;
+    if (plan->frequencies != sim_state->frequencies) return false;
+    if (memcmp(&plan->settings, &sim_state->settings, sizeof(plan->settings)) != 0) return false;
+    for (size_t i = 0; i < goal_count; i++) {
+        if (!goals_equal(&plan->entries[i].goal, &goals[i])) return false;
+        if (plan->entries[i].plottable != goal_target_values(&goals[i], sim_state)) return false;
+    }
+    return true;
+}
+
+void circuit_optimizer_goal_plan_accumulate(const struct Optimization_Goal_Plan *plan, size_t from, size_t to, double *goal_losses) {
+    for (size_t g = 0; g < plan->goal_count; g++) {
+        const struct Optimization_Goal_Plan_Entry *entry = &plan->entries[g];
+        const struct Optimization_Goal *goal = &entry->goal;
+        size_t start = max(entry->start, from);
+        size_t end = min(entry->end, to);
+        bool lt = goal->type == OPTIMIZATION_TYPE_LESS_THAN;
+        double goal_value = goal->goal_value;
+        double loss = goal_losses[g];
+
+        // a zero term is skipped, loss + 0.0 is loss
+        switch (entry->kernel) {
+        case OPTIMIZATION_GOAL_KERNEL_VALUES:
+            for (size_t i = start; i < end; i++) {
+                loss += lt ? fmax(0.0, entry->re[i] - goal_value) : fmax(0.0, goal_value - entry->re[i]);
+            }
+        break;
+        case OPTIMIZATION_GOAL_KERNEL_DB:
+        case OPTIMIZATION_GOAL_KERNEL_MAG:
+            for (size_t i = start; i < end; i++) {
+                // the same expression as dB() and mag()
+                double squared = entry->im[i] * entry->im[i] + entry->re[i] * entry->re[i];
+                if (lt ? squared < entry->skip_below : squared > entry->skip_above) continue;
+                double value = entry->kernel == OPTIMIZATION_GOAL_KERNEL_DB ? dB_from_squared(squared) : sqrt(squared);
+                loss += lt ? fmax(0.0, value - goal_value) : fmax(0.0, goal_value - value);
+            }
+        break;
+        case OPTIMIZATION_GOAL_KERNEL_GENERIC:
+            for (size_t i = start; i < end; i++) {
+                double value = goal->value_map ? goal->value_map(i, entry->plottable) : ((double *)entry->plottable)[i];
+                loss += lt ? fmax(0.0, value - goal_value) : fmax(0.0, goal_value - value);
+            }
+        break;
+        }
+        goal_losses[g] = loss;
+    }
+}
+
+double circuit_optimizer_goal_plan_total(const struct Optimization_Goal_Plan *plan, const double *goal_losses) {
+    double total_loss = 0.0;
+    for (size_t g = 0; g < plan->goal_count; g++) total_loss += plan->entries[g].goal.weight * goal_losses[g];
+    return total_loss;
+}
 
-    switch(component_cascade[index].kind) {
+void circuit_optimizer_goal_plan_destroy(struct Optimization_Goal_Plan *plan) {
+    free(plan->entries);
+    memset(plan, 0, sizeof(*plan));
+}
+
+// Simulates the candidate of circuit_simulation_begin_incremental() step by step and adds up the goal
+// losses of the finished frequencies. The hinge terms are never negative and rounding keeps partial
+// sums monotone, so a partial loss at or above bound means the full loss is too: the rest of the
+// sweep is skipped and false is returned. Otherwise loss_out gets the same bits as the sum of
+// circuit_optimizer_evaluate_goal().
+static bool incremental_loss_bounded(struct Optimizer_State* opt_state, struct Simulation_State* sim_state, double bound, double *loss_out) {
+    const struct Optimization_Goal_Plan *plan = &opt_state->goal_plan;
+    double *goal_losses = opt_state->goal_losses;
+    for (size_t g = 0; g < plan->goal_count; g++) goal_losses[g] = 0.0;
+
+    size_t done = 0;
+    bool finished = false;
+    double total_loss = 0.0;
+    while (!finished) {
+        size_t from = done;
+        finished = circuit_simulation_continue_incremental(sim_state, &done);
+        circuit_optimizer_goal_plan_accumulate(plan, from, done, goal_losses);
+        total_loss = circuit_optimizer_goal_plan_total(plan, goal_losses);
+        if (total_loss >= bound) break;
+    }
+
+    *loss_out = total_loss;
+    return finished && total_loss < bound;
+}
+
+// multiplies the value of a lumped component with factor or selects the setting of a stage
+static void tweak_component(struct Circuit_Component *component, double factor, size_t setting) {
+    switch(component->kind) {
         case CIRCUIT_COMPONENT_RESISTOR_IDEAL:
-            component_cascade[index].as.resistor_ideal.R *= rand_double;
+            component->as.resistor_ideal.R *= factor;
         break;
         case CIRCUIT_COMPONENT_CAPACITOR_IDEAL:
-            component_cascade[index].as.capacitor_ideal.C *= rand_double;
+            component->as.capacitor_ideal.C *= factor;
         break;
         case CIRCUIT_COMPONENT_INDUCTOR_IDEAL:
-            component_cascade[index].as.inductor_ideal.L *= rand_double;
+            component->as.inductor_ideal.L *= factor;
         break;
         case CIRCUIT_COMPONENT_STAGE:
-            size_t i = rand() % component_cascade[index].as.stage.n_settings;
-            component_cascade[index].as.stage.selected_setting = i;
+            component->as.stage.selected_setting = setting;
         break;
         case CIRCUIT_COMPONENT_RESISTOR_IDEAL_PARALLEL:
-            component_cascade[index].as.resistor_ideal_parallel.R *= rand_double;
+            component->as.resistor_ideal_parallel.R *= factor;
         break;
         case CIRCUIT_COMPONENT_CAPACITOR_IDEAL_PARALLEL:
-            component_cascade[index].as.capacitor_ideal_parallel.C *= rand_double;
+            component->as.capacitor_ideal_parallel.C *= factor;
         break;
         case CIRCUIT_COMPONENT_INDUCTOR_IDEAL_PARALLEL:
-            component_cascade[index].as.inductor_ideal_parallel.L *= rand_double;
+            component->as.inductor_ideal_parallel.L *= factor;
         break;
         case CIRCUIT_COMPONENT_KIND_COUNT:
             assert(false && "implement me (next component kind)");
@@ -147,10 +322,57 @@ void circuit_random_tweak_cascade(struct Circuit_Component *component_cascade, s
     }
 }
 
+// tweaks one random component and returns its index
+size_t circuit_random_tweak_cascade(struct Circuit_Component *component_cascade, size_t n_components) {
+    double rand_double = rand_from(0.3, 1.3);
+    size_t index = rand() % n_components;
+    size_t setting = 0;
+    if (component_cascade[index].kind == CIRCUIT_COMPONENT_STAGE) {
+        setting = rand() % component_cascade[index].as.stage.n_settings;
+    }
+    tweak_component(&component_cascade[index], rand_double, setting);
+    return index;
+}
+
+// same as circuit_random_tweak_cascade() but with its own random stream, so it can run on many threads
+size_t circuit_random_tweak_cascade_rng(struct Circuit_Component *component_cascade, size_t n_components, struct Uti_Rng *rng) {
+    double rand_double = uti_rng_range(rng, 0.3, 1.3);
+    size_t index = uti_rng_index(rng, n_components);
+    size_t setting = 0;
+    if (component_cascade[index].kind == CIRCUIT_COMPONENT_STAGE) {
+        setting = uti_rng_index(rng, component_cascade[index].as.stage.n_settings);
+    }
+    tweak_component(&component_cascade[index], rand_double, setting);
+    return index;
+}
+
+// the tweaked value is snapped to the grid, a factor that snaps back to the old value steps to the
+// neighbouring part in its direction, so every tweak changes the circuit
+size_t circuit_random_tweak_cascade_discrete(struct Circuit_Component *component_cascade, size_t n_components, const struct Circuit_Value_Grid *value_grids, struct Uti_Rng *rng) {
+    double rand_double = rng ? uti_rng_range(rng, 0.3, 1.3) : rand_from(0.3, 1.3);
+    size_t index = rng ? uti_rng_index(rng, n_components) : rand() % n_components;
+    size_t setting = 0;
+    if (component_cascade[index].kind == CIRCUIT_COMPONENT_STAGE) {
+        size_t n_settings = component_cascade[index].as.stage.n_settings;
+        setting = rng ? uti_rng_index(rng, n_settings) : rand() % n_settings;
+    }
+    double *value = circuit_component_value(&component_cascade[index]);
+    double before = value ? *value : 0.0;
+    tweak_component(&component_cascade[index], rand_double, setting);
+    if (value && value_grids) {
+        const struct Circuit_Value_Grid *grid = &value_grids[index];
+        double snapped = circuit_value_grid_snap(grid, *value);
+        if (snapped == circuit_value_grid_snap(grid, before)) snapped = circuit_value_grid_step(grid, before, rand_double >= 1.0 ? 1 : -1);
+        *value = snapped;
+    }
+    return index;
+}
+
 bool circuit_optimizer_setup(struct Optimizer_State* state, size_t max_iterations, struct Circuit_Component *intial_component_cascade, size_t n_components) {
     state->iteration = 0;
     state->max_iterations = max_iterations;
     state->best_total_loss_value = DBL_MAX;
+    state->n_components = n_components;
 
     state->initial_component_cascade = malloc(sizeof(*intial_component_cascade) * n_components);
     state->temporary_component_cascade = malloc(sizeof(*intial_component_cascade) * n_components);
@@ -159,6 +381,18 @@ bool circuit_optimizer_setup(struct Optimizer_State* state, size_t max_iteration
     memcpy(state->initial_component_cascade, intial_component_cascade, sizeof(*intial_component_cascade) * n_components);
     memcpy(state->best_component_cascade, intial_component_cascade, sizeof(*intial_component_cascade) * n_components);
     memcpy(state->temporary_component_cascade, intial_component_cascade, sizeof(*intial_component_cascade) * n_components);
+    state->simulation_prepared = false;
+    state->print_progress = true;
+    state->rng = NULL;
+    state->early_abort = true;
+    memset(&state->goal_plan, 0, sizeof(state->goal_plan));
+    state->goal_losses = NULL;
+    state->value_grids = NULL;
+    state->t_cache = NULL;
+    state->checkpoint_path = NULL;
+    state->checkpoint_interval = 0;
+    state->loss_log = NULL;
+    state->loss_log_records = 0;
 
     return true;
 }
@@ -170,31 +404,1390 @@ bool circuit_optimizer_update_one_round(struct Optimizer_State* opt_state, struc
         return true;
     }
 
-    printf("optimizer round %zu\n", opt_state->iteration);
+    if (opt_state->print_progress) printf("optimizer round %zu\n", opt_state->iteration);
 
-    memcpy(opt_state->temporary_component_cascade, opt_state->best_component_cascade, sizeof(*component_cascade) * n_components);
+    // the sim_state keeps the partial cascades of the best cascade, a candidate differs in one component only
+    if (!opt_state->simulation_prepared || sim_state->components_cascade != opt_state->best_component_cascade ||
+        !circuit_simulation_matches_settings(sim_state, sim_settings)) {
+        circuit_simulation_setup(opt_state->best_component_cascade, n_components, sim_state, sim_settings);
+        opt_state->simulation_prepared = true;
+    }
 
-    int stop_tweak = rand() % 10;
-    for (int i = 0; i < stop_tweak; i++);
-        circuit_random_tweak_cascade(opt_state->temporary_component_cascade, n_components);
+    memcpy(opt_state->temporary_component_cascade, opt_state->best_component_cascade, sizeof(*component_cascade) * n_components);
 
-    circuit_simulation_setup(opt_state->temporary_component_cascade, n_components, sim_state, sim_settings);
-    circuit_simulation_do(sim_state, false);
+    size_t tweaked_index;
+    if (opt_state->value_grids) {
+        tweaked_index = circuit_random_tweak_cascade_discrete(opt_state->temporary_component_cascade, n_components, opt_state->value_grids, opt_state->rng);
+    } else if (opt_state->rng) {
+        tweaked_index = circuit_random_tweak_cascade_rng(opt_state->temporary_component_cascade, n_components, opt_state->rng);
+    } else {
+        tweaked_index = circuit_random_tweak_cascade(opt_state->temporary_component_cascade, n_components);
+    }
+    if (!circuit_optimizer_goal_plan_matches(&opt_state->goal_plan, goals, goal_count, sim_state)) {
+        free(opt_state->goal_losses);
+        opt_state->goal_losses = malloc(sizeof(double) * max(goal_count, 1));
+        if (!opt_state->goal_losses || !circuit_optimizer_goal_plan_compile(&opt_state->goal_plan, goals, goal_count, sim_state)) {
+            printf("ERROR: circuit_optimizer_update_one_round(): could not compile the goals\n");
+            return true;
+        }
+    }
 
+    struct Circuit_Component *candidate = &opt_state->temporary_component_cascade[tweaked_index];
+    const double *t_planes = opt_state->t_cache ? circuit_t_cache_get(opt_state->t_cache, candidate, sim_state) : NULL;
     double total_loss = 0.0f;
-    for (size_t i = 0; i < goal_count; i++) {
-        total_loss += goals[i].weight * circuit_optimizer_evaluate_goal(&goals[i], sim_state);
+    bool improved;
+    if (opt_state->early_abort) {
+        if (t_planes) circuit_simulation_begin_incremental_cached(sim_state, tweaked_index, candidate, t_planes);
+        else circuit_simulation_begin_incremental(sim_state, tweaked_index, candidate);
+        improved = incremental_loss_bounded(opt_state, sim_state, opt_state->best_total_loss_value, &total_loss);
+    } else {
+        if (t_planes) {
+            size_t done = 0;
+            circuit_simulation_begin_incremental_cached(sim_state, tweaked_index, candidate, t_planes);
+            while (!circuit_simulation_continue_incremental(sim_state, &done));
+        } else {
+            circuit_simulation_do_incremental(sim_state, tweaked_index, candidate);
+        }
+        for (size_t g = 0; g < goal_count; g++) opt_state->goal_losses[g] = 0.0;
+        circuit_optimizer_goal_plan_accumulate(&opt_state->goal_plan, 0, sim_state->n_frequencies, opt_state->goal_losses);
+        total_loss = circuit_optimizer_goal_plan_total(&opt_state->goal_plan, opt_state->goal_losses);
+        improved = total_loss < opt_state->best_total_loss_value;
     }
 
-    if (total_loss < opt_state->best_total_loss_value) {
+    if (improved) {
         opt_state->best_total_loss_value = total_loss;
+        circuit_simulation_accept_incremental(sim_state);
         memcpy(component_cascade, opt_state->temporary_component_cascade, sizeof(*component_cascade) * n_components);
         memcpy(opt_state->best_component_cascade, opt_state->temporary_component_cascade, sizeof(*component_cascade) * n_components);
     }
 
-    printf("optimizer best loss: %f, current loss: %f\n", opt_state->best_total_loss_value, total_loss);
+    if (opt_state->print_progress) printf("optimizer best loss: %f, current loss: %f\n", opt_state->best_total_loss_value, total_loss);
+
+    if (opt_state->loss_log) {
+        struct Optimizer_Loss_Record record = {opt_state->iteration, total_loss, opt_state->best_total_loss_value};
+        if (fwrite(&record, sizeof(record), 1, opt_state->loss_log) == 1) opt_state->loss_log_records++;
+    }
 
     opt_state->iteration++;
 
+    if (opt_state->checkpoint_path && opt_state->checkpoint_interval > 0 && opt_state->iteration % opt_state->checkpoint_interval == 0) {
+        circuit_optimizer_checkpoint_write(opt_state, opt_state->checkpoint_path);
+    }
+
     return false;
 }
+
+void circuit_optimizer_destroy(struct Optimizer_State* state) {
+    free(state->initial_component_cascade);
+    free(state->temporary_component_cascade);
+    free(state->best_component_cascade);
+    circuit_optimizer_goal_plan_destroy(&state->goal_plan);
+    circuit_optimizer_loss_log_close(state);
+    free(state->goal_losses);
+    state->goal_losses = NULL;
+    state->initial_component_cascade = NULL;
+    state->temporary_component_cascade = NULL;
+    state->best_component_cascade = NULL;
+}
+
+//
+// checkpoints and the loss log
+//
+
+#define OPTIMIZER_CHECKPOINT_MAGIC "IMPCKPT1"
+#define OPTIMIZER_CHECKPOINT_VERSION 1
+
+// the file is the header, one entry per component and the hash of all bytes before it
+struct Optimizer_Checkpoint_Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_components;
+    uint64_t iteration;
+    uint64_t loss_log_records;
+    double best_total_loss_value;
+    uint64_t rng[4];
+    uint32_t has_rng;
+    uint32_t reserved;
+};
+
+struct Optimizer_Checkpoint_Component {
+    uint32_t kind;
+    uint32_t reserved;
+    double value; // lumped components
+    uint64_t setting; // stages
+};
+
+bool circuit_optimizer_checkpoint_write(const struct Optimizer_State *state, const char *path) {
+    // the log has to reach the rounds the checkpoint counts
+    if (state->loss_log) fflush(state->loss_log);
+
+    size_t n = state->n_components;
+    size_t size = sizeof(struct Optimizer_Checkpoint_Header) + n * sizeof(struct Optimizer_Checkpoint_Component) + sizeof(uint64_t);
+    unsigned char *buffer = calloc(1, size);
+    if (!buffer) {
+        printf("ERROR: circuit_optimizer_checkpoint_write(): out of memory\n");
+        return false;
+    }
+
+    struct Optimizer_Checkpoint_Header header = {0};
+    memcpy(header.magic, OPTIMIZER_CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = OPTIMIZER_CHECKPOINT_VERSION;
+    header.n_components = (uint32_t)n;
+    header.iteration = state->iteration;
+    header.loss_log_records = state->loss_log_records;
+    header.best_total_loss_value = state->best_total_loss_value;
+    if (state->rng) {
+        memcpy(header.rng, state->rng->s, sizeof(header.rng));
+        header.has_rng = 1;
+    }
+    memcpy(buffer, &header, sizeof(header));
+
+    unsigned char *at = buffer + sizeof(header);
+    for (size_t i = 0; i < n; i++) {
+        struct Circuit_Component *component = &state->best_component_cascade[i];
+        struct Optimizer_Checkpoint_Component entry = {0};
+        entry.kind = (uint32_t)component->kind;
+        double *value = circuit_component_value(component);
+        if (value) entry.value = *value;
+        else if (component->kind == CIRCUIT_COMPONENT_STAGE) entry.setting = component->as.stage.selected_setting;
+        memcpy(at, &entry, sizeof(entry));
+        at += sizeof(entry);
+    }
+    uint64_t hash = uti_hash_bytes(buffer, size - sizeof(hash), 0);
+    memcpy(at, &hash, sizeof(hash));
+
+    bool ok = uti_write_entire_file_atomic(path, buffer, size);
+    free(buffer);
+    return ok;
+}
+
+bool circuit_optimizer_checkpoint_read(struct Optimizer_State *state, const char *path) {
+    char *content;
+    size_t size;
+    if (!uti_read_entire_file(path, &content, &size)) return false;
+
+    size_t n = state->n_components;
+    struct Optimizer_Checkpoint_Header header;
+    uint64_t hash;
+    size_t expected_size = sizeof(header) + n * sizeof(struct Optimizer_Checkpoint_Component) + sizeof(hash);
+    if (size >= sizeof(header)) memcpy(&header, content, sizeof(header));
+    if (size < sizeof(header) || memcmp(header.magic, OPTIMIZER_CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != OPTIMIZER_CHECKPOINT_VERSION) {
+        printf("ERROR: %s is not an optimizer checkpoint\n", path);
+        free(content);
+        return false;
+    }
+    if (header.n_components != n || size != expected_size) {
+        printf("ERROR: the checkpoint %s has %u components, the circuit %zu\n", path, header.n_components, n);
+        free(content);
+        return false;
+    }
+    memcpy(&hash, content + size - sizeof(hash), sizeof(hash));
+    if (hash != uti_hash_bytes(content, size - sizeof(hash), 0)) {
+        printf("ERROR: the checkpoint %s is damaged\n", path);
+        free(content);
+        return false;
+    }
+    // resuming a seeded search without its stream (or the other way around) would not reproduce it
+    if ((header.has_rng != 0) != (state->rng != NULL)) {
+        printf("ERROR: the checkpoint %s was written %s a random stream, the optimizer runs %s one\n", path,
+            header.has_rng ? "with" : "without", state->rng ? "with" : "without");
+        free(content);
+        return false;
+    }
+
+    // check everything before the state changes
+    const char *at = content + sizeof(header);
+    for (size_t i = 0; i < n; i++) {
+        struct Optimizer_Checkpoint_Component entry;
+        memcpy(&entry, at + i * sizeof(entry), sizeof(entry));
+        struct Circuit_Component *component = &state->best_component_cascade[i];
+        bool matches = entry.kind == (uint32_t)component->kind;
+        if (matches && component->kind == CIRCUIT_COMPONENT_STAGE) matches = entry.setting < component->as.stage.n_settings;
+        if (!matches) {
+            printf("ERROR: component %zu of the checkpoint %s does not match the circuit\n", i, path);
+            free(content);
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        struct Optimizer_Checkpoint_Component entry;
+        memcpy(&entry, at + i * sizeof(entry), sizeof(entry));
+        struct Circuit_Component *component = &state->best_component_cascade[i];
+        double *value = circuit_component_value(component);
+        if (value) *value = entry.value;
+        else if (component->kind == CIRCUIT_COMPONENT_STAGE) component->as.stage.selected_setting = entry.setting;
+    }
+    memcpy(state->temporary_component_cascade, state->best_component_cascade, sizeof(*state->best_component_cascade) * n);
+    state->iteration = header.iteration;
+    state->best_total_loss_value = header.best_total_loss_value;
+    state->loss_log_records = header.loss_log_records;
+    if (state->rng) memcpy(state->rng->s, header.rng, sizeof(header.rng));
+    state->simulation_prepared = false;
+
+    free(content);
+    return true;
+}
+
+bool circuit_optimizer_loss_log_open(struct Optimizer_State *state, const char *path) {
+    circuit_optimizer_loss_log_close(state);
+
+    struct Optimizer_Loss_Log_Header header = {0};
+    memcpy(header.magic, OPTIMIZER_LOSS_LOG_MAGIC, sizeof(header.magic));
+    header.version = OPTIMIZER_LOSS_LOG_VERSION;
+    header.record_size = sizeof(struct Optimizer_Loss_Record);
+
+    // the records of an existing log, a torn last record is dropped with the rest
+    size_t records = 0;
+    bool exists = false;
+    FILE *file = fopen(path, "rb");
+    if (file) {
+        struct Optimizer_Loss_Log_Header existing;
+        size_t got = fread(&existing, 1, sizeof(existing), file);
+        exists = got > 0;
+        if (exists && (got != sizeof(existing) || memcmp(&existing, &header, sizeof(header)) != 0)) {
+            printf("ERROR: %s is not a loss log\n", path);
+            fclose(file);
+            return false;
+        }
+        if (exists && fseek(file, 0, SEEK_END) == 0) {
+            long size = ftell(file);
+            if (size > (long)sizeof(header)) records = ((size_t)size - sizeof(header)) / sizeof(struct Optimizer_Loss_Record);
+        }
+        fclose(file);
+    }
+
+    if (records > state->loss_log_records) records = state->loss_log_records;
+    if (exists) {
+        if (!uti_truncate_file(path, sizeof(header) + records * sizeof(struct Optimizer_Loss_Record))) return false;
+    } else if (!uti_write_entire_file_atomic(path, &header, sizeof(header))) {
+        return false;
+    }
+
+    state->loss_log = fopen(path, "ab");
+    if (!state->loss_log) {
+        printf("ERROR: Could not open the loss log %s\n", path);
+        return false;
+    }
+    state->loss_log_records = records;
+    return true;
+}
+
+void circuit_optimizer_loss_log_close(struct Optimizer_State *state) {
+    if (state->loss_log) fclose(state->loss_log);
+    state->loss_log = NULL;
+}
+
+//
+// gradient descent
+//
+
+static struct Complex complex_scale(struct Complex a, double k) {
+    return mma_complex(a.r * k, a.i * k);
+}
+
+// gradient (dmu/dRe + j dmu/dIm) of mu = (1 - |a|^2) / (|d - conj(a) det| + |b c|) with respect to
+// a = S11, b = S12, c = S21 and d = S22, det = a d - b c. mu' is the same with a and d swapped.
+static void mu_gradient(struct Complex a, struct Complex b, struct Complex c, struct Complex d,
+        struct Complex *ga, struct Complex *gb, struct Complex *gc, struct Complex *gd) {
+    struct Complex bc = mma_complex_mult(b, c);
+    struct Complex det = mma_complex_subtract(mma_complex_mult(a, d), bc);
+    struct Complex u = mma_complex_subtract(d, mma_complex_mult(mma_complex_conjugate(a), det));
+    double u_abs = mma_complex_absolute(u);
+    double bc_abs = mma_complex_absolute(bc);
+    double numerator = 1.0 - mma_complex_absolute_squared(a);
+    double denominator = u_abs + bc_abs;
+
+    // d|z| = Re(conj(z/|z|) dz)
+    struct Complex gu = u_abs > 0.0 ? complex_scale(u, 1.0 / u_abs) : mma_complex(0.0, 0.0);
+    struct Complex gv = bc_abs > 0.0 ? complex_scale(bc, 1.0 / bc_abs) : mma_complex(0.0, 0.0);
+
+    // u = d (1 - |a|^2) + conj(a) b c, so du = -conj(a) d da + (b c - a d) conj(da) + ...
+    struct Complex ga_den = mma_complex_add(
+        mma_complex_negate(mma_complex_mult(gu, mma_complex_mult(a, mma_complex_conjugate(d)))),
+        mma_complex_mult(mma_complex_conjugate(gu), mma_complex_subtract(bc, mma_complex_mult(a, d))));
+    struct Complex gb_den = mma_complex_add(mma_complex_mult(gu, mma_complex_mult(a, mma_complex_conjugate(c))),
+        mma_complex_mult(gv, mma_complex_conjugate(c)));
+    struct Complex gc_den = mma_complex_add(mma_complex_mult(gu, mma_complex_mult(a, mma_complex_conjugate(b))),
+        mma_complex_mult(gv, mma_complex_conjugate(b)));
+    struct Complex gd_den = complex_scale(gu, numerator);
+
+    // mu = N / D  ->  G = G_N / D - N / D^2 G_D
+    double k = -numerator / (denominator * denominator);
+    *ga = mma_complex_add(complex_scale(a, -2.0 / denominator), complex_scale(ga_den, k));
+    *gb = complex_scale(gb_den, k);
+    *gc = complex_scale(gc_den, k);
+    *gd = complex_scale(gd_den, k);
+}
+
+static void soa_add(struct Complex_2x2_SoA *soa, size_t row, size_t col, size_t i, struct Complex value) {
+    if (row == 0 && col == 0) { soa->r11[i] += value.r; soa->i11[i] += value.i; }
+    if (row == 0 && col == 1) { soa->r12[i] += value.r; soa->i12[i] += value.i; }
+    if (row == 1 && col == 0) { soa->r21[i] += value.r; soa->i21[i] += value.i; }
+    if (row == 1 && col == 1) { soa->r22[i] += value.r; soa->i22[i] += value.i; }
+}
+
+bool circuit_optimizer_loss_gradient(const struct Optimization_Goal *goals, size_t goal_count, struct Simulation_State *sim_state, struct Complex_2x2_SoA *ds, double *loss_out) {
+    size_t n_f = sim_state->n_frequencies;
+    double *planes[8] = {ds->r11, ds->r12, ds->r21, ds->r22, ds->i11, ds->i12, ds->i21, ds->i22};
+    for (size_t p = 0; p < 8; p++) memset(planes[p], 0, sizeof(double) * n_f);
+
+    double loss = 0.0;
+    for (size_t i_goal = 0; i_goal < goal_count; i_goal++) {
+        const struct Optimization_Goal *goal = &goals[i_goal];
+        loss += goal->weight * circuit_optimizer_evaluate_goal(goal, sim_state);
+
+        size_t start, count;
+        circuit_optimizer_goal_frequency_range(goal, sim_state, &start, &count);
+
+        struct Complex *s_values = NULL;
+        size_t row = 0, col = 0;
+        switch (goal->target) {
+        case OPTIMIZATION_TARGET_S11: s_values = sim_state->s11_result_plottable; row = 0; col = 0; break;
+        case OPTIMIZATION_TARGET_S12: s_values = sim_state->s12_result_plottable; row = 0; col = 1; break;
+        case OPTIMIZATION_TARGET_S21: s_values = sim_state->s21_result_plottable; row = 1; col = 0; break;
+        case OPTIMIZATION_TARGET_S22: s_values = sim_state->s22_result_plottable; row = 1; col = 1; break;
+        case OPTIMIZATION_TARGET_MU:
+        case OPTIMIZATION_TARGET_MU_PRIME:
+        break;
+        default:
+            assert(false && "wrong or implement me");
+        break;
+        }
+
+        if (s_values && goal->value_map != dB && goal->value_map != mag) {
+            printf("ERROR: circuit_optimizer_loss_gradient(): S-parameter goals need the dB or mag value map\n");
+            return false;
+        }
+        if (!s_values && goal->value_map != NULL) {
+            printf("ERROR: circuit_optimizer_loss_gradient(): stability goals can't have a value map\n");
+            return false;
+        }
+
+        for (size_t i = start; i < start + count; i++) {
+            double value;
+            if (s_values) value = goal->value_map(i, s_values);
+            else value = goal->target == OPTIMIZATION_TARGET_MU ? sim_state->stab_mu[i] : sim_state->stab_mu_prime[i];
+
+            // derivative of the hinge
+            double slope = 0.0;
+            if (goal->type == OPTIMIZATION_TYPE_LESS_THAN && value > goal->goal_value) slope = goal->weight;
+            if (goal->type == OPTIMIZATION_TYPE_MORE_THAN && value < goal->goal_value) slope = -goal->weight;
+            if (slope == 0.0) continue;
+
+            if (s_values) {
+                struct Complex s = s_values[i];
+                double s_abs_sq = mma_complex_absolute_squared(s);
+                if (s_abs_sq <= 0.0) continue;
+                // dB = 10 log10(|s|^2) -> 20/ln(10) s/|s|^2     mag = |s| -> s/|s|
+                double k = goal->value_map == dB ? 20.0 / log(10.0) / s_abs_sq : 1.0 / sqrt(s_abs_sq);
+                soa_add(ds, row, col, i, complex_scale(s, slope * k));
+            } else {
+                struct Complex s11 = sim_state->s11_result_plottable[i];
+                struct Complex s12 = sim_state->s12_result_plottable[i];
+                struct Complex s21 = sim_state->s21_result_plottable[i];
+                struct Complex s22 = sim_state->s22_result_plottable[i];
+                struct Complex g11, g12, g21, g22;
+                if (goal->target == OPTIMIZATION_TARGET_MU) mu_gradient(s11, s12, s21, s22, &g11, &g12, &g21, &g22);
+                else mu_gradient(s22, s12, s21, s11, &g22, &g12, &g21, &g11);
+                soa_add(ds, 0, 0, i, complex_scale(g11, slope));
+                soa_add(ds, 0, 1, i, complex_scale(g12, slope));
+                soa_add(ds, 1, 0, i, complex_scale(g21, slope));
+                soa_add(ds, 1, 1, i, complex_scale(g22, slope));
+            }
+        }
+    }
+
+    *loss_out = loss;
+    return true;
+}
+
+#define LBFGS_MEMORY 8
+#define LBFGS_MAX_LOG_STEP 1.0 // a step changes a value by e^1 at most
+#define LBFGS_ARMIJO 1e-4
+
+struct Gradient_Descent {
+    struct Circuit_Component *cascade;
+    size_t n_components;
+    const struct Optimization_Goal *goals;
+    size_t goal_count;
+    struct Simulation_State sim_state;
+    struct Complex_2x2_SoA ds;
+    double *ds_block;
+    double *full_gradient; // n_components
+    size_t *params; // component index of every parameter
+    size_t n_params;
+    size_t evaluations;
+};
+
+// loss and gradient at x (the logs of the values)
+static bool gradient_descent_evaluate(struct Gradient_Descent *gd, const double *x, double *loss, double *gradient) {
+    for (size_t j = 0; j < gd->n_params; j++) {
+        *circuit_component_value(&gd->cascade[gd->params[j]]) = exp(x[j]);
+        circuit_simulation_mark_dirty(&gd->sim_state, gd->params[j]);
+    }
+    gd->evaluations++;
+    if (!circuit_simulation_do(&gd->sim_state, false)) return false;
+    if (!circuit_optimizer_loss_gradient(gd->goals, gd->goal_count, &gd->sim_state, &gd->ds, loss)) return false;
+    if (!circuit_simulation_gradient(&gd->sim_state, &gd->ds, gd->full_gradient)) return false;
+    for (size_t j = 0; j < gd->n_params; j++) gradient[j] = gd->full_gradient[gd->params[j]];
+    return true;
+}
+
+static double dot(const double *a, const double *b, size_t n) {
+    double result = 0.0;
+    for (size_t i = 0; i < n; i++) result += a[i] * b[i];
+    return result;
+}
+
+bool circuit_optimizer_gradient_descent(struct Circuit_Component *component_cascade, size_t n_components,
+        const struct Simulation_Settings *sim_settings, const struct Optimization_Goal *goals, size_t goal_count,
+        size_t max_evaluations, double *best_loss, size_t *evaluations) {
+    struct Gradient_Descent gd = {
+        .cascade = component_cascade,
+        .n_components = n_components,
+        .goals = goals,
+        .goal_count = goal_count,
+    };
+
+    size_t n_f = sim_settings->n_frequencies;
+    gd.ds_block = malloc(sizeof(double) * 8 * n_f);
+    gd.full_gradient = malloc(sizeof(double) * n_components);
+    gd.params = malloc(sizeof(size_t) * n_components);
+    size_t m = n_components;
+    // x, gradient, new x, new gradient, direction, the history of s and y
+    double *work = calloc(m * (5 + 2 * LBFGS_MEMORY), sizeof(double));
+    if (!gd.ds_block || !gd.full_gradient || !gd.params || !work) {
+        printf("ERROR: circuit_optimizer_gradient_descent(): out of memory\n");
+        free(gd.ds_block); free(gd.full_gradient); free(gd.params); free(work);
+        return false;
+    }
+    double *planes[8];
+    for (size_t p = 0; p < 8; p++) planes[p] = &gd.ds_block[p * n_f];
+    gd.ds = (struct Complex_2x2_SoA){planes[0], planes[1], planes[2], planes[3], planes[4], planes[5], planes[6], planes[7]};
+
+    for (size_t k = 0; k < n_components; k++) {
+        if (circuit_component_value(&component_cascade[k])) gd.params[gd.n_params++] = k;
+    }
+    size_t n = gd.n_params;
+    double *x = work, *g = x + m, *x_new = g + m, *g_new = x_new + m, *d = g_new + m;
+    double *s_hist = d + m, *y_hist = s_hist + m * LBFGS_MEMORY;
+    double rho[LBFGS_MEMORY], alpha_hist[LBFGS_MEMORY];
+    size_t n_hist = 0, hist_next = 0;
+
+    for (size_t j = 0; j < n; j++) x[j] = log(*circuit_component_value(&component_cascade[gd.params[j]]));
+
+    bool ok = circuit_simulation_setup(component_cascade, n_components, &gd.sim_state, sim_settings);
+    double loss = DBL_MAX;
+    ok = ok && gradient_descent_evaluate(&gd, x, &loss, g);
+
+    while (ok && n > 0 && gd.evaluations < max_evaluations && loss > 1e-15) {
+        double g_max = 0.0;
+        for (size_t j = 0; j < n; j++) g_max = fmax(g_max, fabs(g[j]));
+        if (g_max < 1e-12) break; // converged (or all goals flat)
+
+        // two loop recursion: d = -H g
+        for (size_t j = 0; j < n; j++) d[j] = -g[j];
+        for (size_t h = 0; h < n_hist; h++) {
+            size_t slot = (hist_next + LBFGS_MEMORY - 1 - h) % LBFGS_MEMORY;
+            alpha_hist[slot] = rho[slot] * dot(&s_hist[slot * m], d, n);
+            for (size_t j = 0; j < n; j++) d[j] -= alpha_hist[slot] * y_hist[slot * m + j];
+        }
+        if (n_hist > 0) {
+            size_t newest = (hist_next + LBFGS_MEMORY - 1) % LBFGS_MEMORY;
+            double gamma = dot(&s_hist[newest * m], &y_hist[newest * m], n) / dot(&y_hist[newest * m], &y_hist[newest * m], n);
+            for (size_t j = 0; j < n; j++) d[j] *= gamma;
+        }
+        for (size_t h = n_hist; h > 0; h--) {
+            size_t slot = (hist_next + LBFGS_MEMORY - h) % LBFGS_MEMORY;
+            double beta = rho[slot] * dot(&y_hist[slot * m], d, n);
+            for (size_t j = 0; j < n; j++) d[j] += (alpha_hist[slot] - beta) * s_hist[slot * m + j];
+        }
+
+        double slope = dot(g, d, n);
+        if (!(slope < 0.0)) {
+            // not a descent direction, start over with the gradient
+            n_hist = 0;
+            for (size_t j = 0; j < n; j++) d[j] = -g[j];
+            slope = dot(g, d, n);
+        }
+
+        // backtracking line search (Armijo), steps are limited in the log space
+        double d_max = 0.0;
+        for (size_t j = 0; j < n; j++) d_max = fmax(d_max, fabs(d[j]));
+        double step = fmin(1.0, LBFGS_MAX_LOG_STEP / d_max);
+        bool accepted = false;
+        double loss_new = DBL_MAX;
+        while (gd.evaluations < max_evaluations && step * d_max > 1e-12) {
+            for (size_t j = 0; j < n; j++) x_new[j] = x[j] + step * d[j];
+            ok = gradient_descent_evaluate(&gd, x_new, &loss_new, g_new);
+            if (!ok) break;
+            if (loss_new <= loss + LBFGS_ARMIJO * step * slope) {
+                accepted = true;
+                break;
+            }
+            step *= 0.5;
+        }
+
+        if (!accepted) {
+            if (n_hist == 0) break; // no progress along the gradient either
+            n_hist = 0;
+            continue;
+        }
+
+        // curvature pair, only kept if it keeps H positive definite
+        double *s_slot = &s_hist[hist_next * m];
+        double *y_slot = &y_hist[hist_next * m];
+        for (size_t j = 0; j < n; j++) {
+            s_slot[j] = x_new[j] - x[j];
+            y_slot[j] = g_new[j] - g[j];
+        }
+        double sy = dot(s_slot, y_slot, n);
+        if (sy > 1e-12 * sqrt(dot(s_slot, s_slot, n) * dot(y_slot, y_slot, n))) {
+            rho[hist_next] = 1.0 / sy;
+            hist_next = (hist_next + 1) % LBFGS_MEMORY;
+            if (n_hist < LBFGS_MEMORY) n_hist++;
+        }
+
+        memcpy(x, x_new, sizeof(double) * n);
+        memcpy(g, g_new, sizeof(double) * n);
+        loss = loss_new;
+    }
+
+    // the cascade may hold a rejected trial point
+    for (size_t j = 0; j < n; j++) *circuit_component_value(&component_cascade[gd.params[j]]) = exp(x[j]);
+    if (best_loss) *best_loss = loss;
+    if (evaluations) *evaluations = gd.evaluations;
+
+    circuit_simulation_destroy(&gd.sim_state);
+    free(gd.ds_block);
+    free(gd.full_gradient);
+    free(gd.params);
+    free(work);
+    return ok;
+}
+
+//
+// population optimizers (differential evolution, CMA-ES)
+//
+
+// losses of n_candidates cascades (n_candidates x n_components) in one batch
+static bool population_losses(struct Simulation_Batch *batch, const struct Circuit_Component *cascades, size_t n_candidates,
+        const struct Optimization_Goal *goals, size_t goal_count, double *losses) {
+    for (size_t c = 0; c < n_candidates; c++) {
+        circuit_simulation_batch_set_cascade(batch, c, &cascades[c * batch->n_components]);
+    }
+    return circuit_simulation_batch_run(batch, n_candidates, goals, goal_count, losses);
+}
+
+// the ln(value) of the lumped components are the continuous genes, the stage settings the discrete ones
+static size_t count_lumped(struct Circuit_Component *cascade, size_t n_components) {
+    size_t n_lumped = 0;
+    for (size_t k = 0; k < n_components; k++) {
+        if (circuit_component_value(&cascade[k])) n_lumped++;
+    }
+    return n_lumped;
+}
+
+#define POPULATION_VALUE_RANGE 9.210340371976184 // ln(1e4): values stay within / 1e4 .. * 1e4 of the initial circuit
+
+static void clamp_circuit_component_value(double *value, double initial) {
+    *value = fmin(fmax(*value, initial * exp(-POPULATION_VALUE_RANGE)), initial * exp(POPULATION_VALUE_RANGE));
+}
+
+#define DE_WEIGHT 0.7
+#define DE_CROSSOVER 0.9
+#define POPULATION_INITIAL_SPREAD 2.302585092994046 // ln(10): initial values within / 10 .. * 10
+
+bool circuit_optimizer_differential_evolution(struct Circuit_Component *component_cascade, size_t n_components,
+        const struct Simulation_Settings *sim_settings, const struct Optimization_Goal *goals, size_t goal_count,
+        size_t population_size, size_t max_generations, uint64_t seed, double *best_loss) {
+    size_t np = population_size > 0 ? population_size : max(16, min(64, 10 * n_components));
+    if (np < 4) np = 4; // three donors besides the target
+
+    struct Uti_Rng rng;
+    uti_rng_seed(&rng, seed, 0);
+
+    struct Circuit_Component *population = malloc(sizeof(*population) * np * n_components);
+    struct Circuit_Component *trials = malloc(sizeof(*trials) * np * n_components);
+    double *losses = malloc(sizeof(double) * np);
+    double *trial_losses = malloc(sizeof(double) * np);
+    struct Simulation_Batch batch = {0};
+    bool ok = population && trials && losses && trial_losses &&
+        circuit_simulation_batch_setup(&batch, component_cascade, n_components, sim_settings, np, false);
+    if (!ok) printf("ERROR: circuit_optimizer_differential_evolution(): could not set up\n");
+
+    // the initial circuit and random ones around it
+    for (size_t i = 0; ok && i < np; i++) {
+        struct Circuit_Component *member = &population[i * n_components];
+        memcpy(member, component_cascade, sizeof(*member) * n_components);
+        if (i == 0) continue;
+        for (size_t k = 0; k < n_components; k++) {
+            double *value = circuit_component_value(&member[k]);
+            if (value) *value *= exp(uti_rng_range(&rng, -POPULATION_INITIAL_SPREAD, POPULATION_INITIAL_SPREAD));
+            else member[k].as.stage.selected_setting = uti_rng_index(&rng, member[k].as.stage.n_settings);
+        }
+    }
+    ok = ok && population_losses(&batch, population, np, goals, goal_count, losses);
+
+    size_t best = 0;
+    for (size_t generation = 0; ok && generation < max_generations; generation++) {
+        best = 0;
+        for (size_t i = 1; i < np; i++) if (losses[i] < losses[best]) best = i;
+        if (losses[best] <= 1e-15) break;
+
+        // DE/rand/1/bin, a stage takes the setting of the base donor and a random one (with the
+        // probability DE_WEIGHT) where the two difference donors disagree
+        for (size_t i = 0; i < np; i++) {
+            size_t a, b, c;
+            do a = uti_rng_index(&rng, np); while (a == i);
+            do b = uti_rng_index(&rng, np); while (b == i || b == a);
+            do c = uti_rng_index(&rng, np); while (c == i || c == a || c == b);
+            size_t j_rand = uti_rng_index(&rng, n_components);
+
+            struct Circuit_Component *trial = &trials[i * n_components];
+            const struct Circuit_Component *target = &population[i * n_components];
+            memcpy(trial, target, sizeof(*trial) * n_components);
+            for (size_t k = 0; k < n_components; k++) {
+                if (!(uti_rng_double(&rng) < DE_CROSSOVER || k == j_rand)) continue;
+                double *value = circuit_component_value(&trial[k]);
+                if (value) {
+                    double va = *circuit_component_value(&population[a * n_components + k]);
+                    double vb = *circuit_component_value(&population[b * n_components + k]);
+                    double vc = *circuit_component_value(&population[c * n_components + k]);
+                    *value = va * pow(vb / vc, DE_WEIGHT);
+                    clamp_circuit_component_value(value, *circuit_component_value(&component_cascade[k]));
+                } else {
+                    size_t sa = population[a * n_components + k].as.stage.selected_setting;
+                    size_t sb = population[b * n_components + k].as.stage.selected_setting;
+                    size_t sc = population[c * n_components + k].as.stage.selected_setting;
+                    if (sb != sc && uti_rng_double(&rng) < DE_WEIGHT) sa = uti_rng_index(&rng, trial[k].as.stage.n_settings);
+                    trial[k].as.stage.selected_setting = sa;
+                }
+            }
+        }
+
+        ok = population_losses(&batch, trials, np, goals, goal_count, trial_losses);
+        for (size_t i = 0; ok && i < np; i++) {
+            if (trial_losses[i] <= losses[i]) {
+                memcpy(&population[i * n_components], &trials[i * n_components], sizeof(*trials) * n_components);
+                losses[i] = trial_losses[i];
+            }
+        }
+    }
+
+    if (ok) {
+        best = 0;
+        for (size_t i = 1; i < np; i++) if (losses[i] < losses[best]) best = i;
+        memcpy(component_cascade, &population[best * n_components], sizeof(*component_cascade) * n_components);
+        if (best_loss) *best_loss = losses[best];
+    }
+
+    circuit_simulation_batch_destroy(&batch);
+    free(population);
+    free(trials);
+    free(losses);
+    free(trial_losses);
+    return ok;
+}
+
+#define CMA_INITIAL_SIGMA 0.7 // in ln(value), a factor of 2 per standard deviation
+#define CMA_CATEGORICAL_RATE 0.3
+#define CMA_CATEGORICAL_MARGIN 0.1 // every setting keeps at least margin / n_settings probability
+
+bool circuit_optimizer_cma_es(struct Circuit_Component *component_cascade, size_t n_components,
+        const struct Simulation_Settings *sim_settings, const struct Optimization_Goal *goals, size_t goal_count,
+        size_t population_size, size_t max_generations, uint64_t seed, double *best_loss) {
+    size_t n = count_lumped(component_cascade, n_components);
+    size_t lambda = population_size > 0 ? population_size : max(8, 4 + (size_t)(3.0 * log((double)max(n, 1))));
+    size_t mu = lambda / 2;
+    if (mu < 1) mu = 1;
+
+    struct Uti_Rng rng;
+    uti_rng_seed(&rng, seed, 0);
+
+    double *weights = malloc(sizeof(double) * mu);
+    // mean, paths, covariance C = B diag(D^2) B^T and the samples y = B D z
+    size_t n_work = 5 * n + 3 * n * n + lambda * n;
+    double *work = calloc(max(n_work, 1), sizeof(double));
+    double *mean = work, *p_sigma = mean + n, *p_c = p_sigma + n, *D = p_c + n, *tmp = D + n;
+    double *C = tmp + n, *B = C + n * n, *C_copy = B + n * n, *ys = C_copy + n * n;
+
+    // one categorical distribution per stage, started around the initial setting
+    double **probabilities = calloc(n_components, sizeof(double *));
+    struct Circuit_Component *population = malloc(sizeof(*population) * lambda * n_components);
+    struct Circuit_Component *best_cascade = malloc(sizeof(*best_cascade) * n_components);
+    double *losses = malloc(sizeof(double) * lambda);
+    size_t *order = malloc(sizeof(size_t) * lambda);
+    struct Simulation_Batch batch = {0};
+    bool ok = weights && work && probabilities && population && best_cascade && losses && order &&
+        circuit_simulation_batch_setup(&batch, component_cascade, n_components, sim_settings, lambda, false);
+    if (!ok) printf("ERROR: circuit_optimizer_cma_es(): could not set up\n");
+
+    // recombination weights and the strategy parameters of the standard CMA-ES
+    double weight_sum = 0.0, weight_sq_sum = 0.0;
+    for (size_t i = 0; ok && i < mu; i++) {
+        weights[i] = log(mu + 0.5) - log(i + 1.0);
+        weight_sum += weights[i];
+    }
+    for (size_t i = 0; ok && i < mu; i++) {
+        weights[i] /= weight_sum;
+        weight_sq_sum += weights[i] * weights[i];
+    }
+    double mu_eff = ok ? 1.0 / weight_sq_sum : 1.0;
+    double nd = (double)max(n, 1);
+    double c_sigma = (mu_eff + 2.0) / (nd + mu_eff + 5.0);
+    double d_sigma = 1.0 + 2.0 * fmax(0.0, sqrt((mu_eff - 1.0) / (nd + 1.0)) - 1.0) + c_sigma;
+    double c_c = (4.0 + mu_eff / nd) / (nd + 4.0 + 2.0 * mu_eff / nd);
+    double c_1 = 2.0 / ((nd + 1.3) * (nd + 1.3) + mu_eff);
+    double c_mu = fmin(1.0 - c_1, 2.0 * (mu_eff - 2.0 + 1.0 / mu_eff) / ((nd + 2.0) * (nd + 2.0) + mu_eff));
+    double chi_n = sqrt(nd) * (1.0 - 1.0 / (4.0 * nd) + 1.0 / (21.0 * nd * nd));
+
+    for (size_t k = 0, j = 0; ok && k < n_components; k++) {
+        double *value = circuit_component_value(&component_cascade[k]);
+        if (value) {
+            mean[j++] = log(*value);
+            continue;
+        }
+        size_t n_settings = component_cascade[k].as.stage.n_settings;
+        probabilities[k] = malloc(sizeof(double) * n_settings);
+        if (!probabilities[k]) {
+            printf("ERROR: circuit_optimizer_cma_es(): out of memory\n");
+            ok = false;
+            break;
+        }
+        for (size_t i = 0; i < n_settings; i++) probabilities[k][i] = n_settings > 1 ? 0.5 / (n_settings - 1) : 1.0;
+        if (n_settings > 1) probabilities[k][component_cascade[k].as.stage.selected_setting] = 0.5;
+    }
+    for (size_t i = 0; ok && i < n; i++) {
+        C[i * n + i] = 1.0;
+        B[i * n + i] = 1.0;
+        D[i] = 1.0;
+    }
+    double sigma = CMA_INITIAL_SIGMA;
+    double best = DBL_MAX;
+    if (ok) memcpy(best_cascade, component_cascade, sizeof(*best_cascade) * n_components);
+
+    for (size_t generation = 0; ok && generation < max_generations && best > 1e-15; generation++) {
+        // B and D from C
+        if (n > 0) {
+            memcpy(C_copy, C, sizeof(double) * n * n);
+            mma_eigen_symmetric(C_copy, n, D, B);
+            for (size_t i = 0; i < n; i++) D[i] = sqrt(fmax(D[i], 1e-20));
+        }
+
+        // sample
+        for (size_t c = 0; c < lambda; c++) {
+            struct Circuit_Component *member = &population[c * n_components];
+            memcpy(member, component_cascade, sizeof(*member) * n_components);
+            double *y = &ys[c * n];
+            for (size_t i = 0; i < n; i++) tmp[i] = D[i] * uti_rng_normal(&rng);
+            for (size_t i = 0; i < n; i++) {
+                y[i] = 0.0;
+                for (size_t j = 0; j < n; j++) y[i] += B[i * n + j] * tmp[j];
+            }
+            for (size_t k = 0, j = 0; k < n_components; k++) {
+                double *value = circuit_component_value(&member[k]);
+                if (value) {
+                    *value = exp(mean[j] + sigma * y[j]);
+                    clamp_circuit_component_value(value, *circuit_component_value(&component_cascade[k]));
+                    j++;
+                } else {
+                    double u = uti_rng_double(&rng);
+                    size_t n_settings = member[k].as.stage.n_settings;
+                    size_t setting = n_settings - 1;
+                    for (size_t i = 0; i < n_settings; i++) {
+                        u -= probabilities[k][i];
+                        if (u < 0.0) { setting = i; break; }
+                    }
+                    member[k].as.stage.selected_setting = setting;
+                }
+            }
+        }
+
+        ok = population_losses(&batch, population, lambda, goals, goal_count, losses);
+        if (!ok) break;
+
+        // rank by loss (stable, ties keep the sample order)
+        for (size_t i = 0; i < lambda; i++) {
+            size_t j = i;
+            while (j > 0 && losses[order[j - 1]] > losses[i]) {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = i;
+        }
+        if (losses[order[0]] < best) {
+            best = losses[order[0]];
+            memcpy(best_cascade, &population[order[0] * n_components], sizeof(*best_cascade) * n_components);
+        }
+
+        // categorical distributions move towards the settings of the selected ones
+        for (size_t k = 0; k < n_components; k++) {
+            if (!probabilities[k]) continue;
+            size_t n_settings = component_cascade[k].as.stage.n_settings;
+            for (size_t i = 0; i < n_settings; i++) probabilities[k][i] *= 1.0 - CMA_CATEGORICAL_RATE;
+            for (size_t i = 0; i < mu; i++) {
+                probabilities[k][population[order[i] * n_components + k].as.stage.selected_setting] += CMA_CATEGORICAL_RATE * weights[i];
+            }
+            double floor = CMA_CATEGORICAL_MARGIN / n_settings;
+            double sum = 0.0;
+            for (size_t i = 0; i < n_settings; i++) {
+                probabilities[k][i] = fmax(probabilities[k][i], floor);
+                sum += probabilities[k][i];
+            }
+            for (size_t i = 0; i < n_settings; i++) probabilities[k][i] /= sum;
+        }
+        if (n == 0) continue;
+
+        // mean: y_w = sum w_i y_i:lambda
+        double *y_w = tmp;
+        for (size_t j = 0; j < n; j++) {
+            y_w[j] = 0.0;
+            for (size_t i = 0; i < mu; i++) y_w[j] += weights[i] * ys[order[i] * n + j];
+            mean[j] += sigma * y_w[j];
+        }
+
+        // p_sigma with C^(-1/2) y_w = B D^-1 B^T y_w
+        double *bt_y = C_copy; // free again after the decomposition
+        for (size_t i = 0; i < n; i++) {
+            bt_y[i] = 0.0;
+            for (size_t j = 0; j < n; j++) bt_y[i] += B[j * n + i] * y_w[j];
+            bt_y[i] /= D[i];
+        }
+        double p_sigma_norm = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            double c_inv_sqrt_y = 0.0;
+            for (size_t j = 0; j < n; j++) c_inv_sqrt_y += B[i * n + j] * bt_y[j];
+            p_sigma[i] = (1.0 - c_sigma) * p_sigma[i] + sqrt(c_sigma * (2.0 - c_sigma) * mu_eff) * c_inv_sqrt_y;
+            p_sigma_norm += p_sigma[i] * p_sigma[i];
+        }
+        p_sigma_norm = sqrt(p_sigma_norm);
+        double h_sigma = p_sigma_norm / sqrt(1.0 - pow(1.0 - c_sigma, 2.0 * (generation + 1))) < (1.4 + 2.0 / (nd + 1.0)) * chi_n ? 1.0 : 0.0;
+        for (size_t i = 0; i < n; i++) {
+            p_c[i] = (1.0 - c_c) * p_c[i] + h_sigma * sqrt(c_c * (2.0 - c_c) * mu_eff) * y_w[i];
+        }
+
+        // rank one and rank mu update of C
+        double c_keep = 1.0 - c_1 - c_mu + (1.0 - h_sigma) * c_1 * c_c * (2.0 - c_c);
+        for (size_t i = 0; i < n; i++) {
+            for (size_t j = 0; j <= i; j++) {
+                double rank_mu = 0.0;
+                for (size_t l = 0; l < mu; l++) rank_mu += weights[l] * ys[order[l] * n + i] * ys[order[l] * n + j];
+                double c_ij = c_keep * C[i * n + j] + c_1 * p_c[i] * p_c[j] + c_mu * rank_mu;
+                C[i * n + j] = C[j * n + i] = c_ij;
+            }
+        }
+
+        sigma *= exp((c_sigma / d_sigma) * (p_sigma_norm / chi_n - 1.0));
+        double d_max = 0.0;
+        for (size_t i = 0; i < n; i++) d_max = fmax(d_max, D[i]);
+        if (sigma * d_max < 1e-12) break; // converged
+    }
+
+    if (ok) {
+        memcpy(component_cascade, best_cascade, sizeof(*component_cascade) * n_components);
+        if (best_loss) *best_loss = best;
+    }
+
+    circuit_simulation_batch_destroy(&batch);
+    for (size_t k = 0; probabilities && k < n_components; k++) free(probabilities[k]);
+    free(probabilities);
+    free(weights);
+    free(work);
+    free(population);
+    free(best_cascade);
+    free(losses);
+    free(order);
+    return ok;
+}
+
+//
+// exhaustive search over the stage settings
+//
+
+// frequencies per step of the last product, the loss is checked against the best after each
+#define STAGE_SEARCH_BLOCK_SIZE 256
+
+struct Stage_Search {
+    struct Simulation_State sim_state; // the grid, t_result / s_result of the combination in flight
+    struct Optimization_Goal_Plan plan;
+    double *goal_losses;
+    size_t n_stages;
+    size_t *stage_index; // position of the stages in the cascade
+    size_t *n_settings;
+    double ***stage_t; // [stage][setting] 8 planes of n_frequencies
+    double **segments; // [0 .. n_stages] passive products before, between and after the stages, NULL is identity
+    double **levels; // [stage] product up to and including the segment after it, n_stages - 1 of them
+    size_t *settings; // combination in flight
+    size_t *best_settings;
+    double best_loss;
+    size_t combinations;
+};
+
+static struct Complex_2x2_SoA stage_search_soa(const struct Stage_Search *search, double *block, size_t offset) {
+    struct Complex_2x2_SoA soa;
+    size_t n_f = search->sim_state.n_frequencies;
+    soa.r11 = &block[0 * n_f + offset]; soa.r12 = &block[1 * n_f + offset];
+    soa.r21 = &block[2 * n_f + offset]; soa.r22 = &block[3 * n_f + offset];
+    soa.i11 = &block[4 * n_f + offset]; soa.i12 = &block[5 * n_f + offset];
+    soa.i21 = &block[6 * n_f + offset]; soa.i22 = &block[7 * n_f + offset];
+    return soa;
+}
+
+// loss of the combination with the last stage at its setting, prefix is the product of everything before it
+static void stage_search_leaf(struct Stage_Search *search, double *prefix) {
+    struct Simulation_State *sim_state = &search->sim_state;
+    size_t n_f = sim_state->n_frequencies;
+    size_t last = search->n_stages - 1;
+    double *t_stage = search->stage_t[last][search->settings[last]];
+    double *t_after = search->segments[search->n_stages];
+    for (size_t g = 0; g < search->plan.goal_count; g++) search->goal_losses[g] = 0.0;
+    search->combinations++;
+
+    double loss = 0.0;
+    for (size_t offset = 0; offset < n_f; offset += STAGE_SEARCH_BLOCK_SIZE) {
+        size_t count = min(STAGE_SEARCH_BLOCK_SIZE, n_f - offset);
+        struct Complex_2x2_SoA t_f = circuit_soa_offset(&sim_state->t_result, offset);
+        struct Complex_2x2_SoA p = stage_search_soa(search, prefix, offset);
+        struct Complex_2x2_SoA t = stage_search_soa(search, t_stage, offset);
+        circuit_multiply_t_soa(&t_f, &p, &t, count);
+        if (t_after) {
+            struct Complex_2x2_SoA a = stage_search_soa(search, t_after, offset);
+            circuit_multiply_t_soa(&t_f, &t_f, &a, count);
+        }
+        circuit_simulation_finish_results(sim_state, offset, count);
+        circuit_optimizer_goal_plan_accumulate(&search->plan, offset, offset + count, search->goal_losses);
+        loss = circuit_optimizer_goal_plan_total(&search->plan, search->goal_losses);
+        if (loss >= search->best_loss) return; // the rest can only add to it
+    }
+
+    search->best_loss = loss;
+    memcpy(search->best_settings, search->settings, sizeof(size_t) * search->n_stages);
+}
+
+// all settings of stage depth and the ones after it, prefix is the product of everything before it
+static void stage_search_level(struct Stage_Search *search, size_t depth, double *prefix) {
+    if (depth == search->n_stages - 1) {
+        for (size_t x = 0; x < search->n_settings[depth]; x++) {
+            search->settings[depth] = x;
+            stage_search_leaf(search, prefix);
+        }
+        return;
+    }
+
+    size_t n_f = search->sim_state.n_frequencies;
+    double *level = search->levels[depth];
+    double *t_after = search->segments[depth + 1];
+    struct Complex_2x2_SoA l = stage_search_soa(search, level, 0);
+    struct Complex_2x2_SoA p = stage_search_soa(search, prefix, 0);
+    for (size_t x = 0; x < search->n_settings[depth]; x++) {
+        search->settings[depth] = x;
+        struct Complex_2x2_SoA t = stage_search_soa(search, search->stage_t[depth][x], 0);
+        circuit_multiply_t_soa(&l, &p, &t, n_f);
+        if (t_after) {
+            struct Complex_2x2_SoA a = stage_search_soa(search, t_after, 0);
+            circuit_multiply_t_soa(&l, &l, &a, n_f);
+        }
+        stage_search_level(search, depth + 1, level);
+    }
+}
+
+// product of the lumped components first .. end - 1, T_in is put in front of the first segment and
+// T_out behind the last one. NULL if there is nothing in between.
+static double *stage_search_segment(struct Stage_Search *search, size_t first, size_t end) {
+    struct Simulation_State *sim_state = &search->sim_state;
+    size_t n = sim_state->n_components;
+    size_t n_f = sim_state->n_frequencies;
+    const struct Complex_2x2_SoA **ts = malloc(sizeof(*ts) * (n + 2));
+    if (!ts) return NULL;
+    size_t n_t = 0;
+    if (first == 0) ts[n_t++] = &sim_state->t_prefix[0];
+    for (size_t k = first; k < end; k++) ts[n_t++] = &sim_state->intermediate_states[k].t;
+    if (end == n) ts[n_t++] = &sim_state->t_suffix[n];
+
+    double *block = NULL;
+    if (n_t > 0) block = malloc(sizeof(double) * 8 * n_f);
+    if (block) {
+        struct Complex_2x2_SoA t = stage_search_soa(search, block, 0);
+        circuit_cascade_t_soa(&t, ts, n_t, 0, n_f);
+    }
+    free(ts);
+    return block;
+}
+
+static void stage_search_destroy(struct Stage_Search *search) {
+    for (size_t j = 0; search->stage_t && j < search->n_stages; j++) {
+        for (size_t x = 0; search->stage_t[j] && x < search->n_settings[j]; x++) free(search->stage_t[j][x]);
+        free(search->stage_t[j]);
+    }
+    for (size_t j = 0; search->segments && j <= search->n_stages; j++) free(search->segments[j]);
+    for (size_t j = 0; search->levels && j + 1 < search->n_stages; j++) free(search->levels[j]);
+    free(search->stage_t);
+    free(search->segments);
+    free(search->levels);
+    free(search->stage_index);
+    free(search->n_settings);
+    free(search->settings);
+    free(search->best_settings);
+    free(search->goal_losses);
+    circuit_optimizer_goal_plan_destroy(&search->plan);
+    circuit_simulation_destroy(&search->sim_state);
+}
+
+bool circuit_optimizer_stage_settings_search(struct Circuit_Component *component_cascade, size_t n_components,
+        const struct Simulation_Settings *sim_settings, const struct Optimization_Goal *goals, size_t goal_count,
+        double *best_loss, size_t *combinations) {
+    struct Stage_Search search = {0};
+    size_t n = n_components;
+
+    // the initial circuit gives the first bound and the T of the lumped components
+    bool ok = circuit_simulation_setup(component_cascade, n, &search.sim_state, sim_settings) &&
+        circuit_simulation_do(&search.sim_state, false) &&
+        circuit_optimizer_goal_plan_compile(&search.plan, goals, goal_count, &search.sim_state);
+    search.goal_losses = calloc(max(goal_count, 1), sizeof(double));
+    ok = ok && search.goal_losses;
+    if (ok) {
+        circuit_optimizer_goal_plan_accumulate(&search.plan, 0, search.sim_state.n_frequencies, search.goal_losses);
+        search.best_loss = circuit_optimizer_goal_plan_total(&search.plan, search.goal_losses);
+    }
+
+    for (size_t k = 0; k < n; k++) {
+        if (component_cascade[k].kind == CIRCUIT_COMPONENT_STAGE) search.n_stages++;
+    }
+    size_t m = search.n_stages;
+    search.stage_index = malloc(sizeof(size_t) * max(m, 1));
+    search.n_settings = malloc(sizeof(size_t) * max(m, 1));
+    search.settings = malloc(sizeof(size_t) * max(m, 1));
+    search.best_settings = malloc(sizeof(size_t) * max(m, 1));
+    search.stage_t = calloc(max(m, 1), sizeof(*search.stage_t));
+    search.segments = calloc(m + 1, sizeof(*search.segments));
+    search.levels = calloc(max(m, 1), sizeof(*search.levels));
+    ok = ok && search.stage_index && search.n_settings && search.settings && search.best_settings &&
+        search.stage_t && search.segments && search.levels;
+
+    size_t n_f = search.sim_state.n_frequencies;
+    for (size_t k = 0, j = 0; ok && k < n; k++) {
+        if (component_cascade[k].kind != CIRCUIT_COMPONENT_STAGE) continue;
+        search.stage_index[j] = k;
+        search.n_settings[j] = component_cascade[k].as.stage.n_settings;
+        search.best_settings[j] = component_cascade[k].as.stage.selected_setting;
+        search.stage_t[j] = calloc(search.n_settings[j], sizeof(**search.stage_t));
+        ok = search.stage_t[j] != NULL;
+        for (size_t x = 0; ok && x < search.n_settings[j]; x++) {
+            struct Circuit_Component stage = component_cascade[k];
+            stage.as.stage.selected_setting = x;
+            search.stage_t[j][x] = malloc(sizeof(double) * 8 * n_f);
+            ok = search.stage_t[j][x] != NULL;
+            if (!ok) break;
+            struct Complex_2x2_SoA t = stage_search_soa(&search, search.stage_t[j][x], 0);
+            circuit_interpolate_sparams_circuit_component(&stage, search.sim_state.frequencies, &t, n_f);
+            calc_t_from_s_array(&t, &t, n_f);
+        }
+        j++;
+    }
+    for (size_t j = 0; ok && j <= m && m > 0; j++) {
+        size_t first = j == 0 ? 0 : search.stage_index[j - 1] + 1;
+        size_t end = j == m ? n : search.stage_index[j];
+        search.segments[j] = stage_search_segment(&search, first, end);
+        // the first and the last segment always hold T_in resp. T_out
+        if ((j == 0 || j == m) && !search.segments[j]) ok = false;
+    }
+    for (size_t j = 0; ok && j + 1 < m; j++) {
+        search.levels[j] = malloc(sizeof(double) * 8 * n_f);
+        ok = search.levels[j] != NULL;
+    }
+    if (!ok) {
+        printf("ERROR: circuit_optimizer_stage_settings_search(): could not set up\n");
+        stage_search_destroy(&search);
+        return false;
+    }
+
+    if (m > 0) stage_search_level(&search, 0, search.segments[0]);
+    else search.combinations = 1;
+
+    // the reported loss is the one of a plain simulation of the result
+    for (size_t j = 0; j < m; j++) {
+        component_cascade[search.stage_index[j]].as.stage.selected_setting = search.best_settings[j];
+        circuit_simulation_mark_dirty(&search.sim_state, search.stage_index[j]);
+    }
+    if (m > 0) {
+        circuit_simulation_do(&search.sim_state, false);
+        for (size_t g = 0; g < goal_count; g++) search.goal_losses[g] = 0.0;
+        circuit_optimizer_goal_plan_accumulate(&search.plan, 0, n_f, search.goal_losses);
+        search.best_loss = circuit_optimizer_goal_plan_total(&search.plan, search.goal_losses);
+    }
+    if (best_loss) *best_loss = search.best_loss;
+    if (combinations) *combinations = search.combinations;
+    stage_search_destroy(&search);
+    return true;
+}
+
+//
+// parallel multi-start search
+//
+
+#define OPTIMIZER_PARALLEL_SYNC_INTERVAL 256
+
+// one per search, a multiple of the cache line size so the searches never share a line
+struct Parallel_Search {
+    _Alignas(UTI_CACHE_LINE_SIZE) struct Optimizer_State state;
+    struct Simulation_State sim_state;
+    struct Uti_Rng rng;
+    struct Circuit_Component *cascade;
+    bool done;
+};
+
+struct Parallel_Search_Job {
+    struct Parallel_Search *searches;
+    const struct Simulation_Settings *settings;
+    const struct Optimization_Goal *goals;
+    size_t goal_count;
+    size_t n_components;
+    size_t rounds;
+};
+
+// runs the next rounds of one search, only touches the memory of that search
+static void parallel_search_rounds(void *context, size_t search_index) {
+    struct Parallel_Search_Job *job = context;
+    struct Parallel_Search *search = &job->searches[search_index];
+    for (size_t i = 0; i < job->rounds && !search->done; i++) {
+        search->done = circuit_optimizer_update_one_round(&search->state, &search->sim_state, job->settings,
+            job->goals, job->goal_count, search->cascade, job->n_components);
+    }
+}
+
+bool circuit_optimizer_parallel_search(struct Circuit_Component *component_cascade, size_t n_components,
+        const struct Simulation_Settings *sim_settings, const struct Optimization_Goal *goals, size_t goal_count,
+        size_t max_iterations, size_t n_searches, size_t sync_interval, uint64_t seed, double *best_loss) {
+    if (n_searches == 0) n_searches = 1;
+    if (sync_interval == 0) sync_interval = OPTIMIZER_PARALLEL_SYNC_INTERVAL;
+
+    struct Uti_Block block = {0};
+    if (!uti_block_alloc(&block, sizeof(struct Parallel_Search) * n_searches, false)) {
+        printf("ERROR: circuit_optimizer_parallel_search(): out of memory\n");
+        return false;
+    }
+    struct Parallel_Search *searches = block.memory;
+    memset(searches, 0, sizeof(*searches) * n_searches);
+
+    for (size_t i = 0; i < n_searches; i++) {
+        struct Parallel_Search *search = &searches[i];
+        uti_rng_seed(&search->rng, seed, i);
+        search->cascade = malloc(sizeof(*component_cascade) * n_components);
+        memcpy(search->cascade, component_cascade, sizeof(*component_cascade) * n_components);
+        // multi-start: every search but the first one starts somewhere else
+        if (i > 0) {
+            for (size_t j = 0; j < n_components; j++) {
+                circuit_random_tweak_cascade_rng(search->cascade, n_components, &search->rng);
+            }
+        }
+        circuit_optimizer_setup(&search->state, max_iterations, search->cascade, n_components);
+        search->state.print_progress = false;
+        search->state.rng = &search->rng;
+        search->sim_state.single_threaded = true;
+    }
+
+    struct Uti_Thread_Pool *pool = uti_thread_pool_create(min(n_searches, uti_cpu_count()));
+    struct Parallel_Search_Job job = {
+        .searches = searches,
+        .settings = sim_settings,
+        .goals = goals,
+        .goal_count = goal_count,
+        .n_components = n_components,
+        .rounds = sync_interval,
+    };
+
+    size_t best_index = 0;
+    while (true) {
+        // the job index is the search index, so it does not matter which thread runs a search
+        if (pool) {
+            uti_thread_pool_run(pool, parallel_search_rounds, &job, n_searches);
+        } else {
+            for (size_t i = 0; i < n_searches; i++) parallel_search_rounds(&job, i);
+        }
+
+        // lowest loss wins, ties go to the lowest index
+        bool all_done = true;
+        best_index = 0;
+        for (size_t i = 0; i < n_searches; i++) {
+            if (searches[i].state.best_total_loss_value < searches[best_index].state.best_total_loss_value) best_index = i;
+            all_done = all_done && searches[i].done;
+        }
+        struct Optimizer_State *best = &searches[best_index].state;
+        if (all_done || best->best_total_loss_value <= 1e-15) break;
+
+        // share the global best, the searches go on with their own random streams
+        for (size_t i = 0; i < n_searches; i++) {
+            struct Optimizer_State *state = &searches[i].state;
+            if (state->best_total_loss_value <= best->best_total_loss_value) continue;
+            memcpy(state->best_component_cascade, best->best_component_cascade, sizeof(*component_cascade) * n_components);
+            state->best_total_loss_value = best->best_total_loss_value;
+            state->simulation_prepared = false;
+        }
+    }
+
+    memcpy(component_cascade, searches[best_index].state.best_component_cascade, sizeof(*component_cascade) * n_components);
+    if (best_loss) *best_loss = searches[best_index].state.best_total_loss_value;
+
+    uti_thread_pool_destroy(pool);
+    for (size_t i = 0; i < n_searches; i++) {
+        circuit_simulation_destroy(&searches[i].sim_state);
+        circuit_optimizer_destroy(&searches[i].state);
+        free(searches[i].cascade);
+    }
+    uti_block_free(&block);
+    return true;
+}
+
+//
+// background optimizer
+//
+
+#define OPTIMIZER_WORKER_PUBLISH_INTERVAL 256
+#define OPTIMIZER_SNAPSHOT_FRESH 4u // flag next to the slot index in middle_slot
+
+struct Optimizer_Worker {
+    pthread_t thread;
+    bool thread_started;
+
+    // private to the worker thread
+    struct Optimizer_State state;
+    struct Simulation_State sim_state;
+    struct Simulation_Settings settings;
+    struct Optimization_Goal *goals;
+    size_t goal_count;
+    struct Circuit_Component *cascade;
+    size_t n_components;
+
+    // triple buffer: the worker writes slot back_slot, the reader reads slot front_slot and the
+    // third one is handed over with an atomic exchange of middle_slot, so nobody ever waits
+    struct Optimizer_Snapshot snapshots[3];
+    unsigned int back_slot;
+    unsigned int front_slot;
+    atomic_uint middle_slot;
+
+    atomic_bool cancel;
+    atomic_bool paused;
+    pthread_mutex_t pause_mutex;
+    pthread_cond_t pause_changed;
+};
+
+static void optimizer_worker_publish(struct Optimizer_Worker *worker, bool finished) {
+    struct Optimizer_Snapshot *snapshot = &worker->snapshots[worker->back_slot];
+    memcpy(snapshot->cascade, worker->state.best_component_cascade, sizeof(*snapshot->cascade) * worker->n_components);
+    snapshot->best_loss = worker->state.best_total_loss_value;
+    snapshot->iteration = worker->state.iteration;
+    snapshot->finished = finished;
+    unsigned int old = atomic_exchange(&worker->middle_slot, worker->back_slot | OPTIMIZER_SNAPSHOT_FRESH);
+    worker->back_slot = old & ~OPTIMIZER_SNAPSHOT_FRESH;
+}
+
+static void *optimizer_worker_thread(void *arg) {
+    struct Optimizer_Worker *worker = arg;
+
+    while (!atomic_load(&worker->cancel)) {
+        if (atomic_load(&worker->paused)) {
+            pthread_mutex_lock(&worker->pause_mutex);
+            while (atomic_load(&worker->paused) && !atomic_load(&worker->cancel)) {
+                pthread_cond_wait(&worker->pause_changed, &worker->pause_mutex);
+            }
+            pthread_mutex_unlock(&worker->pause_mutex);
+            continue;
+        }
+
+        double best_before = worker->state.best_total_loss_value;
+        bool done = circuit_optimizer_update_one_round(&worker->state, &worker->sim_state, &worker->settings,
+            worker->goals, worker->goal_count, worker->cascade, worker->n_components);
+        if (done) break;
+
+        if (worker->state.best_total_loss_value < best_before || worker->state.iteration % OPTIMIZER_WORKER_PUBLISH_INTERVAL == 0) {
+            optimizer_worker_publish(worker, false);
+        }
+    }
+
+    optimizer_worker_publish(worker, true);
+    return NULL;
+}
+
+struct Optimizer_Worker *circuit_optimizer_worker_start(const struct Circuit_Component *component_cascade, size_t n_components,
+        const struct Simulation_Settings *sim_settings, const struct Optimization_Goal *goals, size_t goal_count, size_t max_iterations) {
+    struct Optimizer_Worker *worker = calloc(1, sizeof(*worker));
+    if (!worker) {
+        printf("ERROR: circuit_optimizer_worker_start(): out of memory\n");
+        return NULL;
+    }
+
+    worker->n_components = n_components;
+    worker->settings = *sim_settings;
+    worker->goal_count = goal_count;
+    worker->goals = malloc(sizeof(*worker->goals) * goal_count);
+    memcpy(worker->goals, goals, sizeof(*worker->goals) * goal_count);
+    worker->cascade = malloc(sizeof(*worker->cascade) * n_components);
+    memcpy(worker->cascade, component_cascade, sizeof(*worker->cascade) * n_components);
+    for (size_t i = 0; i < 3; i++) {
+        worker->snapshots[i].cascade = malloc(sizeof(*worker->snapshots[i].cascade) * n_components);
+        memcpy(worker->snapshots[i].cascade, component_cascade, sizeof(*worker->snapshots[i].cascade) * n_components);
+        worker->snapshots[i].n_components = n_components;
+        worker->snapshots[i].best_loss = DBL_MAX;
+    }
+    worker->back_slot = 0;
+    worker->front_slot = 1;
+    atomic_init(&worker->middle_slot, 2);
+    atomic_init(&worker->cancel, false);
+    atomic_init(&worker->paused, false);
+    pthread_mutex_init(&worker->pause_mutex, NULL);
+    pthread_cond_init(&worker->pause_changed, NULL);
+
+    circuit_optimizer_setup(&worker->state, max_iterations, worker->cascade, n_components);
+    worker->state.print_progress = false;
+
+    if (pthread_create(&worker->thread, NULL, optimizer_worker_thread, worker) != 0) {
+        printf("ERROR: circuit_optimizer_worker_start(): could not start the optimizer thread\n");
+        circuit_optimizer_worker_destroy(worker);
+        return NULL;
+    }
+    worker->thread_started = true;
+    return worker;
+}
+
+void circuit_optimizer_worker_pause(struct Optimizer_Worker *worker, bool pause) {
+    pthread_mutex_lock(&worker->pause_mutex);
+    atomic_store(&worker->paused, pause);
+    pthread_cond_broadcast(&worker->pause_changed);
+    pthread_mutex_unlock(&worker->pause_mutex);
+}
+
+void circuit_optimizer_worker_cancel(struct Optimizer_Worker *worker) {
+    pthread_mutex_lock(&worker->pause_mutex);
+    atomic_store(&worker->cancel, true);
+    pthread_cond_broadcast(&worker->pause_changed);
+    pthread_mutex_unlock(&worker->pause_mutex);
+}
+
+const struct Optimizer_Snapshot *circuit_optimizer_worker_snapshot(struct Optimizer_Worker *worker, bool *is_new) {
+    bool fresh = atomic_load(&worker->middle_slot) & OPTIMIZER_SNAPSHOT_FRESH;
+    if (fresh) {
+        unsigned int old = atomic_exchange(&worker->middle_slot, worker->front_slot);
+        worker->front_slot = old & ~OPTIMIZER_SNAPSHOT_FRESH;
+    }
+    if (is_new) *is_new = fresh;
+    return &worker->snapshots[worker->front_slot];
+}
+
+void circuit_optimizer_worker_destroy(struct Optimizer_Worker *worker) {
+    if (!worker) return;
+    if (worker->thread_started) {
+        circuit_optimizer_worker_cancel(worker);
+        pthread_join(worker->thread, NULL);
+    }
+    circuit_simulation_destroy(&worker->sim_state);
+    circuit_optimizer_destroy(&worker->state);
+    for (size_t i = 0; i < 3; i++) free(worker->snapshots[i].cascade);
+    free(worker->cascade);
+    free(worker->goals);
+    pthread_cond_destroy(&worker->pause_changed);
+    pthread_mutex_destroy(&worker->pause_mutex);
+    free(worker);
+}
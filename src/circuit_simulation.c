@@ -1,64 +1,19 @@
 #include "circuit.h"
+#include "uti.h"
 
 #include "stdlib.h"
 #include "assert.h"
 #include "string.h"
 #include "stdio.h"
+#include "float.h"
+#include "pthread.h"
 
 void calc_t_from_s_array(struct Complex_2x2_SoA *s, struct Complex_2x2_SoA *t_out, size_t length) {
-    for (size_t i = 0; i < length; i++) {
-
-        struct Complex s1[2][2];
-        s1[0][0].r = s->r11[i];
-        s1[0][1].r = s->r12[i];
-        s1[1][0].r = s->r21[i];
-        s1[1][1].r = s->r22[i];
-
-        s1[0][0].i = s->i11[i];
-        s1[0][1].i = s->i12[i];
-        s1[1][0].i = s->i21[i];
-        s1[1][1].i = s->i22[i];
-
-        struct Mma_Complex_2x2 t = calc_t_from_s(s1);
-
-        t_out->r11[i] = t.v[0][0].r;
-        t_out->r12[i] = t.v[0][1].r;
-        t_out->r21[i] = t.v[1][0].r;
-        t_out->r22[i] = t.v[1][1].r;
-
-        t_out->i11[i] = t.v[0][0].i;
-        t_out->i12[i] = t.v[0][1].i;
-        t_out->i21[i] = t.v[1][0].i;
-        t_out->i22[i] = t.v[1][1].i;
-    }
+    circuit_t_from_s_soa(t_out, s, length);
 }
 
 void calc_s_from_t_array(struct Complex_2x2_SoA *t, struct Complex_2x2_SoA *s_out, size_t length) {
-    for (size_t i = 0; i < length; i++) {
-
-        struct Complex t1[2][2];
-        t1[0][0].r = t->r11[i];
-        t1[0][1].r = t->r12[i];
-        t1[1][0].r = t->r21[i];
-        t1[1][1].r = t->r22[i];
-
-        t1[0][0].i = t->i11[i];
-        t1[0][1].i = t->i12[i];
-        t1[1][0].i = t->i21[i];
-        t1[1][1].i = t->i22[i];
-
-        struct Mma_Complex_2x2 s = calc_s_from_t(t1);
-
-        s_out->r11[i] = s.v[0][0].r;
-        s_out->r12[i] = s.v[0][1].r;
-        s_out->r21[i] = s.v[1][0].r;
-        s_out->r22[i] = s.v[1][1].r;
-
-        s_out->i11[i] = s.v[0][0].i;
-        s_out->i12[i] = s.v[0][1].i;
-        s_out->i21[i] = s.v[1][0].i;
-        s_out->i22[i] = s.v[1][1].i;
-    }
+    circuit_s_from_t_soa(s_out, t, length);
 }
 
 void calc_mu_and_mu_prime(struct Complex s11, struct Complex s12, struct Complex s21, struct Complex s22, double* mu_out, double* mu_prime_out) {
@@ -137,10 +92,7 @@ bool circuit_interpolate_sparams_circuit_component(struct Circuit_Component *com
     case CIRCUIT_COMPONENT_STAGE: {
         struct Circuit_Component_Stage* stage = &component->as.stage;
         struct S2P_Info *info = &stage->s2p_infos[stage->selected_setting];
-        mma_spline_cubic_natural_complex_2(info->freq, info->s11, info->data_length, s_out->r11, s_out->i11, frequencies, n_frequencies);
-        mma_spline_cubic_natural_complex_2(info->freq, info->s12, info->data_length, s_out->r12, s_out->i12, frequencies, n_frequencies);
-        mma_spline_cubic_natural_complex_2(info->freq, info->s21, info->data_length, s_out->r21, s_out->i21, frequencies, n_frequencies);
-        mma_spline_cubic_natural_complex_2(info->freq, info->s22, info->data_length, s_out->r22, s_out->i22, frequencies, n_frequencies);
+        mma_spline_cubic_natural_2x2_soa_eval(info->freq, &info->s, &info->s_a, &info->s_b, info->data_length, s_out, frequencies, n_frequencies);
     } break;
 
     case CIRCUIT_COMPONENT_RESISTOR_IDEAL_PARALLEL: {
@@ -203,6 +155,237 @@ bool circuit_interpolate_sparams_circuit_component(struct Circuit_Component *com
     return true;
 }
 
+// Closed form T of the lumped components, without the detour over S.
+// series impedance z = Z / Z0          shunt admittance y = Y Z0
+// T = | 1 + z/2   -z/2    |            T = | 1 + y/2   y/2     |
+//     | z/2       1 - z/2 |                | -y/2      1 - y/2 |
+static inline void store_series_t(struct Complex_2x2_SoA *t_out, size_t i, double zr, double zi) {
+    double hr = 0.5 * zr;
+    double hi = 0.5 * zi;
+    t_out->r11[i] = 1.0 + hr; t_out->i11[i] = hi;
+    t_out->r12[i] = -hr;      t_out->i12[i] = -hi;
+    t_out->r21[i] = hr;       t_out->i21[i] = hi;
+    t_out->r22[i] = 1.0 - hr; t_out->i22[i] = -hi;
+}
+
+static inline void store_shunt_t(struct Complex_2x2_SoA *t_out, size_t i, double yr, double yi) {
+    double hr = 0.5 * yr;
+    double hi = 0.5 * yi;
+    t_out->r11[i] = 1.0 + hr; t_out->i11[i] = hi;
+    t_out->r12[i] = hr;       t_out->i12[i] = hi;
+    t_out->r21[i] = -hr;      t_out->i21[i] = -hi;
+    t_out->r22[i] = 1.0 - hr; t_out->i22[i] = -hi;
+}
+
+bool circuit_t_params_circuit_component(struct Circuit_Component *component, double *frequencies, struct Complex_2x2_SoA *t_out, size_t n_frequencies) {
+    switch (component->kind) {
+    case CIRCUIT_COMPONENT_RESISTOR_IDEAL: {
+        double z = component->as.resistor_ideal.R / Z0;
+        for (size_t i = 0; i < n_frequencies; i++) store_series_t(t_out, i, z, 0.0);
+    } break;
+
+    case CIRCUIT_COMPONENT_CAPACITOR_IDEAL: {
+        // z = -j / (omega C Z0)
+        double k = -1.0 / (component->as.capacitor_ideal.C * Z0);
+        for (size_t i = 0; i < n_frequencies; i++) {
+            double omega = fmax(2.0 * M_PI * frequencies[i], OMEGA_ZERO_SNAP);
+            store_series_t(t_out, i, 0.0, k / omega);
+        }
+    } break;
+
+    case CIRCUIT_COMPONENT_INDUCTOR_IDEAL: {
+        // z = j omega L / Z0
+        double k = component->as.inductor_ideal.L / Z0;
+        for (size_t i = 0; i < n_frequencies; i++) {
+            double omega = fmax(2.0 * M_PI * frequencies[i], OMEGA_ZERO_SNAP);
+            store_series_t(t_out, i, 0.0, k * omega);
+        }
+    } break;
+
+    case CIRCUIT_COMPONENT_RESISTOR_IDEAL_PARALLEL: {
+        double y = Z0 / component->as.resistor_ideal_parallel.R;
+        for (size_t i = 0; i < n_frequencies; i++) store_shunt_t(t_out, i, y, 0.0);
+    } break;
+
+    case CIRCUIT_COMPONENT_CAPACITOR_IDEAL_PARALLEL: {
+        // y = j omega C Z0
+        double k = component->as.capacitor_ideal_parallel.C * Z0;
+        for (size_t i = 0; i < n_frequencies; i++) {
+            double omega = fmax(2.0 * M_PI * frequencies[i], OMEGA_ZERO_SNAP);
+            store_shunt_t(t_out, i, 0.0, k * omega);
+        }
+    } break;
+
+    case CIRCUIT_COMPONENT_INDUCTOR_IDEAL_PARALLEL: {
+        // y = -j Z0 / (omega L)
+        double k = -Z0 / component->as.inductor_ideal_parallel.L;
+        for (size_t i = 0; i < n_frequencies; i++) {
+            double omega = fmax(2.0 * M_PI * frequencies[i], OMEGA_ZERO_SNAP);
+            store_shunt_t(t_out, i, 0.0, k / omega);
+        }
+    } break;
+
+    case CIRCUIT_COMPONENT_STAGE:
+        // measured S-parameters, no closed form
+        return false;
+
+    default:
+        assert(false && "implement me please (T of new kind)");
+        return false;
+    }
+
+    return true;
+}
+
+// point the 8 planes of the SoA into a block of 8 * n doubles
+static void soa_from_block(struct Complex_2x2_SoA *soa, double *block, size_t n) {
+    soa->r11 = &block[0 * n];
+    soa->r12 = &block[1 * n];
+    soa->r21 = &block[2 * n];
+    soa->r22 = &block[3 * n];
+    soa->i11 = &block[4 * n];
+    soa->i12 = &block[5 * n];
+    soa->i21 = &block[6 * n];
+    soa->i22 = &block[7 * n];
+}
+
+// Fill a T-SoA with a constant impedance step
+// T = 1/sqrt(1-G^2) * | 1  G |
+//                     | G  1 |
+static void fill_impedance_step_t(struct Complex_2x2_SoA *t_out, double z_from, double z_to, size_t n_f) {
+    // Calculate Reflection Coeff Gamma
+    // Note: Standard definition G = (Z_load - Z0) / (Z_load + Z0)
+    double gamma = (z_to - z_from) / (z_to + z_from);
+
+    // T-param factor
+    double factor = 1.0 / sqrt(1.0 - gamma * gamma);
+    double t11_22 = factor * 1.0;
+    double t12_21 = factor * gamma;
+
+    for (size_t i = 0; i < n_f; i++) {
+        t_out->r11[i] = t11_22;
+        t_out->r22[i] = t11_22;
+        t_out->r12[i] = t12_21;
+        t_out->r21[i] = t12_21;
+
+        // Resistive steps have 0 imaginary part
+        t_out->i11[i] = 0; t_out->i22[i] = 0;
+        t_out->i12[i] = 0; t_out->i21[i] = 0;
+    }
+}
+
+// frequencies per job of the worker pool, all T planes of a chunk stay in L1/L2
+#define SIMULATION_CHUNK_SIZE 256
+
+static struct Uti_Thread_Pool *simulation_thread_pool = NULL;
+static size_t simulation_thread_count = 0; // 0 means one thread per cpu
+static pthread_mutex_t simulation_thread_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void circuit_simulation_set_thread_count(size_t n_threads) {
+    pthread_mutex_lock(&simulation_thread_pool_mutex);
+    uti_thread_pool_destroy(simulation_thread_pool);
+    simulation_thread_pool = NULL;
+    simulation_thread_count = n_threads;
+    pthread_mutex_unlock(&simulation_thread_pool_mutex);
+}
+
+// started on first use and kept alive for all following simulations
+static struct Uti_Thread_Pool *simulation_get_thread_pool(void) {
+    pthread_mutex_lock(&simulation_thread_pool_mutex);
+    if (!simulation_thread_pool) {
+        size_t n_threads = simulation_thread_count > 0 ? simulation_thread_count : uti_cpu_count();
+        simulation_thread_pool = uti_thread_pool_create(n_threads);
+    }
+    struct Uti_Thread_Pool *pool = simulation_thread_pool;
+    pthread_mutex_unlock(&simulation_thread_pool_mutex);
+    return pool;
+}
+
+size_t circuit_simulation_thread_count(void) {
+    struct Uti_Thread_Pool *pool = simulation_get_thread_pool();
+    return pool ? uti_thread_pool_thread_count(pool) : 1;
+}
+
+// the chunks on the pool, or one after the other if single threaded or the pool could not be started
+static void simulation_run_chunks(bool single_threaded, Uti_Job_Function chunk, void *job, size_t n_chunks) {
+    struct Uti_Thread_Pool *pool = single_threaded ? NULL : simulation_get_thread_pool();
+    if (pool) {
+        uti_thread_pool_run(pool, chunk, job, n_chunks);
+    } else {
+        for (size_t i = 0; i < n_chunks; i++) chunk(job, i);
+    }
+}
+
+static bool simulation_huge_pages = false;
+
+void circuit_simulation_set_huge_pages(bool huge_pages) {
+    simulation_huge_pages = huge_pages;
+}
+
+static size_t arena_round(size_t size) {
+    return (size + UTI_CACHE_LINE_SIZE - 1) / UTI_CACHE_LINE_SIZE * UTI_CACHE_LINE_SIZE;
+}
+
+// the planes of the SoAs are padded to whole cache lines, so every plane starts 64 byte aligned
+static size_t simulation_plane_length(size_t n_frequencies) {
+    return arena_round(n_frequencies * sizeof(double)) / sizeof(double);
+}
+
+// Layout of the arena, every array starts on a cache line:
+//   frequencies, stab_mu, stab_mu_prime, 4 plottables, s_result, t_result, candidate S and T,
+//   S and T of the components, t_prefix and t_suffix planes, then the small bookkeeping arrays
+static size_t simulation_arena_size(size_t n_components, size_t n_frequencies) {
+    size_t plane = simulation_plane_length(n_frequencies) * sizeof(double);
+    size_t n_soa = 4 + 2 * n_components + 2 * (n_components + 1);
+    return 3 * plane
+        + 4 * 2 * plane
+        + n_soa * 8 * plane
+        + arena_round(sizeof(struct Simulation_Component_Intermediate_State) * n_components)
+        + arena_round(sizeof(bool) * n_components)
+        + 2 * arena_round(sizeof(struct Complex_2x2_SoA) * (n_components + 1))
+        + arena_round(sizeof(const struct Complex_2x2_SoA *) * (n_components + 2));
+}
+
+static void *arena_take(char **next, size_t size) {
+    void *result = *next;
+    *next += arena_round(size);
+    return result;
+}
+
+static void simulation_arena_carve(struct Simulation_State *sim_state, size_t n_components, size_t n_frequencies) {
+    size_t plane_length = simulation_plane_length(n_frequencies);
+    size_t plane = plane_length * sizeof(double);
+    char *next = sim_state->arena.memory;
+
+    sim_state->frequencies = arena_take(&next, plane);
+    sim_state->stab_mu = arena_take(&next, plane);
+    sim_state->stab_mu_prime = arena_take(&next, plane);
+    sim_state->s11_result_plottable = arena_take(&next, 2 * plane);
+    sim_state->s12_result_plottable = arena_take(&next, 2 * plane);
+    sim_state->s21_result_plottable = arena_take(&next, 2 * plane);
+    sim_state->s22_result_plottable = arena_take(&next, 2 * plane);
+    soa_from_block(&sim_state->s_result, arena_take(&next, 8 * plane), plane_length);
+    soa_from_block(&sim_state->t_result, arena_take(&next, 8 * plane), plane_length);
+    soa_from_block(&sim_state->candidate_state.s, arena_take(&next, 8 * plane), plane_length);
+    soa_from_block(&sim_state->candidate_state.t, arena_take(&next, 8 * plane), plane_length);
+
+    sim_state->intermediate_states = arena_take(&next, sizeof(*sim_state->intermediate_states) * n_components);
+    for (size_t i_comp = 0; i_comp < n_components; i_comp++) {
+        soa_from_block(&sim_state->intermediate_states[i_comp].s, arena_take(&next, 8 * plane), plane_length);
+        soa_from_block(&sim_state->intermediate_states[i_comp].t, arena_take(&next, 8 * plane), plane_length);
+    }
+    sim_state->t_prefix = arena_take(&next, sizeof(*sim_state->t_prefix) * (n_components + 1));
+    sim_state->t_suffix = arena_take(&next, sizeof(*sim_state->t_suffix) * (n_components + 1));
+    for (size_t i = 0; i < n_components + 1; i++) {
+        soa_from_block(&sim_state->t_prefix[i], arena_take(&next, 8 * plane), plane_length);
+        soa_from_block(&sim_state->t_suffix[i], arena_take(&next, 8 * plane), plane_length);
+    }
+    sim_state->dirty = arena_take(&next, sizeof(*sim_state->dirty) * n_components);
+    sim_state->t_chain = arena_take(&next, sizeof(*sim_state->t_chain) * (n_components + 2));
+
+    assert((size_t)(next - (char*)sim_state->arena.memory) == simulation_arena_size(n_components, n_frequencies));
+}
+
 bool circuit_simulation_setup(struct Circuit_Component *component_cascade, size_t n_components, struct Simulation_State *sim_state, const struct Simulation_Settings *settings) {
 
     size_t n_frequencies = settings->n_frequencies;
@@ -213,72 +396,54 @@ bool circuit_simulation_setup(struct Circuit_Component *component_cascade, size_
     sim_state->n_components = n_components;
     sim_state->n_frequencies = n_frequencies;
     sim_state->components_cascade = component_cascade;
+    sim_state->settings = *settings;
 
     /// START MALLOC BUSINESS
-    if (!sim_state->memory_initalized) {
-        sim_state->frequencies = malloc(sizeof(*sim_state->frequencies) * n_frequencies);
-        sim_state->s11_result_plottable = malloc(sizeof(*sim_state->s11_result_plottable) * n_frequencies);
-        sim_state->s12_result_plottable = malloc(sizeof(*sim_state->s12_result_plottable) * n_frequencies);
-        sim_state->s21_result_plottable = malloc(sizeof(*sim_state->s21_result_plottable) * n_frequencies);
-        sim_state->s22_result_plottable = malloc(sizeof(*sim_state->s22_result_plottable) * n_frequencies);
-        sim_state->stab_mu = malloc(sizeof(*sim_state->stab_mu) * n_frequencies);
-        sim_state->stab_mu_prime = malloc(sizeof(*sim_state->stab_mu_prime) * n_frequencies);
-        sim_state->s_result.r11 = malloc(8 * sizeof(*sim_state->s_result.r11) * sim_state->n_frequencies);
-        sim_state->s_result.r12 = &sim_state->s_result.r11[1 * sim_state->n_frequencies];
-        sim_state->s_result.r21 = &sim_state->s_result.r11[2 * sim_state->n_frequencies];
-        sim_state->s_result.r22 = &sim_state->s_result.r11[3 * sim_state->n_frequencies];
-        sim_state->s_result.i11 = &sim_state->s_result.r11[4 * sim_state->n_frequencies];
-        sim_state->s_result.i12 = &sim_state->s_result.r11[5 * sim_state->n_frequencies];
-        sim_state->s_result.i21 = &sim_state->s_result.r11[6 * sim_state->n_frequencies];
-        sim_state->s_result.i22 = &sim_state->s_result.r11[7 * sim_state->n_frequencies];
-
-        sim_state->t_result.r11 = malloc(8 * sizeof(*sim_state->t_result.r11) * sim_state->n_frequencies);
-        sim_state->t_result.r12 = &sim_state->t_result.r11[1 * sim_state->n_frequencies];
-        sim_state->t_result.r21 = &sim_state->t_result.r11[2 * sim_state->n_frequencies];
-        sim_state->t_result.r22 = &sim_state->t_result.r11[3 * sim_state->n_frequencies];
-        sim_state->t_result.i11 = &sim_state->t_result.r11[4 * sim_state->n_frequencies];
-        sim_state->t_result.i12 = &sim_state->t_result.r11[5 * sim_state->n_frequencies];
-        sim_state->t_result.i21 = &sim_state->t_result.r11[6 * sim_state->n_frequencies];
-        sim_state->t_result.i22 = &sim_state->t_result.r11[7 * sim_state->n_frequencies];
-        sim_state->intermediate_states = malloc(sizeof(*sim_state->intermediate_states) * n_components);
-        for (size_t i_comp = 0; i_comp < n_components; i_comp++) {
-            sim_state->intermediate_states[i_comp].s.r11 = malloc(8 * sizeof(*sim_state->intermediate_states[i_comp].s.r11) * sim_state->n_frequencies);
-            sim_state->intermediate_states[i_comp].s.r12 = &sim_state->intermediate_states[i_comp].s.r11[1 * sim_state->n_frequencies];
-            sim_state->intermediate_states[i_comp].s.r21 = &sim_state->intermediate_states[i_comp].s.r11[2 * sim_state->n_frequencies];
-            sim_state->intermediate_states[i_comp].s.r22 = &sim_state->intermediate_states[i_comp].s.r11[3 * sim_state->n_frequencies];
-            sim_state->intermediate_states[i_comp].s.i11 = &sim_state->intermediate_states[i_comp].s.r11[4 * sim_state->n_frequencies];
-            sim_state->intermediate_states[i_comp].s.i12 = &sim_state->intermediate_states[i_comp].s.r11[5 * sim_state->n_frequencies];
-            sim_state->intermediate_states[i_comp].s.i21 = &sim_state->intermediate_states[i_comp].s.r11[6 * sim_state->n_frequencies];
-            sim_state->intermediate_states[i_comp].s.i22 = &sim_state->intermediate_states[i_comp].s.r11[7 * sim_state->n_frequencies];
-            sim_state->intermediate_states[i_comp].t.r11 = malloc(8 * sizeof(*sim_state->intermediate_states[i_comp].t.r11) * sim_state->n_frequencies);
-            sim_state->intermediate_states[i_comp].t.r12 = &sim_state->intermediate_states[i_comp].t.r11[1 * sim_state->n_frequencies];
-            sim_state->intermediate_states[i_comp].t.r21 = &sim_state->intermediate_states[i_comp].t.r11[2 * sim_state->n_frequencies];
-            sim_state->intermediate_states[i_comp].t.r22 = &sim_state->intermediate_states[i_comp].t.r11[3 * sim_state->n_frequencies];
-            sim_state->intermediate_states[i_comp].t.i11 = &sim_state->intermediate_states[i_comp].t.r11[4 * sim_state->n_frequencies];
-            sim_state->intermediate_states[i_comp].t.i12 = &sim_state->intermediate_states[i_comp].t.r11[5 * sim_state->n_frequencies];
-            sim_state->intermediate_states[i_comp].t.i21 = &sim_state->intermediate_states[i_comp].t.r11[6 * sim_state->n_frequencies];
-            sim_state->intermediate_states[i_comp].t.i22 = &sim_state->intermediate_states[i_comp].t.r11[7 * sim_state->n_frequencies];
+    // one arena for everything, only reallocated when the problem grows
+    size_t arena_size = simulation_arena_size(n_components, n_frequencies);
+    if (sim_state->arena.size < arena_size) {
+        uti_block_free(&sim_state->arena);
+        if (!uti_block_alloc(&sim_state->arena, arena_size, simulation_huge_pages)) {
+            sim_state->memory_initalized = false;
+            return false;
         }
-        sim_state->memory_initalized = true;
     }
+    simulation_arena_carve(sim_state, n_components, n_frequencies);
+    sim_state->memory_initalized = true;
     /// END MALLOC BUSINESS
 
     // generate frequency
     for (size_t i = 0; i < n_frequencies; i++) {
         sim_state->frequencies[i] = start_f + i * df;
     }
+    sim_state->grid_hash = uti_hash_bytes(sim_state->frequencies, sizeof(double) * n_frequencies, 0);
 
     sim_state->z0_in = settings->z0_in;
     sim_state->z0_out = settings->z0_out;
 
-    // interpolate S-Parameters and generate T-parameters
+    // S-Parameters and T-parameters are calculated by the worker pool in the next simulation
     for (size_t i_comp = 0; i_comp < n_components; i_comp++) {
-        circuit_update_s_and_t_paramas_of_component(sim_state, i_comp);
+        sim_state->dirty[i_comp] = true;
     }
 
+    // the impedance steps are the ends of the partial cascades, nothing else is cached yet
+    fill_impedance_step_t(&sim_state->t_prefix[0], sim_state->z0_in, 50.0, n_frequencies);
+    fill_impedance_step_t(&sim_state->t_suffix[n_components], 50.0, sim_state->z0_out, n_frequencies);
+    sim_state->prefix_valid_count = 1;
+    sim_state->suffix_valid_from = n_components;
+    sim_state->candidate_valid = false;
+
     return true;
 }
 
+bool circuit_simulation_matches_settings(const struct Simulation_State *sim_state, const struct Simulation_Settings *settings) {
+    return sim_state->memory_initalized &&
+        sim_state->settings.f_min == settings->f_min &&
+        sim_state->settings.f_max == settings->f_max &&
+        sim_state->settings.z0_in == settings->z0_in &&
+        sim_state->settings.z0_out == settings->z0_out &&
+        sim_state->settings.n_frequencies == settings->n_frequencies;
+}
 
 void circuit_update_s_and_t_paramas_of_component(struct Simulation_State* sim_state, size_t component_index) {
     circuit_interpolate_sparams_circuit_component(
@@ -297,19 +462,7 @@ bool circuit_simulation_destroy(struct Simulation_State *sim_state) {
     if (!sim_state->memory_initalized) return true;
 
     /// START FREE BUSINESS
-    for (size_t i_comp = 0; i_comp < sim_state->n_components; i_comp++) {
-        free(sim_state->intermediate_states[i_comp].s.r11);
-        free(sim_state->intermediate_states[i_comp].t.r11);
-    }
-
-    free(sim_state->intermediate_states);
-    free(sim_state->frequencies);
-    free(sim_state->s11_result_plottable);
-    free(sim_state->s12_result_plottable);
-    free(sim_state->s21_result_plottable);
-    free(sim_state->s22_result_plottable);
-    free(sim_state->s_result.r11);
-    free(sim_state->t_result.r11);
+    uti_block_free(&sim_state->arena);
     /// END FREE BUSINESS
 
     sim_state->memory_initalized = false;
@@ -317,49 +470,250 @@ bool circuit_simulation_destroy(struct Simulation_State *sim_state) {
     return true;
 }
 
+void circuit_simulation_mark_dirty(struct Simulation_State *sim_state, size_t component_index) {
+    assert(component_index < sim_state->n_components);
+    sim_state->dirty[component_index] = true;
+}
 
-// T_f = T_x * T_y
-static void multiply_t_soa(struct Complex_2x2_SoA *tf, struct Complex_2x2_SoA *tx, struct Complex_2x2_SoA *ty, size_t n_f) {
-    // (A+iB)(C+iD) = (AC − BD) + i (AD + BC)
-    for (size_t i = 0; i < n_f; i++) {
-        // AC - BD     real real - imag imag
-        tf->r11[i] = tx->r11[i] * ty->r11[i] + tx->r12[i] * ty->r21[i]  -  (tx->i11[i] * ty->i11[i] + tx->i12[i] * ty->i21[i]);
-        tf->r21[i] = tx->r21[i] * ty->r11[i] + tx->r22[i] * ty->r21[i]  -  (tx->i21[i] * ty->i11[i] + tx->i22[i] * ty->i21[i]);
-        tf->r12[i] = tx->r11[i] * ty->r12[i] + tx->r12[i] * ty->r22[i]  -  (tx->i11[i] * ty->i12[i] + tx->i12[i] * ty->i22[i]);
-        tf->r22[i] = tx->r21[i] * ty->r12[i] + tx->r22[i] * ty->r22[i]  -  (tx->i21[i] * ty->i12[i] + tx->i22[i] * ty->i22[i]);
-        // i (AD + BC) realx imagy + imagx realy
-        tf->i11[i] = tx->r11[i] * ty->i11[i] + tx->r12[i] * ty->i21[i]  +  (tx->i11[i] * ty->r11[i] + tx->i12[i] * ty->r21[i]);
-        tf->i21[i] = tx->r21[i] * ty->i11[i] + tx->r22[i] * ty->i21[i]  +  (tx->i21[i] * ty->r11[i] + tx->i22[i] * ty->r21[i]);
-        tf->i12[i] = tx->r11[i] * ty->i12[i] + tx->r12[i] * ty->i22[i]  +  (tx->i11[i] * ty->r12[i] + tx->i12[i] * ty->r22[i]);
-        tf->i22[i] = tx->r21[i] * ty->i12[i] + tx->r22[i] * ty->i22[i]  +  (tx->i21[i] * ty->r12[i] + tx->i22[i] * ty->r22[i]);
+// T of the frequencies offset .. offset + count, thread safe (stages use the spline coefficients of S2P_Info).
+// Only the cascade needs the components, so the S planes are filled for stages only.
+static void interpolate_component_chunk(struct Circuit_Component *component, struct Simulation_Component_Intermediate_State *state, double *frequencies, size_t offset, size_t count) {
+    struct Complex_2x2_SoA s = circuit_soa_offset(&state->s, offset);
+    struct Complex_2x2_SoA t = circuit_soa_offset(&state->t, offset);
+    double *f = &frequencies[offset];
+
+    if (circuit_t_params_circuit_component(component, f, &t, count)) return;
+
+    // stage: interpolate the measured S-parameters
+    assert(component->kind == CIRCUIT_COMPONENT_STAGE);
+    struct Circuit_Component_Stage *stage = &component->as.stage;
+    struct S2P_Info *info = &stage->s2p_infos[stage->selected_setting];
+    mma_spline_cubic_natural_2x2_soa_eval(info->freq, &info->s, &info->s_a, &info->s_b, info->data_length, &s, f, count);
+
+    calc_t_from_s_array(&s, &t, count);
+}
+
+// S-parameters, plottables and stability factors from t_result
+static void finish_results_chunk(struct Simulation_State *sim_state, size_t offset, size_t count) {
+    struct Complex_2x2_SoA t_f = circuit_soa_offset(&sim_state->t_result, offset);
+    struct Complex_2x2_SoA s_f = circuit_soa_offset(&sim_state->s_result, offset);
+    calc_s_from_t_array(&t_f, &s_f, count);
+
+    // unpack the SoA to Complex struct for plotting
+    struct Complex_2x2_SoA* s_soa = &sim_state->s_result;
+    for (size_t i = offset; i < offset + count; i++) {
+        sim_state->s11_result_plottable[i].r = s_soa->r11[i];
+        sim_state->s12_result_plottable[i].r = s_soa->r12[i];
+        sim_state->s21_result_plottable[i].r = s_soa->r21[i];
+        sim_state->s22_result_plottable[i].r = s_soa->r22[i];
+        sim_state->s11_result_plottable[i].i = s_soa->i11[i];
+        sim_state->s12_result_plottable[i].i = s_soa->i12[i];
+        sim_state->s21_result_plottable[i].i = s_soa->i21[i];
+        sim_state->s22_result_plottable[i].i = s_soa->i22[i];
+        calc_mu_and_mu_prime(
+            sim_state->s11_result_plottable[i],
+            sim_state->s12_result_plottable[i],
+            sim_state->s21_result_plottable[i],
+            sim_state->s22_result_plottable[i],
+            &sim_state->stab_mu[i],
+            &sim_state->stab_mu_prime[i]
+        );
     }
 }
 
-// Fill a T-SoA with a constant impedance step
-// T = 1/sqrt(1-G^2) * | 1  G |
-//                     | G  1 |
-static void fill_impedance_step_t(struct Complex_2x2_SoA *t_out, double z_from, double z_to, size_t n_f) {
-    // Calculate Reflection Coeff Gamma
-    // Note: Standard definition G = (Z_load - Z0) / (Z_load + Z0)
-    double gamma = (z_to - z_from) / (z_to + z_from);
+void circuit_simulation_finish_results(struct Simulation_State *sim_state, size_t offset, size_t count) {
+    assert(offset + count <= sim_state->n_frequencies);
+    finish_results_chunk(sim_state, offset, count);
+}
 
-    // T-param factor
-    double factor = 1.0 / sqrt(1.0 - gamma * gamma);
-    double t11_22 = factor * 1.0;
-    double t12_21 = factor * gamma;
+// T_f = [T_in T_0 ... T_(k-1)] T_k' [T_(k+1) ... T_(n-1) T_out] of one chunk,
+// the missing parts of the partial cascades are calculated on the way
+static void cascade_incremental_chunk(struct Simulation_State *sim_state, size_t prefix_valid_count, size_t suffix_valid_from, size_t offset, size_t count) {
+    size_t k = sim_state->candidate_index;
 
-    for (size_t i = 0; i < n_f; i++) {
-        t_out->r11[i] = t11_22;
-        t_out->r22[i] = t11_22;
-        t_out->r12[i] = t12_21;
-        t_out->r21[i] = t12_21;
+    for (size_t j = prefix_valid_count; j <= k; j++) {
+        struct Complex_2x2_SoA p = circuit_soa_offset(&sim_state->t_prefix[j], offset);
+        struct Complex_2x2_SoA p_before = circuit_soa_offset(&sim_state->t_prefix[j - 1], offset);
+        struct Complex_2x2_SoA t_j = circuit_soa_offset(&sim_state->intermediate_states[j - 1].t, offset);
+        circuit_multiply_t_soa(&p, &p_before, &t_j, count);
+    }
 
-        // Resistive steps have 0 imaginary part
-        t_out->i11[i] = 0; t_out->i22[i] = 0;
-        t_out->i12[i] = 0; t_out->i21[i] = 0;
+    for (size_t j = suffix_valid_from; j > k + 1; j--) {
+        struct Complex_2x2_SoA q = circuit_soa_offset(&sim_state->t_suffix[j - 1], offset);
+        struct Complex_2x2_SoA q_after = circuit_soa_offset(&sim_state->t_suffix[j], offset);
+        struct Complex_2x2_SoA t_j = circuit_soa_offset(&sim_state->intermediate_states[j - 1].t, offset);
+        circuit_multiply_t_soa(&q, &t_j, &q_after, count);
+    }
+
+    struct Complex_2x2_SoA t_f = circuit_soa_offset(&sim_state->t_result, offset);
+    struct Complex_2x2_SoA prefix = circuit_soa_offset(&sim_state->t_prefix[k], offset);
+    struct Complex_2x2_SoA suffix = circuit_soa_offset(&sim_state->t_suffix[k + 1], offset);
+    struct Complex_2x2_SoA t_cached;
+    if (sim_state->candidate_t_planes) soa_from_block(&t_cached, (double *)sim_state->candidate_t_planes, sim_state->n_frequencies);
+    struct Complex_2x2_SoA t_candidate = circuit_soa_offset(sim_state->candidate_t_planes ? &t_cached : &sim_state->candidate_state.t, offset);
+    circuit_multiply_t_soa(&t_f, &prefix, &t_candidate, count);
+    circuit_multiply_t_soa(&t_f, &t_f, &suffix, count);
+}
+
+struct Simulation_Chunk_Job {
+    struct Simulation_State *sim_state;
+    bool incremental; // use the candidate at candidate_index
+    size_t prefix_valid_count;
+    size_t suffix_valid_from;
+    size_t first_chunk; // job index 0 is this chunk
+};
+
+// Every frequency is independent, so each chunk runs the whole pipeline on its own:
+// interpolation -> S to T -> cascade -> T to S -> mu, mu'
+static void simulation_chunk(void *context, size_t chunk_index) {
+    struct Simulation_Chunk_Job *job = context;
+    struct Simulation_State *sim_state = job->sim_state;
+    size_t offset = (job->first_chunk + chunk_index) * SIMULATION_CHUNK_SIZE;
+    size_t count = min(SIMULATION_CHUNK_SIZE, sim_state->n_frequencies - offset);
+
+    for (size_t i_comp = 0; i_comp < sim_state->n_components; i_comp++) {
+        if (!sim_state->dirty[i_comp]) continue;
+        interpolate_component_chunk(&sim_state->components_cascade[i_comp], &sim_state->intermediate_states[i_comp], sim_state->frequencies, offset, count);
+    }
+
+    if (job->incremental) {
+        if (!sim_state->candidate_t_planes) {
+            interpolate_component_chunk(&sim_state->candidate, &sim_state->candidate_state, sim_state->frequencies, offset, count);
+        }
+        cascade_incremental_chunk(sim_state, job->prefix_valid_count, job->suffix_valid_from, offset, count);
+    } else {
+        // all components at once, the product of a few frequencies stays in registers
+        circuit_cascade_t_soa(&sim_state->t_result, sim_state->t_chain, sim_state->n_chain, offset, count);
+    }
+
+    finish_results_chunk(sim_state, offset, count);
+}
+
+// Drop the partial cascades that contain changed components.
+// The dirty flags stay set until the chunks have recalculated S and T.
+static void prepare_dirty_components(struct Simulation_State *sim_state) {
+    for (size_t i_comp = 0; i_comp < sim_state->n_components; i_comp++) {
+        if (!sim_state->dirty[i_comp]) continue;
+        if (sim_state->prefix_valid_count > i_comp + 1) sim_state->prefix_valid_count = i_comp + 1;
+        if (sim_state->suffix_valid_from < i_comp + 1) sim_state->suffix_valid_from = i_comp + 1;
+        // the candidate was simulated against the old cascade
+        sim_state->candidate_valid = false;
+    }
+}
+
+static void run_simulation_chunks(struct Simulation_Chunk_Job *job) {
+    struct Simulation_State *sim_state = job->sim_state;
+    size_t n_chunks = (sim_state->n_frequencies + SIMULATION_CHUNK_SIZE - 1) / SIMULATION_CHUNK_SIZE;
+    simulation_run_chunks(sim_state->single_threaded, simulation_chunk, job, n_chunks);
+
+    for (size_t i_comp = 0; i_comp < sim_state->n_components; i_comp++) {
+        sim_state->dirty[i_comp] = false;
     }
 }
 
+void circuit_simulation_begin_incremental(struct Simulation_State *sim_state, size_t component_index, const struct Circuit_Component *candidate) {
+    assert(sim_state->memory_initalized);
+    assert(component_index < sim_state->n_components);
+
+    prepare_dirty_components(sim_state);
+
+    sim_state->candidate = *candidate;
+    sim_state->candidate_index = component_index;
+    sim_state->candidate_valid = false;
+    sim_state->candidate_t_planes = NULL;
+    sim_state->incremental_done = 0;
+    sim_state->incremental_prefix_valid_count = sim_state->prefix_valid_count;
+    sim_state->incremental_suffix_valid_from = sim_state->suffix_valid_from;
+}
+
+void circuit_simulation_begin_incremental_cached(struct Simulation_State *sim_state, size_t component_index, const struct Circuit_Component *candidate, const double *t_planes) {
+    circuit_simulation_begin_incremental(sim_state, component_index, candidate);
+    sim_state->candidate_t_planes = t_planes;
+}
+
+// The chunks of an unfinished candidate leave the bookkeeping alone: the dirty flags stay set and the
+// partial cascades count as stale until the last chunk is done, so the next candidate recalculates them.
+bool circuit_simulation_continue_incremental(struct Simulation_State *sim_state, size_t *done_out) {
+    size_t n_chunks = (sim_state->n_frequencies + SIMULATION_CHUNK_SIZE - 1) / SIMULATION_CHUNK_SIZE;
+    size_t first_chunk = sim_state->incremental_done / SIMULATION_CHUNK_SIZE;
+    struct Uti_Thread_Pool *pool = sim_state->single_threaded ? NULL : simulation_get_thread_pool();
+    size_t step_chunks = pool ? uti_thread_pool_thread_count(pool) : 1;
+    size_t step_end = min(first_chunk + max(step_chunks, 1), n_chunks);
+
+    struct Simulation_Chunk_Job job = {
+        .sim_state = sim_state,
+        .incremental = true,
+        .prefix_valid_count = sim_state->incremental_prefix_valid_count,
+        .suffix_valid_from = sim_state->incremental_suffix_valid_from,
+        .first_chunk = first_chunk,
+    };
+    if (pool) {
+        uti_thread_pool_run(pool, simulation_chunk, &job, step_end - first_chunk);
+    } else {
+        for (size_t i = 0; i < step_end - first_chunk; i++) simulation_chunk(&job, i);
+    }
+    sim_state->incremental_done = min(step_end * SIMULATION_CHUNK_SIZE, sim_state->n_frequencies);
+    if (done_out) *done_out = sim_state->incremental_done;
+    if (step_end < n_chunks) return false;
+
+    for (size_t i_comp = 0; i_comp < sim_state->n_components; i_comp++) {
+        sim_state->dirty[i_comp] = false;
+    }
+    size_t k = sim_state->candidate_index;
+    if (sim_state->prefix_valid_count < k + 1) sim_state->prefix_valid_count = k + 1;
+    if (sim_state->suffix_valid_from > k + 1) sim_state->suffix_valid_from = k + 1;
+    sim_state->candidate_valid = true;
+    return true;
+}
+
+bool circuit_simulation_do_incremental(struct Simulation_State *sim_state, size_t component_index, const struct Circuit_Component *candidate) {
+    circuit_simulation_begin_incremental(sim_state, component_index, candidate);
+
+    struct Simulation_Chunk_Job job = {
+        .sim_state = sim_state,
+        .incremental = true,
+        .prefix_valid_count = sim_state->prefix_valid_count,
+        .suffix_valid_from = sim_state->suffix_valid_from,
+    };
+    run_simulation_chunks(&job);
+
+    if (sim_state->prefix_valid_count < component_index + 1) sim_state->prefix_valid_count = component_index + 1;
+    if (sim_state->suffix_valid_from > component_index + 1) sim_state->suffix_valid_from = component_index + 1;
+    sim_state->incremental_done = sim_state->n_frequencies;
+    sim_state->candidate_valid = true;
+
+    return true;
+}
+
+void circuit_simulation_accept_incremental(struct Simulation_State *sim_state) {
+    assert(sim_state->candidate_valid);
+
+    size_t k = sim_state->candidate_index;
+    sim_state->components_cascade[k] = sim_state->candidate;
+
+    if (sim_state->candidate_t_planes) {
+        // the cache owns the planes, the component gets a copy of its T
+        struct Complex_2x2_SoA t_cached;
+        soa_from_block(&t_cached, (double *)sim_state->candidate_t_planes, sim_state->n_frequencies);
+        struct Complex_2x2_SoA *t = &sim_state->intermediate_states[k].t;
+        size_t size = sizeof(double) * sim_state->n_frequencies;
+        memcpy(t->r11, t_cached.r11, size); memcpy(t->i11, t_cached.i11, size);
+        memcpy(t->r12, t_cached.r12, size); memcpy(t->i12, t_cached.i12, size);
+        memcpy(t->r21, t_cached.r21, size); memcpy(t->i21, t_cached.i21, size);
+        memcpy(t->r22, t_cached.r22, size); memcpy(t->i22, t_cached.i22, size);
+        sim_state->candidate_t_planes = NULL;
+    } else {
+        // the candidate S and T become the ones of the component (swap the buffers instead of copying)
+        struct Simulation_Component_Intermediate_State old = sim_state->intermediate_states[k];
+        sim_state->intermediate_states[k] = sim_state->candidate_state;
+        sim_state->candidate_state = old;
+    }
+
+    if (sim_state->prefix_valid_count > k + 1) sim_state->prefix_valid_count = k + 1;
+    if (sim_state->suffix_valid_from < k + 1) sim_state->suffix_valid_from = k + 1;
+    sim_state->candidate_valid = false;
+}
+
 // simulate the cascade of components using T-parameters
 bool circuit_simulation_do(struct Simulation_State *sim_state, bool print_stdout) {
 
@@ -368,6 +722,7 @@ bool circuit_simulation_do(struct Simulation_State *sim_state, bool print_stdout
         printf("simulation started\n");
         printf("    components: %zu\n    number of frequencies: %zu\n", sim_state->n_components, sim_state->n_frequencies);
         printf("    source impedance: %.1f\n    load impedance: %.1f\n", sim_state->z0_in, sim_state->z0_out);
+        printf("    threads: %zu\n", circuit_simulation_thread_count());
     }
 
     if (sim_state->n_components < 1) {
@@ -375,136 +730,739 @@ bool circuit_simulation_do(struct Simulation_State *sim_state, bool print_stdout
         return false;
     }
 
-    size_t n_f = sim_state->n_frequencies;
-    size_t byte_size_total = 8 * n_f * sizeof(*sim_state->t_result.r11);
-
-    // [T_in] T_0 T_1 T_2 ... [T_out]
-    // ---------------
-    // copy T_f = T_0
-    //
-    // copy T_t = T_f
-    // T_f = T_t T_1
-    //
-    // copy T_t = T_f
-    // T_f = T_t T_2
-    //
-    // ...
-
-    // reserve some temporary space (T_t)
-    mma_temp_set_restore_point();
-    struct Complex_2x2_SoA t_temporary;
-    t_temporary.r11 = mma_temp_alloc(byte_size_total);
-    t_temporary.r12 = &t_temporary.r11[1 * n_f];
-    t_temporary.r21 = &t_temporary.r11[2 * n_f];
-    t_temporary.r22 = &t_temporary.r11[3 * n_f];
-    t_temporary.i11 = &t_temporary.r11[4 * n_f];
-    t_temporary.i12 = &t_temporary.r11[5 * n_f];
-    t_temporary.i21 = &t_temporary.r11[6 * n_f];
-    t_temporary.i22 = &t_temporary.r11[7 * n_f];
-
-    // input impedance step if not 50 ohm
-    // copy T_f = T_0 [or T_f = T_in]
-    size_t start_index = 1;
-    if (fabs(sim_state->z0_in - 50.0) < 1e-9) {
-        // case 50 ohm: T_f = T_0
-        memcpy(
-            sim_state->t_result.r11,
-            sim_state->intermediate_states[0].t.r11,
-            byte_size_total
-        );
-    } else {
-        // case not 50 ohm: T_f = T_in
-        start_index = 0;
-        fill_impedance_step_t(
-            &sim_state->t_result,
-            sim_state->z0_in, 50.0, n_f
-        );
+    prepare_dirty_components(sim_state);
+
+    // [T_in] T_0 T_1 T_2 ... [T_out], the impedance steps only if not 50 ohm
+    size_t n_chain = 0;
+    if (fabs(sim_state->z0_in - 50.0) > 1e-9) {
+        sim_state->t_chain[n_chain++] = &sim_state->t_prefix[0];
+    }
+    for (size_t i_comp = 0; i_comp < sim_state->n_components; i_comp++) {
+        sim_state->t_chain[n_chain++] = &sim_state->intermediate_states[i_comp].t;
+    }
+    if (fabs(sim_state->z0_out - 50.0) > 1e-9) {
+        sim_state->t_chain[n_chain++] = &sim_state->t_suffix[sim_state->n_components];
     }
+    sim_state->n_chain = n_chain;
 
-    for (size_t i_comp = start_index; i_comp < sim_state->n_components; i_comp++) {
+    struct Simulation_Chunk_Job job = {
+        .sim_state = sim_state,
+        .incremental = false,
+    };
+    run_simulation_chunks(&job);
 
-        // copy T_t = T_f
-        memcpy(
-            t_temporary.r11,
-            sim_state->t_result.r11,
-            byte_size_total
-        );
+    if (print_stdout) {
+        printf("simulation finished.\n");
+        printf("===========================================================\n");
+    }
+
+    return true;
+}
+
+//
+// gradient (adjoint of the cascade)
+//
+
+static inline struct Complex c_make(double r, double i) {
+    struct Complex c = {r, i};
+    return c;
+}
 
-        struct Complex_2x2_SoA *tx = &t_temporary;
-        struct Complex_2x2_SoA *ty = &sim_state->intermediate_states[i_comp].t;
-        struct Complex_2x2_SoA *tf = &sim_state->t_result;
-        // T_f = T_x * T_y
-        multiply_t_soa(tf, tx, ty, n_f);
+static inline struct Complex c_mul(struct Complex a, struct Complex b) {
+    return c_make(a.r * b.r - a.i * b.i, a.r * b.i + a.i * b.r);
+}
+
+static inline struct Complex c_mul_conj(struct Complex a, struct Complex b) {
+    // a * conj(b)
+    return c_make(a.r * b.r + a.i * b.i, a.i * b.r - a.r * b.i);
+}
+
+static inline struct Complex c_add(struct Complex a, struct Complex b) { return c_make(a.r + b.r, a.i + b.i); }
+static inline struct Complex c_sub(struct Complex a, struct Complex b) { return c_make(a.r - b.r, a.i - b.i); }
+
+static inline struct Complex soa_get(const struct Complex_2x2_SoA *m, size_t row, size_t col, size_t i) {
+    if (row == 0) return col == 0 ? c_make(m->r11[i], m->i11[i]) : c_make(m->r12[i], m->i12[i]);
+    return col == 0 ? c_make(m->r21[i], m->i21[i]) : c_make(m->r22[i], m->i22[i]);
+}
+
+// dz/d ln(value) = sign z for the series impedance z, dy/d ln(value) = sign y for the shunt admittance y:
+// +1 if it grows with the value (R, L, CP), -1 if it shrinks (C, RP, LP), 0 for stages
+static double lumped_log_derivative_sign(CIRCUIT_COMPONENT_KIND kind, bool *shunt) {
+    *shunt = false;
+    switch (kind) {
+    case CIRCUIT_COMPONENT_RESISTOR_IDEAL:          return 1.0;
+    case CIRCUIT_COMPONENT_INDUCTOR_IDEAL:          return 1.0;
+    case CIRCUIT_COMPONENT_CAPACITOR_IDEAL:         return -1.0;
+    case CIRCUIT_COMPONENT_RESISTOR_IDEAL_PARALLEL: *shunt = true; return -1.0;
+    case CIRCUIT_COMPONENT_INDUCTOR_IDEAL_PARALLEL: *shunt = true; return -1.0;
+    case CIRCUIT_COMPONENT_CAPACITOR_IDEAL_PARALLEL:*shunt = true; return 1.0;
+    case CIRCUIT_COMPONENT_STAGE:                   return 0.0;
+    default:
+        assert(false && "implement me please (derivative of new kind)");
+        return 0.0;
     }
+}
 
-    // output impedance step if not 50 ohm
-    if (fabs(sim_state->z0_out - 50.0) > 1e-9) {
+struct Simulation_Gradient_Job {
+    struct Simulation_State *sim_state;
+    const struct Complex_2x2_SoA *ds;
+    size_t prefix_valid_count;
+    size_t suffix_valid_from;
+    double *partial_gradients; // n_components per chunk, summed up in chunk order afterwards
+};
+
+static void simulation_gradient_chunk(void *context, size_t chunk_index) {
+    struct Simulation_Gradient_Job *job = context;
+    struct Simulation_State *sim_state = job->sim_state;
+    size_t n = sim_state->n_components;
+    size_t offset = chunk_index * SIMULATION_CHUNK_SIZE;
+    size_t count = min(SIMULATION_CHUNK_SIZE, sim_state->n_frequencies - offset);
+    double *gradient = &job->partial_gradients[chunk_index * n];
+
+    // forward pass: t_prefix[j] = T_in T_0 ... T_(j-1)
+    for (size_t j = job->prefix_valid_count; j <= n; j++) {
+        struct Complex_2x2_SoA p = circuit_soa_offset(&sim_state->t_prefix[j], offset);
+        struct Complex_2x2_SoA p_before = circuit_soa_offset(&sim_state->t_prefix[j - 1], offset);
+        struct Complex_2x2_SoA t_j = circuit_soa_offset(&sim_state->intermediate_states[j - 1].t, offset);
+        circuit_multiply_t_soa(&p, &p_before, &t_j, count);
+    }
+    // backward pass: t_suffix[j] = T_j ... T_(n-1) T_out
+    for (size_t j = job->suffix_valid_from; j > 0; j--) {
+        struct Complex_2x2_SoA q = circuit_soa_offset(&sim_state->t_suffix[j - 1], offset);
+        struct Complex_2x2_SoA q_after = circuit_soa_offset(&sim_state->t_suffix[j], offset);
+        struct Complex_2x2_SoA t_j = circuit_soa_offset(&sim_state->intermediate_states[j - 1].t, offset);
+        circuit_multiply_t_soa(&q, &t_j, &q_after, count);
+    }
 
-        // copy T_t = T_f
-        memcpy(
-            t_temporary.r11,
-            sim_state->t_result.r11,
-            byte_size_total
-        );
+    for (size_t i = offset; i < offset + count; i++) {
+        // dL/dT of the whole cascade from dL/dS with
+        // s21 = 1/T11   s11 = T21/T11   s22 = -T12/T11   s12 = T22 - T21 T12/T11
+        struct Complex p = soa_get(&sim_state->t_result, 0, 0, i);
+        struct Complex q = soa_get(&sim_state->t_result, 0, 1, i);
+        struct Complex r = soa_get(&sim_state->t_result, 1, 0, i);
+        struct Complex inv_p = mma_complex_divide_or_zero(c_make(1.0, 0.0), p);
+        struct Complex inv_p2 = c_mul(inv_p, inv_p);
+        struct Complex g11 = soa_get(job->ds, 0, 0, i);
+        struct Complex g12 = soa_get(job->ds, 0, 1, i);
+        struct Complex g21 = soa_get(job->ds, 1, 0, i);
+        struct Complex g22 = soa_get(job->ds, 1, 1, i);
+
+        // G_T = sum over s of G_s conj(ds/dT)
+        struct Complex gt11 = c_sub(c_add(c_mul_conj(g22, c_mul(q, inv_p2)), c_mul_conj(g12, c_mul(c_mul(r, q), inv_p2))),
+                                    c_add(c_mul_conj(g21, inv_p2), c_mul_conj(g11, c_mul(r, inv_p2))));
+        struct Complex gt12 = c_sub(c_make(0.0, 0.0), c_add(c_mul_conj(g22, inv_p), c_mul_conj(g12, c_mul(r, inv_p))));
+        struct Complex gt21 = c_sub(c_mul_conj(g11, inv_p), c_mul_conj(g12, c_mul(q, inv_p)));
+        struct Complex gt22 = g12;
+
+        for (size_t k = 0; k < n; k++) {
+            bool shunt;
+            double sign = lumped_log_derivative_sign(sim_state->components_cascade[k].kind, &shunt);
+            if (sign == 0.0) continue;
+
+            // dT_k/dln(value) = h E with the rank one E = a b^T, series a = (1, 1) b = (1, -1),
+            // shunt a = (1, -1) b = (1, 1). dL/dln(value) = Re(h conj(e)), e = conj(P a)^T G_T conj(S^T b)
+            // with the prefix P = t_prefix[k] and the suffix S = t_suffix[k + 1]
+            const struct Complex_2x2_SoA *pre = &sim_state->t_prefix[k];
+            const struct Complex_2x2_SoA *suf = &sim_state->t_suffix[k + 1];
+            double sa = shunt ? -1.0 : 1.0;
+            double sb = shunt ? 1.0 : -1.0;
+            struct Complex pa0 = c_make(pre->r11[i] + sa * pre->r12[i], pre->i11[i] + sa * pre->i12[i]);
+            struct Complex pa1 = c_make(pre->r21[i] + sa * pre->r22[i], pre->i21[i] + sa * pre->i22[i]);
+            struct Complex sb0 = c_make(suf->r11[i] + sb * suf->r21[i], suf->i11[i] + sb * suf->i21[i]);
+            struct Complex sb1 = c_make(suf->r12[i] + sb * suf->r22[i], suf->i12[i] + sb * suf->i22[i]);
+            // G_T conj(S^T b)
+            struct Complex v0 = c_add(c_mul_conj(gt11, sb0), c_mul_conj(gt12, sb1));
+            struct Complex v1 = c_add(c_mul_conj(gt21, sb0), c_mul_conj(gt22, sb1));
+            struct Complex e = c_add(c_mul_conj(v0, pa0), c_mul_conj(v1, pa1));
+
+            // h = (d z/d ln(value)) / 2 from the T of the component: series T12 = -z/2, shunt T12 = y/2
+            const struct Complex_2x2_SoA *t_k = &sim_state->intermediate_states[k].t;
+            double h_sign = shunt ? sign : -sign;
+            struct Complex h = c_make(h_sign * t_k->r12[i], h_sign * t_k->i12[i]);
+            gradient[k] += c_mul_conj(h, e).r;
+        }
+    }
+}
 
-        struct Complex_2x2_SoA *tx = &t_temporary;
-        struct Complex_2x2_SoA *tf = &sim_state->t_result;
-        struct Complex_2x2_SoA t_load_step;
-        t_load_step.r11 = mma_temp_alloc(byte_size_total);
-        t_load_step.r12 = &t_load_step.r11[1 * n_f];
-        t_load_step.r21 = &t_load_step.r11[2 * n_f];
-        t_load_step.r22 = &t_load_step.r11[3 * n_f];
-        t_load_step.i11 = &t_load_step.r11[4 * n_f];
-        t_load_step.i12 = &t_load_step.r11[5 * n_f];
-        t_load_step.i21 = &t_load_step.r11[6 * n_f];
-        t_load_step.i22 = &t_load_step.r11[7 * n_f];
+bool circuit_simulation_gradient(struct Simulation_State *sim_state, const struct Complex_2x2_SoA *ds, double *gradient_out) {
+    assert(sim_state->memory_initalized);
+    size_t n = sim_state->n_components;
+    size_t n_chunks = (sim_state->n_frequencies + SIMULATION_CHUNK_SIZE - 1) / SIMULATION_CHUNK_SIZE;
 
-        fill_impedance_step_t(&t_load_step, 50.0, sim_state->z0_out, n_f);
+    prepare_dirty_components(sim_state);
+    for (size_t k = 0; k < n; k++) {
+        if (sim_state->dirty[k]) {
+            printf("ERROR: circuit_simulation_gradient(): component %zu changed since the last simulation\n", k);
+            return false;
+        }
+    }
 
-        // T_f = T_x * T_y
-        multiply_t_soa(tf, tx, &t_load_step, n_f);
+    struct Simulation_Gradient_Job job = {
+        .sim_state = sim_state,
+        .ds = ds,
+        .prefix_valid_count = sim_state->prefix_valid_count,
+        .suffix_valid_from = sim_state->suffix_valid_from,
+        .partial_gradients = calloc(n_chunks * n, sizeof(double)),
+    };
+    if (!job.partial_gradients) {
+        printf("ERROR: circuit_simulation_gradient(): out of memory\n");
+        return false;
     }
 
-    calc_s_from_t_array(
-        &sim_state->t_result,
-        &sim_state->s_result,
-        sim_state->n_frequencies
-    );
+    simulation_run_chunks(sim_state->single_threaded, simulation_gradient_chunk, &job, n_chunks);
 
+    // all partial cascades are up to date now
+    sim_state->prefix_valid_count = n + 1;
+    sim_state->suffix_valid_from = 0;
 
-    // unpack the SoA to Complex struct for plotting
-    //struct Complex_2x2_SoA* s_soa = &sim_state->intermediate_states[0].s;
-    struct Complex_2x2_SoA* s_soa = &sim_state->s_result;
-    for (size_t i = 0; i < n_f; i++) {
-        sim_state->s11_result_plottable[i].r = s_soa->r11[i];
-        sim_state->s12_result_plottable[i].r = s_soa->r12[i];
-        sim_state->s21_result_plottable[i].r = s_soa->r21[i];
-        sim_state->s22_result_plottable[i].r = s_soa->r22[i];
-        sim_state->s11_result_plottable[i].i = s_soa->i11[i];
-        sim_state->s12_result_plottable[i].i = s_soa->i12[i];
-        sim_state->s21_result_plottable[i].i = s_soa->i21[i];
-        sim_state->s22_result_plottable[i].i = s_soa->i22[i];
-        calc_mu_and_mu_prime(
-            sim_state->s11_result_plottable[i],
-            sim_state->s12_result_plottable[i],
-            sim_state->s21_result_plottable[i],
-            sim_state->s22_result_plottable[i],
-            &sim_state->stab_mu[i],
-            &sim_state->stab_mu_prime[i]
-        );
+    // summed in chunk order, the gradient does not depend on the number of threads
+    for (size_t k = 0; k < n; k++) gradient_out[k] = 0.0;
+    for (size_t c = 0; c < n_chunks; c++) {
+        for (size_t k = 0; k < n; k++) gradient_out[k] += job.partial_gradients[c * n + k];
+    }
+    free(job.partial_gradients);
+    return true;
+}
+
+//
+// batched evaluation of many candidates
+//
+
+// frequencies per block inside a chunk, two T of a block live on the stack of the job
+#define SIMULATION_BATCH_BLOCK_SIZE 64
+
+bool circuit_simulation_batch_setup(struct Simulation_Batch *batch, const struct Circuit_Component *template_cascade, size_t n_components,
+        const struct Simulation_Settings *sim_settings, size_t max_candidates, bool full_results) {
+    memset(batch, 0, sizeof(*batch));
+    batch->n_components = n_components;
+    batch->max_candidates = max_candidates;
+    batch->full_results = full_results;
+
+    batch->template_cascade = malloc(sizeof(*batch->template_cascade) * max(n_components, 1));
+    batch->values = calloc(max(n_components * max_candidates, 1), sizeof(double));
+    batch->settings = calloc(max(n_components * max_candidates, 1), sizeof(size_t));
+    batch->stage_t = calloc(max(n_components, 1), sizeof(*batch->stage_t));
+    if (!batch->template_cascade || !batch->values || !batch->settings || !batch->stage_t) {
+        printf("ERROR: circuit_simulation_batch_setup(): out of memory\n");
+        return false;
+    }
+    memcpy(batch->template_cascade, template_cascade, sizeof(*batch->template_cascade) * n_components);
+    if (!circuit_simulation_setup(batch->template_cascade, n_components, &batch->grid, sim_settings)) return false;
+
+    for (size_t k = 0; k < n_components; k++) {
+        if (batch->template_cascade[k].kind == CIRCUIT_COMPONENT_STAGE) {
+            batch->stage_t[k] = calloc(batch->template_cascade[k].as.stage.n_settings, sizeof(**batch->stage_t));
+            if (!batch->stage_t[k]) {
+                printf("ERROR: circuit_simulation_batch_setup(): out of memory\n");
+                return false;
+            }
+        }
     }
+    for (size_t c = 0; c < max_candidates; c++) circuit_simulation_batch_set_cascade(batch, c, batch->template_cascade);
 
+    if (full_results) {
+        batch->s_results = malloc(sizeof(double) * 8 * batch->grid.n_frequencies * max_candidates);
+        if (!batch->s_results) {
+            printf("ERROR: circuit_simulation_batch_setup(): out of memory\n");
+            return false;
+        }
+    }
+    return true;
+}
 
-    if (print_stdout) {
-        printf("simulation finished.\n");
-        printf("===========================================================\n");
+void circuit_simulation_batch_set_cascade(struct Simulation_Batch *batch, size_t candidate, const struct Circuit_Component *component_cascade) {
+    assert(candidate < batch->max_candidates);
+    for (size_t k = 0; k < batch->n_components; k++) {
+        assert(component_cascade[k].kind == batch->template_cascade[k].kind);
+        size_t i = k * batch->max_candidates + candidate;
+        struct Circuit_Component component = component_cascade[k];
+        double *value = circuit_component_value(&component);
+        if (value) batch->values[i] = *value;
+        else batch->settings[i] = component.as.stage.selected_setting;
     }
+}
 
-    mma_temp_restore();
+void circuit_simulation_batch_get_cascade(const struct Simulation_Batch *batch, size_t candidate, struct Circuit_Component *component_cascade_out) {
+    assert(candidate < batch->max_candidates);
+    for (size_t k = 0; k < batch->n_components; k++) {
+        size_t i = k * batch->max_candidates + candidate;
+        component_cascade_out[k] = batch->template_cascade[k];
+        double *value = circuit_component_value(&component_cascade_out[k]);
+        if (value) *value = batch->values[i];
+        else component_cascade_out[k].as.stage.selected_setting = batch->settings[i];
+    }
+}
+
+struct Complex_2x2_SoA circuit_simulation_batch_s_result(const struct Simulation_Batch *batch, size_t candidate) {
+    assert(batch->full_results && candidate < batch->max_candidates);
+    size_t n_f = batch->grid.n_frequencies;
+    struct Complex_2x2_SoA s;
+    soa_from_block(&s, &batch->s_results[candidate * 8 * n_f], n_f);
+    return s;
+}
+
+void circuit_simulation_batch_destroy(struct Simulation_Batch *batch) {
+    for (size_t k = 0; batch->stage_t && k < batch->n_components; k++) {
+        if (!batch->stage_t[k]) continue;
+        for (size_t i = 0; i < batch->template_cascade[k].as.stage.n_settings; i++) free(batch->stage_t[k][i]);
+        free(batch->stage_t[k]);
+    }
+    free(batch->stage_t);
+    free(batch->values);
+    free(batch->settings);
+    free(batch->s_results);
+    if (batch->grid.memory_initalized) circuit_simulation_destroy(&batch->grid);
+    free(batch->template_cascade);
+    memset(batch, 0, sizeof(*batch));
+}
 
+// T of a stage setting on the grid, interpolated the first time a candidate uses it
+static bool simulation_batch_stage_t(struct Simulation_Batch *batch, size_t k, size_t setting) {
+    if (batch->stage_t[k][setting]) return true;
+    size_t n_f = batch->grid.n_frequencies;
+    double *block = malloc(sizeof(double) * 8 * n_f);
+    if (!block) {
+        printf("ERROR: circuit_simulation_batch_run(): out of memory\n");
+        return false;
+    }
+    struct Circuit_Component stage = batch->template_cascade[k];
+    stage.as.stage.selected_setting = setting;
+    struct Complex_2x2_SoA t;
+    soa_from_block(&t, block, n_f);
+    circuit_interpolate_sparams_circuit_component(&stage, batch->grid.frequencies, &t, n_f);
+    calc_t_from_s_array(&t, &t, n_f);
+    batch->stage_t[k][setting] = block;
     return true;
 }
 
+struct Simulation_Batch_Job {
+    struct Simulation_Batch *batch;
+    size_t n_candidates;
+    const struct Optimization_Goal *goals;
+    size_t goal_count;
+    size_t *goal_start; // goal_count entries each
+    size_t *goal_end;
+    double *partial_losses; // [chunk][candidate][goal], the last column counts non finite S
+};
+
+// hinge loss of one goal at one frequency
+static double batch_goal_loss(const struct Optimization_Goal *goal, const struct Complex_2x2_SoA *s, size_t j) {
+    struct Complex s11 = {s->r11[j], s->i11[j]};
+    struct Complex s12 = {s->r12[j], s->i12[j]};
+    struct Complex s21 = {s->r21[j], s->i21[j]};
+    struct Complex s22 = {s->r22[j], s->i22[j]};
+    struct Complex s_value;
+    double stab_values[2];
+    void *value;
+    switch (goal->target) {
+    case OPTIMIZATION_TARGET_S11: s_value = s11; value = &s_value; break;
+    case OPTIMIZATION_TARGET_S12: s_value = s12; value = &s_value; break;
+    case OPTIMIZATION_TARGET_S21: s_value = s21; value = &s_value; break;
+    case OPTIMIZATION_TARGET_S22: s_value = s22; value = &s_value; break;
+    case OPTIMIZATION_TARGET_MU:
+        calc_mu_and_mu_prime(s11, s12, s21, s22, &stab_values[0], &stab_values[1]);
+        value = &stab_values[0];
+    break;
+    case OPTIMIZATION_TARGET_MU_PRIME:
+        calc_mu_and_mu_prime(s11, s12, s21, s22, &stab_values[0], &stab_values[1]);
+        value = &stab_values[1];
+    break;
+    default:
+        assert(false && "wrong or implement me");
+        return 0.0;
+    }
+    return goal->type == OPTIMIZATION_TYPE_LESS_THAN ?
+        circuit_optimizer_calculate_loss_hinge_lt(value, 1, goal->value_map, goal->goal_value) :
+        circuit_optimizer_calculate_loss_hinge_gt(value, 1, goal->value_map, goal->goal_value);
+}
 
+// blocks of the chunk outside, candidates inside: the stage T and the frequencies of a block are
+// loaded once for all candidates
+static void simulation_batch_chunk(void *context, size_t chunk_index) {
+    struct Simulation_Batch_Job *job = context;
+    struct Simulation_Batch *batch = job->batch;
+    size_t n = batch->n_components;
+    size_t n_f = batch->grid.n_frequencies;
+    size_t chunk_start = chunk_index * SIMULATION_CHUNK_SIZE;
+    size_t chunk_end = min(chunk_start + SIMULATION_CHUNK_SIZE, n_f);
+    size_t columns = job->goal_count + 1;
+    double *partial = &job->partial_losses[chunk_index * job->n_candidates * columns];
+
+    _Alignas(64) double scratch[2 * 8 * SIMULATION_BATCH_BLOCK_SIZE];
+    struct Complex_2x2_SoA acc, tmp;
+    soa_from_block(&acc, scratch, SIMULATION_BATCH_BLOCK_SIZE);
+    soa_from_block(&tmp, scratch + 8 * SIMULATION_BATCH_BLOCK_SIZE, SIMULATION_BATCH_BLOCK_SIZE);
+
+    for (size_t offset = chunk_start; offset < chunk_end; offset += SIMULATION_BATCH_BLOCK_SIZE) {
+        size_t count = min(SIMULATION_BATCH_BLOCK_SIZE, chunk_end - offset);
+        double *f = &batch->grid.frequencies[offset];
+        struct Complex_2x2_SoA t_in = circuit_soa_offset(&batch->grid.t_prefix[0], offset);
+        struct Complex_2x2_SoA t_out = circuit_soa_offset(&batch->grid.t_suffix[n], offset);
+
+        for (size_t c = 0; c < job->n_candidates; c++) {
+            // [T_in] T_0 ... T_(n-1) [T_out]
+            memcpy(acc.r11, t_in.r11, sizeof(double) * count); memcpy(acc.i11, t_in.i11, sizeof(double) * count);
+            memcpy(acc.r12, t_in.r12, sizeof(double) * count); memcpy(acc.i12, t_in.i12, sizeof(double) * count);
+            memcpy(acc.r21, t_in.r21, sizeof(double) * count); memcpy(acc.i21, t_in.i21, sizeof(double) * count);
+            memcpy(acc.r22, t_in.r22, sizeof(double) * count); memcpy(acc.i22, t_in.i22, sizeof(double) * count);
+            for (size_t k = 0; k < n; k++) {
+                size_t i = k * batch->max_candidates + c;
+                if (batch->template_cascade[k].kind == CIRCUIT_COMPONENT_STAGE) {
+                    struct Complex_2x2_SoA t_stage;
+                    soa_from_block(&t_stage, batch->stage_t[k][batch->settings[i]], n_f);
+                    struct Complex_2x2_SoA t_k = circuit_soa_offset(&t_stage, offset);
+                    circuit_multiply_t_soa(&acc, &acc, &t_k, count);
+                } else {
+                    struct Circuit_Component component = batch->template_cascade[k];
+                    *circuit_component_value(&component) = batch->values[i];
+                    circuit_t_params_circuit_component(&component, f, &tmp, count);
+                    circuit_multiply_t_soa(&acc, &acc, &tmp, count);
+                }
+            }
+            circuit_multiply_t_soa(&acc, &acc, &t_out, count);
+            circuit_s_from_t_soa(&acc, &acc, count);
+
+            double *losses = &partial[c * columns];
+            for (size_t j = 0; j < count; j++) {
+                if (!isfinite(acc.r11[j] + acc.i11[j] + acc.r12[j] + acc.i12[j] + acc.r21[j] + acc.i21[j] + acc.r22[j] + acc.i22[j])) {
+                    losses[job->goal_count] += 1.0;
+                }
+            }
+            if (batch->full_results) {
+                struct Complex_2x2_SoA s_all = circuit_simulation_batch_s_result(batch, c);
+                struct Complex_2x2_SoA s = circuit_soa_offset(&s_all, offset);
+                memcpy(s.r11, acc.r11, sizeof(double) * count); memcpy(s.i11, acc.i11, sizeof(double) * count);
+                memcpy(s.r12, acc.r12, sizeof(double) * count); memcpy(s.i12, acc.i12, sizeof(double) * count);
+                memcpy(s.r21, acc.r21, sizeof(double) * count); memcpy(s.i21, acc.i21, sizeof(double) * count);
+                memcpy(s.r22, acc.r22, sizeof(double) * count); memcpy(s.i22, acc.i22, sizeof(double) * count);
+            }
+
+            // the hinge losses of the goals that overlap this block
+            for (size_t g = 0; g < job->goal_count; g++) {
+                size_t from = max(job->goal_start[g], offset);
+                size_t to = min(job->goal_end[g], offset + count);
+                for (size_t j = from; j < to; j++) losses[g] += batch_goal_loss(&job->goals[g], &acc, j - offset);
+            }
+        }
+    }
+}
+
+bool circuit_simulation_batch_run(struct Simulation_Batch *batch, size_t n_candidates, const struct Optimization_Goal *goals, size_t goal_count, double *losses_out) {
+    assert(n_candidates <= batch->max_candidates);
+    size_t n_f = batch->grid.n_frequencies;
+    size_t n_chunks = (n_f + SIMULATION_CHUNK_SIZE - 1) / SIMULATION_CHUNK_SIZE;
+    size_t columns = goal_count + 1;
+
+    for (size_t k = 0; k < batch->n_components; k++) {
+        if (batch->template_cascade[k].kind != CIRCUIT_COMPONENT_STAGE) continue;
+        for (size_t c = 0; c < n_candidates; c++) {
+            if (!simulation_batch_stage_t(batch, k, batch->settings[k * batch->max_candidates + c])) return false;
+        }
+    }
+
+    struct Simulation_Batch_Job job = {
+        .batch = batch,
+        .n_candidates = n_candidates,
+        .goals = goals,
+        .goal_count = goal_count,
+        .goal_start = malloc(sizeof(size_t) * max(goal_count, 1)),
+        .goal_end = malloc(sizeof(size_t) * max(goal_count, 1)),
+        .partial_losses = calloc(max(n_chunks * n_candidates * columns, 1), sizeof(double)),
+    };
+    if (!job.goal_start || !job.goal_end || !job.partial_losses) {
+        printf("ERROR: circuit_simulation_batch_run(): out of memory\n");
+        free(job.goal_start);
+        free(job.goal_end);
+        free(job.partial_losses);
+        return false;
+    }
+    for (size_t g = 0; g < goal_count; g++) {
+        size_t start, count;
+        circuit_optimizer_goal_frequency_range(&goals[g], &batch->grid, &start, &count);
+        job.goal_start[g] = start;
+        job.goal_end[g] = start + count;
+    }
 
+    simulation_run_chunks(batch->grid.single_threaded, simulation_batch_chunk, &job, n_chunks);
+
+    // goal losses summed in chunk order, the losses do not depend on the number of threads
+    for (size_t c = 0; losses_out && c < n_candidates; c++) {
+        double loss = 0.0;
+        bool broken = false;
+        for (size_t g = 0; g < columns; g++) {
+            double goal_loss = 0.0;
+            for (size_t i = 0; i < n_chunks; i++) goal_loss += job.partial_losses[(i * n_candidates + c) * columns + g];
+            if (g == goal_count) broken = goal_loss > 0.0;
+            else loss += goals[g].weight * goal_loss;
+        }
+        losses_out[c] = broken ? DBL_MAX : loss;
+    }
+
+    free(job.goal_start);
+    free(job.goal_end);
+    free(job.partial_losses);
+    return true;
+}
+
+//
+// cache of component responses
+//
+
+struct Circuit_T_Cache_Entry {
+    uint64_t hash; // of the key below
+    CIRCUIT_COMPONENT_KIND kind;
+    double value; // lumped components
+    const struct S2P_Info *s2p_infos; // stages
+    size_t setting;
+    uint64_t grid_hash;
+    size_t n_frequencies;
+    double *planes; // 8 planes of n_frequencies
+    size_t newer; // neighbours in the recently used list, capacity means none
+    size_t older;
+};
+
+struct Circuit_T_Cache {
+    struct Circuit_T_Cache_Entry *entries;
+    size_t capacity;
+    size_t count;
+    size_t *slots; // open addressing index into entries, capacity means empty
+    size_t slot_mask;
+    size_t newest;
+    size_t oldest;
+    size_t hits;
+    size_t misses;
+};
+
+struct Circuit_T_Cache *circuit_t_cache_create(size_t capacity) {
+    if (capacity == 0) capacity = 1;
+    struct Circuit_T_Cache *cache = calloc(1, sizeof(*cache));
+    size_t n_slots = 2;
+    while (n_slots < 2 * capacity) n_slots *= 2;
+    if (cache) {
+        cache->entries = calloc(capacity, sizeof(*cache->entries));
+        cache->slots = malloc(sizeof(size_t) * n_slots);
+    }
+    if (!cache || !cache->entries || !cache->slots) {
+        printf("ERROR: circuit_t_cache_create(): out of memory\n");
+        if (cache) free(cache->entries);
+        if (cache) free(cache->slots);
+        free(cache);
+        return NULL;
+    }
+    for (size_t i = 0; i < n_slots; i++) cache->slots[i] = capacity;
+    cache->capacity = capacity;
+    cache->slot_mask = n_slots - 1;
+    cache->newest = capacity;
+    cache->oldest = capacity;
+    return cache;
+}
+
+void circuit_t_cache_destroy(struct Circuit_T_Cache *cache) {
+    if (!cache) return;
+    for (size_t i = 0; i < cache->count; i++) free(cache->entries[i].planes);
+    free(cache->entries);
+    free(cache->slots);
+    free(cache);
+}
 
+void circuit_t_cache_stats(const struct Circuit_T_Cache *cache, size_t *hits, size_t *misses) {
+    if (hits) *hits = cache->hits;
+    if (misses) *misses = cache->misses;
+}
+
+// key of a component on a grid, false for kinds that can not be cached
+static bool t_cache_key(const struct Circuit_Component *component, const struct Simulation_State *sim_state, struct Circuit_T_Cache_Entry *key) {
+    memset(key, 0, sizeof(*key));
+    key->kind = component->kind;
+    key->grid_hash = sim_state->grid_hash;
+    key->n_frequencies = sim_state->n_frequencies;
+    if (component->kind == CIRCUIT_COMPONENT_STAGE) {
+        key->s2p_infos = component->as.stage.s2p_infos;
+        key->setting = component->as.stage.selected_setting;
+    } else {
+        double *value = circuit_component_value((struct Circuit_Component *)component);
+        if (!value) return false;
+        key->value = *value;
+    }
+    uint64_t hash = uti_hash_bytes(&key->kind, sizeof(key->kind), 0);
+    hash = uti_hash_bytes(&key->value, sizeof(key->value), hash);
+    hash = uti_hash_bytes(&key->s2p_infos, sizeof(key->s2p_infos), hash);
+    hash = uti_hash_bytes(&key->setting, sizeof(key->setting), hash);
+    hash = uti_hash_bytes(&key->grid_hash, sizeof(key->grid_hash), hash);
+    key->hash = uti_hash_bytes(&key->n_frequencies, sizeof(key->n_frequencies), hash);
+    return true;
+}
+
+static bool t_cache_key_equal(const struct Circuit_T_Cache_Entry *a, const struct Circuit_T_Cache_Entry *b) {
+    return a->hash == b->hash && a->kind == b->kind && memcmp(&a->value, &b->value, sizeof(a->value)) == 0 &&
+        a->s2p_infos == b->s2p_infos && a->setting == b->setting && a->grid_hash == b->grid_hash &&
+        a->n_frequencies == b->n_frequencies;
+}
+
+static void t_cache_unlink(struct Circuit_T_Cache *cache, size_t i) {
+    struct Circuit_T_Cache_Entry *entry = &cache->entries[i];
+    if (entry->newer < cache->capacity) cache->entries[entry->newer].older = entry->older;
+    else cache->newest = entry->older;
+    if (entry->older < cache->capacity) cache->entries[entry->older].newer = entry->newer;
+    else cache->oldest = entry->newer;
+}
+
+static void t_cache_link_newest(struct Circuit_T_Cache *cache, size_t i) {
+    struct Circuit_T_Cache_Entry *entry = &cache->entries[i];
+    entry->newer = cache->capacity;
+    entry->older = cache->newest;
+    if (cache->newest < cache->capacity) cache->entries[cache->newest].newer = i;
+    cache->newest = i;
+    if (cache->oldest == cache->capacity) cache->oldest = i;
+}
+
+// slot of the key, or the empty slot where it would go
+static size_t t_cache_find_slot(const struct Circuit_T_Cache *cache, const struct Circuit_T_Cache_Entry *key) {
+    size_t slot = key->hash & cache->slot_mask;
+    while (cache->slots[slot] != cache->capacity && !t_cache_key_equal(&cache->entries[cache->slots[slot]], key)) {
+        slot = (slot + 1) & cache->slot_mask;
+    }
+    return slot;
+}
+
+// linear probing delete: move the following entries of the run back so no lookup stops early
+static void t_cache_remove_slot(struct Circuit_T_Cache *cache, size_t slot) {
+    cache->slots[slot] = cache->capacity;
+    size_t next = (slot + 1) & cache->slot_mask;
+    while (cache->slots[next] != cache->capacity) {
+        size_t i = cache->slots[next];
+        size_t home = cache->entries[i].hash & cache->slot_mask;
+        // the entry may stay unless the hole lies between its home and its slot
+        bool move = slot <= next ? (home <= slot || home > next) : (home <= slot && home > next);
+        if (move) {
+            cache->slots[slot] = i;
+            cache->slots[next] = cache->capacity;
+            slot = next;
+        }
+        next = (next + 1) & cache->slot_mask;
+    }
+}
+
+const double *circuit_t_cache_get(struct Circuit_T_Cache *cache, const struct Circuit_Component *component, const struct Simulation_State *sim_state) {
+    struct Circuit_T_Cache_Entry key;
+    if (!t_cache_key(component, sim_state, &key)) return NULL;
+
+    size_t slot = t_cache_find_slot(cache, &key);
+    if (cache->slots[slot] != cache->capacity) {
+        size_t i = cache->slots[slot];
+        cache->hits++;
+        t_cache_unlink(cache, i);
+        t_cache_link_newest(cache, i);
+        return cache->entries[i].planes;
+    }
+    cache->misses++;
+
+    // a new entry or the least recently used one
+    size_t i;
+    double *planes;
+    if (cache->count < cache->capacity) {
+        i = cache->count++;
+        planes = malloc(sizeof(double) * 8 * sim_state->n_frequencies);
+        if (!planes) {
+            cache->count--;
+            printf("ERROR: circuit_t_cache_get(): out of memory\n");
+            return NULL;
+        }
+    } else {
+        i = cache->oldest;
+        t_cache_unlink(cache, i);
+        t_cache_remove_slot(cache, t_cache_find_slot(cache, &cache->entries[i]));
+        planes = cache->entries[i].planes;
+        if (cache->entries[i].n_frequencies < sim_state->n_frequencies) {
+            free(planes);
+            planes = malloc(sizeof(double) * 8 * sim_state->n_frequencies);
+            if (!planes) {
+                // drop the entry for good, the last one takes its place (with its slot and links)
+                size_t last = --cache->count;
+                if (i != last) {
+                    cache->slots[t_cache_find_slot(cache, &cache->entries[last])] = i;
+                    cache->entries[i] = cache->entries[last];
+                    struct Circuit_T_Cache_Entry *entry = &cache->entries[i];
+                    if (entry->newer < cache->capacity) cache->entries[entry->newer].older = i;
+                    else cache->newest = i;
+                    if (entry->older < cache->capacity) cache->entries[entry->older].newer = i;
+                    else cache->oldest = i;
+                }
+                printf("ERROR: circuit_t_cache_get(): out of memory\n");
+                return NULL;
+            }
+        }
+        slot = t_cache_find_slot(cache, &key);
+    }
+
+    size_t n_f = sim_state->n_frequencies;
+    struct Circuit_Component copy = *component;
+    struct Complex_2x2_SoA t;
+    soa_from_block(&t, planes, n_f);
+    if (!circuit_t_params_circuit_component(&copy, sim_state->frequencies, &t, n_f)) {
+        circuit_interpolate_sparams_circuit_component(&copy, sim_state->frequencies, &t, n_f);
+        calc_t_from_s_array(&t, &t, n_f);
+    }
+
+    key.planes = planes;
+    cache->entries[i] = key;
+    cache->slots[slot] = i;
+    t_cache_link_newest(cache, i);
+    return planes;
+}
+
+#define SIMULATION_WRITE_BUFFER_SIZE (1 << 20)
+
+static FILE *open_result_file(const char *path, char **buffer) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        printf("ERROR: could not open %s for writing\n", path);
+        return NULL;
+    }
+    // the rows are formatted into one big buffer and written in large blocks
+    *buffer = malloc(SIMULATION_WRITE_BUFFER_SIZE);
+    if (*buffer) setvbuf(file, *buffer, _IOFBF, SIMULATION_WRITE_BUFFER_SIZE);
+    return file;
+}
+
+static bool close_result_file(FILE *file, char *buffer, const char *path) {
+    bool ok = !ferror(file);
+    if (fclose(file) != 0) ok = false;
+    free(buffer);
+    if (!ok) printf("ERROR: could not write %s\n", path);
+    return ok;
+}
+
+bool circuit_simulation_write_touchstone(const struct Simulation_State *sim_state, const char *path) {
+    char *buffer = NULL;
+    FILE *file = open_result_file(path, &buffer);
+    if (!file) return false;
+
+    fprintf(file, "! simulated by impedancer: %zu components, source impedance %.17g, load impedance %.17g\n",
+        sim_state->n_components, sim_state->z0_in, sim_state->z0_out);
+    fprintf(file, "# Hz S RI R 50\n");
+    fprintf(file, "! freq ReS11 ImS11 ReS21 ImS21 ReS12 ImS12 ReS22 ImS22\n");
+    const struct Complex_2x2_SoA *s = &sim_state->s_result;
+    for (size_t i = 0; i < sim_state->n_frequencies; i++) {
+        fprintf(file, "%.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g\n", sim_state->frequencies[i],
+            s->r11[i], s->i11[i], s->r21[i], s->i21[i], s->r12[i], s->i12[i], s->r22[i], s->i22[i]);
+    }
+
+    return close_result_file(file, buffer, path);
+}
+
+bool circuit_simulation_write_csv(const struct Simulation_State *sim_state, const char *path) {
+    char *buffer = NULL;
+    FILE *file = open_result_file(path, &buffer);
+    if (!file) return false;
+
+    fprintf(file, "f,re_s11,im_s11,re_s21,im_s21,re_s12,im_s12,re_s22,im_s22,mu,mu_prime\n");
+    const struct Complex_2x2_SoA *s = &sim_state->s_result;
+    for (size_t i = 0; i < sim_state->n_frequencies; i++) {
+        fprintf(file, "%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g\n", sim_state->frequencies[i],
+            s->r11[i], s->i11[i], s->r21[i], s->i21[i], s->r12[i], s->i12[i], s->r22[i], s->i22[i],
+            sim_state->stab_mu[i], sim_state->stab_mu_prime[i]);
+    }
+
+    return close_result_file(file, buffer, path);
+}
@@ -0,0 +1,1561 @@
+// Copyright (C) 2026 Benjamin Froelich
+// This file is part of https://github.com/bbeni/impedancer
+// For conditions of distribution and use, see copyright notice in project root.
+#include "stdbool.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "stdint.h"
+#include "float.h"
+#include "time.h"
+#include "locale.h"
+#include "circuit.h"
+
+#define TEST_START() bool did_fail = false
+#define EQF(a, b, tol) if(fabs((a)-(b)) > (tol)){printf("SUBTEST FAILED: %s:%d: %.20f (have) == %.20f (should have)\n", __FILE__, __LINE__, (a), (b)); did_fail = true;}
+#define EQFi(a, b, tol, i) if(fabs((a)-(b)) > (tol)){printf("SUBTEST(%zu) FAILED: %s:%d: %.20f (have) == %.20f (should have)\n", (i), __FILE__, __LINE__, (a), (b)); did_fail = true;}
+#define EQBITSi(a, b, i) if(memcmp(&(a), &(b), sizeof(double)) != 0){printf("SUBTEST(%zu) FAILED: %s:%d: %.20f (have) == %.20f (should have) bitwise\n", (i), __FILE__, __LINE__, (a), (b)); did_fail = true;}
+#define TEST_END() return !did_fail
+
+static double random_double(void) {
+    return 2.0 * rand() / RAND_MAX - 1.0;
+}
+
+// malloc an SoA with n entries per plane and fill it with random numbers in [-1, 1]
+static struct Complex_2x2_SoA random_soa(size_t n) {
+    struct Complex_2x2_SoA soa;
+    soa.r11 = malloc(8 * n * sizeof(double));
+    soa.r12 = &soa.r11[1 * n];
+    soa.r21 = &soa.r11[2 * n];
+    soa.r22 = &soa.r11[3 * n];
+    soa.i11 = &soa.r11[4 * n];
+    soa.i12 = &soa.r11[5 * n];
+    soa.i21 = &soa.r11[6 * n];
+    soa.i22 = &soa.r11[7 * n];
+    for (size_t i = 0; i < 8 * n; i++) soa.r11[i] = random_double();
+    return soa;
+}
+
+// the planes of an SoA created by random_soa() are contiguous, so compare them as one array
+static double *soa_flat(struct Complex_2x2_SoA *soa) {
+    return soa->r11;
+}
+
+bool test_circuit_multiply_t_soa_sse2_bitwise() {
+    // odd length to run through the scalar tail too
+    size_t n = 1001;
+    srand(1);
+    struct Complex_2x2_SoA tx = random_soa(n);
+    struct Complex_2x2_SoA ty = random_soa(n);
+    struct Complex_2x2_SoA tf_reference = random_soa(n);
+    struct Complex_2x2_SoA tf = random_soa(n);
+
+    circuit_multiply_t_soa_scalar(&tf_reference, &tx, &ty, n);
+    circuit_multiply_t_soa_sse2(&tf, &tx, &ty, n);
+
+    TEST_START();
+    for (size_t i = 0; i < 8 * n; i++) {
+        EQBITSi(soa_flat(&tf)[i], soa_flat(&tf_reference)[i], i);
+    }
+    free(tx.r11); free(ty.r11); free(tf_reference.r11); free(tf.r11);
+    TEST_END();
+}
+
+bool test_circuit_multiply_t_soa_avx2_tolerance() {
+    TEST_START();
+    if (circuit_kernel_detect() != CIRCUIT_KERNEL_AVX2_FMA) {
+        printf("INFO: cpu has no AVX2/FMA, skipping %s\n", __func__);
+        TEST_END();
+    }
+
+    size_t n = 1003;
+    srand(2);
+    struct Complex_2x2_SoA tx = random_soa(n);
+    struct Complex_2x2_SoA ty = random_soa(n);
+    struct Complex_2x2_SoA tf_reference = random_soa(n);
+    struct Complex_2x2_SoA tf = random_soa(n);
+
+    circuit_multiply_t_soa_scalar(&tf_reference, &tx, &ty, n);
+    circuit_multiply_t_soa_avx2(&tf, &tx, &ty, n);
+
+    // four products of numbers <= 1 summed, fma saves one rounding per pair
+    for (size_t i = 0; i < 8 * n; i++) {
+        EQFi(soa_flat(&tf)[i], soa_flat(&tf_reference)[i], 4e-15, i);
+    }
+    free(tx.r11); free(ty.r11); free(tf_reference.r11); free(tf.r11);
+    TEST_END();
+}
+
+bool test_circuit_multiply_t_soa_in_place() {
+    // T_f = T_f * T_y must give the same as with a separate output
+    size_t n = 17;
+    srand(3);
+    struct Complex_2x2_SoA tx = random_soa(n);
+    struct Complex_2x2_SoA ty = random_soa(n);
+    struct Complex_2x2_SoA tf_reference = random_soa(n);
+    circuit_multiply_t_soa_scalar(&tf_reference, &tx, &ty, n);
+
+    circuit_multiply_t_soa(&tx, &tx, &ty, n);
+
+    TEST_START();
+    for (size_t i = 0; i < 8 * n; i++) {
+        EQFi(soa_flat(&tx)[i], soa_flat(&tf_reference)[i], 4e-15, i);
+    }
+    free(tx.r11); free(ty.r11); free(tf_reference.r11);
+    TEST_END();
+}
+
+bool test_circuit_multiply_t_soa_against_mma() {
+    // compare one frequency point with a plain complex 2x2 matrix product
+    size_t n = 1;
+    srand(4);
+    struct Complex_2x2_SoA tx = random_soa(n);
+    struct Complex_2x2_SoA ty = random_soa(n);
+    struct Complex_2x2_SoA tf = random_soa(n);
+    circuit_multiply_t_soa(&tf, &tx, &ty, n);
+
+    struct Complex x[2][2] = {{{tx.r11[0], tx.i11[0]}, {tx.r12[0], tx.i12[0]}}, {{tx.r21[0], tx.i21[0]}, {tx.r22[0], tx.i22[0]}}};
+    struct Complex y[2][2] = {{{ty.r11[0], ty.i11[0]}, {ty.r12[0], ty.i12[0]}}, {{ty.r21[0], ty.i21[0]}, {ty.r22[0], ty.i22[0]}}};
+    struct Complex f[2][2];
+    for (size_t r = 0; r < 2; r++) {
+        for (size_t c = 0; c < 2; c++) {
+            f[r][c] = mma_complex_add(mma_complex_mult(x[r][0], y[0][c]), mma_complex_mult(x[r][1], y[1][c]));
+        }
+    }
+
+    TEST_START();
+    EQF(tf.r11[0], f[0][0].r, 1e-14); EQF(tf.i11[0], f[0][0].i, 1e-14);
+    EQF(tf.r12[0], f[0][1].r, 1e-14); EQF(tf.i12[0], f[0][1].i, 1e-14);
+    EQF(tf.r21[0], f[1][0].r, 1e-14); EQF(tf.i21[0], f[1][0].i, 1e-14);
+    EQF(tf.r22[0], f[1][1].r, 1e-14); EQF(tf.i22[0], f[1][1].i, 1e-14);
+    free(tx.r11); free(ty.r11); free(tf.r11);
+    TEST_END();
+}
+
+bool test_circuit_cascade_t_soa_matches_chained_multiply() {
+    // accumulating in registers must round exactly like multiplying one after the other
+    size_t n = 1001;
+    size_t offset = 3;
+    srand(6);
+    struct Complex_2x2_SoA ts[5];
+    const struct Complex_2x2_SoA *ts_pointers[5];
+    for (size_t k = 0; k < 5; k++) {
+        ts[k] = random_soa(n);
+        ts_pointers[k] = &ts[k];
+    }
+    struct Complex_2x2_SoA tf_reference = random_soa(n);
+    struct Complex_2x2_SoA tf = random_soa(n);
+
+    TEST_START();
+    CIRCUIT_KERNEL kernels[] = {CIRCUIT_KERNEL_SCALAR, CIRCUIT_KERNEL_SSE2, CIRCUIT_KERNEL_AVX2_FMA};
+    for (size_t i_kernel = 0; i_kernel < 3; i_kernel++) {
+        if (kernels[i_kernel] > circuit_kernel_detect()) continue;
+        circuit_kernel_select(kernels[i_kernel]);
+
+        struct Complex_2x2_SoA reference = circuit_soa_offset(&tf_reference, offset);
+        struct Complex_2x2_SoA t_0 = circuit_soa_offset(&ts[0], offset);
+        for (size_t k = 1; k < 5; k++) {
+            struct Complex_2x2_SoA t_k = circuit_soa_offset(&ts[k], offset);
+            circuit_multiply_t_soa(&reference, k == 1 ? &t_0 : &reference, &t_k, n - offset);
+        }
+        circuit_cascade_t_soa(&tf, ts_pointers, 5, offset, n - offset);
+
+        for (size_t i = offset; i < n; i++) {
+            EQBITSi(tf.r11[i], tf_reference.r11[i], i); EQBITSi(tf.i11[i], tf_reference.i11[i], i);
+            EQBITSi(tf.r12[i], tf_reference.r12[i], i); EQBITSi(tf.i12[i], tf_reference.i12[i], i);
+            EQBITSi(tf.r21[i], tf_reference.r21[i], i); EQBITSi(tf.i21[i], tf_reference.i21[i], i);
+            EQBITSi(tf.r22[i], tf_reference.r22[i], i); EQBITSi(tf.i22[i], tf_reference.i22[i], i);
+        }
+    }
+    circuit_kernel_select(circuit_kernel_detect());
+
+    for (size_t k = 0; k < 5; k++) free(ts[k].r11);
+    free(tf_reference.r11); free(tf.r11);
+    TEST_END();
+}
+
+bool test_circuit_s_t_conversion_kernels() {
+    size_t n = 1001;
+    srand(7);
+    struct Complex_2x2_SoA s = random_soa(n);
+    struct Complex_2x2_SoA t_reference = random_soa(n);
+    struct Complex_2x2_SoA t = random_soa(n);
+    struct Complex_2x2_SoA s_back = random_soa(n);
+
+    TEST_START();
+
+    // against the per point version in mma.c
+    circuit_t_from_s_soa_scalar(&t_reference, &s, n);
+    for (size_t i = 0; i < n; i++) {
+        struct Complex s1[2][2] = {{{s.r11[i], s.i11[i]}, {s.r12[i], s.i12[i]}}, {{s.r21[i], s.i21[i]}, {s.r22[i], s.i22[i]}}};
+        struct Mma_Complex_2x2 t1 = calc_t_from_s(s1);
+        double tol = 1e-12 * (1.0 + mma_complex_absolute(t1.v[1][1]) + mma_complex_absolute(t1.v[0][0]));
+        EQFi(t_reference.r11[i], t1.v[0][0].r, tol, i); EQFi(t_reference.i11[i], t1.v[0][0].i, tol, i);
+        EQFi(t_reference.r12[i], t1.v[0][1].r, tol, i); EQFi(t_reference.i12[i], t1.v[0][1].i, tol, i);
+        EQFi(t_reference.r21[i], t1.v[1][0].r, tol, i); EQFi(t_reference.i21[i], t1.v[1][0].i, tol, i);
+        EQFi(t_reference.r22[i], t1.v[1][1].r, tol, i); EQFi(t_reference.i22[i], t1.v[1][1].i, tol, i);
+    }
+
+    // SSE2 is bit identical, AVX2 within a few ulp
+    circuit_t_from_s_soa_sse2(&t, &s, n);
+    for (size_t i = 0; i < 8 * n; i++) {
+        EQBITSi(soa_flat(&t)[i], soa_flat(&t_reference)[i], i);
+    }
+    circuit_s_from_t_soa_scalar(&s_back, &t_reference, n);
+    circuit_s_from_t_soa_sse2(&t, &t_reference, n);
+    for (size_t i = 0; i < 8 * n; i++) {
+        EQBITSi(soa_flat(&t)[i], soa_flat(&s_back)[i], i);
+    }
+    if (circuit_kernel_detect() == CIRCUIT_KERNEL_AVX2_FMA) {
+        circuit_t_from_s_soa_avx2(&t, &s, n);
+        for (size_t i = 0; i < 8 * n; i++) {
+            EQFi(soa_flat(&t)[i], soa_flat(&t_reference)[i], 1e-12 * (1.0 + fabs(soa_flat(&t_reference)[i])), i);
+        }
+        circuit_s_from_t_soa_avx2(&t, &t_reference, n);
+        for (size_t i = 0; i < 8 * n; i++) {
+            EQFi(soa_flat(&t)[i], soa_flat(&s_back)[i], 1e-12 * (1.0 + fabs(soa_flat(&s_back)[i])), i);
+        }
+    }
+
+    // S -> T -> S round trip
+    for (size_t i = 0; i < 8 * n; i++) {
+        EQFi(soa_flat(&s_back)[i], soa_flat(&s)[i], 1e-9, i);
+    }
+
+    // zero denominators: the reciprocal is treated as zero (in place)
+    s.r21[0] = 0.0; s.i21[0] = 0.0;
+    s.r21[1] = 1e-170; s.i21[1] = -1e-170;
+    double s12r_0 = s.r12[0], s12i_1 = s.i12[1];
+    circuit_t_from_s_soa(&s, &s, 2);
+    EQF(s.r11[0], 0.0, 0.0); EQF(s.i11[0], 0.0, 0.0); EQF(s.r12[0], 0.0, 0.0); EQF(s.r21[0], 0.0, 0.0);
+    EQF(s.r22[0], s12r_0, 0.0);
+    EQF(s.r11[1], 0.0, 0.0); EQF(s.i12[1], 0.0, 0.0); EQF(s.i21[1], 0.0, 0.0);
+    EQF(s.i22[1], s12i_1, 0.0);
+
+    free(s.r11); free(t_reference.r11); free(t.r11); free(s_back.r11);
+    TEST_END();
+}
+
+// lumped components only, so no s2p files are needed
+// a small measured stage, parsed from memory
+static char test_s2p_content[] =
+    "! test stage\n"
+    "# GHz S MA R 50\n"
+    "1.0 0.90 -30 4.1 150 0.020 70 0.60 -20\n"
+    "2.0 0.85 -55 3.8 130 0.030 60 0.55 -35\n"
+    "3.5 0.78 -85 3.2 110 0.040 50 0.50 -50\n"
+    "5.0 0.70 -110 2.7 95 0.045 45 0.47 -62\n"
+    "7.0 0.64 -140 2.1 75 0.050 40 0.45 -80\n"
+    "1.0 0.5 0.45 40 0.30\n"
+    "2.0 0.6 0.40 70 0.28\n"
+    "3.5 0.8 0.35 100 0.25\n"
+    "5.0 1.0 0.30 130 0.22\n"
+    "7.0 1.2 0.28 160 0.20\n";
+
+bool test_circuit_stage_precomputed_splines() {
+    struct S2P_Info info = {0};
+    info.file_content = test_s2p_content;
+    info.file_content_size = strlen(test_s2p_content);
+
+    TEST_START();
+    if (!parse_s2p_file(&info, false)) return false;
+
+    size_t n = 777;
+    double *frequencies = malloc(n * sizeof(double));
+    for (size_t i = 0; i < n; i++) frequencies[i] = 1e9 + 6e9 * i / (n - 1);
+
+    struct Circuit_Component stage = {0};
+    stage.kind = CIRCUIT_COMPONENT_STAGE;
+    stage.as.stage.s2p_infos = &info;
+    stage.as.stage.n_settings = 1;
+
+    struct Complex_2x2_SoA have = random_soa(n);
+    struct Complex_2x2_SoA should = random_soa(n);
+    circuit_interpolate_sparams_circuit_component(&stage, frequencies, &have, n);
+    // the coefficients are the same as the ones solved on every call, so the result is bitwise equal
+    mma_spline_cubic_natural_complex_2(info.freq, info.s11, info.data_length, should.r11, should.i11, frequencies, n);
+    mma_spline_cubic_natural_complex_2(info.freq, info.s12, info.data_length, should.r12, should.i12, frequencies, n);
+    mma_spline_cubic_natural_complex_2(info.freq, info.s21, info.data_length, should.r21, should.i21, frequencies, n);
+    mma_spline_cubic_natural_complex_2(info.freq, info.s22, info.data_length, should.r22, should.i22, frequencies, n);
+    for (size_t i = 0; i < 8 * n; i++) {
+        EQBITSi(soa_flat(&have)[i], soa_flat(&should)[i], i);
+    }
+
+    // noise parameters: the spline passes through the measured points
+    double nf[5];
+    double rn[5];
+    double gopt_r[5];
+    double gopt_i[5];
+    mma_spline_cubic_natural_eval(info.noise.freq, info.noise.NFmin, info.noise.NFmin_a, info.noise.NFmin_b, info.noise.length, nf, info.noise.freq, info.noise.length);
+    mma_spline_cubic_natural_eval(info.noise.freq, info.noise.Rn, info.noise.Rn_a, info.noise.Rn_b, info.noise.length, rn, info.noise.freq, info.noise.length);
+    mma_spline_cubic_natural_complex_eval(info.noise.freq, info.noise.GammaOpt, info.noise.GammaOpt_a, info.noise.GammaOpt_b, info.noise.length, gopt_r, gopt_i, info.noise.freq, info.noise.length);
+    for (size_t i = 0; i < info.noise.length; i++) {
+        // the noise lines are on the frequencies of the S-parameters, in Hz as well
+        EQBITSi(info.noise.freq[i], info.freq[i], i);
+        EQFi(nf[i], info.noise.NFmin[i], 1e-14, i);
+        EQFi(rn[i], info.noise.Rn[i], 1e-14, i);
+        EQFi(gopt_r[i], info.noise.GammaOpt[i].r, 1e-14, i);
+        EQFi(gopt_i[i], info.noise.GammaOpt[i].i, 1e-14, i);
+    }
+
+    free(frequencies);
+    free(have.r11);
+    free(should.r11);
+    TEST_END();
+}
+
+static size_t build_test_cascade(struct Circuit_Component *components) {
+    size_t n = 0;
+    circuit_create_inductor_ideal_parallel(1.7e-6, &components[n++]);
+    circuit_create_capacitor_ideal_parallel(95e-15, &components[n++]);
+    circuit_create_inductor_ideal(5.5e-9, &components[n++]);
+    circuit_create_capacitor_ideal(120e-12, &components[n++]);
+    circuit_create_resistor_ideal(5.0, &components[n++]);
+    circuit_create_resistor_ideal_parallel(35e3, &components[n++]);
+    circuit_create_inductor_ideal_parallel(4.7e-6, &components[n++]);
+    circuit_create_capacitor_ideal(2.2e-9, &components[n++]);
+    return n;
+}
+
+static bool results_equal(struct Simulation_State *a, struct Simulation_State *b, double tol) {
+    TEST_START();
+    for (size_t i = 0; i < a->n_frequencies; i++) {
+        EQFi(a->s_result.r11[i], b->s_result.r11[i], tol, i); EQFi(a->s_result.i11[i], b->s_result.i11[i], tol, i);
+        EQFi(a->s_result.r12[i], b->s_result.r12[i], tol, i); EQFi(a->s_result.i12[i], b->s_result.i12[i], tol, i);
+        EQFi(a->s_result.r21[i], b->s_result.r21[i], tol, i); EQFi(a->s_result.i21[i], b->s_result.i21[i], tol, i);
+        EQFi(a->s_result.r22[i], b->s_result.r22[i], tol, i); EQFi(a->s_result.i22[i], b->s_result.i22[i], tol, i);
+    }
+    TEST_END();
+}
+
+bool test_circuit_t_params_lumped_closed_form() {
+    // the closed form T must agree with S-parameters converted to T
+    struct Circuit_Component components[16];
+    size_t n_components = build_test_cascade(components);
+    size_t n = 64;
+    double frequencies[64];
+    for (size_t i = 0; i < n; i++) frequencies[i] = 1e3 * pow(1.3, (double)i);
+
+    struct Complex_2x2_SoA s = random_soa(n);
+    struct Complex_2x2_SoA t_reference = random_soa(n);
+    struct Complex_2x2_SoA t = random_soa(n);
+
+    TEST_START();
+    for (size_t i_comp = 0; i_comp < n_components; i_comp++) {
+        circuit_interpolate_sparams_circuit_component(&components[i_comp], frequencies, &s, n);
+        circuit_t_from_s_soa(&t_reference, &s, n);
+        if (!circuit_t_params_circuit_component(&components[i_comp], frequencies, &t, n)) {
+            printf("SUBTEST(%zu) FAILED: %s:%d: no closed form T\n", i_comp, __FILE__, __LINE__);
+            did_fail = true;
+            continue;
+        }
+        for (size_t i = 0; i < 8 * n; i++) {
+            EQFi(soa_flat(&t)[i], soa_flat(&t_reference)[i], 1e-9 * (1.0 + fabs(soa_flat(&t_reference)[i])), i);
+        }
+    }
+    free(s.r11); free(t_reference.r11); free(t.r11);
+    TEST_END();
+}
+
+bool test_circuit_simulation_incremental() {
+    struct Circuit_Component cascade[16];
+    struct Circuit_Component reference_cascade[16];
+    size_t n = build_test_cascade(cascade);
+    memcpy(reference_cascade, cascade, sizeof(cascade));
+
+    struct Simulation_Settings settings = {1e6, 1e9, 25.0, 75.0, 301};
+    struct Simulation_State sim = {0};
+    struct Simulation_State reference = {0};
+    circuit_simulation_setup(cascade, n, &sim, &settings);
+    circuit_simulation_do(&sim, false);
+
+    TEST_START();
+    srand(5);
+    for (size_t round = 0; round < 40; round++) {
+        struct Circuit_Component candidate_cascade[16];
+        memcpy(candidate_cascade, cascade, sizeof(cascade));
+        size_t k = circuit_random_tweak_cascade(candidate_cascade, n);
+        circuit_simulation_do_incremental(&sim, k, &candidate_cascade[k]);
+
+        circuit_simulation_setup(candidate_cascade, n, &reference, &settings);
+        circuit_simulation_do(&reference, false);
+        if (!results_equal(&sim, &reference, 1e-12)) did_fail = true;
+
+        // accept every second candidate
+        if (round % 2 == 0) {
+            circuit_simulation_accept_incremental(&sim);
+            reference_cascade[k] = candidate_cascade[k];
+        }
+    }
+
+    // the accepted candidates ended up in the cascade
+    for (size_t i = 0; i < n; i++) {
+        if (memcmp(&cascade[i], &reference_cascade[i], sizeof(cascade[i])) != 0) {
+            printf("SUBTEST(%zu) FAILED: %s:%d: component differs after accepting\n", i, __FILE__, __LINE__);
+            did_fail = true;
+        }
+    }
+
+    // marking a changed component dirty gives the same as a new setup
+    cascade[3].as.capacitor_ideal.C *= 2.0;
+    circuit_simulation_mark_dirty(&sim, 3);
+    circuit_simulation_do(&sim, false);
+    circuit_simulation_setup(cascade, n, &reference, &settings);
+    circuit_simulation_do(&reference, false);
+    if (!results_equal(&sim, &reference, 0.0)) did_fail = true;
+
+    circuit_simulation_destroy(&sim);
+    circuit_simulation_destroy(&reference);
+    TEST_END();
+}
+
+bool test_circuit_simulation_arena_resize() {
+    // a state that is set up again for a bigger problem must give the same as a fresh one
+    struct Circuit_Component cascade[16];
+    size_t n = build_test_cascade(cascade);
+    struct Simulation_Settings small_settings = {1e6, 1e9, 50.0, 50.0, 101};
+    struct Simulation_Settings big_settings = {1e6, 2e9, 25.0, 75.0, 1003};
+
+    struct Simulation_State reused = {0};
+    circuit_simulation_setup(cascade, 3, &reused, &small_settings);
+    circuit_simulation_do(&reused, false);
+    size_t small_arena_size = reused.arena.size;
+
+    TEST_START();
+    circuit_simulation_setup(cascade, n, &reused, &big_settings);
+    circuit_simulation_do(&reused, false);
+    struct Simulation_State fresh = {0};
+    circuit_simulation_setup(cascade, n, &fresh, &big_settings);
+    circuit_simulation_do(&fresh, false);
+    if (!results_equal(&reused, &fresh, 0.0)) did_fail = true;
+    if (reused.arena.size <= small_arena_size) {
+        printf("SUBTEST FAILED: %s:%d: arena was not grown\n", __FILE__, __LINE__);
+        did_fail = true;
+    }
+
+    // every plane starts on a cache line
+    const double *planes[] = {
+        reused.frequencies, reused.stab_mu, reused.s_result.r11, reused.s_result.i22,
+        reused.t_result.r12, reused.intermediate_states[n - 1].t.i21, reused.t_suffix[n].r22,
+    };
+    for (size_t i = 0; i < sizeof planes / sizeof planes[0]; i++) {
+        if ((uintptr_t)planes[i] % UTI_CACHE_LINE_SIZE != 0) {
+            printf("SUBTEST(%zu) FAILED: %s:%d: plane is not cache line aligned\n", i, __FILE__, __LINE__);
+            did_fail = true;
+        }
+    }
+
+    // shrinking keeps the arena
+    void *big_arena = reused.arena.memory;
+    circuit_simulation_setup(cascade, 3, &reused, &small_settings);
+    circuit_simulation_do(&reused, false);
+    if (reused.arena.memory != big_arena) {
+        printf("SUBTEST FAILED: %s:%d: arena was reallocated for a smaller problem\n", __FILE__, __LINE__);
+        did_fail = true;
+    }
+
+    // huge pages (or the fallback) give the same results
+    struct Simulation_State huge = {0};
+    circuit_simulation_set_huge_pages(true);
+    circuit_simulation_setup(cascade, n, &huge, &big_settings);
+    circuit_simulation_set_huge_pages(false);
+    circuit_simulation_do(&huge, false);
+    if (!results_equal(&huge, &fresh, 0.0)) did_fail = true;
+
+    circuit_simulation_destroy(&reused);
+    circuit_simulation_destroy(&fresh);
+    circuit_simulation_destroy(&huge);
+    TEST_END();
+}
+
+bool test_circuit_simulation_write_touchstone_round_trip() {
+    // the written Touchstone file parses back to the simulated S-parameters
+    struct Circuit_Component cascade[16];
+    size_t n = build_test_cascade(cascade);
+    struct Simulation_Settings settings = {1e6, 1e9, 50.0, 50.0, 257};
+    struct Simulation_State sim = {0};
+    circuit_simulation_setup(cascade, n, &sim, &settings);
+    circuit_simulation_do(&sim, false);
+
+    TEST_START();
+    const char *path = "build/circuit_tests_result.s2p";
+    if (!circuit_simulation_write_touchstone(&sim, path)) {
+        circuit_simulation_destroy(&sim);
+        return false;
+    }
+
+    struct S2P_Info info = {0};
+    if (!uti_read_entire_file(path, &info.file_content, &info.file_content_size) || !parse_s2p_file(&info, false)) {
+        circuit_simulation_destroy(&sim);
+        return false;
+    }
+    remove(path);
+
+    if (info.data_length != sim.n_frequencies) {
+        printf("SUBTEST FAILED: %s:%d: %zu (have) == %zu (should have) frequencies\n", __FILE__, __LINE__, info.data_length, sim.n_frequencies);
+        did_fail = true;
+    }
+    for (size_t i = 0; i < info.data_length && i < sim.n_frequencies; i++) {
+        EQBITSi(info.freq[i], sim.frequencies[i], i);
+        EQBITSi(info.s11[i].r, sim.s_result.r11[i], i); EQBITSi(info.s11[i].i, sim.s_result.i11[i], i);
+        EQBITSi(info.s21[i].r, sim.s_result.r21[i], i); EQBITSi(info.s21[i].i, sim.s_result.i21[i], i);
+        EQBITSi(info.s12[i].r, sim.s_result.r12[i], i); EQBITSi(info.s12[i].i, sim.s_result.i12[i], i);
+        EQBITSi(info.s22[i].r, sim.s_result.r22[i], i); EQBITSi(info.s22[i].i, sim.s_result.i22[i], i);
+    }
+
+    circuit_simulation_destroy(&sim);
+    TEST_END();
+}
+
+bool test_circuit_simulation_threads_bitwise() {
+    // every frequency is calculated the same way, no matter which thread gets the chunk
+    struct Circuit_Component cascade[16];
+    size_t n = build_test_cascade(cascade);
+    struct Simulation_Settings settings = {1e6, 1e9, 50.0, 75.0, 5001};
+
+    struct Simulation_State single = {0};
+    circuit_simulation_set_thread_count(1);
+    circuit_simulation_setup(cascade, n, &single, &settings);
+    circuit_simulation_do(&single, false);
+
+    struct Simulation_State threaded = {0};
+    circuit_simulation_set_thread_count(4);
+    circuit_simulation_setup(cascade, n, &threaded, &settings);
+    circuit_simulation_do(&threaded, false);
+
+    TEST_START();
+    if (circuit_simulation_thread_count() != 4) {
+        printf("SUBTEST FAILED: %s:%d: %zu threads instead of 4\n", __FILE__, __LINE__, circuit_simulation_thread_count());
+        did_fail = true;
+    }
+    if (!results_equal(&threaded, &single, 0.0)) did_fail = true;
+    for (size_t i = 0; i < settings.n_frequencies; i++) {
+        EQBITSi(threaded.stab_mu[i], single.stab_mu[i], i);
+        EQBITSi(threaded.stab_mu_prime[i], single.stab_mu_prime[i], i);
+    }
+
+    struct Circuit_Component candidate = cascade[2];
+    candidate.as.inductor_ideal.L *= 1.5;
+    circuit_simulation_do_incremental(&threaded, 2, &candidate);
+    circuit_simulation_set_thread_count(1);
+    circuit_simulation_do_incremental(&single, 2, &candidate);
+    if (!results_equal(&threaded, &single, 0.0)) did_fail = true;
+
+    circuit_simulation_set_thread_count(0);
+    circuit_simulation_destroy(&single);
+    circuit_simulation_destroy(&threaded);
+    TEST_END();
+}
+
+bool test_circuit_optimizer_worker_pause_cancel() {
+    // the worker runs on its own thread, the snapshot never goes back to a worse loss and a
+    // cancelled worker publishes a last, finished snapshot
+    struct Circuit_Component cascade[16];
+    size_t n = build_test_cascade(cascade);
+    struct Simulation_Settings settings = {1e6, 1e9, 50.0, 50.0, 501};
+    struct Optimization_Goal goal = {OPTIMIZATION_TYPE_MORE_THAN, OPTIMIZATION_TARGET_S21, 0.0, 1e8, 5e8, 1.0, true, dB};
+
+    TEST_START();
+    struct Optimizer_Worker *worker = circuit_optimizer_worker_start(cascade, n, &settings, &goal, 1, 1000000);
+    if (!worker) {
+        printf("SUBTEST FAILED: %s:%d: worker did not start\n", __FILE__, __LINE__);
+        did_fail = true;
+        TEST_END();
+    }
+
+    double last_loss = DBL_MAX;
+    bool is_new = false;
+    const struct Optimizer_Snapshot *snapshot = NULL;
+    for (size_t i = 0; i < 1000; i++) {
+        snapshot = circuit_optimizer_worker_snapshot(worker, &is_new);
+        if (is_new) {
+            if (snapshot->best_loss > last_loss) {
+                printf("SUBTEST FAILED: %s:%d: loss got worse %f > %f\n", __FILE__, __LINE__, snapshot->best_loss, last_loss);
+                did_fail = true;
+            }
+            last_loss = snapshot->best_loss;
+        }
+        if (snapshot->iteration > 0) break;
+        struct timespec ts = {0, 1000000};
+        nanosleep(&ts, NULL);
+    }
+
+    circuit_optimizer_worker_pause(worker, true);
+    circuit_optimizer_worker_pause(worker, false);
+    circuit_optimizer_worker_pause(worker, true);
+    circuit_optimizer_worker_cancel(worker);
+
+    // a paused worker must still see the cancel
+    for (size_t i = 0; i < 5000; i++) {
+        snapshot = circuit_optimizer_worker_snapshot(worker, &is_new);
+        if (snapshot->finished) break;
+        struct timespec ts = {0, 1000000};
+        nanosleep(&ts, NULL);
+    }
+    if (!snapshot->finished) {
+        printf("SUBTEST FAILED: %s:%d: worker did not finish after cancel\n", __FILE__, __LINE__);
+        did_fail = true;
+    }
+    if (snapshot->n_components != n || !(snapshot->best_loss <= last_loss) || !isfinite(snapshot->best_loss)) {
+        printf("SUBTEST FAILED: %s:%d: bad final snapshot, loss %f\n", __FILE__, __LINE__, snapshot->best_loss);
+        did_fail = true;
+    }
+
+    circuit_optimizer_worker_destroy(worker);
+    TEST_END();
+}
+
+bool test_circuit_optimizer_parallel_search_reproducible() {
+    // same seed and number of searches -> bitwise the same circuit, whatever the threads do
+    struct Circuit_Component first[16] = {0};
+    struct Circuit_Component second[16] = {0};
+    size_t n = build_test_cascade(first);
+    build_test_cascade(second);
+    struct Simulation_Settings settings = {1e6, 1e9, 50.0, 50.0, 301};
+    struct Optimization_Goal goal = {OPTIMIZATION_TYPE_MORE_THAN, OPTIMIZATION_TARGET_S21, 0.0, 1e8, 5e8, 1.0, true, dB};
+
+    TEST_START();
+    double first_loss = DBL_MAX;
+    double second_loss = DBL_MAX;
+    if (!circuit_optimizer_parallel_search(first, n, &settings, &goal, 1, 300, 3, 64, 42, &first_loss)) did_fail = true;
+    if (!circuit_optimizer_parallel_search(second, n, &settings, &goal, 1, 300, 3, 64, 42, &second_loss)) did_fail = true;
+
+    EQBITSi(first_loss, second_loss, (size_t)0);
+    if (memcmp(first, second, sizeof(*first) * n) != 0) {
+        printf("SUBTEST FAILED: %s:%d: the circuits differ\n", __FILE__, __LINE__);
+        did_fail = true;
+    }
+
+    // the result is the best cascade, so simulating it gives the reported loss
+    struct Simulation_State sim = {0};
+    circuit_simulation_setup(first, n, &sim, &settings);
+    circuit_simulation_do(&sim, false);
+    double loss = circuit_optimizer_evaluate_goal(&goal, &sim);
+    EQF(loss, first_loss, 1e-9 * (1.0 + fabs(first_loss)));
+
+    circuit_simulation_destroy(&sim);
+    TEST_END();
+}
+
+bool test_circuit_optimizer_early_abort_exact() {
+    // aborting hopeless candidates early never changes a decision: the same rounds with and without
+    // the early abort end in bitwise the same circuit and loss
+    struct Circuit_Component first[16] = {0};
+    struct Circuit_Component second[16] = {0};
+    size_t n = build_test_cascade(first);
+    build_test_cascade(second);
+    struct Simulation_Settings settings = {1e6, 1e9, 50.0, 75.0, 1201};
+    struct Optimization_Goal goals[] = {
+        {OPTIMIZATION_TYPE_LESS_THAN, OPTIMIZATION_TARGET_S11, -20.0, 2e7, 3e8, 1.0, true, dB},
+        {OPTIMIZATION_TYPE_MORE_THAN, OPTIMIZATION_TARGET_S21, -0.5, 5e7, 6e8, 0.5, true, dB},
+        {OPTIMIZATION_TYPE_MORE_THAN, OPTIMIZATION_TARGET_MU, 1.0, 1e8, 9e8, 1.0, true, NULL},
+    };
+    size_t goal_count = sizeof goals / sizeof goals[0];
+
+    TEST_START();
+    struct Circuit_Component *cascades[2] = {first, second};
+    double losses[2];
+    for (size_t run = 0; run < 2; run++) {
+        struct Optimizer_State opt = {0};
+        struct Simulation_State sim = {0};
+        struct Uti_Rng rng;
+        uti_rng_seed(&rng, 11, 0);
+        circuit_optimizer_setup(&opt, 400, cascades[run], n);
+        opt.print_progress = false;
+        opt.rng = &rng;
+        opt.early_abort = run == 0;
+        while (!circuit_optimizer_update_one_round(&opt, &sim, &settings, goals, goal_count, cascades[run], n));
+        losses[run] = opt.best_total_loss_value;
+        circuit_optimizer_destroy(&opt);
+        circuit_simulation_destroy(&sim);
+    }
+    EQBITSi(losses[0], losses[1], (size_t)0);
+    if (memcmp(first, second, sizeof(*first) * n) != 0) {
+        printf("SUBTEST FAILED: %s:%d: the circuits differ\n", __FILE__, __LINE__);
+        did_fail = true;
+    }
+    TEST_END();
+}
+
+static double real_part(size_t i, void *x) {
+    return ((struct Complex *)x)[i].r;
+}
+
+bool test_circuit_optimizer_goal_plan_bitwise() {
+    // the compiled goals give bitwise the losses of circuit_optimizer_evaluate_goal(), in one piece or in blocks
+    struct Circuit_Component cascade[16];
+    size_t n = build_test_cascade(cascade);
+    struct Simulation_Settings settings = {1e6, 1e9, 50.0, 75.0, 997};
+    struct Optimization_Goal goals[] = {
+        {OPTIMIZATION_TYPE_LESS_THAN, OPTIMIZATION_TARGET_S11, -10.0, 1e7, 6e8, 1.0, true, dB},
+        {OPTIMIZATION_TYPE_MORE_THAN, OPTIMIZATION_TARGET_S21, -1.0, 5e7, 9e8, 0.5, true, dB},
+        {OPTIMIZATION_TYPE_LESS_THAN, OPTIMIZATION_TARGET_S22, 0.3, 2e6, 4e8, 2.0, true, mag},
+        {OPTIMIZATION_TYPE_MORE_THAN, OPTIMIZATION_TARGET_S12, 0.2, 2e6, 4e8, 1.5, true, mag},
+        {OPTIMIZATION_TYPE_MORE_THAN, OPTIMIZATION_TARGET_S12, -0.2, 2e6, 4e8, 1.0, true, mag},
+        {OPTIMIZATION_TYPE_MORE_THAN, OPTIMIZATION_TARGET_MU, 1.0, 1e8, 9e8, 1.0, true, NULL},
+        {OPTIMIZATION_TYPE_LESS_THAN, OPTIMIZATION_TARGET_MU_PRIME, 1.5, 1e6, 1e9, 0.25, true, NULL},
+        {OPTIMIZATION_TYPE_LESS_THAN, OPTIMIZATION_TARGET_S21, 0.1, 1e6, 1e9, 1.0, true, real_part},
+    };
+    size_t goal_count = sizeof goals / sizeof goals[0];
+
+    struct Simulation_State sim = {0};
+    circuit_simulation_setup(cascade, n, &sim, &settings);
+    circuit_simulation_do(&sim, false);
+
+    TEST_START();
+    struct Optimization_Goal_Plan plan = {0};
+    if (!circuit_optimizer_goal_plan_compile(&plan, goals, goal_count, &sim) ||
+        !circuit_optimizer_goal_plan_matches(&plan, goals, goal_count, &sim)) {
+        printf("SUBTEST FAILED: %s:%d: could not compile the goals\n", __FILE__, __LINE__);
+        did_fail = true;
+    }
+    double whole[8] = {0}, blocks[8] = {0};
+    circuit_optimizer_goal_plan_accumulate(&plan, 0, sim.n_frequencies, whole);
+    for (size_t from = 0; from < sim.n_frequencies; from += 100) {
+        circuit_optimizer_goal_plan_accumulate(&plan, from, min(from + 100, sim.n_frequencies), blocks);
+    }
+    double total = 0.0;
+    for (size_t g = 0; g < goal_count; g++) {
+        double loss = circuit_optimizer_evaluate_goal(&goals[g], &sim);
+        EQBITSi(whole[g], loss, g);
+        EQBITSi(blocks[g], loss, g);
+        total += goals[g].weight * loss;
+    }
+    double plan_total = circuit_optimizer_goal_plan_total(&plan, whole);
+    EQBITSi(plan_total, total, (size_t)0);
+
+    // another goal value needs a new plan
+    goals[0].goal_value = -12.0;
+    if (circuit_optimizer_goal_plan_matches(&plan, goals, goal_count, &sim)) {
+        printf("SUBTEST FAILED: %s:%d: the plan matches changed goals\n", __FILE__, __LINE__);
+        did_fail = true;
+    }
+
+    circuit_optimizer_goal_plan_destroy(&plan);
+    circuit_simulation_destroy(&sim);
+    TEST_END();
+}
+
+bool test_circuit_gradient_against_finite_differences() {
+    // the analytic gradient of the loss (S- and stability goals) matches central differences in ln(value)
+    struct Circuit_Component cascade[16];
+    size_t n = build_test_cascade(cascade);
+    struct Simulation_Settings settings = {1e6, 1e9, 50.0, 75.0, 701};
+    // far away goals, so no hinge switches between the difference points
+    struct Optimization_Goal goals[] = {
+        {OPTIMIZATION_TYPE_MORE_THAN, OPTIMIZATION_TARGET_S21, 100.0, 1e7, 9e8, 1.0, true, dB},
+        {OPTIMIZATION_TYPE_LESS_THAN, OPTIMIZATION_TARGET_S11, 1e-6, 1e8, 5e8, 0.5, true, mag},
+        {OPTIMIZATION_TYPE_MORE_THAN, OPTIMIZATION_TARGET_MU, 1e3, 2e7, 8e8, 2.0, true, NULL},
+        {OPTIMIZATION_TYPE_LESS_THAN, OPTIMIZATION_TARGET_MU_PRIME, -1e3, 2e7, 8e8, 0.25, true, NULL},
+    };
+    size_t goal_count = sizeof goals / sizeof goals[0];
+
+    size_t n_f = settings.n_frequencies;
+    double *ds_block = malloc(sizeof(double) * 8 * n_f);
+    struct Complex_2x2_SoA ds = {&ds_block[0 * n_f], &ds_block[1 * n_f], &ds_block[2 * n_f], &ds_block[3 * n_f],
+                                 &ds_block[4 * n_f], &ds_block[5 * n_f], &ds_block[6 * n_f], &ds_block[7 * n_f]};
+    double gradient[16];
+
+    struct Simulation_State sim = {0};
+    circuit_simulation_setup(cascade, n, &sim, &settings);
+    circuit_simulation_do(&sim, false);
+    double loss;
+
+    TEST_START();
+    if (!circuit_optimizer_loss_gradient(goals, goal_count, &sim, &ds, &loss)) did_fail = true;
+    if (!circuit_simulation_gradient(&sim, &ds, gradient)) did_fail = true;
+
+    double h = 1e-5;
+    for (size_t k = 0; k < n; k++) {
+        double *value = NULL;
+        switch (cascade[k].kind) {
+        case CIRCUIT_COMPONENT_RESISTOR_IDEAL:          value = &cascade[k].as.resistor_ideal.R; break;
+        case CIRCUIT_COMPONENT_CAPACITOR_IDEAL:         value = &cascade[k].as.capacitor_ideal.C; break;
+        case CIRCUIT_COMPONENT_INDUCTOR_IDEAL:          value = &cascade[k].as.inductor_ideal.L; break;
+        case CIRCUIT_COMPONENT_RESISTOR_IDEAL_PARALLEL: value = &cascade[k].as.resistor_ideal_parallel.R; break;
+        case CIRCUIT_COMPONENT_CAPACITOR_IDEAL_PARALLEL:value = &cascade[k].as.capacitor_ideal_parallel.C; break;
+        case CIRCUIT_COMPONENT_INDUCTOR_IDEAL_PARALLEL: value = &cascade[k].as.inductor_ideal_parallel.L; break;
+        default: break;
+        }
+        double original = *value;
+        double losses[2];
+        for (size_t side = 0; side < 2; side++) {
+            *value = original * exp(side == 0 ? h : -h);
+            circuit_simulation_mark_dirty(&sim, k);
+            circuit_simulation_do(&sim, false);
+            circuit_optimizer_loss_gradient(goals, goal_count, &sim, &ds, &losses[side]);
+        }
+        *value = original;
+        circuit_simulation_mark_dirty(&sim, k);
+        double numeric = (losses[0] - losses[1]) / (2.0 * h);
+        // the differences of the large hinge sums cancel, their rounding error is about eps * loss / h
+        EQFi(gradient[k], numeric, 1e-5 * fabs(numeric) + 1e-15 * loss / h, k);
+    }
+
+    circuit_simulation_destroy(&sim);
+    free(ds_block);
+    TEST_END();
+}
+
+static double cascade_loss(struct Circuit_Component *cascade, size_t n, struct Simulation_Settings *settings, struct Optimization_Goal *goals, size_t goal_count) {
+    struct Simulation_State sim = {0};
+    circuit_simulation_setup(cascade, n, &sim, settings);
+    circuit_simulation_do(&sim, false);
+    double loss = 0.0;
+    for (size_t i = 0; i < goal_count; i++) loss += goals[i].weight * circuit_optimizer_evaluate_goal(&goals[i], &sim);
+    circuit_simulation_destroy(&sim);
+    return loss;
+}
+
+bool test_circuit_optimizer_population_batched_loss() {
+    // the batched generation loss is the loss of the simulation up to rounding, DE never gets worse than the start
+    // and both strategies give the same circuit for the same seed
+    struct Circuit_Component initial[16] = {0};
+    size_t n = build_test_cascade(initial);
+    struct Simulation_Settings settings = {1e6, 1e9, 50.0, 75.0, 401};
+    struct Optimization_Goal goals[] = {
+        {OPTIMIZATION_TYPE_MORE_THAN, OPTIMIZATION_TARGET_S21, -1.0, 1e8, 4e8, 1.0, true, dB},
+        {OPTIMIZATION_TYPE_LESS_THAN, OPTIMIZATION_TARGET_S11, -15.0, 1e8, 4e8, 0.5, true, dB},
+        {OPTIMIZATION_TYPE_MORE_THAN, OPTIMIZATION_TARGET_MU, 1.0, 2e7, 8e8, 1.0, true, NULL},
+    };
+    size_t goal_count = sizeof goals / sizeof goals[0];
+    double initial_loss = cascade_loss(initial, n, &settings, goals, goal_count);
+
+    TEST_START();
+    for (size_t strategy = 0; strategy < 2; strategy++) {
+        struct Circuit_Component first[16], second[16];
+        memcpy(first, initial, sizeof(initial));
+        memcpy(second, initial, sizeof(initial));
+        double first_loss = DBL_MAX, second_loss = DBL_MAX;
+        bool ok = strategy == 0 ?
+            circuit_optimizer_differential_evolution(first, n, &settings, goals, goal_count, 0, 30, 7, &first_loss) &&
+            circuit_optimizer_differential_evolution(second, n, &settings, goals, goal_count, 0, 30, 7, &second_loss) :
+            circuit_optimizer_cma_es(first, n, &settings, goals, goal_count, 0, 30, 7, &first_loss) &&
+            circuit_optimizer_cma_es(second, n, &settings, goals, goal_count, 0, 30, 7, &second_loss);
+        if (!ok) {
+            printf("SUBTEST(%zu) FAILED: %s:%d: optimizer failed\n", strategy, __FILE__, __LINE__);
+            did_fail = true;
+            continue;
+        }
+        EQBITSi(first_loss, second_loss, strategy);
+        if (memcmp(first, second, sizeof(*first) * n) != 0) {
+            printf("SUBTEST(%zu) FAILED: %s:%d: the circuits differ\n", strategy, __FILE__, __LINE__);
+            did_fail = true;
+        }
+        double simulated = cascade_loss(first, n, &settings, goals, goal_count);
+        EQFi(first_loss, simulated, 1e-9 * (1.0 + simulated), strategy);
+        if (strategy == 0 && first_loss > initial_loss) {
+            printf("SUBTEST FAILED: %s:%d: loss %f worse than the initial %f\n", __FILE__, __LINE__, first_loss, initial_loss);
+            did_fail = true;
+        }
+    }
+    TEST_END();
+}
+
+bool test_circuit_simulation_batch_matches_simulation() {
+    // every candidate of a batch gets the S and the loss of its own simulation up to rounding, and bitwise
+    // the same losses on any number of threads
+    struct Circuit_Component initial[16] = {0};
+    size_t n = build_test_cascade(initial);
+    struct Simulation_Settings settings = {1e6, 1e9, 50.0, 75.0, 1001};
+    struct Optimization_Goal goals[] = {
+        {OPTIMIZATION_TYPE_MORE_THAN, OPTIMIZATION_TARGET_S21, -1.0, 1e8, 4e8, 1.0, true, dB},
+        {OPTIMIZATION_TYPE_LESS_THAN, OPTIMIZATION_TARGET_S11, -15.0, 1e8, 4e8, 0.5, true, dB},
+        {OPTIMIZATION_TYPE_MORE_THAN, OPTIMIZATION_TARGET_MU, 1.0, 2e7, 8e8, 1.0, true, NULL},
+    };
+    size_t goal_count = sizeof goals / sizeof goals[0];
+    size_t n_candidates = 6;
+
+    struct Uti_Rng rng;
+    uti_rng_seed(&rng, 3, 0);
+    struct Circuit_Component cascades[6][16];
+    struct Simulation_Batch batch = {0};
+    TEST_START();
+    if (!circuit_simulation_batch_setup(&batch, initial, n, &settings, n_candidates, true)) {
+        printf("SUBTEST FAILED: %s:%d: batch setup failed\n", __FILE__, __LINE__);
+        did_fail = true;
+        TEST_END();
+    }
+    for (size_t c = 0; c < n_candidates; c++) {
+        memcpy(cascades[c], initial, sizeof(initial));
+        for (size_t k = 0; c > 0 && k < n; k++) *circuit_component_value(&cascades[c][k]) *= exp(uti_rng_range(&rng, -1.0, 1.0));
+        circuit_simulation_batch_set_cascade(&batch, c, cascades[c]);
+    }
+
+    double losses[6], losses_single[6];
+    circuit_simulation_batch_run(&batch, n_candidates, goals, goal_count, losses);
+    batch.grid.single_threaded = true;
+    circuit_simulation_batch_run(&batch, n_candidates, goals, goal_count, losses_single);
+
+    for (size_t c = 0; c < n_candidates; c++) {
+        EQBITSi(losses[c], losses_single[c], c);
+        double simulated = cascade_loss(cascades[c], n, &settings, goals, goal_count);
+        EQFi(losses[c], simulated, 1e-9 * (1.0 + simulated), c);
+
+        struct Circuit_Component back[16];
+        circuit_simulation_batch_get_cascade(&batch, c, back);
+        if (memcmp(back, cascades[c], sizeof(*back) * n) != 0) {
+            printf("SUBTEST(%zu) FAILED: %s:%d: the cascade of the slot differs\n", c, __FILE__, __LINE__);
+            did_fail = true;
+        }
+
+        struct Simulation_State sim = {0};
+        circuit_simulation_setup(cascades[c], n, &sim, &settings);
+        circuit_simulation_do(&sim, false);
+        struct Complex_2x2_SoA s = circuit_simulation_batch_s_result(&batch, c);
+        for (size_t i = 0; i < sim.n_frequencies; i++) {
+            EQFi(s.r11[i], sim.s_result.r11[i], 1e-12, i); EQFi(s.i11[i], sim.s_result.i11[i], 1e-12, i);
+            EQFi(s.r12[i], sim.s_result.r12[i], 1e-12, i); EQFi(s.i12[i], sim.s_result.i12[i], 1e-12, i);
+            EQFi(s.r21[i], sim.s_result.r21[i], 1e-12, i); EQFi(s.i21[i], sim.s_result.i21[i], 1e-12, i);
+            EQFi(s.r22[i], sim.s_result.r22[i], 1e-12, i); EQFi(s.i22[i], sim.s_result.i22[i], 1e-12, i);
+        }
+        circuit_simulation_destroy(&sim);
+    }
+    circuit_simulation_batch_destroy(&batch);
+    TEST_END();
+}
+
+// settings of a measured stage that differ in gain and input match
+static bool build_test_stage_settings(struct S2P_Info *infos, char (*contents)[512], size_t n_settings) {
+    for (size_t x = 0; x < n_settings; x++) {
+        double gain = 0.6 + 0.35 * x;
+        double match = 0.95 - 0.1 * x;
+        snprintf(contents[x], 512,
+            "# GHz S MA R 50\n"
+            "0.001 %.3f -10 %.3f 170 0.010 80 0.60 -5\n"
+            "0.5 %.3f -30 %.3f 150 0.020 70 0.60 -20\n"
+            "1.0 %.3f -55 %.3f 130 0.030 60 0.55 -35\n"
+            "2.0 %.3f -85 %.3f 110 0.040 50 0.50 -50\n",
+            match, 4.0 * gain, match * 0.97, 3.8 * gain, match * 0.9, 3.3 * gain, match * 0.85, 2.7 * gain);
+        memset(&infos[x], 0, sizeof(infos[x]));
+        infos[x].file_content = contents[x];
+        infos[x].file_content_size = strlen(contents[x]);
+        if (!parse_s2p_file(&infos[x], false)) return false;
+    }
+    return true;
+}
+
+bool test_circuit_optimizer_stage_settings_search() {
+    // the search finds the combination of two stages that a brute force over simulations finds
+    enum { N_SETTINGS = 4 };
+    struct S2P_Info infos[N_SETTINGS];
+    char contents[N_SETTINGS][512];
+    TEST_START();
+    if (!build_test_stage_settings(infos, contents, N_SETTINGS)) return false;
+
+    struct Circuit_Component cascade[8] = {0};
+    size_t n = 0;
+    circuit_create_capacitor_ideal(22e-12, &cascade[n++]);
+    cascade[n].kind = CIRCUIT_COMPONENT_STAGE;
+    cascade[n].as.stage.s2p_infos = infos;
+    cascade[n++].as.stage.n_settings = N_SETTINGS;
+    circuit_create_inductor_ideal_parallel(150e-9, &cascade[n++]);
+    cascade[n++] = cascade[1];
+    circuit_create_resistor_ideal(3.0, &cascade[n++]);
+    struct Simulation_Settings settings = {1e7, 1e9, 50.0, 50.0, 600};
+    struct Optimization_Goal goals[] = {
+        {OPTIMIZATION_TYPE_MORE_THAN, OPTIMIZATION_TARGET_S21, 14.0, 1e8, 6e8, 1.0, true, dB},
+        {OPTIMIZATION_TYPE_LESS_THAN, OPTIMIZATION_TARGET_S11, -6.0, 1e8, 6e8, 2.0, true, dB},
+        {OPTIMIZATION_TYPE_MORE_THAN, OPTIMIZATION_TARGET_MU, 1.0, 1e7, 1e9, 0.5, true, NULL},
+    };
+    size_t goal_count = sizeof goals / sizeof goals[0];
+
+    double brute_loss = DBL_MAX;
+    size_t brute_first = 0, brute_second = 0;
+    for (size_t a = 0; a < N_SETTINGS; a++) {
+        for (size_t b = 0; b < N_SETTINGS; b++) {
+            cascade[1].as.stage.selected_setting = a;
+            cascade[3].as.stage.selected_setting = b;
+            double loss = cascade_loss(cascade, n, &settings, goals, goal_count);
+            if (loss < brute_loss) {
+                brute_loss = loss;
+                brute_first = a;
+                brute_second = b;
+            }
+        }
+    }
+
+    cascade[1].as.stage.selected_setting = 0;
+    cascade[3].as.stage.selected_setting = 0;
+    double best_loss = DBL_MAX;
+    size_t combinations = 0;
+    if (!circuit_optimizer_stage_settings_search(cascade, n, &settings, goals, goal_count, &best_loss, &combinations)) {
+        printf("SUBTEST FAILED: %s:%d: search failed\n", __FILE__, __LINE__);
+        did_fail = true;
+    }
+    EQFi((double)combinations, (double)(N_SETTINGS * N_SETTINGS), 0.0, (size_t)0);
+    EQFi((double)cascade[1].as.stage.selected_setting, (double)brute_first, 0.0, (size_t)1);
+    EQFi((double)cascade[3].as.stage.selected_setting, (double)brute_second, 0.0, (size_t)3);
+    EQBITSi(best_loss, brute_loss, (size_t)0);
+    TEST_END();
+}
+
+bool test_circuit_value_grid_e_series() {
+    // snapping and stepping land on the same doubles as the literals of the parts
+    struct Circuit_Value_Grid e12 = {CIRCUIT_E_SERIES_E12, NULL, 0};
+    struct Circuit_Value_Grid e96 = {CIRCUIT_E_SERIES_E96, NULL, 0};
+    struct Circuit_Value_Grid continuous = {CIRCUIT_E_SERIES_NONE, NULL, 0};
+    double parts[] = {1e-12, 10e-12, 100e-12};
+    struct Circuit_Value_Grid stock = {CIRCUIT_E_SERIES_E12, parts, 3}; // the list wins
+    struct {
+        const struct Circuit_Value_Grid *grid;
+        double value;
+        int steps;
+        double expected;
+    } cases[] = {
+        {&e12, 4.6e-9, 0, 4.7e-9},
+        {&e12, 1.07e3, 0, 1.0e3},
+        {&e12, 9.5, 0, 10.0},
+        {&e12, 8.2, 1, 10.0}, // into the next decade
+        {&e12, 1.0e-12, -1, 8.2e-13},
+        {&e96, 2.2e-12, 0, 2.21e-12},
+        {&continuous, 4.6e-9, 0, 4.6e-9},
+        {&stock, 3e-12, 0, 1e-12}, // nearest by ratio
+        {&stock, 5e-11, 0, 100e-12},
+        {&stock, 100e-12, 1, 100e-12}, // the ends of a part list stay
+        {&stock, 1e-12, -2, 1e-12},
+    };
+    TEST_START();
+    for (size_t i = 0; i < sizeof cases / sizeof cases[0]; i++) {
+        double have = circuit_value_grid_step(cases[i].grid, cases[i].value, cases[i].steps);
+        EQBITSi(have, cases[i].expected, i);
+    }
+    TEST_END();
+}
+
+bool test_circuit_t_cache_out_of_memory() {
+    // an allocation that fails while evicting drops the entry and moves the last one into its
+    // place, the moved entry must still be found and the recently used list must stay intact
+    struct Circuit_Component cascade[16] = {0};
+    size_t n = build_test_cascade(cascade);
+    struct Simulation_Settings settings = {1e6, 1e9, 50.0, 75.0, 300};
+    TEST_START();
+
+    struct Simulation_State sim = {0};
+    circuit_simulation_setup(cascade, n, &sim, &settings);
+    struct Circuit_T_Cache *cache = circuit_t_cache_create(3);
+    for (size_t c = 2; c <= 4; c++) circuit_t_cache_get(cache, &cascade[c], &sim);
+
+    // a grid too big to allocate evicts cascade[2] (the oldest, entry 0) and fails
+    struct Simulation_State huge = sim;
+    huge.n_frequencies = SIZE_MAX / 128;
+    huge.grid_hash ^= 1;
+    if (circuit_t_cache_get(cache, &cascade[5], &huge) != NULL) {
+        printf("SUBTEST FAILED: %s:%d: the allocation did not fail\n", __FILE__, __LINE__);
+        did_fail = true;
+    }
+
+    // hits 4, 3, then misses 2 and 5 (evicting 4), hits 3, 2, 5
+    size_t order[] = {4, 3, 2, 5, 3, 2, 5};
+    struct Complex_2x2_SoA t = random_soa(sim.n_frequencies);
+    for (size_t k = 0; k < sizeof order / sizeof order[0]; k++) {
+        const double *planes = circuit_t_cache_get(cache, &cascade[order[k]], &sim);
+        if (!planes) {
+            printf("SUBTEST(%zu) FAILED: %s:%d: no planes\n", k, __FILE__, __LINE__);
+            did_fail = true;
+            continue;
+        }
+        circuit_t_params_circuit_component(&cascade[order[k]], sim.frequencies, &t, sim.n_frequencies);
+        for (size_t i = 0; i < sim.n_frequencies; i += 29) {
+            EQBITSi(planes[i], t.r11[i], k);
+            EQBITSi(planes[6 * sim.n_frequencies + i], t.i21[i], k);
+        }
+    }
+    size_t hits, misses;
+    circuit_t_cache_stats(cache, &hits, &misses);
+    EQFi((double)hits, 5.0, 0.0, (size_t)0);
+    EQFi((double)misses, 6.0, 0.0, (size_t)1);
+
+    free(t.r11);
+    circuit_t_cache_destroy(cache);
+    circuit_simulation_destroy(&sim);
+    TEST_END();
+}
+
+bool test_circuit_optimizer_discrete_cached() {
+    // the cache hands out the T of the component on the grid, and the discrete search only ever
+    // accepts circuits on the E-series with the loss a plain simulation gives
+    struct Circuit_Component cascade[16] = {0};
+    size_t n = build_test_cascade(cascade);
+    struct Simulation_Settings settings = {1e6, 1e9, 50.0, 75.0, 700};
+    struct Optimization_Goal goals[] = {
+        {OPTIMIZATION_TYPE_LESS_THAN, OPTIMIZATION_TARGET_S11, -20.0, 2e7, 3e8, 1.0, true, dB},
+        {OPTIMIZATION_TYPE_MORE_THAN, OPTIMIZATION_TARGET_S21, -0.5, 5e7, 6e8, 0.5, true, dB},
+    };
+    size_t goal_count = sizeof goals / sizeof goals[0];
+    TEST_START();
+
+    struct Simulation_State sim = {0};
+    circuit_simulation_setup(cascade, n, &sim, &settings);
+    struct Circuit_T_Cache *cache = circuit_t_cache_create(2);
+    const double *planes = circuit_t_cache_get(cache, &cascade[2], &sim);
+    const double *again = circuit_t_cache_get(cache, &cascade[2], &sim);
+    if (!planes || planes != again) {
+        printf("SUBTEST FAILED: %s:%d: no hit for the same component\n", __FILE__, __LINE__);
+        did_fail = true;
+    }
+    struct Complex_2x2_SoA t = random_soa(sim.n_frequencies);
+    circuit_t_params_circuit_component(&cascade[2], sim.frequencies, &t, sim.n_frequencies);
+    for (size_t i = 0; planes && i < sim.n_frequencies; i += 37) {
+        EQFi(planes[i], t.r11[i], 1e-12 * fabs(t.r11[i]), i);
+        EQFi(planes[5 * sim.n_frequencies + i], t.i12[i], 1e-12 * fabs(t.i12[i]), i);
+    }
+    free(t.r11);
+    // the third component evicts the least recently used one
+    circuit_t_cache_get(cache, &cascade[3], &sim);
+    circuit_t_cache_get(cache, &cascade[4], &sim);
+    circuit_t_cache_get(cache, &cascade[3], &sim);
+    circuit_t_cache_get(cache, &cascade[2], &sim);
+    size_t hits, misses;
+    circuit_t_cache_stats(cache, &hits, &misses);
+    EQFi((double)hits, 2.0, 0.0, (size_t)0);
+    EQFi((double)misses, 4.0, 0.0, (size_t)1);
+    circuit_t_cache_destroy(cache);
+    circuit_simulation_destroy(&sim);
+
+    struct Circuit_Value_Grid grids[16];
+    for (size_t i = 0; i < n; i++) {
+        grids[i] = (struct Circuit_Value_Grid){CIRCUIT_E_SERIES_E24, NULL, 0};
+        double *value = circuit_component_value(&cascade[i]);
+        *value = circuit_value_grid_snap(&grids[i], *value);
+    }
+    struct Optimizer_State opt = {0};
+    struct Uti_Rng rng;
+    uti_rng_seed(&rng, 5, 0);
+    sim = (struct Simulation_State){0};
+    circuit_optimizer_setup(&opt, 600, cascade, n);
+    opt.print_progress = false;
+    opt.rng = &rng;
+    opt.value_grids = grids;
+    opt.t_cache = circuit_t_cache_create(64);
+    while (!circuit_optimizer_update_one_round(&opt, &sim, &settings, goals, goal_count, cascade, n));
+    circuit_t_cache_stats(opt.t_cache, &hits, &misses);
+    if (hits == 0) {
+        printf("SUBTEST FAILED: %s:%d: the search never hit the cache\n", __FILE__, __LINE__);
+        did_fail = true;
+    }
+    for (size_t i = 0; i < n; i++) {
+        double value = *circuit_component_value(&cascade[i]);
+        double snapped = circuit_value_grid_snap(&grids[i], value);
+        EQBITSi(value, snapped, i);
+    }
+    double loss = cascade_loss(cascade, n, &settings, goals, goal_count);
+    EQF(opt.best_total_loss_value, loss, 1e-9 * (loss + 1.0));
+    circuit_t_cache_destroy(opt.t_cache);
+    circuit_optimizer_destroy(&opt);
+    circuit_simulation_destroy(&sim);
+    TEST_END();
+}
+
+// rounds of a search with its own stream, checkpointing and logging as configured
+static double checkpointed_search(struct Circuit_Component *cascade, size_t n, size_t first, size_t last, bool resume,
+        const char *checkpoint, const char *log, struct Simulation_Settings *settings, struct Optimization_Goal *goals, size_t goal_count) {
+    struct Optimizer_State opt = {0};
+    struct Simulation_State sim = {0};
+    struct Uti_Rng rng;
+    uti_rng_seed(&rng, 7, 0);
+    circuit_optimizer_setup(&opt, last, cascade, n);
+    opt.print_progress = false;
+    opt.rng = &rng;
+    opt.checkpoint_path = checkpoint;
+    opt.checkpoint_interval = first;
+    if (resume && !circuit_optimizer_checkpoint_read(&opt, checkpoint)) return -1.0;
+    if (!circuit_optimizer_loss_log_open(&opt, log)) return -1.0;
+    while (!circuit_optimizer_update_one_round(&opt, &sim, settings, goals, goal_count, cascade, n));
+    memcpy(cascade, opt.best_component_cascade, sizeof(*cascade) * n);
+    double loss = opt.best_total_loss_value;
+    circuit_optimizer_destroy(&opt);
+    circuit_simulation_destroy(&sim);
+    return loss;
+}
+
+bool test_circuit_optimizer_checkpoint_resume() {
+    // a search that dies after its checkpoint and resumes from it ends bitwise like an uninterrupted
+    // one, and the rounds after the checkpoint are dropped from the loss log
+    struct Circuit_Component straight[16] = {0};
+    struct Circuit_Component resumed[16] = {0};
+    size_t n = build_test_cascade(straight);
+    build_test_cascade(resumed);
+    struct Simulation_Settings settings = {1e6, 1e9, 50.0, 75.0, 601};
+    struct Optimization_Goal goals[] = {
+        {OPTIMIZATION_TYPE_LESS_THAN, OPTIMIZATION_TARGET_S11, -20.0, 2e7, 3e8, 1.0, true, dB},
+        {OPTIMIZATION_TYPE_MORE_THAN, OPTIMIZATION_TARGET_S21, -0.5, 5e7, 6e8, 0.5, true, dB},
+    };
+    size_t goal_count = sizeof goals / sizeof goals[0];
+    const char *checkpoint = "build/circuit_tests_search.ckpt";
+    const char *log_straight = "build/circuit_tests_straight.loss";
+    const char *log_resumed = "build/circuit_tests_resumed.loss";
+    remove(log_straight);
+    remove(log_resumed);
+
+    TEST_START();
+    double loss_straight = checkpointed_search(straight, n, 1000, 300, false, checkpoint, log_straight, &settings, goals, goal_count);
+    // checkpoint at round 100, the process "dies" at round 150
+    checkpointed_search(resumed, n, 100, 150, false, checkpoint, log_resumed, &settings, goals, goal_count);
+    build_test_cascade(resumed);
+    double loss_resumed = checkpointed_search(resumed, n, 1000, 300, true, checkpoint, log_resumed, &settings, goals, goal_count);
+    // the seeded checkpoint does not resume an optimizer without a random stream
+    struct Optimizer_State unseeded = {0};
+    circuit_optimizer_setup(&unseeded, 300, resumed, n);
+    if (circuit_optimizer_checkpoint_read(&unseeded, checkpoint)) {
+        printf("SUBTEST FAILED: %s:%d: the checkpoint without a random stream was accepted\n", __FILE__, __LINE__);
+        did_fail = true;
+    }
+    circuit_optimizer_destroy(&unseeded);
+    remove(checkpoint);
+
+    EQBITSi(loss_resumed, loss_straight, (size_t)0);
+    if (memcmp(straight, resumed, sizeof(*straight) * n) != 0) {
+        printf("SUBTEST FAILED: %s:%d: the circuits differ\n", __FILE__, __LINE__);
+        did_fail = true;
+    }
+
+    char *content[2];
+    size_t size[2];
+    if (!uti_read_entire_file(log_straight, &content[0], &size[0]) || !uti_read_entire_file(log_resumed, &content[1], &size[1])) return false;
+    remove(log_straight);
+    remove(log_resumed);
+    EQFi((double)size[0], (double)(sizeof(struct Optimizer_Loss_Log_Header) + 300 * sizeof(struct Optimizer_Loss_Record)), 0.0, (size_t)0);
+    if (size[0] != size[1] || memcmp(content[0], content[1], size[0]) != 0) {
+        printf("SUBTEST FAILED: %s:%d: the loss logs differ\n", __FILE__, __LINE__);
+        did_fail = true;
+    }
+    free(content[0]);
+    free(content[1]);
+    TEST_END();
+}
+
+bool test_uti_sv_parse_double_matches_strtod() {
+    // the direct conversion gives the same doubles as strtod() in every notation the files use
+    const char *formats[] = {"%.17g", "%.9g", "%.6f", "%.3e", "%.12E", "%+.4f", "%g"};
+    const char *special[] = {"0", "-0.0", "1e", "12345678901234567890123", "0.1234567890123456789012", "4.9e-324", "1.7976931348623157e308", "1e400", "inf", "-nan", "0x1p-3", ".5", "5.", "+7e+02"};
+    char buffer[64];
+    TEST_START();
+    srand(3);
+    for (size_t i = 0; i < 20000 + sizeof special / sizeof special[0]; i++) {
+        if (i < 20000) {
+            double value = (random_double() - 0.5) * pow(10.0, (double)(rand() % 40 - 20));
+            snprintf(buffer, sizeof buffer, formats[i % (sizeof formats / sizeof formats[0])], value);
+        } else {
+            snprintf(buffer, sizeof buffer, "%s", special[i - 20000]);
+        }
+        char *end;
+        double expected = strtod(buffer, &end);
+        struct Uti_String_View sv = uti_sv_from_cstr(buffer);
+        double have;
+        if (!uti_sv_parse_double(&sv, &have)) {
+            printf("SUBTEST(%zu) FAILED: %s:%d: '%s' not parsed\n", i, __FILE__, __LINE__, buffer);
+            did_fail = true;
+            continue;
+        }
+        if (isnan(expected)) {
+            if (!isnan(have)) {
+                printf("SUBTEST(%zu) FAILED: %s:%d: '%s' is not nan\n", i, __FILE__, __LINE__, buffer);
+                did_fail = true;
+            }
+        } else {
+            EQBITSi(have, expected, i);
+        }
+        EQFi((double)(sv.text - buffer), (double)(end - buffer), 0.0, i);
+    }
+
+    // a Touchstone line, up to the comment
+    struct Uti_String_View line = uti_sv_from_cstr("  1.5\t-2e-3  7 ! comment 8");
+    double values[4];
+    size_t count = 0;
+    while (count < 4 && uti_sv_parse_double(&line, &values[count])) count++;
+    EQFi((double)count, 3.0, 0.0, (size_t)0);
+    EQF(values[1], -2e-3, 0.0);
+
+    // a token longer than the stack copy of the strtod() fallback, i.e. a value with many digits
+    char long_line[300] = "0.";
+    memset(long_line + 2, '0', 200);
+    snprintf(long_line + 202, sizeof long_line - 202, "25e3 7");
+    line = uti_sv_from_cstr(long_line);
+    count = 0;
+    while (count < 4 && uti_sv_parse_double(&line, &values[count])) count++;
+    EQFi((double)count, 2.0, 0.0, (size_t)1);
+    double long_value = strtod(long_line, NULL);
+    EQBITSi(values[0], long_value, (size_t)1);
+    EQF(values[1], 7.0, 0.0);
+
+    // the strtod() fallback keeps the "." in a locale with a "," decimal point (if one is installed)
+    const char *comma_locales[] = {"de_DE.UTF-8", "de_DE.utf8", "German_Germany.1252"};
+    for (size_t i = 0; i < sizeof comma_locales / sizeof comma_locales[0]; i++) {
+        if (!setlocale(LC_NUMERIC, comma_locales[i])) continue;
+        struct Uti_String_View sv = uti_sv_from_cstr("0.1234567890123456789012");
+        double have = 0.0;
+        bool parsed = uti_sv_parse_double(&sv, &have);
+        setlocale(LC_NUMERIC, "C");
+        EQFi((double)parsed, 1.0, 0.0, i);
+        EQFi(have, 0.1234567890123456789012, 0.0, i);
+        EQFi((double)sv.length, 0.0, 0.0, i);
+        break;
+    }
+    TEST_END();
+}
+
+bool test_s2p_mapped_file_parse() {
+    // a file mapped by read_s2p_file() parses to the same data as the content in memory, and the
+    // mapping is gone after the release
+    const char *dir = "build";
+    const char *name = "circuit_tests_stage.s2p";
+    char path[256];
+    snprintf(path, sizeof path, "%s/%s", dir, name);
+    if (!uti_write_entire_file_atomic(path, test_s2p_content, strlen(test_s2p_content))) return false;
+
+    struct S2P_Info mapped = {0};
+    struct S2P_Info in_memory = {0};
+    in_memory.file_content = test_s2p_content;
+    in_memory.file_content_size = strlen(test_s2p_content);
+    TEST_START();
+    if (!read_s2p_file(name, dir, &mapped)) return false;
+    remove(path);
+    if (!mapped.file_content_mapped) {
+        printf("SUBTEST FAILED: %s:%d: a regular file is not mapped\n", __FILE__, __LINE__);
+        did_fail = true;
+    }
+    if (!parse_s2p_file(&mapped, false) || !parse_s2p_file(&in_memory, false)) return false;
+    s2p_release_file_content(&mapped);
+    if (mapped.file_content || mapped.file_content_size != 0) {
+        printf("SUBTEST FAILED: %s:%d: the content is not released\n", __FILE__, __LINE__);
+        did_fail = true;
+    }
+
+    EQFi((double)mapped.data_length, (double)in_memory.data_length, 0.0, (size_t)0);
+    EQFi((double)mapped.noise.length, (double)in_memory.noise.length, 0.0, (size_t)1);
+    for (size_t i = 0; i < mapped.data_length && i < in_memory.data_length; i++) {
+        EQBITSi(mapped.freq[i], in_memory.freq[i], i);
+        EQBITSi(mapped.s21[i].r, in_memory.s21[i].r, i);
+        EQBITSi(mapped.s21[i].i, in_memory.s21[i].i, i);
+    }
+    TEST_END();
+}
+
+bool test_s2p_load_files_parallel() {
+    // files of very different sizes loaded on 4 threads come out bitwise like parsed one by one
+    enum { N_FILES = 12 };
+    struct S2P_Info parallel[N_FILES];
+    struct S2P_Info serial[N_FILES];
+    char *contents[N_FILES];
+    TEST_START();
+    for (size_t f = 0; f < N_FILES; f++) {
+        size_t rows = 5 + 300 * (f % 4) * (f % 3);
+        size_t capacity = 128 + rows * 128;
+        contents[f] = malloc(capacity);
+        size_t size = (size_t)snprintf(contents[f], capacity, "# GHz S MA R 50\n");
+        for (size_t r = 0; r < rows; r++) {
+            double x = (double)(r + 1) / (double)rows;
+            size += (size_t)snprintf(contents[f] + size, capacity - size, "%.6f %.5f %.3f %.5f %.3f %.5f %.3f %.5f %.3f\n",
+                0.01 + 2.0 * x, 0.9 - 0.3 * x, -30.0 * x, 4.0 - x, 150.0 - 40.0 * x, 0.02, 70.0, 0.6 - 0.1 * x, -20.0 * x - (double)f);
+        }
+        char name[64];
+        snprintf(name, sizeof name, "circuit_tests_load_%zu.s2p", f);
+        memset(&parallel[f], 0, sizeof(parallel[f]));
+        s2p_set_file_path(&parallel[f], name, "build");
+        if (!uti_write_entire_file_atomic(parallel[f].full_path, contents[f], size)) return false;
+
+        memset(&serial[f], 0, sizeof(serial[f]));
+        serial[f].file_content = contents[f];
+        serial[f].file_content_size = size;
+        if (!parse_s2p_file(&serial[f], true)) return false;
+    }
+
+    if (!s2p_load_files(parallel, N_FILES, true, 4)) {
+        printf("SUBTEST FAILED: %s:%d: loading failed\n", __FILE__, __LINE__);
+        did_fail = true;
+    }
+    for (size_t f = 0; f < N_FILES; f++) {
+        remove(parallel[f].full_path);
+        free(contents[f]);
+        if (parallel[f].file_content) {
+            printf("SUBTEST(%zu) FAILED: %s:%d: the content is not released\n", f, __FILE__, __LINE__);
+            did_fail = true;
+        }
+        EQFi((double)parallel[f].data_length, (double)serial[f].data_length, 0.0, f);
+        if (did_fail) continue;
+        size_t n = serial[f].data_length;
+        if (memcmp(parallel[f].freq, serial[f].freq, sizeof(double) * n) != 0 ||
+            memcmp(parallel[f].s22, serial[f].s22, sizeof(struct Complex) * n) != 0 ||
+            memcmp(parallel[f].s_b.r21, serial[f].s_b.r21, sizeof(double) * (n - 1)) != 0 ||
+            memcmp(parallel[f].s_b.i21, serial[f].s_b.i21, sizeof(double) * (n - 1)) != 0 ||
+            memcmp(parallel[f].z12.items, serial[f].z12.items, sizeof(struct Complex) * n) != 0) {
+            printf("SUBTEST(%zu) FAILED: %s:%d: the data differs\n", f, __FILE__, __LINE__);
+            did_fail = true;
+        }
+    }
+    TEST_END();
+}
+
+// bitwise, the data, the splines and the impedances
+static bool s2p_same_data(const struct S2P_Info *a, const struct S2P_Info *b) {
+    size_t n = a->data_length, n_noise = a->noise.length;
+    if (n != b->data_length || n_noise != b->noise.length || memcmp(&a->R_ref, &b->R_ref, sizeof(double)) != 0) return false;
+    size_t c = sizeof(struct Complex);
+    return memcmp(a->freq, b->freq, sizeof(double) * n) == 0 &&
+           memcmp(a->s11, b->s11, c * n) == 0 && memcmp(a->s12, b->s12, c * n) == 0 &&
+           memcmp(a->s21, b->s21, c * n) == 0 && memcmp(a->s22, b->s22, c * n) == 0 &&
+           memcmp(a->s.i12, b->s.i12, sizeof(double) * n) == 0 &&
+           memcmp(a->s_a.r11, b->s_a.r11, sizeof(double) * (n - 1)) == 0 && memcmp(a->s_b.i22, b->s_b.i22, sizeof(double) * (n - 1)) == 0 &&
+           memcmp(a->noise.freq, b->noise.freq, sizeof(double) * n_noise) == 0 &&
+           memcmp(a->noise.Rn, b->noise.Rn, sizeof(double) * n_noise) == 0 &&
+           memcmp(a->noise.GammaOpt, b->noise.GammaOpt, c * n_noise) == 0 &&
+           memcmp(a->noise.NFmin_b, b->noise.NFmin_b, sizeof(double) * (n_noise - 1)) == 0 &&
+           memcmp(a->noise.GammaOpt_a, b->noise.GammaOpt_a, c * (n_noise - 1)) == 0 &&
+           memcmp(a->z21.items, b->z21.items, c * n) == 0 && memcmp(a->zGopt.items, b->zGopt.items, c * n_noise) == 0;
+}
+
+bool test_s2p_binary_cache() {
+    // the first load parses and writes the cache, the next one maps it. Touching the file keeps the
+    // cache (same content hash), changing it (same size) parses again.
+    const char *dir = "build";
+    const char *name = "circuit_tests_cached.s2p";
+    char path[256];
+    snprintf(path, sizeof path, "%s/%s", dir, name);
+    size_t size = strlen(test_s2p_content);
+    char *changed = malloc(size + 1);
+    memcpy(changed, test_s2p_content, size + 1);
+    *strstr(changed, "4.1 150") = '5';
+
+    struct S2P_Info expected = {0}, expected_changed = {0};
+    expected.file_content = test_s2p_content;
+    expected.file_content_size = size;
+    expected_changed.file_content = changed;
+    expected_changed.file_content_size = size;
+    TEST_START();
+    if (!parse_s2p_file(&expected, true) || !parse_s2p_file(&expected_changed, true)) return false;
+
+    s2p_set_cache_dir(dir);
+    struct S2P_Info loads[4];
+    const char *contents[4] = {test_s2p_content, NULL, test_s2p_content, changed};
+    bool expect_cached[4] = {false, true, true, false};
+    for (size_t i = 0; i < 4; i++) {
+        if (contents[i] && !uti_write_entire_file_atomic(path, contents[i], size)) return false;
+        memset(&loads[i], 0, sizeof(loads[i]));
+        s2p_set_file_path(&loads[i], name, dir);
+        if (!s2p_load_files(&loads[i], 1, true, 1)) return false;
+        if (loads[i].cached != expect_cached[i]) {
+            printf("SUBTEST(%zu) FAILED: %s:%d: cached is %d\n", i, __FILE__, __LINE__, loads[i].cached);
+            did_fail = true;
+        }
+        if (!s2p_same_data(&loads[i], i < 3 ? &expected : &expected_changed)) {
+            printf("SUBTEST(%zu) FAILED: %s:%d: the data differs\n", i, __FILE__, __LINE__);
+            did_fail = true;
+        }
+    }
+    if ((uintptr_t)loads[1].s.i21 % UTI_CACHE_LINE_SIZE != 0 || (uintptr_t)loads[1].noise.Rn_a % UTI_CACHE_LINE_SIZE != 0) {
+        printf("SUBTEST FAILED: %s:%d: the columns are not aligned\n", __FILE__, __LINE__);
+        did_fail = true;
+    }
+    s2p_set_cache_dir(NULL);
+    // the cached data goes with its view
+    s2p_free_data(&loads[1]);
+    if (loads[1].cache_view.content || loads[1].cached) {
+        printf("SUBTEST FAILED: %s:%d: the cache view is still open\n", __FILE__, __LINE__);
+        did_fail = true;
+    }
+    for (size_t i = 0; i < 4; i++) {
+        if (i != 1) s2p_free_data(&loads[i]);
+    }
+    s2p_free_data(&expected);
+    s2p_free_data(&expected_changed);
+
+    char cache_path[1024];
+    snprintf(cache_path, sizeof cache_path, "%s/%s.%016llx.s2pc", dir, name, (unsigned long long)uti_hash_bytes(path, strlen(path), 0));
+    if (remove(cache_path) != 0) {
+        printf("SUBTEST FAILED: %s:%d: no cache file %s\n", __FILE__, __LINE__, cache_path);
+        did_fail = true;
+    }
+    remove(path);
+    free(changed);
+    TEST_END();
+}
+
+struct Concurrent_Write_Job {
+    const char *path;
+    bool ok[32];
+};
+
+static void concurrent_write_job(void *context, size_t index) {
+    struct Concurrent_Write_Job *job = context;
+    char content[4096];
+    memset(content, 'a' + (int)(index % 26), sizeof content);
+    job->ok[index] = uti_write_entire_file_replace(job->path, content, sizeof content);
+}
+
+bool test_uti_write_file_concurrent() {
+    // threads writing the same path all succeed and the file ends up as one of their contents
+    struct Concurrent_Write_Job job = {.path = "build/circuit_tests_concurrent.bin"};
+    TEST_START();
+    struct Uti_Thread_Pool *pool = uti_thread_pool_create(4);
+    if (!pool) return false;
+    uti_thread_pool_run(pool, concurrent_write_job, &job, 32);
+    uti_thread_pool_destroy(pool);
+    for (size_t i = 0; i < 32; i++) {
+        if (!job.ok[i]) {
+            printf("SUBTEST(%zu) FAILED: %s:%d: the write failed\n", i, __FILE__, __LINE__);
+            did_fail = true;
+        }
+    }
+    char *content;
+    size_t size;
+    if (!uti_read_entire_file(job.path, &content, &size)) return false;
+    EQFi((double)size, 4096.0, 0.0, (size_t)0);
+    for (size_t i = 1; i < size; i++) {
+        if (content[i] != content[0]) {
+            printf("SUBTEST(%zu) FAILED: %s:%d: mixed content\n", i, __FILE__, __LINE__);
+            did_fail = true;
+            break;
+        }
+    }
+    free(content);
+    remove(job.path);
+    TEST_END();
+}
+
+int main() {
+
+    printf("INFO: cpu supports %s kernels\n", circuit_kernel_name(circuit_kernel_detect()));
+
+    bool (*tests[])() = {
+        test_circuit_multiply_t_soa_sse2_bitwise,
+        test_circuit_multiply_t_soa_avx2_tolerance,
+        test_circuit_multiply_t_soa_in_place,
+        test_circuit_multiply_t_soa_against_mma,
+        test_circuit_cascade_t_soa_matches_chained_multiply,
+        test_circuit_s_t_conversion_kernels,
+        test_circuit_t_params_lumped_closed_form,
+        test_circuit_stage_precomputed_splines,
+        test_circuit_simulation_incremental,
+        test_circuit_simulation_arena_resize,
+        test_circuit_simulation_threads_bitwise,
+        test_circuit_simulation_write_touchstone_round_trip,
+        test_circuit_optimizer_worker_pause_cancel,
+        test_circuit_optimizer_parallel_search_reproducible,
+        test_circuit_optimizer_early_abort_exact,
+        test_circuit_optimizer_goal_plan_bitwise,
+        test_circuit_gradient_against_finite_differences,
+        test_circuit_optimizer_population_batched_loss,
+        test_circuit_simulation_batch_matches_simulation,
+        test_circuit_optimizer_stage_settings_search,
+        test_circuit_value_grid_e_series,
+        test_circuit_optimizer_discrete_cached,
+        test_circuit_t_cache_out_of_memory,
+        test_circuit_optimizer_checkpoint_resume,
+        test_uti_sv_parse_double_matches_strtod,
+        test_s2p_mapped_file_parse,
+        test_s2p_load_files_parallel,
+        test_s2p_binary_cache,
+        test_uti_write_file_concurrent,
+    };
+
+    size_t n_tests = sizeof tests / sizeof tests[0];
+    size_t passed = 0;
+
+    for (size_t i = 0; i < n_tests; i++) {
+        if (tests[i]()) passed++;
+    }
+
+    printf("%zu/%zu tests passed.\n", passed, n_tests);
+    return 0;
+}
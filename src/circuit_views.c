@@ -7,22 +7,6 @@
 #include "gra.h"
 #include "uti.h"
 
-double mag(size_t i, void* x) {
-    struct Complex *s = (struct Complex *)x;
-    struct Complex si = s[i];
-    return sqrtf(si.i * si.i + si.r* si.r);
-}
-
-double dB_from_squared(double x) {
-    return 10 * log10f(x);
-}
-
-double dB(size_t i, void* x) {
-    struct Complex *s = (struct Complex *)x;
-    struct Complex si = s[i];
-    return dB_from_squared(si.i * si.i + si.r * si.r);
-}
-
 
 //
 // initialization of views
@@ -140,6 +124,13 @@ void stage_view_update_active_setting(struct Stage_View* stage_view, size_t new_
     stage_view->noise_length = info->noise.length;
     stage_view->NFmins = info->noise.NFmin;
     stage_view->noise_fs = info->noise.freq;
+    stage_view->s_params_soa = info->s;
+    stage_view->s_params_a = info->s_a;
+    stage_view->s_params_b = info->s_b;
+    stage_view->Gopt_a = info->noise.GammaOpt_a;
+    stage_view->Gopt_b = info->noise.GammaOpt_b;
+    stage_view->NFmins_a = info->noise.NFmin_a;
+    stage_view->NFmins_b = info->noise.NFmin_b;
 
     size_t i = 0;
     double Z0 = info->R_ref;
@@ -190,13 +181,26 @@ void stage_view_update_data(struct Stage_View* stage_view) {
 
 
     for (size_t i = 0; i < N_INTERPOL; i ++) {
-        stage_view->fs_interpolated[i] = min_f + i * (max_f - min_f) / N_INTERPOL;
+        stage_view->fs_interpolated[i] = min_f + i * (max_f - min_f) / (N_INTERPOL - 1);
     }
 
-    mma_spline_cubic_natural_linear_complex(stage_view->noise_fs, stage_view->Gopt, noise_length, stage_view->Gopt_interpolated, N_INTERPOL, min_f, max_f);
-    mma_spline_cubic_natural_linear(stage_view->noise_fs, stage_view->NFmins, noise_length, stage_view->NFmins_interpolated, N_INTERPOL, min_f, max_f);
-    for (size_t i = 0; i < 4; i ++) {
-        mma_spline_cubic_natural_linear_complex(stage_view->fs, stage_view->s_params[i], length, stage_view->s_params_interpolated[i], N_INTERPOL, min_f, max_f);
+    // the splines are solved once when parsing, here they are only evaluated
+    double *fs_interpolated = stage_view->fs_interpolated;
+    double real[N_INTERPOL];
+    double imag[N_INTERPOL];
+    if (noise_length >= 2) {
+        mma_spline_cubic_natural_complex_eval(stage_view->noise_fs, stage_view->Gopt, stage_view->Gopt_a, stage_view->Gopt_b, noise_length, real, imag, fs_interpolated, N_INTERPOL);
+        for (size_t j = 0; j < N_INTERPOL; j ++) stage_view->Gopt_interpolated[j] = mma_complex(real[j], imag[j]);
+        mma_spline_cubic_natural_eval(stage_view->noise_fs, stage_view->NFmins, stage_view->NFmins_a, stage_view->NFmins_b, noise_length, stage_view->NFmins_interpolated, fs_interpolated, N_INTERPOL);
+    }
+    double planes[8][N_INTERPOL];
+    struct Complex_2x2_SoA s = {planes[0], planes[1], planes[2], planes[3], planes[4], planes[5], planes[6], planes[7]};
+    mma_spline_cubic_natural_2x2_soa_eval(stage_view->fs, &stage_view->s_params_soa, &stage_view->s_params_a, &stage_view->s_params_b, length, &s, fs_interpolated, N_INTERPOL);
+    for (size_t j = 0; j < N_INTERPOL; j ++) {
+        stage_view->s_params_interpolated[0][j] = mma_complex(s.r11[j], s.i11[j]);
+        stage_view->s_params_interpolated[1][j] = mma_complex(s.r21[j], s.i21[j]);
+        stage_view->s_params_interpolated[2][j] = mma_complex(s.r12[j], s.i12[j]);
+        stage_view->s_params_interpolated[3][j] = mma_complex(s.r22[j], s.i22[j]);
     }
 
     // insted of this just calculate z again
@@ -60,6 +60,14 @@ struct Stage_View {
     size_t noise_length;
     double *noise_fs;
     double *NFmins;
+    // spline coefficients precalculated in S2P_Info
+    struct Complex_2x2_SoA s_params_soa;
+    struct Complex_2x2_SoA s_params_a;
+    struct Complex_2x2_SoA s_params_b;
+    struct Complex *Gopt_a;
+    struct Complex *Gopt_b;
+    double *NFmins_a;
+    double *NFmins_b;
 
     // interpolated data
     #define N_INTERPOL 2000
@@ -214,10 +222,4 @@ void simulation_cockpit_view_init(struct Simulation_Cockpit_View_State* view, st
 SIMULATION_COCKPIT_ACTION simulation_cockpit_view_draw(struct Simulation_Cockpit_View_State* view, struct Simulation_Settings* settings_out, Mui_Rectangle area, double grid_pixels);
 void simulation_optimization_goals_draw(Mui_Rectangle plot_area, struct Optimization_Goal* goals, size_t n_goals, double f_min, double f_max, double y_min, double y_max);
 
-
-// utility functions
-double mag(size_t i, void* x);
-double dB_from_squared(double x);
-double dB(size_t i, void* x);
-
 #endif //CIRCUIT_VIEWS_H_
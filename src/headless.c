@@ -0,0 +1,412 @@
+// Copyright (C) 2026 Benjamin Froelich
+// This file is part of https://github.com/bbeni/impedancer
+// For conditions of distribution and use, see copyright notice in project root.
+//
+// Headless simulation / optimization without the GUI (no raylib needed).
+//
+// Usage: impedancer_headless <circuit_file> [-d s2p_dir] [-o out.s2p|out.csv] [-O iterations] [-G evaluations] [-D generations] [-C generations] [-B 1] [-E 12|24|96] [-K checkpoint] [-L loss_log] [-c cache_dir] [-t threads] [-j searches] [-s seed]
+//
+// -t sets the simulation threads. -j > 1 optimizes with that many parallel searches (on their own
+// threads, -O rounds each), the result is the same for the same seed and number of searches.
+// -D and -C run differential evolution resp. CMA-ES (stages included), -G optimizes the lumped
+// components with the gradient (L-BFGS). -B 1 tries every combination of the stage settings with the
+// lumped components fixed. Given together they run in the order -O, -D, -C, -B, -G.
+// -E snaps the lumped components to the E12, E24 or E96 series and keeps the -O rounds on it (the
+// parallel searches of -j are continuous only).
+// -K keeps a checkpoint of the -O search (every 1000 rounds and at the end) and resumes from it if the
+// file exists, the search then runs on its own random stream of -s so a resumed run ends like an
+// uninterrupted one. -L appends the loss of every round to a binary log (see Optimizer_Loss_Record).
+// -c keeps a binary cache of the parsed s2p files in cache_dir (see s2p_set_cache_dir()), the next run
+// maps it instead of parsing again. The directory must exist, it can be s2p_dir itself.
+//
+// The circuit file describes the sweep, the cascade (in order from source to load) and the goals:
+//     # comment
+//     SWEEP 5M 100M 1000          f_min f_max n_frequencies
+//     Z0 50 50                    source and load impedance
+//     C 120p                      series R, C, L
+//     LP 1.7u                     parallel (to ground) RP, CP, LP
+//     STAGE 0                     measured stage from s2p_dir with its initial setting
+//     GOAL S21 > 30 5M 100M 1.0   target(S11 S21 S12 S22 MU MU_PRIME) < or > value f_min f_max [weight]
+// The S-parameter goals are in dB.
+#include "circuit.h"
+#include "uti.h"
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "stdbool.h"
+#include "assert.h"
+
+#define HEADLESS_MAX_COMPONENTS 256
+#define HEADLESS_MAX_GOALS 64
+#define HEADLESS_MAX_ARGS 8
+#define HEADLESS_CHECKPOINT_INTERVAL 1000
+
+struct Headless_Job {
+    struct Simulation_Settings settings;
+    struct Circuit_Component components[HEADLESS_MAX_COMPONENTS];
+    size_t n_components;
+    struct Optimization_Goal goals[HEADLESS_MAX_GOALS];
+    size_t n_goals;
+};
+
+char* next(int* count, char*** argv) {
+    (*count)--;
+    return *((*argv)++);
+}
+
+static void usage(const char *prog_name) {
+    printf("Usage: %s <circuit_file> [-d s2p_dir] [-o out.s2p|out.csv] [-O iterations] [-G evaluations] [-D generations] [-C generations] [-B 1] [-E 12|24|96] [-K checkpoint] [-L loss_log] [-c cache_dir] [-t threads] [-j searches] [-s seed]\n", prog_name);
+}
+
+static bool parse_value(struct Uti_String_View sv, double *value) {
+    char *cstr = uti_temp_strndup(sv.text, sv.length);
+    return uti_parse_number_postfixed(cstr, sv.length + 1, value);
+}
+
+static bool parse_target(struct Uti_String_View sv, OPTIMIZATION_TARGET *target) {
+    if (uti_sv_eq(sv, uti_sv_from_cstr("S11"))) *target = OPTIMIZATION_TARGET_S11;
+    else if (uti_sv_eq(sv, uti_sv_from_cstr("S21"))) *target = OPTIMIZATION_TARGET_S21;
+    else if (uti_sv_eq(sv, uti_sv_from_cstr("S12"))) *target = OPTIMIZATION_TARGET_S12;
+    else if (uti_sv_eq(sv, uti_sv_from_cstr("S22"))) *target = OPTIMIZATION_TARGET_S22;
+    else if (uti_sv_eq(sv, uti_sv_from_cstr("MU"))) *target = OPTIMIZATION_TARGET_MU;
+    else if (uti_sv_eq(sv, uti_sv_from_cstr("MU_PRIME"))) *target = OPTIMIZATION_TARGET_MU_PRIME;
+    else return false;
+    return true;
+}
+
+// the stage archetype is only loaded if the circuit has a stage
+static bool parse_circuit_file(const char *path, const char *s2p_dir, struct Headless_Job *job) {
+    char *content;
+    size_t content_size;
+    if (!uti_read_entire_file(path, &content, &content_size)) return false;
+
+    // defaults
+    job->settings = (struct Simulation_Settings){5e6, 1e8, 50.0, 50.0, 1000};
+    job->n_components = 0;
+    job->n_goals = 0;
+
+    struct Circuit_Component_Stage stage_archetype;
+    bool stage_archetype_loaded = false;
+
+    struct Uti_String_View content_sv = uti_sv_from_parts(content, content_size);
+    size_t line_number = 0;
+    while (content_sv.length > 0) {
+        struct Uti_String_View line = uti_sv_trim(uti_sv_chop_by_delim(&content_sv, '\n'));
+        line_number++;
+        if (line.length == 0 || line.text[0] == '#') continue;
+
+        struct Uti_String_View args[HEADLESS_MAX_ARGS];
+        size_t n_args = 0;
+        while (line.length > 0 && n_args < HEADLESS_MAX_ARGS) {
+            struct Uti_String_View arg = uti_sv_trim(uti_sv_chop_by_delim(&line, ' '));
+            line = uti_sv_trim_left(line);
+            if (arg.length > 0) args[n_args++] = arg;
+        }
+        struct Uti_String_View keyword = args[0];
+
+        bool ok = true;
+        double values[HEADLESS_MAX_ARGS];
+        if (uti_sv_eq(keyword, uti_sv_from_cstr("SWEEP"))) {
+            ok = n_args == 4 && parse_value(args[1], &values[1]) && parse_value(args[2], &values[2]) && parse_value(args[3], &values[3]) &&
+                values[1] < values[2] && values[3] >= 2;
+            if (ok) {
+                job->settings.f_min = values[1];
+                job->settings.f_max = values[2];
+                job->settings.n_frequencies = (size_t)values[3];
+            }
+        } else if (uti_sv_eq(keyword, uti_sv_from_cstr("Z0"))) {
+            ok = n_args == 3 && parse_value(args[1], &values[1]) && parse_value(args[2], &values[2]);
+            if (ok) {
+                job->settings.z0_in = values[1];
+                job->settings.z0_out = values[2];
+            }
+        } else if (uti_sv_eq(keyword, uti_sv_from_cstr("GOAL"))) {
+            if (job->n_goals >= HEADLESS_MAX_GOALS) {
+                printf("ERROR: %s:%zu: more than %d goals\n", path, line_number, HEADLESS_MAX_GOALS);
+                return false;
+            }
+            struct Optimization_Goal *goal = &job->goals[job->n_goals];
+            goal->weight = 1.0;
+            goal->active = true;
+            ok = (n_args == 6 || n_args == 7) && parse_target(args[1], &goal->target) &&
+                args[2].length == 1 && (args[2].text[0] == '<' || args[2].text[0] == '>') &&
+                parse_value(args[3], &goal->goal_value) && parse_value(args[4], &goal->f_min) && parse_value(args[5], &goal->f_max) &&
+                (n_args == 6 || parse_value(args[6], &goal->weight)) && goal->f_min < goal->f_max;
+            if (ok) {
+                goal->type = args[2].text[0] == '<' ? OPTIMIZATION_TYPE_LESS_THAN : OPTIMIZATION_TYPE_MORE_THAN;
+                bool is_s = goal->target != OPTIMIZATION_TARGET_MU && goal->target != OPTIMIZATION_TARGET_MU_PRIME;
+                goal->value_map = is_s ? dB : NULL;
+                job->n_goals++;
+            }
+        } else {
+            if (job->n_components >= HEADLESS_MAX_COMPONENTS) {
+                printf("ERROR: %s:%zu: more than %d components\n", path, line_number, HEADLESS_MAX_COMPONENTS);
+                return false;
+            }
+            struct Circuit_Component *component = &job->components[job->n_components];
+            ok = n_args == 2 && parse_value(args[1], &values[1]);
+            if (!ok) {
+                // reported below
+            } else if (uti_sv_eq(keyword, uti_sv_from_cstr("R"))) {
+                circuit_create_resistor_ideal(values[1], component);
+            } else if (uti_sv_eq(keyword, uti_sv_from_cstr("C"))) {
+                circuit_create_capacitor_ideal(values[1], component);
+            } else if (uti_sv_eq(keyword, uti_sv_from_cstr("L"))) {
+                circuit_create_inductor_ideal(values[1], component);
+            } else if (uti_sv_eq(keyword, uti_sv_from_cstr("RP"))) {
+                circuit_create_resistor_ideal_parallel(values[1], component);
+            } else if (uti_sv_eq(keyword, uti_sv_from_cstr("CP"))) {
+                circuit_create_capacitor_ideal_parallel(values[1], component);
+            } else if (uti_sv_eq(keyword, uti_sv_from_cstr("LP"))) {
+                circuit_create_inductor_ideal_parallel(values[1], component);
+            } else if (uti_sv_eq(keyword, uti_sv_from_cstr("STAGE"))) {
+                if (!s2p_dir) {
+                    printf("ERROR: %s:%zu: a STAGE needs the s2p directory (-d s2p_dir)\n", path, line_number);
+                    return false;
+                }
+                if (!stage_archetype_loaded) {
+                    if (!circuit_create_stage_archetype("000_device_settings.csv", (char*)s2p_dir, &stage_archetype)) return false;
+                    stage_archetype_loaded = true;
+                }
+                circuit_create_stage(&stage_archetype, component);
+                size_t setting = (size_t)values[1];
+                ok = values[1] >= 0 && setting < stage_archetype.n_settings;
+                component->as.stage.selected_setting = setting;
+            } else {
+                printf("ERROR: %s:%zu: unknown keyword '%.*s'\n", path, line_number, (int)keyword.length, keyword.text);
+                return false;
+            }
+            if (ok) job->n_components++;
+        }
+
+        if (!ok) {
+            printf("ERROR: %s:%zu: invalid line for '%.*s'\n", path, line_number, (int)keyword.length, keyword.text);
+            return false;
+        }
+        uti_temp_reset();
+    }
+
+    free(content);
+
+    if (job->n_components == 0) {
+        printf("ERROR: %s: the circuit has no components\n", path);
+        return false;
+    }
+    return true;
+}
+
+// in the circuit file format, so the result can be used as the next input
+static void print_circuit(const struct Circuit_Component *components, size_t n_components) {
+    for (size_t i = 0; i < n_components; i++) {
+        const struct Circuit_Component *c = &components[i];
+        switch (c->kind) {
+        case CIRCUIT_COMPONENT_RESISTOR_IDEAL:          printf("R %.17g\n", c->as.resistor_ideal.R); break;
+        case CIRCUIT_COMPONENT_CAPACITOR_IDEAL:         printf("C %.17g\n", c->as.capacitor_ideal.C); break;
+        case CIRCUIT_COMPONENT_INDUCTOR_IDEAL:          printf("L %.17g\n", c->as.inductor_ideal.L); break;
+        case CIRCUIT_COMPONENT_RESISTOR_IDEAL_PARALLEL: printf("RP %.17g\n", c->as.resistor_ideal_parallel.R); break;
+        case CIRCUIT_COMPONENT_CAPACITOR_IDEAL_PARALLEL:printf("CP %.17g\n", c->as.capacitor_ideal_parallel.C); break;
+        case CIRCUIT_COMPONENT_INDUCTOR_IDEAL_PARALLEL: printf("LP %.17g\n", c->as.inductor_ideal_parallel.L); break;
+        case CIRCUIT_COMPONENT_STAGE:
+            printf("STAGE %zu # %s\n", c->as.stage.selected_setting, c->as.stage.models[c->as.stage.selected_setting]);
+        break;
+        case CIRCUIT_COMPONENT_KIND_COUNT:
+        default:
+            assert(false && "implement me (next component kind)");
+        break;
+        }
+    }
+}
+
+static bool ends_with(const char *s, const char *suffix) {
+    size_t l = strlen(s);
+    size_t l_suffix = strlen(suffix);
+    return l >= l_suffix && strcmp(s + l - l_suffix, suffix) == 0;
+}
+
+int main(int argc, char** argv) {
+
+    char* prog_name = next(&argc, &argv);
+
+    if (argc == 0) {
+        printf("ERROR: Need 'circuit_file'\n");
+        usage(prog_name);
+        return 1;
+    }
+
+    char *circuit_file = next(&argc, &argv);
+    char *s2p_dir = NULL;
+    char *output_file = NULL;
+    size_t iterations = 0;
+    size_t evaluations = 0;
+    size_t de_generations = 0;
+    size_t cma_generations = 0;
+    bool stage_search = false;
+    CIRCUIT_E_SERIES e_series = CIRCUIT_E_SERIES_NONE;
+    char *checkpoint_file = NULL;
+    char *loss_log_file = NULL;
+    char *cache_dir = NULL;
+    size_t threads = 0;
+    size_t searches = 1;
+    unsigned int seed = 1;
+
+    while (argc > 0) {
+        char *flag = next(&argc, &argv);
+        if (argc == 0) {
+            printf("ERROR: '%s' needs a value\n", flag);
+            usage(prog_name);
+            return 1;
+        }
+        char *value = next(&argc, &argv);
+        if (strcmp(flag, "-d") == 0) s2p_dir = value;
+        else if (strcmp(flag, "-o") == 0) output_file = value;
+        else if (strcmp(flag, "-O") == 0) iterations = strtoull(value, NULL, 10);
+        else if (strcmp(flag, "-D") == 0) de_generations = strtoull(value, NULL, 10);
+        else if (strcmp(flag, "-C") == 0) cma_generations = strtoull(value, NULL, 10);
+        else if (strcmp(flag, "-B") == 0) stage_search = strtoull(value, NULL, 10) > 0;
+        else if (strcmp(flag, "-E") == 0) {
+            if (strcmp(value, "12") == 0) e_series = CIRCUIT_E_SERIES_E12;
+            else if (strcmp(value, "24") == 0) e_series = CIRCUIT_E_SERIES_E24;
+            else if (strcmp(value, "96") == 0) e_series = CIRCUIT_E_SERIES_E96;
+            else {
+                printf("ERROR: unknown E-series '%s', use 12, 24 or 96\n", value);
+                return 1;
+            }
+        }
+        else if (strcmp(flag, "-K") == 0) checkpoint_file = value;
+        else if (strcmp(flag, "-L") == 0) loss_log_file = value;
+        else if (strcmp(flag, "-c") == 0) cache_dir = value;
+        else if (strcmp(flag, "-G") == 0) evaluations = strtoull(value, NULL, 10);
+        else if (strcmp(flag, "-t") == 0) threads = strtoull(value, NULL, 10);
+        else if (strcmp(flag, "-j") == 0) searches = strtoull(value, NULL, 10);
+        else if (strcmp(flag, "-s") == 0) seed = (unsigned int)strtoul(value, NULL, 10);
+        else {
+            printf("ERROR: unknown option '%s'\n", flag);
+            usage(prog_name);
+            return 1;
+        }
+    }
+
+    s2p_set_cache_dir(cache_dir);
+    static struct Headless_Job job;
+    if (!parse_circuit_file(circuit_file, s2p_dir, &job)) return 2;
+
+    circuit_simulation_set_thread_count(threads);
+    srand(seed);
+
+    struct Simulation_State simulation_state = {0};
+
+    if ((iterations > 0 || evaluations > 0 || de_generations > 0 || cma_generations > 0 || stage_search) && job.n_goals == 0) {
+        printf("ERROR: optimizing needs at least one GOAL in %s\n", circuit_file);
+        return 2;
+    }
+
+    if (e_series != CIRCUIT_E_SERIES_NONE && searches > 1) {
+        printf("ERROR: -E does not work with parallel searches (-j %zu)\n", searches);
+        return 1;
+    }
+    if ((checkpoint_file || loss_log_file) && searches > 1) {
+        printf("ERROR: -K and -L do not work with parallel searches (-j %zu)\n", searches);
+        return 1;
+    }
+
+    static struct Circuit_Value_Grid value_grids[HEADLESS_MAX_COMPONENTS];
+    for (size_t i = 0; i < job.n_components; i++) {
+        value_grids[i] = (struct Circuit_Value_Grid){.series = e_series};
+        double *value = circuit_component_value(&job.components[i]);
+        if (value) *value = circuit_value_grid_snap(&value_grids[i], *value);
+    }
+
+    if (iterations > 0) {
+        if (searches > 1) {
+            double best_loss;
+            if (!circuit_optimizer_parallel_search(job.components, job.n_components, &job.settings, job.goals, job.n_goals, iterations, searches, 0, seed, &best_loss)) return 3;
+            printf("INFO: optimized %zu searches, best loss: %.17g\n", searches, best_loss);
+        } else {
+            struct Optimizer_State optimizer_state;
+            circuit_optimizer_setup(&optimizer_state, iterations, job.components, job.n_components);
+            optimizer_state.print_progress = false;
+            if (e_series != CIRCUIT_E_SERIES_NONE) {
+                optimizer_state.value_grids = value_grids;
+                optimizer_state.t_cache = circuit_t_cache_create(1024);
+            }
+            struct Uti_Rng rng;
+            if (checkpoint_file) {
+                uti_rng_seed(&rng, seed, 0);
+                optimizer_state.rng = &rng;
+                optimizer_state.checkpoint_path = checkpoint_file;
+                optimizer_state.checkpoint_interval = HEADLESS_CHECKPOINT_INTERVAL;
+                FILE *existing = fopen(checkpoint_file, "rb");
+                if (existing) {
+                    fclose(existing);
+                    if (!circuit_optimizer_checkpoint_read(&optimizer_state, checkpoint_file)) return 3;
+                    printf("INFO: resumed %s at round %zu, best loss: %.17g\n", checkpoint_file, optimizer_state.iteration, optimizer_state.best_total_loss_value);
+                }
+            }
+            if (loss_log_file && !circuit_optimizer_loss_log_open(&optimizer_state, loss_log_file)) return 3;
+            while (!circuit_optimizer_update_one_round(&optimizer_state, &simulation_state, &job.settings, job.goals, job.n_goals, job.components, job.n_components));
+            printf("INFO: optimized %zu rounds, best loss: %.17g\n", optimizer_state.iteration, optimizer_state.best_total_loss_value);
+            if (checkpoint_file && !circuit_optimizer_checkpoint_write(&optimizer_state, checkpoint_file)) return 3;
+            // a resumed search may not improve on its checkpoint
+            memcpy(job.components, optimizer_state.best_component_cascade, sizeof(*job.components) * job.n_components);
+            if (optimizer_state.t_cache) {
+                size_t hits, misses;
+                circuit_t_cache_stats(optimizer_state.t_cache, &hits, &misses);
+                printf("INFO: component cache %zu hits, %zu misses\n", hits, misses);
+                circuit_t_cache_destroy(optimizer_state.t_cache);
+            }
+            circuit_optimizer_destroy(&optimizer_state);
+        }
+        print_circuit(job.components, job.n_components);
+    }
+
+    if (de_generations > 0) {
+        double best_loss;
+        if (!circuit_optimizer_differential_evolution(job.components, job.n_components, &job.settings, job.goals, job.n_goals, 0, de_generations, seed, &best_loss)) return 3;
+        printf("INFO: differential evolution, best loss: %.17g\n", best_loss);
+        print_circuit(job.components, job.n_components);
+    }
+
+    if (cma_generations > 0) {
+        double best_loss;
+        if (!circuit_optimizer_cma_es(job.components, job.n_components, &job.settings, job.goals, job.n_goals, 0, cma_generations, seed, &best_loss)) return 3;
+        printf("INFO: CMA-ES, best loss: %.17g\n", best_loss);
+        print_circuit(job.components, job.n_components);
+    }
+
+    if (stage_search) {
+        double best_loss;
+        size_t combinations;
+        if (!circuit_optimizer_stage_settings_search(job.components, job.n_components, &job.settings, job.goals, job.n_goals, &best_loss, &combinations)) return 3;
+        printf("INFO: tried %zu combinations of the stage settings, best loss: %.17g\n", combinations, best_loss);
+        print_circuit(job.components, job.n_components);
+    }
+
+    if (evaluations > 0) {
+        double best_loss;
+        size_t used;
+        if (!circuit_optimizer_gradient_descent(job.components, job.n_components, &job.settings, job.goals, job.n_goals, evaluations, &best_loss, &used)) return 3;
+        printf("INFO: gradient descent used %zu evaluations, best loss: %.17g\n", used, best_loss);
+        print_circuit(job.components, job.n_components);
+    }
+
+    if (!circuit_simulation_setup(job.components, job.n_components, &simulation_state, &job.settings)) return 3;
+    if (!circuit_simulation_do(&simulation_state, false)) return 3;
+
+    double total_loss = 0.0;
+    for (size_t i = 0; i < job.n_goals; i++) {
+        total_loss += job.goals[i].weight * circuit_optimizer_evaluate_goal(&job.goals[i], &simulation_state);
+    }
+    if (job.n_goals > 0) printf("INFO: loss of the circuit: %.17g\n", total_loss);
+
+    if (output_file) {
+        bool ok = ends_with(output_file, ".csv") ?
+            circuit_simulation_write_csv(&simulation_state, output_file) :
+            circuit_simulation_write_touchstone(&simulation_state, output_file);
+        if (!ok) return 4;
+        printf("INFO: wrote %zu frequencies to %s\n", simulation_state.n_frequencies, output_file);
+    }
+
+    circuit_simulation_destroy(&simulation_state);
+    return 0;
+}
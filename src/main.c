@@ -30,11 +30,16 @@ int main(int argc, char** argv) {
 
     if (argc == 0) {
         printf("ERROR: Need 's2p_dir'\n");
-        printf("Usage: %s 's2p_dir'\n", prog_name);
+        printf("Usage: %s 's2p_dir' ['cache_dir']\n", prog_name);
         exit(1);
     }
 
     char* directory = next(&argc, &argv);
+    // optional binary cache of the parsed s2p files, for a quick start the next time
+    if (argc > 0) s2p_set_cache_dir(next(&argc, &argv));
+
+    circuit_kernel_select(circuit_kernel_detect());
+    printf("INFO: using %s simulation kernels\n", circuit_kernel_name(circuit_kernel_selected_kind()));
 
     struct Circuit_Component_Stage stage_archetype;
     if (!circuit_create_stage_archetype("000_device_settings.csv", directory, &stage_archetype))
@@ -239,11 +244,13 @@ int main(int argc, char** argv) {
     struct Simulation_Settings simulation_settings;
     simulation_cockpit_view_init(&sim_cockpit_view_state, &simulation_settings, 5e6, 1e8, 1000);
 
-    struct Simulation_State simulation_state;
+    struct Simulation_State simulation_state = {0};
     bool todo_first_sim = true;
 
-    struct Optimizer_State optimizer_state;
+    // the optimizer runs on its own thread, the ui only picks up its best cascade
+    struct Optimizer_Worker *optimizer_worker = NULL;
     bool optimizer_running = false;
+    bool optimizer_paused = false;
 
     while (!mui_window_should_close())
     {
@@ -331,7 +338,6 @@ int main(int argc, char** argv) {
 
         // simulate
         if (mui_is_key_pressed(MUI_KEY_S)) {
-            if (!todo_first_sim) circuit_simulation_destroy(&simulation_state);
             circuit_simulation_setup(component_array, n_comps, &simulation_state, &simulation_settings);
             circuit_simulation_do(&simulation_state, true);
             if (todo_first_sim) todo_first_sim = false;
@@ -398,7 +404,6 @@ int main(int argc, char** argv) {
         case SIMULATION_COCKPIT_ACTION_NONE:
         break;
         case SIMULATION_COCKPIT_ACTION_SIMULATE:
-            if (!todo_first_sim) circuit_simulation_destroy(&simulation_state);
             circuit_simulation_setup(component_array, n_comps, &simulation_state, &simulation_settings);
             circuit_simulation_do(&simulation_state, true);
             if (todo_first_sim) todo_first_sim = false;
@@ -411,10 +416,11 @@ int main(int argc, char** argv) {
                 if (todo_first_sim) todo_first_sim = false;
 
                 // TODO: check if 1 or more goals are activated
-                circuit_optimizer_setup(&optimizer_state, 100000, component_array, n_comps);
-                optimizer_running = true;
+                optimizer_worker = circuit_optimizer_worker_start(component_array, n_comps, &simulation_settings, sim_cockpit_view_state.goals, sim_cockpit_view_state.n_goals, 100000);
+                optimizer_running = optimizer_worker != NULL;
+                optimizer_paused = false;
             } else {
-                optimizer_running = false;
+                circuit_optimizer_worker_cancel(optimizer_worker);
             }
         break;
         case SIMULATION_COCKPIT_ACTION_ERROR:
@@ -429,19 +435,37 @@ int main(int argc, char** argv) {
         }
 
         if (optimizer_running) {
-            optimizer_running = !circuit_optimizer_update_one_round(&optimizer_state, &simulation_state, &simulation_settings, sim_cockpit_view_state.goals, sim_cockpit_view_state.n_goals, component_array, n_comps);
-            // update stage views
-            for (size_t i = 0; i < n_comps; i++) {
-                if (component_array[i].kind == CIRCUIT_COMPONENT_STAGE) {
-                    if (component_view_array[i].as.stage_view.active_setting != component_array[i].as.stage.selected_setting) {
-                        stage_view_update_active_setting(&component_view_array[i].as.stage_view, component_array[i].as.stage.selected_setting);
+            // pause / resume
+            if (mui_is_key_pressed(MUI_KEY_P)) {
+                optimizer_paused = !optimizer_paused;
+                circuit_optimizer_worker_pause(optimizer_worker, optimizer_paused);
+            }
+
+            bool is_new;
+            const struct Optimizer_Snapshot *snapshot = circuit_optimizer_worker_snapshot(optimizer_worker, &is_new);
+            if (is_new) {
+                memcpy(component_array, snapshot->cascade, sizeof(*component_array) * n_comps);
+
+                // update stage views
+                for (size_t i = 0; i < n_comps; i++) {
+                    if (component_array[i].kind == CIRCUIT_COMPONENT_STAGE) {
+                        if (component_view_array[i].as.stage_view.active_setting != component_array[i].as.stage.selected_setting) {
+                            stage_view_update_active_setting(&component_view_array[i].as.stage_view, component_array[i].as.stage.selected_setting);
+                        }
                     }
                 }
+
+                // update plot with the best cascade so far
+                circuit_simulation_setup(component_array, n_comps, &simulation_state, &simulation_settings);
+                circuit_simulation_do(&simulation_state, false);
+                printf("optimizer round %zu best loss: %f\n", snapshot->iteration, snapshot->best_loss);
             }
 
-            // update plot
-            circuit_simulation_setup(component_array, n_comps, &simulation_state, &simulation_settings);
-            circuit_simulation_do(&simulation_state, false);
+            if (snapshot->finished) {
+                circuit_optimizer_worker_destroy(optimizer_worker);
+                optimizer_worker = NULL;
+                optimizer_running = false;
+            }
         }
 
         sim_cockpit_view_state.optimizer_running = optimizer_running;
@@ -594,6 +618,7 @@ int main(int argc, char** argv) {
         uti_temp_reset();
     }
 
+    circuit_optimizer_worker_destroy(optimizer_worker);
     mui_close_window();
 
     return 0;
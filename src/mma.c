@@ -189,10 +189,49 @@ void mma_spline_cubic_natural_complex_2(const double *x, const struct Complex *z
 	struct Complex *a = mma_temp_alloc(sizeof(struct Complex) * (n_in - 1));
 	struct Complex *b = mma_temp_alloc(sizeof(struct Complex) * (n_in - 1));
 	mma_spline_cubic_natural_ab_complex(x, z, n_in, a, b);
+	mma_spline_cubic_natural_complex_eval(x, z, a, b, n_in, real_out, imaginary_out, x_resamples, n_out);
+	mma_temp_restore();
+}
+
+// binary search the first interval, the resamples might start anywhere in x
+// (smallest j with x_now <= x[j + 1], but at most n_in - 2)
+static size_t spline_first_interval(const double *x, size_t n_in, double x_now) {
+	size_t lo = 0;
+	size_t hi = n_in - 2;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (x_now > x[mid + 1]) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+// evaluate the spline with a_i b_i from mma_spline_cubic_natural_ab()
+// does not touch the temp allocator, so it can be called from multiple threads
+void mma_spline_cubic_natural_eval(const double *x, const double *y, const double *a, const double *b, size_t n_in, double *y_out, const double *x_resamples, size_t n_out) {
+	if (n_out == 0) return;
+
+	size_t j = spline_first_interval(x, n_in, x_resamples[0]);
+	for (size_t i = 0; i < n_out ; i ++) {
+		double x_now = x_resamples[i];
+		while (j + 1 < n_in - 1 && x_now > x[j + 1]) {
+			j++;
+		}
+
+		double t = (x_now - x[j]) / (x[j + 1] - x[j]);
+		y_out[i] = (1 - t) * y[j] + t * y[j + 1] + t * (1 - t) * ((1 - t) * a[j] + t * b[j]);
+	}
+}
+
+// evaluate the spline with a_i b_i from mma_spline_cubic_natural_ab_complex()
+// does not touch the temp allocator, so it can be called from multiple threads
+void mma_spline_cubic_natural_complex_eval(const double *x, const struct Complex *z, const struct Complex *a, const struct Complex *b, size_t n_in, double *real_out, double *imaginary_out, const double *x_resamples, size_t n_out) {
+	if (n_out == 0) return;
+
 	// a_i b_i are used to derive the spline and are related for example to
 	//        q_i(x) = (1-t) y_(i-1) + t y_i + t (t-1) ((1-t)a_i + tb_i)
 
-	size_t j = 0;
+	size_t j = spline_first_interval(x, n_in, x_resamples[0]);
 	for (size_t i = 0; i < n_out ; i ++) {
 		double x_now = x_resamples[i];
 		// we increase j until x is in [x[j], x[j+1]]
@@ -205,11 +244,35 @@ void mma_spline_cubic_natural_complex_2(const double *x, const struct Complex *z
 		real_out[i] = (1 - t) * z[j].r + t * z[j + 1].r + t * (1 - t) * ((1 - t) * a[j].r + t * b[j].r);
 		imaginary_out[i] = (1 - t) * z[j].i + t * z[j + 1].i + t * (1 - t) * ((1 - t) * a[j].i + t * b[j].i);
 	}
-
-	mma_temp_restore();
 }
 
 
+// evaluate the splines of the 8 planes with a_i b_i from mma_spline_cubic_natural_ab() (or _multi) of each plane
+// does not touch the temp allocator, so it can be called from multiple threads
+void mma_spline_cubic_natural_2x2_soa_eval(const double *x, const struct Complex_2x2_SoA *y, const struct Complex_2x2_SoA *a, const struct Complex_2x2_SoA *b, size_t n_in, struct Complex_2x2_SoA *y_out, const double *x_resamples, size_t n_out) {
+	if (n_out == 0) return;
+
+	#define SPLINE_POINT(plane) ((1 - t) * y->plane[j] + t * y->plane[j + 1] + t * (1 - t) * ((1 - t) * a->plane[j] + t * b->plane[j]))
+	size_t j = spline_first_interval(x, n_in, x_resamples[0]);
+	for (size_t i = 0; i < n_out ; i ++) {
+		double x_now = x_resamples[i];
+		while (j + 1 < n_in - 1 && x_now > x[j + 1]) {
+			j++;
+		}
+
+		double t = (x_now - x[j]) / (x[j + 1] - x[j]);
+		y_out->r11[i] = SPLINE_POINT(r11);
+		y_out->r12[i] = SPLINE_POINT(r12);
+		y_out->r21[i] = SPLINE_POINT(r21);
+		y_out->r22[i] = SPLINE_POINT(r22);
+		y_out->i11[i] = SPLINE_POINT(i11);
+		y_out->i12[i] = SPLINE_POINT(i12);
+		y_out->i21[i] = SPLINE_POINT(i21);
+		y_out->i22[i] = SPLINE_POINT(i22);
+	}
+	#undef SPLINE_POINT
+}
+
 // S''(x0) = S''(x(n-1)) = 0
 // make sure there is enough space in y_out
 void mma_spline_cubic_natural_linear(const double *x, const double *y, size_t n_in, double *y_out, size_t n_out, double x_min, double x_max) {
@@ -282,61 +345,78 @@ void mma_spline_cubic_natural_linear_complex(const double *x, const struct Compl
 //        q_i(x) = (1-t) y_(i-1) + t y_i + t (t-1) ((1-t)a_i + tb_i)
 //
 void mma_spline_cubic_natural_ab(const double *x, const double *y, size_t n_in, double *a_out, double *b_out) {
-	assert(n_in >= 2);
-	mma_temp_set_restore_point();
-	double *a_sub = mma_temp_alloc(n_in*sizeof(double));
-	double *a = mma_temp_alloc(n_in*sizeof(double));
-	double *a_sup = mma_temp_alloc(n_in*sizeof(double));
-	double *k = mma_temp_alloc(n_in*sizeof(double)); // out k, initally holds b
-	// diagonal a_ii
-	a[0] = 2.0 / (x[1] - x[0]);
-	a[n_in - 1] = 2.0 / (x[n_in - 1] - x[n_in - 2]);
-	for (size_t i = 1; i < n_in-1; i ++) {
-		a[i] = 2.0 * (1.0 / (x[i] - x[i - 1]) + 1.0/ (x[i + 1] - x[i]));
-	}
+	mma_spline_cubic_natural_ab_multi(x, y, n_in, 1, a_out, b_out);
+}
 
-	// sub and super diagonal elements
-	for (size_t i = 1; i < n_in; i ++) {
-		a_sub[i] = 1.0 / (x[i] - x[i - 1]);
-		a_sup[i - 1] = 1.0 / (x[i] - x[i - 1]);
-	}
+// see https://en.wikipedia.org/wiki/Spline_interpolation
+// make sure there is enough space (n_in - 1) in a_out, b_out
+// a_i b_i are used to derive the spline and are related for example to
+//        q_i(x) = (1-t) y_(i-1) + t y_i + t (t-1) ((1-t)a_i + tb_i)
+//
+void mma_spline_cubic_natural_ab_complex(const double *x, const struct Complex *z, size_t n_in, struct Complex *a_out, struct Complex *b_out) {
+	// real and imaginary part are two interleaved channels
+	mma_spline_cubic_natural_ab_multi(x, (const double *)z, n_in, 2, (double *)a_out, (double *)b_out);
+}
 
-	// b vector is stored in k
-	k[0] = 3.0 * (y[1] - y[0]) / ((x[1] - x[0]) * (x[1] - x[0]));
-	k[n_in - 1] = 3.0 * (y[n_in - 1] - y[n_in - 2]) / ((x[n_in - 1] - x[n_in - 2]) * (x[n_in - 1] - x[n_in - 2]));
-	for (size_t i = 1; i < n_in - 1; i++) {
-		k[i] = 3.0 * ((y[i] - y[i - 1]) / ((x[i] - x[i - 1]) * (x[i] - x[i - 1]))  + (y[i + 1] - y[i]) / ((x[i + 1] - x[i]) * (x[i + 1] - x[i])));
+// thomas algorithm for n_channels right hand sides of the same matrix
+// x_out is interleaved: x_out[ix * n_channels + c] is equation ix of channel c
+// scratch_buffer needs 2 * N space, the matrix is factored once into it
+// every channel gets bitwise the same result as mma_solve_tridiagonal_matrix()
+void mma_solve_tridiagonal_matrix_multi(const size_t N, size_t n_channels, const double *a, const double *b,
+            const double *c, double *x_out, double *scratch_buffer) {
+	double *c_prime = scratch_buffer;
+	double *denominator = &scratch_buffer[N];
+
+	denominator[0] = b[0];
+	c_prime[0] = c[0] / b[0];
+	for (size_t ix = 1; ix < N; ix++) {
+		denominator[ix] = b[ix] - a[ix] * c_prime[ix - 1];
+		if (ix < N - 1) {
+			c_prime[ix] = c[ix] / denominator[ix];
+		}
 	}
 
-	double *scratch = mma_temp_alloc(n_in*sizeof(double));
-	mma_solve_tridiagonal_matrix(n_in, a_sub, a, a_sup, k, scratch);
+	// the channels are contiguous, so the inner loops vectorize
+	for (size_t ch = 0; ch < n_channels; ch++) {
+		x_out[ch] = x_out[ch] / denominator[0];
+	}
+	for (size_t ix = 1; ix < N; ix++) {
+		double *x_now = &x_out[ix * n_channels];
+		const double *x_before = &x_out[(ix - 1) * n_channels];
+		for (size_t ch = 0; ch < n_channels; ch++) {
+			x_now[ch] = (x_now[ch] - a[ix] * x_before[ch]) / denominator[ix];
+		}
+	}
 
-	// calc a_out b_out
-	for (size_t i = 0; i < n_in - 1; i++) {
-		a_out[i] = k[i] * (x[i+1] - x[i]) - (y[i+1] - y[i]);
-		b_out[i] = -k[i+1] * (x[i+1] - x[i]) + (y[i+1] - y[i]);
+	for (size_t ix = N - 1; ix > 0; ix--) {
+		double *x_before = &x_out[(ix - 1) * n_channels];
+		const double *x_now = &x_out[ix * n_channels];
+		for (size_t ch = 0; ch < n_channels; ch++) {
+			x_before[ch] -= c_prime[ix - 1] * x_now[ch];
+		}
 	}
+}
 
+// natural splines of n_channels data sets on the same grid x
+// y is interleaved: y[i * n_channels + c] is point i of channel c,
+// a_out and b_out ((n_in - 1) * n_channels) are interleaved the same way
+// the tridiagonal matrix only depends on x, so it is built and factored once for all channels
+void mma_spline_cubic_natural_ab_multi(const double *x, const double *y, size_t n_in, size_t n_channels, double *a_out, double *b_out) {
+	mma_temp_set_restore_point();
+	double *scratch = mma_temp_alloc(MMA_SPLINE_AB_MULTI_SCRATCH_COUNT(n_in, n_channels)*sizeof(double));
+	mma_spline_cubic_natural_ab_multi_scratch(x, y, n_in, n_channels, a_out, b_out, scratch);
 	mma_temp_restore();
 }
 
-// see https://en.wikipedia.org/wiki/Spline_interpolation
-// make sure there is enough space (n_in - 1) in a_out, b_out
-// a_i b_i are used to derive the spline and are related for example to
-//        q_i(x) = (1-t) y_(i-1) + t y_i + t (t-1) ((1-t)a_i + tb_i)
-//
-void mma_spline_cubic_natural_ab_complex(const double *x, const struct Complex *z, size_t n_in, struct Complex *a_out, struct Complex *b_out) {
+void mma_spline_cubic_natural_ab_multi_scratch(const double *x, const double *y, size_t n_in, size_t n_channels, double *a_out, double *b_out, double *scratch) {
 	assert(n_in >= 2);
-	mma_temp_set_restore_point();
-	double *a_sub = mma_temp_alloc(n_in*sizeof(double));
-	double *a = mma_temp_alloc(n_in*sizeof(double));
-	double *a_sup = mma_temp_alloc(n_in*sizeof(double));
-	double *k = mma_temp_alloc(n_in*sizeof(double)); // out k, initally holds b
-	double *ia_sub = mma_temp_alloc(n_in*sizeof(double));
-	double *ia = mma_temp_alloc(n_in*sizeof(double));
-	double *ia_sup = mma_temp_alloc(n_in*sizeof(double));
-	double *ik = mma_temp_alloc(n_in*sizeof(double)); // out k, initally holds b
-
+	size_t nc = n_channels;
+	double *a_sub = scratch;
+	double *a = &scratch[n_in];
+	double *a_sup = &scratch[2*n_in];
+	double *h2 = &scratch[3*n_in]; // h2[i] = (x[i] - x[i - 1])^2
+	double *k = &scratch[4*n_in]; // out k, initally holds b
+	double *solve_scratch = &scratch[(4 + nc)*n_in];
 
 	// diagonal a_ii
 	a[0] = 2.0 / (x[1] - x[0]);
@@ -349,53 +429,33 @@ void mma_spline_cubic_natural_ab_complex(const double *x, const struct Complex *
 	for (size_t i = 1; i < n_in; i ++) {
 		a_sub[i] = 1.0 / (x[i] - x[i - 1]);
 		a_sup[i - 1] = 1.0 / (x[i] - x[i - 1]);
+		h2[i] = (x[i] - x[i - 1]) * (x[i] - x[i - 1]);
 	}
 
 	// b vector is stored in k
-	k[0] = 3.0 * (z[1].r - z[0].r) / ((x[1] - x[0]) * (x[1] - x[0]));
-	k[n_in - 1] = 3.0 * (z[n_in - 1].r - z[n_in - 2].r) / ((x[n_in - 1] - x[n_in - 2]) * (x[n_in - 1] - x[n_in - 2]));
-	for (size_t i = 1; i < n_in - 1; i++) {
-		k[i] = 3.0 * ((z[i].r - z[i - 1].r) / ((x[i] - x[i - 1]) * (x[i] - x[i - 1]))  + (z[i + 1].r - z[i].r) / ((x[i + 1] - x[i]) * (x[i + 1] - x[i])));
-	}
-
-	// imag part
-	// diagonal a_ii
-	ia[0] = 2.0 / (x[1] - x[0]);
-	ia[n_in - 1] = 2.0 / (x[n_in - 1] - x[n_in - 2]);
-	for (size_t i = 1; i < n_in-1; i ++) {
-		ia[i] = 2.0 * (1.0 / (x[i] - x[i - 1]) + 1.0/ (x[i + 1] - x[i]));
-	}
-
-	// sub and super diagonal elements
-	for (size_t i = 1; i < n_in; i ++) {
-		ia_sub[i] = 1.0 / (x[i] - x[i - 1]);
-		ia_sup[i - 1] = 1.0 / (x[i] - x[i - 1]);
+	for (size_t ch = 0; ch < nc; ch++) {
+		k[ch] = 3.0 * (y[nc + ch] - y[ch]) / h2[1];
+		k[(n_in - 1) * nc + ch] = 3.0 * (y[(n_in - 1) * nc + ch] - y[(n_in - 2) * nc + ch]) / h2[n_in - 1];
 	}
-
-	// b vector is stored in k
-	ik[0] = 3.0 * (z[1].i - z[0].i) / ((x[1] - x[0]) * (x[1] - x[0]));
-	ik[n_in - 1] = 3.0 * (z[n_in - 1].i - z[n_in - 2].i) / ((x[n_in - 1] - x[n_in - 2]) * (x[n_in - 1] - x[n_in - 2]));
 	for (size_t i = 1; i < n_in - 1; i++) {
-		ik[i] = 3.0 * ((z[i].i - z[i - 1].i) / ((x[i] - x[i - 1]) * (x[i] - x[i - 1]))  + (z[i + 1].i - z[i].i) / ((x[i + 1] - x[i]) * (x[i + 1] - x[i])));
+		for (size_t ch = 0; ch < nc; ch++) {
+			k[i * nc + ch] = 3.0 * ((y[i * nc + ch] - y[(i - 1) * nc + ch]) / h2[i]  + (y[(i + 1) * nc + ch] - y[i * nc + ch]) / h2[i + 1]);
+		}
 	}
 
-
-	double *scratch = mma_temp_alloc(n_in*sizeof(double));
-	mma_solve_tridiagonal_matrix(n_in, a_sub, a, a_sup, k, scratch);
-	mma_solve_tridiagonal_matrix(n_in, ia_sub, ia, ia_sup, ik, scratch);
+	mma_solve_tridiagonal_matrix_multi(n_in, nc, a_sub, a, a_sup, k, solve_scratch);
 
 	// calc a_out b_out
 	for (size_t i = 0; i < n_in - 1; i++) {
-		a_out[i].r = k[i] * (x[i+1] - x[i]) - (z[i+1].r - z[i].r);
-		b_out[i].r = -k[i+1] * (x[i+1] - x[i]) + (z[i+1].r - z[i].r);
-		a_out[i].i = ik[i] * (x[i+1] - x[i]) - (z[i+1].i - z[i].i);
-		b_out[i].i = -ik[i+1] * (x[i+1] - x[i]) + (z[i+1].i - z[i].i);
+		double dx = x[i+1] - x[i];
+		for (size_t ch = 0; ch < nc; ch++) {
+			double dy = y[(i + 1) * nc + ch] - y[i * nc + ch];
+			a_out[i * nc + ch] = k[i * nc + ch] * dx - dy;
+			b_out[i * nc + ch] = -k[(i + 1) * nc + ch] * dx + dy;
+		}
 	}
-
-	mma_temp_restore();
 }
 
-
 // S'(x0) = y0', S'(x(n-1)) = y(n-1)'
 // make sure there is enough space in y_out
 //void mma_spline_cubic_clamped(double *x, double *y, size_t n_in, double *y_out, size_t n_out) {
@@ -960,3 +1020,54 @@ struct Mma_Complex_2x2 calc_s_from_t(struct Complex t[2][2]) {
     s_out.v[1][1] = mma_complex_divide_or_zero(mma_complex_negate(t[0][1]), t[0][0]);
 	return s_out;
 }
+
+bool mma_eigen_symmetric(double *a, size_t n, double *eigenvalues_out, double *eigenvectors_out) {
+    double *v = eigenvectors_out;
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n; j++) v[i*n + j] = i == j ? 1.0 : 0.0;
+    }
+
+    bool converged = false;
+    for (size_t sweep = 0; sweep < 64; sweep++) {
+        double off = 0.0;
+        double diagonal = 0.0;
+        for (size_t p = 0; p < n; p++) {
+            diagonal += a[p*n + p] * a[p*n + p];
+            for (size_t q = p + 1; q < n; q++) off += a[p*n + q] * a[p*n + q];
+        }
+        if (off <= 1e-32 * diagonal || off == 0.0) {
+            converged = true;
+            break;
+        }
+
+        for (size_t p = 0; p < n; p++) {
+            for (size_t q = p + 1; q < n; q++) {
+                double apq = a[p*n + q];
+                if (apq == 0.0) continue;
+                // rotation that zeros a_pq
+                double theta = (a[q*n + q] - a[p*n + p]) / (2.0 * apq);
+                double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                double c = 1.0 / sqrt(t * t + 1.0);
+                double s = t * c;
+                for (size_t k = 0; k < n; k++) {
+                    double akp = a[k*n + p], akq = a[k*n + q];
+                    a[k*n + p] = c * akp - s * akq;
+                    a[k*n + q] = s * akp + c * akq;
+                }
+                for (size_t k = 0; k < n; k++) {
+                    double apk = a[p*n + k], aqk = a[q*n + k];
+                    a[p*n + k] = c * apk - s * aqk;
+                    a[q*n + k] = s * apk + c * aqk;
+                }
+                for (size_t k = 0; k < n; k++) {
+                    double vkp = v[k*n + p], vkq = v[k*n + q];
+                    v[k*n + p] = c * vkp - s * vkq;
+                    v[k*n + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) eigenvalues_out[i] = a[i*n + i];
+    return converged;
+}
@@ -39,6 +39,19 @@ struct Complex {
     double i;
 };
 
+// 2x2 complex matrices (S- or T-parameters) over frequency as 8 planes
+struct Complex_2x2_SoA {
+    double* r11;
+    double* r12;
+    double* r21;
+    double* r22;
+    double* i11;
+    double* i12;
+    double* i21;
+    double* i22;
+    // count is implicit by the caller (i.e. n_frequencies)
+};
+
 extern const struct Mat4f mat4f_unit;
 
 struct Complex mma_complex(double r, double i);
@@ -99,14 +112,29 @@ float mma_matrix_detmat4f(struct Mat4f *m);
 // functions to determine parameters for spline
 void mma_spline_cubic_natural_ab(const double *x, const double *y, size_t n_in, double *a_out, double *b_out);
 void mma_spline_cubic_natural_ab_complex(const double *x, const struct Complex *z, size_t n_in, struct Complex *a_out, struct Complex *b_out);
+// n_channels data sets on one grid, interleaved y[i * n_channels + c], matrix factored only once
+void mma_spline_cubic_natural_ab_multi(const double *x, const double *y, size_t n_in, size_t n_channels, double *a_out, double *b_out);
+// the same with the caller's scratch instead of the temp allocator (so it can run on many threads)
+#define MMA_SPLINE_AB_MULTI_SCRATCH_COUNT(n_in, n_channels) ((6 + (n_channels)) * (n_in))
+void mma_spline_cubic_natural_ab_multi_scratch(const double *x, const double *y, size_t n_in, size_t n_channels, double *a_out, double *b_out, double *scratch);
 // higher level functions:
 void mma_spline_cubic_natural(const double *x, const double *y, size_t n_in, double *y_out, double* x_out, size_t n_out);
 void mma_spline_cubic_natural_complex(const double *x, const struct Complex *z, size_t n_in, struct Complex *z_out, double *x_out, size_t n_out);
 void mma_spline_cubic_natural_complex_2(const double *x, const struct Complex *z, size_t n_in, double *real_out, double *imaginary_out, double *x_out, size_t n_out);
+// evaluate with precalculated a_i b_i (no temp allocations, thread safe)
+void mma_spline_cubic_natural_eval(const double *x, const double *y, const double *a, const double *b, size_t n_in, double *y_out, const double *x_out, size_t n_out);
+void mma_spline_cubic_natural_complex_eval(const double *x, const struct Complex *z, const struct Complex *a, const struct Complex *b, size_t n_in, double *real_out, double *imaginary_out, const double *x_out, size_t n_out);
+// the 8 planes of y at once (a_i b_i per plane), the interval and t are found once per x_out
+void mma_spline_cubic_natural_2x2_soa_eval(const double *x, const struct Complex_2x2_SoA *y, const struct Complex_2x2_SoA *a, const struct Complex_2x2_SoA *b, size_t n_in, struct Complex_2x2_SoA *y_out, const double *x_out, size_t n_out);
 void mma_spline_cubic_natural_linear(const double *x, const double *y, size_t n_in, double *y_out, size_t n_out, double x_min, double x_max);
 void mma_spline_cubic_natural_linear_complex(const double *x, const struct Complex *z, size_t n_in, struct Complex *z_out, size_t n_out, double x_min, double x_max);
 
 
+// linear algebra
+// eigen decomposition of the symmetric n x n matrix a (row major, destroyed) with the cyclic Jacobi method,
+// the eigenvectors are the columns of eigenvectors_out (row major n x n). false if it did not converge.
+bool mma_eigen_symmetric(double *a, size_t n, double *eigenvalues_out, double *eigenvectors_out);
+
 // utility stuff
 #define MMA_TEMP_BUFFER_CAP_INTERNAL 4096*4096
 void mma_temp_reset(void);
@@ -80,11 +80,135 @@ bool test_mma_spline_cubic_natural_ab_2() {
     TEST_END();
 }
 
+bool test_mma_spline_cubic_natural_ab_multi() {
+    // every channel of the interleaved solver equals the single channel spline bitwise
+    size_t n = 301;
+    size_t n_channels = 5;
+    double *x = malloc(n*sizeof(double));
+    double *y = malloc(n*n_channels*sizeof(double));
+    double *y_channel = malloc(n*sizeof(double));
+    double *a = malloc((n-1)*n_channels*sizeof(double));
+    double *b = malloc((n-1)*n_channels*sizeof(double));
+    double *a_channel = malloc((n-1)*sizeof(double));
+    double *b_channel = malloc((n-1)*sizeof(double));
+
+    x[0] = 0.0;
+    for (size_t i = 1; i < n; i++) x[i] = x[i - 1] + 0.5 + (double)rand() / RAND_MAX;
+    for (size_t i = 0; i < n*n_channels; i++) y[i] = 2.0 * rand() / RAND_MAX - 1.0;
+
+    mma_spline_cubic_natural_ab_multi(x, y, n, n_channels, a, b);
+
+    TEST_START();
+    for (size_t c = 0; c < n_channels; c++) {
+        for (size_t i = 0; i < n; i++) y_channel[i] = y[i*n_channels + c];
+        mma_spline_cubic_natural_ab(x, y_channel, n, a_channel, b_channel);
+        for (size_t i = 0; i < n - 1; i++) {
+            if (memcmp(&a[i*n_channels + c], &a_channel[i], sizeof(double)) != 0 ||
+                memcmp(&b[i*n_channels + c], &b_channel[i], sizeof(double)) != 0) {
+                printf("SUBTEST(%zu) FAILED: %s:%d: channel %zu differs from the single channel spline\n", i, __FILE__, __LINE__, c);
+                did_fail = true;
+            }
+        }
+    }
+
+    free(x);
+    free(y);
+    free(y_channel);
+    free(a);
+    free(b);
+    free(a_channel);
+    free(b_channel);
+    TEST_END();
+}
+
+bool test_mma_spline_cubic_natural_2x2_soa_eval() {
+    // every plane equals mma_spline_cubic_natural_eval() of that plane bitwise, resamples outside
+    // the data and starting in the middle included
+    size_t n = 57;
+    size_t n_out = 400;
+    double *x = malloc(n*sizeof(double));
+    double *x_out = malloc(n_out*sizeof(double));
+    double *data = malloc(8*(3*n + 2*n_out)*sizeof(double));
+    struct Complex_2x2_SoA planes[5];
+    double *next = data;
+    for (size_t k = 0; k < 5; k++) {
+        size_t length = k < 3 ? n : n_out;
+        double **p[8] = {&planes[k].r11, &planes[k].r12, &planes[k].r21, &planes[k].r22, &planes[k].i11, &planes[k].i12, &planes[k].i21, &planes[k].i22};
+        for (size_t c = 0; c < 8; c++) {
+            *p[c] = next;
+            next += length;
+        }
+    }
+    struct Complex_2x2_SoA *y = &planes[0], *a = &planes[1], *b = &planes[2], *y_out = &planes[3], *y_plane = &planes[4];
+
+    x[0] = 1.0;
+    for (size_t i = 1; i < n; i++) x[i] = x[i - 1] + 0.5 + (double)rand() / RAND_MAX;
+    for (size_t i = 0; i < n_out; i++) x_out[i] = 0.5 * (x[0] + x[n / 2]) + (x[n - 1] + 2.0) * i / n_out;
+    double *ys[8] = {y->r11, y->r12, y->r21, y->r22, y->i11, y->i12, y->i21, y->i22};
+    double *as[8] = {a->r11, a->r12, a->r21, a->r22, a->i11, a->i12, a->i21, a->i22};
+    double *bs[8] = {b->r11, b->r12, b->r21, b->r22, b->i11, b->i12, b->i21, b->i22};
+    double *outs[8] = {y_out->r11, y_out->r12, y_out->r21, y_out->r22, y_out->i11, y_out->i12, y_out->i21, y_out->i22};
+    for (size_t c = 0; c < 8; c++) {
+        for (size_t i = 0; i < n; i++) ys[c][i] = 2.0 * rand() / RAND_MAX - 1.0;
+        mma_spline_cubic_natural_ab(x, ys[c], n, as[c], bs[c]);
+    }
+
+    mma_spline_cubic_natural_2x2_soa_eval(x, y, a, b, n, y_out, x_out, n_out);
+
+    TEST_START();
+    for (size_t c = 0; c < 8; c++) {
+        mma_spline_cubic_natural_eval(x, ys[c], as[c], bs[c], n, y_plane->r11, x_out, n_out);
+        if (memcmp(outs[c], y_plane->r11, n_out*sizeof(double)) != 0) {
+            printf("SUBTEST(%zu) FAILED: %s:%d: plane differs from the single plane spline\n", c, __FILE__, __LINE__);
+            did_fail = true;
+        }
+    }
+
+    free(x);
+    free(x_out);
+    free(data);
+    TEST_END();
+}
+
+bool test_mma_eigen_symmetric() {
+    // A v = lambda v for every pair and the eigenvectors are orthonormal
+    size_t n = 7;
+    double a[7*7], a_copy[7*7], eigenvalues[7], eigenvectors[7*7];
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j <= i; j++) {
+            a[i*n + j] = a[j*n + i] = 2.0 * rand() / RAND_MAX - 1.0;
+        }
+    }
+    memcpy(a_copy, a, sizeof(a));
+
+    TEST_START();
+    if (!mma_eigen_symmetric(a_copy, n, eigenvalues, eigenvectors)) {
+        printf("SUBTEST FAILED: %s:%d: did not converge\n", __FILE__, __LINE__);
+        did_fail = true;
+    }
+    for (size_t k = 0; k < n; k++) {
+        for (size_t i = 0; i < n; i++) {
+            double av = 0.0;
+            for (size_t j = 0; j < n; j++) av += a[i*n + j] * eigenvectors[j*n + k];
+            EQF(av, eigenvalues[k] * eigenvectors[i*n + k], 1e-12);
+        }
+        for (size_t l = 0; l < n; l++) {
+            double dot = 0.0;
+            for (size_t i = 0; i < n; i++) dot += eigenvectors[i*n + k] * eigenvectors[i*n + l];
+            EQF(dot, k == l ? 1.0 : 0.0, 1e-12);
+        }
+    }
+    TEST_END();
+}
+
 int main() {
 
     bool (*tests[])() = {
         test_mma_spline_cubic_natural_ab_1,
         test_mma_spline_cubic_natural_ab_2,
+        test_mma_spline_cubic_natural_ab_multi,
+        test_mma_spline_cubic_natural_2x2_soa_eval,
+        test_mma_eigen_symmetric,
     };
 
     size_t n_tests = sizeof tests / sizeof tests[0];
@@ -15,12 +15,29 @@
 
 typedef enum { FMT_RI, FMT_MA, FMT_DB } S_Format;
 
+void s2p_set_file_path(struct S2P_Info *info, const char* file_name, const char* dir) {
+    snprintf(info->full_path, sizeof(info->full_path), "%s/%s", dir, file_name);
+    snprintf(info->file_name, sizeof(info->file_name), "%s", file_name);
+}
+
 bool read_s2p_file(const char* file_name, const char* dir, struct S2P_Info *info) {
 
-    sprintf(info->full_path, "%s/%s", dir, file_name);
-    sprintf(info->file_name, "%s", file_name);
+    s2p_set_file_path(info, file_name, dir);
+
+    struct Uti_File_View view;
+    if (!uti_file_view_open(info->full_path, &view)) return false;
+    info->file_content = (char*)view.content;
+    info->file_content_size = view.size;
+    info->file_content_mapped = view.mapped;
+    return true;
+}
 
-    return uti_read_entire_file(info->full_path, &info->file_content, &info->file_content_size);
+void s2p_release_file_content(struct S2P_Info *info) {
+    struct Uti_File_View view = {info->file_content, info->file_content_size, info->file_content_mapped};
+    uti_file_view_close(&view);
+    info->file_content = NULL;
+    info->file_content_size = 0;
+    info->file_content_mapped = false;
 }
 
 
@@ -89,17 +106,112 @@ struct Complex parse_complex(double v1, double v2, S_Format fmt) {
 }
 
 
-// mallocs the arrays insode info
+static void s2p_calc_z(struct S2P_Info *info) {
+    size_t n = info->data_length;
+    info->z11.length = n;
+    info->z12.length = n;
+    info->z21.length = n;
+    info->z22.length = n;
+    info->z11.items = malloc(sizeof(*info->z11.items)*n);
+    info->z11.capacity = n;
+    info->z21.items = malloc(sizeof(*info->z21.items)*n);
+    info->z21.capacity = n;
+    info->z12.items = malloc(sizeof(*info->z12.items)*n);
+    info->z12.capacity = n;
+    info->z22.items = malloc(sizeof(*info->z22.items)*n);
+    info->z22.capacity = n;
+
+    for (size_t j = 0; j < n; j++) {
+        calc_z_from_s(
+            (struct Complex[2][2]){{info->s11[j], info->s21[j]},{info->s12[j],info->s22[j]}},
+            (struct Complex*[2][2]){{&info->z11.items[j], &info->z21.items[j]},{&info->z12.items[j],&info->z22.items[j]}}
+        );
+    }
+
+    size_t n_noise = info->noise.length;
+    info->zGopt.length = n_noise;
+    info->zGopt.items = malloc(sizeof(*info->zGopt.items)*n_noise);
+    info->zGopt.capacity = n_noise;
+    for (size_t j = 0; j < n_noise; j++) {
+        struct Complex gamma = info->noise.GammaOpt[j];
+        calc_z_from_gamma(gamma, &info->zGopt.items[j]);
+    }
+}
+
+// doubles per plane, every plane starts on a cache line
+#define S2P_PLANE_STRIDE(n) (((n) + 7) / 8 * 8)
+
+// the addresses of the 8 plane pointers, in the order of the struct
+static void s2p_soa_slots(struct Complex_2x2_SoA *soa, double **slots[8]) {
+    slots[0] = &soa->r11;
+    slots[1] = &soa->r12;
+    slots[2] = &soa->r21;
+    slots[3] = &soa->r22;
+    slots[4] = &soa->i11;
+    slots[5] = &soa->i12;
+    slots[6] = &soa->i21;
+    slots[7] = &soa->i22;
+}
+
+// moves freq and the planes of s into a new block for capacity points
+static bool s2p_reserve_data(struct S2P_Info *info, size_t capacity) {
+    size_t stride = S2P_PLANE_STRIDE(capacity);
+    struct Uti_Block block;
+    if (!uti_block_alloc(&block, sizeof(double) * 9 * stride, false)) return false;
+
+    double *freq = block.memory;
+    struct Complex_2x2_SoA s;
+    double **slots[8], **old_slots[8];
+    s2p_soa_slots(&s, slots);
+    s2p_soa_slots(&info->s, old_slots);
+    for (size_t p = 0; p < 8; p++) *slots[p] = &freq[(p + 1) * stride];
+    if (info->data_length > 0) {
+        memcpy(freq, info->freq, sizeof(double) * info->data_length);
+        for (size_t p = 0; p < 8; p++) memcpy(*slots[p], *old_slots[p], sizeof(double) * info->data_length);
+    }
+
+    uti_block_free(&info->data_block);
+    info->data_block = block;
+    info->freq = freq;
+    info->s = s;
+    info->data_capacity = stride;
+    return true;
+}
+
+// the AoS copies of the planes
+static bool s2p_derive_aos(struct S2P_Info *info) {
+    size_t n = info->data_length;
+    info->s11 = malloc(sizeof(*info->s11)*n);
+    info->s12 = malloc(sizeof(*info->s12)*n);
+    info->s21 = malloc(sizeof(*info->s21)*n);
+    info->s22 = malloc(sizeof(*info->s22)*n);
+    if (n > 0 && (!info->s11 || !info->s12 || !info->s21 || !info->s22)) {
+        printf("ERROR: s2p_derive_aos(): out of memory\n");
+        return false;
+    }
+    for (size_t j = 0; j < n; j++) {
+        info->s11[j] = mma_complex(info->s.r11[j], info->s.i11[j]);
+        info->s12[j] = mma_complex(info->s.r12[j], info->s.i12[j]);
+        info->s21[j] = mma_complex(info->s.r21[j], info->s.i21[j]);
+        info->s22[j] = mma_complex(info->s.r22[j], info->s.i22[j]);
+    }
+    return true;
+}
+
+// allocates the data inside info
 bool parse_s2p_file(struct S2P_Info *info, bool calc_z) {
 
     #define INITIAL_CAP 512
-    info->freq = malloc(sizeof(*info->freq)*INITIAL_CAP);
-    info->s11 = malloc(sizeof(*info->s11)*INITIAL_CAP);
-    info->s21 = malloc(sizeof(*info->s21)*INITIAL_CAP);
-    info->s12 = malloc(sizeof(*info->s12)*INITIAL_CAP);
-    info->s22 = malloc(sizeof(*info->s22)*INITIAL_CAP);
-    info->data_capacity = INITIAL_CAP;
+    info->freq = NULL;
+    info->s = (struct Complex_2x2_SoA){0};
+    info->data_block = (struct Uti_Block){0};
     info->data_length = 0;
+    // everything s2p_free_data() frees is valid, also on the way out with an error
+    info->s11 = info->s12 = info->s21 = info->s22 = NULL;
+    info->s_a = info->s_b = (struct Complex_2x2_SoA){0};
+    info->spline_block = (struct Uti_Block){0};
+    info->z11 = info->z12 = info->z21 = info->z22 = info->zGopt = (struct Complex_Array){0};
+    if (!s2p_reserve_data(info, INITIAL_CAP)) return false;
 
 
     info->noise.NFmin = malloc(sizeof(*info->noise.NFmin)*INITIAL_CAP);
@@ -108,6 +220,8 @@ bool parse_s2p_file(struct S2P_Info *info, bool calc_z) {
     info->noise.freq = malloc(sizeof(*info->noise.freq)*INITIAL_CAP);
     info->noise.length = 0;
     info->noise.capacity = INITIAL_CAP;
+    info->cached = false;
+    info->cache_view = (struct Uti_File_View){0};
 
     struct Uti_String_View content;
     content.text = info->file_content;
@@ -121,11 +235,14 @@ bool parse_s2p_file(struct S2P_Info *info, bool calc_z) {
         struct Uti_String_View line = uti_sv_trim(uti_sv_chop_by_delim(&content, '\n'));
         if (line.length == 0 || *line.text == '!') continue;
 
-        char* line_cstr = uti_temp_strndup(line.text, line.length);
-
         // Rules for Version 1.0, Version 2.0, and Version 2.1 files:
         // For 2-port files: # [Hz|kHz|MHz|GHz] [S|Y|Z|G|H] [DB|MA|RI] [R n]
         if (*line.text == '#') {
+            // a copy on the stack, parse_s2p_file() runs on many threads and can't use the temp allocator
+            char line_cstr[256];
+            size_t line_cstr_length = min(line.length, sizeof(line_cstr) - 1);
+            memcpy(line_cstr, line.text, line_cstr_length);
+            line_cstr[line_cstr_length] = '\0';
 
             if (strstr(line_cstr, "GHz")) freq_multiplier = 1e9;
             else if (strstr(line_cstr, "MHz")) freq_multiplier = 1e6;
@@ -143,8 +260,8 @@ bool parse_s2p_file(struct S2P_Info *info, bool calc_z) {
             if (strstr(line_cstr, "R ")) {
                 char* start_r = strstr(line_cstr, "R ");
                 start_r += 2;
-                int n = sscanf(start_r, "%lf", &info->R_ref);
-                if (n != 1) {
+                struct Uti_String_View r_value = uti_sv_from_cstr(start_r);
+                if (!uti_sv_parse_double(&r_value, &info->R_ref)) {
                     printf("ERROR: in parsing s2p file: R is not followed by valid value. \n");
                     printf("    the line:%s\n", line_cstr);
                     return false;
@@ -154,26 +271,27 @@ bool parse_s2p_file(struct S2P_Info *info, bool calc_z) {
             continue;
         }
 
+        // the numbers straight out of the content, like sscanf() up to the first thing that is not one
         double val[9];
-        int scanned = sscanf(line_cstr, "%lf %lf %lf %lf %lf %lf %lf %lf %lf",
-                                &val[0], &val[1], &val[2], &val[3], &val[4], &val[5], &val[6], &val[7], &val[8]);
+        int scanned = 0;
+        while (scanned < 9 && uti_sv_parse_double(&line, &val[scanned])) scanned++;
 
         if (scanned == 9) {
             // S-Parameter Line: Freq S11.1 S11.2 S21.1 S21.2 S12.1 S12.2 S22.1 S22.2
             if (info->data_length + 1 >= info->data_capacity) {
-                info->data_capacity *= 2;
-                info->freq = realloc(info->freq, sizeof(*info->freq)*info->data_capacity);
-                info->s11 = realloc(info->s11, sizeof(*info->s11)*info->data_capacity);
-                info->s12 = realloc(info->s12, sizeof(*info->s12)*info->data_capacity);
-                info->s21 = realloc(info->s21, sizeof(*info->s21)*info->data_capacity);
-                info->s22 = realloc(info->s22, sizeof(*info->s22)*info->data_capacity);
+                if (!s2p_reserve_data(info, info->data_capacity * 2)) return false;
             }
 
-            info->freq[info->data_length] = val[0] * freq_multiplier;
-            info->s11[info->data_length] =  parse_complex(val[1], val[2], format);
-            info->s21[info->data_length] =  parse_complex(val[3], val[4], format);
-            info->s12[info->data_length] =  parse_complex(val[5], val[6], format);
-            info->s22[info->data_length] =  parse_complex(val[7], val[8], format);
+            size_t j = info->data_length;
+            struct Complex s11 = parse_complex(val[1], val[2], format);
+            struct Complex s21 = parse_complex(val[3], val[4], format);
+            struct Complex s12 = parse_complex(val[5], val[6], format);
+            struct Complex s22 = parse_complex(val[7], val[8], format);
+            info->freq[j] = val[0] * freq_multiplier;
+            info->s.r11[j] = s11.r; info->s.i11[j] = s11.i;
+            info->s.r12[j] = s12.r; info->s.i12[j] = s12.i;
+            info->s.r21[j] = s21.r; info->s.i21[j] = s21.i;
+            info->s.r22[j] = s22.r; info->s.i22[j] = s22.i;
             info->data_length++;
         }
         else if (scanned == 5) {
@@ -186,7 +304,7 @@ bool parse_s2p_file(struct S2P_Info *info, bool calc_z) {
                 info->noise.GammaOpt = realloc(info->noise.GammaOpt, sizeof(*info->noise.GammaOpt)*info->noise.capacity);
                 info->noise.Rn = realloc(info->noise.Rn, sizeof(*info->noise.Rn)*info->noise.capacity);
             }
-            info->noise.freq[info->noise.length] = val[0];
+            info->noise.freq[info->noise.length] = val[0] * freq_multiplier;
             info->noise.NFmin[info->noise.length] = val[1];
             info->noise.GammaOpt[info->noise.length] = parse_complex(val[2], val[3], FMT_MA);
             info->noise.Rn[info->noise.length] = val[4];
@@ -194,55 +312,375 @@ bool parse_s2p_file(struct S2P_Info *info, bool calc_z) {
         }
     }
 
-    assert(info->noise.length == info->data_length);
+    // the noise data is optional (i.e. simulated results don't have it)
+    assert(info->noise.length == 0 || info->noise.length == info->data_length);
 
-    uti_temp_reset();
+    if (!s2p_derive_aos(info) || !s2p_calc_splines(info)) return false;
     //printf("INFO: Parsed %zu frequency points from %s\n", info->freq.length, info->file_name);
 
-    if (!calc_z) return true;
+    if (calc_z) s2p_calc_z(info);
+    return true;
+}
+
+
+// the settings of a stage are swapped constantly while optimizing, so the tridiagonal systems
+// of the splines are solved once here and not on every simulation
+bool s2p_calc_splines(struct S2P_Info *info) {
+    info->s_a = info->s_b = (struct Complex_2x2_SoA){0};
+    info->spline_block = (struct Uti_Block){0};
+    info->noise.Rn_a = info->noise.Rn_b = info->noise.NFmin_a = info->noise.NFmin_b = NULL;
+    info->noise.GammaOpt_a = info->noise.GammaOpt_b = NULL;
 
     size_t n = info->data_length;
-    info->z11.length = n;
-    info->z12.length = n;
-    info->z21.length = n;
-    info->z22.length = n;
-    info->z11.items = malloc(sizeof(*info->z11.items)*n);
-    info->z11.capacity = n;
-    info->z21.items = malloc(sizeof(*info->z21.items)*n);
-    info->z21.capacity = n;
-    info->z12.items = malloc(sizeof(*info->z12.items)*n);
-    info->z12.capacity = n;
-    info->z22.items = malloc(sizeof(*info->z22.items)*n);
-    info->z22.capacity = n;
+    if (n >= 2) {
+        // the 16 coefficient planes in one block
+        size_t stride = S2P_PLANE_STRIDE(n - 1);
+        if (!uti_block_alloc(&info->spline_block, sizeof(double) * 16 * stride, false)) return false;
+        double **s[8], **s_a[8], **s_b[8];
+        s2p_soa_slots(&info->s, s);
+        s2p_soa_slots(&info->s_a, s_a);
+        s2p_soa_slots(&info->s_b, s_b);
+        double *block = info->spline_block.memory;
+        for (size_t p = 0; p < 8; p++) {
+            *s_a[p] = &block[p * stride];
+            *s_b[p] = &block[(8 + p) * stride];
+        }
 
-    for (size_t j = 0; j < n; j++) {
-        calc_z_from_s(
-            (struct Complex[2][2]){{info->s11[j], info->s21[j]},{info->s12[j],info->s22[j]}},
-            (struct Complex*[2][2]){{&info->z11.items[j], &info->z21.items[j]},{&info->z12.items[j],&info->z22.items[j]}}
-        );
+        // the 8 planes as interleaved channels, one factorization for all
+        double *y = malloc(sizeof(*y)*8*n);
+        double *a = malloc(sizeof(*a)*8*(n - 1));
+        double *b = malloc(sizeof(*b)*8*(n - 1));
+        double *scratch = malloc(sizeof(*scratch)*MMA_SPLINE_AB_MULTI_SCRATCH_COUNT(n, 8));
+        if (!y || !a || !b || !scratch) {
+            printf("ERROR: s2p_calc_splines(): out of memory\n");
+            free(y);
+            free(a);
+            free(b);
+            free(scratch);
+            return false;
+        }
+        for (size_t j = 0; j < n; j++) {
+            for (size_t p = 0; p < 8; p++) y[8*j + p] = (*s[p])[j];
+        }
+        mma_spline_cubic_natural_ab_multi_scratch(info->freq, y, n, 8, a, b, scratch);
+        for (size_t j = 0; j < n - 1; j++) {
+            for (size_t p = 0; p < 8; p++) {
+                (*s_a[p])[j] = a[8*j + p];
+                (*s_b[p])[j] = b[8*j + p];
+            }
+        }
+        free(y);
+        free(a);
+        free(b);
+        free(scratch);
     }
 
     size_t n_noise = info->noise.length;
-    info->zGopt.length = n_noise;
-    info->zGopt.items = malloc(sizeof(*info->zGopt.items)*n_noise);
-    info->zGopt.capacity = n_noise;
-    for (size_t j = 0; j < n_noise; j++) {
-        struct Complex gamma = info->noise.GammaOpt[j];
-        calc_z_from_gamma(gamma, &info->zGopt.items[j]);
+    if (n_noise >= 2) {
+        info->noise.Rn_a = malloc(sizeof(*info->noise.Rn_a)*(n_noise - 1));
+        info->noise.Rn_b = malloc(sizeof(*info->noise.Rn_b)*(n_noise - 1));
+        info->noise.NFmin_a = malloc(sizeof(*info->noise.NFmin_a)*(n_noise - 1));
+        info->noise.NFmin_b = malloc(sizeof(*info->noise.NFmin_b)*(n_noise - 1));
+        info->noise.GammaOpt_a = malloc(sizeof(*info->noise.GammaOpt_a)*(n_noise - 1));
+        info->noise.GammaOpt_b = malloc(sizeof(*info->noise.GammaOpt_b)*(n_noise - 1));
+
+        // Rn, NFmin, GammaOpt.r, GammaOpt.i as 4 interleaved channels
+        double *y = malloc(sizeof(*y)*4*n_noise);
+        double *a = malloc(sizeof(*a)*4*(n_noise - 1));
+        double *b = malloc(sizeof(*b)*4*(n_noise - 1));
+        double *scratch = malloc(sizeof(*scratch)*MMA_SPLINE_AB_MULTI_SCRATCH_COUNT(n_noise, 4));
+        if (!y || !a || !b || !scratch || !info->noise.Rn_a || !info->noise.Rn_b || !info->noise.NFmin_a ||
+            !info->noise.NFmin_b || !info->noise.GammaOpt_a || !info->noise.GammaOpt_b) {
+            printf("ERROR: s2p_calc_splines(): out of memory\n");
+            free(y);
+            free(a);
+            free(b);
+            free(scratch);
+            return false;
+        }
+        for (size_t j = 0; j < n_noise; j++) {
+            y[4*j + 0] = info->noise.Rn[j];
+            y[4*j + 1] = info->noise.NFmin[j];
+            y[4*j + 2] = info->noise.GammaOpt[j].r;
+            y[4*j + 3] = info->noise.GammaOpt[j].i;
+        }
+        mma_spline_cubic_natural_ab_multi_scratch(info->noise.freq, y, n_noise, 4, a, b, scratch);
+        for (size_t j = 0; j < n_noise - 1; j++) {
+            info->noise.Rn_a[j] = a[4*j + 0];
+            info->noise.Rn_b[j] = b[4*j + 0];
+            info->noise.NFmin_a[j] = a[4*j + 1];
+            info->noise.NFmin_b[j] = b[4*j + 1];
+            info->noise.GammaOpt_a[j] = mma_complex(a[4*j + 2], a[4*j + 3]);
+            info->noise.GammaOpt_b[j] = mma_complex(b[4*j + 2], b[4*j + 3]);
+        }
+        free(y);
+        free(a);
+        free(b);
+        free(scratch);
     }
+    return true;
+}
+
+#define S2P_CACHE_MAGIC "IMPS2PC3"
+#define S2P_CACHE_COLUMN_COUNT 35
+#define S2P_CACHE_PATH_CAP (512 + 512 + 64) // the cache dir, file_name and the hash
+
+// native byte order, the cache belongs to the machine that wrote it
+struct S2P_Cache_Header {
+    char magic[8];
+    uint64_t source_size;
+    int64_t source_mtime_ns;
+    uint64_t source_hash;
+    double R_ref;
+    uint64_t data_length;
+    uint64_t noise_length;
+    uint64_t file_size;
+};
+
+struct S2P_Cache_Column {
+    void **slot; // the pointer in the S2P_Info
+    size_t offset;
+    size_t size;
+};
+
+// set before s2p_load_files(), the loading threads only read it
+static char s2p_cache_dir_internal[512];
+static bool s2p_cache_enabled = false;
+
+void s2p_set_cache_dir(const char *cache_dir) {
+    s2p_cache_enabled = cache_dir != NULL;
+    if (cache_dir) snprintf(s2p_cache_dir_internal, sizeof(s2p_cache_dir_internal), "%s", cache_dir);
+}
+
+static void s2p_cache_path(const struct S2P_Info *info, char *path, size_t path_size) {
+    uint64_t path_hash = uti_hash_bytes(info->full_path, strlen(info->full_path), 0);
+    snprintf(path, path_size, "%s/%s.%016llx.s2pc", s2p_cache_dir_internal, info->file_name, (unsigned long long)path_hash);
+}
+
+static void s2p_cache_add(struct S2P_Cache_Column *columns, size_t *count, void **slot, size_t size) {
+    assert(*count < S2P_CACHE_COLUMN_COUNT);
+    columns[(*count)++] = (struct S2P_Cache_Column){slot, 0, size};
+}
+
+// the layout of the cache file, returns its size
+static size_t s2p_cache_columns(struct S2P_Info *info, size_t n, size_t n_noise, struct S2P_Cache_Column columns[S2P_CACHE_COLUMN_COUNT]) {
+    size_t n_segments = n >= 2 ? n - 1 : 0;
+    size_t n_noise_segments = n_noise >= 2 ? n_noise - 1 : 0;
+    double **s[8], **s_a[8], **s_b[8];
+    s2p_soa_slots(&info->s, s);
+    s2p_soa_slots(&info->s_a, s_a);
+    s2p_soa_slots(&info->s_b, s_b);
+
+    size_t count = 0;
+    s2p_cache_add(columns, &count, (void **)&info->freq, sizeof(double)*n);
+    for (size_t p = 0; p < 8; p++) s2p_cache_add(columns, &count, (void **)s[p], sizeof(double)*n);
+    for (size_t p = 0; p < 8; p++) s2p_cache_add(columns, &count, (void **)s_a[p], sizeof(double)*n_segments);
+    for (size_t p = 0; p < 8; p++) s2p_cache_add(columns, &count, (void **)s_b[p], sizeof(double)*n_segments);
+    s2p_cache_add(columns, &count, (void **)&info->noise.freq, sizeof(double)*n_noise);
+    s2p_cache_add(columns, &count, (void **)&info->noise.Rn, sizeof(double)*n_noise);
+    s2p_cache_add(columns, &count, (void **)&info->noise.NFmin, sizeof(double)*n_noise);
+    s2p_cache_add(columns, &count, (void **)&info->noise.GammaOpt, sizeof(struct Complex)*n_noise);
+    s2p_cache_add(columns, &count, (void **)&info->noise.Rn_a, sizeof(double)*n_noise_segments);
+    s2p_cache_add(columns, &count, (void **)&info->noise.Rn_b, sizeof(double)*n_noise_segments);
+    s2p_cache_add(columns, &count, (void **)&info->noise.NFmin_a, sizeof(double)*n_noise_segments);
+    s2p_cache_add(columns, &count, (void **)&info->noise.NFmin_b, sizeof(double)*n_noise_segments);
+    s2p_cache_add(columns, &count, (void **)&info->noise.GammaOpt_a, sizeof(struct Complex)*n_noise_segments);
+    s2p_cache_add(columns, &count, (void **)&info->noise.GammaOpt_b, sizeof(struct Complex)*n_noise_segments);
+    assert(count == S2P_CACHE_COLUMN_COUNT);
+
+    size_t offset = sizeof(struct S2P_Cache_Header);
+    for (size_t c = 0; c < S2P_CACHE_COLUMN_COUNT; c++) {
+        offset = (offset + UTI_CACHE_LINE_SIZE - 1) / UTI_CACHE_LINE_SIZE * UTI_CACHE_LINE_SIZE;
+        columns[c].offset = offset;
+        offset += columns[c].size;
+    }
+    return offset;
+}
+
+bool s2p_cache_write(const struct S2P_Info *info, uint64_t source_size, int64_t source_mtime_ns, uint64_t source_hash) {
+    if (!s2p_cache_enabled) return false;
 
+    // only read through the slots
+    struct S2P_Cache_Column columns[S2P_CACHE_COLUMN_COUNT];
+    size_t size = s2p_cache_columns((struct S2P_Info *)info, info->data_length, info->noise.length, columns);
+    char *content = calloc(1, size);
+    if (!content) {
+        printf("ERROR: malloc failed in %s:%d\n", __FILE__, __LINE__);
+        return false;
+    }
+
+    struct S2P_Cache_Header header = {
+        .source_size = source_size,
+        .source_mtime_ns = source_mtime_ns,
+        .source_hash = source_hash,
+        .R_ref = info->R_ref,
+        .data_length = info->data_length,
+        .noise_length = info->noise.length,
+        .file_size = size,
+    };
+    memcpy(header.magic, S2P_CACHE_MAGIC, sizeof(header.magic));
+    memcpy(content, &header, sizeof(header));
+    for (size_t c = 0; c < S2P_CACHE_COLUMN_COUNT; c++) {
+        if (columns[c].size > 0) memcpy(content + columns[c].offset, *columns[c].slot, columns[c].size);
+    }
+
+    char path[S2P_CACHE_PATH_CAP];
+    s2p_cache_path(info, path, sizeof(path));
+    bool ok = uti_write_entire_file_replace(path, content, size);
+    free(content);
+    return ok;
+}
+
+bool s2p_cache_load(struct S2P_Info *info, bool calc_z) {
+    if (!s2p_cache_enabled) return false;
+
+    uint64_t source_size, cache_size;
+    int64_t source_mtime_ns, cache_mtime_ns;
+    char path[S2P_CACHE_PATH_CAP];
+    s2p_cache_path(info, path, sizeof(path));
+    if (!uti_file_stat(info->full_path, &source_size, &source_mtime_ns)) return false;
+    if (!uti_file_stat(path, &cache_size, &cache_mtime_ns) || cache_size < sizeof(struct S2P_Cache_Header)) return false;
+
+    struct Uti_File_View view;
+    if (!uti_file_view_open(path, &view)) return false;
+    struct S2P_Cache_Header header;
+    memcpy(&header, view.content, sizeof(header));
+
+    struct S2P_Cache_Column columns[S2P_CACHE_COLUMN_COUNT];
+    bool valid = memcmp(header.magic, S2P_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.file_size == view.size && header.source_size == source_size &&
+                 header.data_length <= view.size && header.noise_length <= view.size &&
+                 s2p_cache_columns(info, header.data_length, header.noise_length, columns) == view.size;
+
+    // touched or copied: the same content is still good
+    bool touched = valid && header.source_mtime_ns != source_mtime_ns;
+    if (touched) {
+        struct Uti_File_View source = {info->file_content, info->file_content_size, info->file_content_mapped};
+        if (source.content || uti_file_view_open(info->full_path, &source)) {
+            valid = source.size == source_size && uti_hash_bytes(source.content, source.size, 0) == header.source_hash;
+            if (source.content != info->file_content) uti_file_view_close(&source);
+        } else {
+            valid = false;
+        }
+    }
+
+    if (!valid) {
+        uti_file_view_close(&view);
+        return false;
+    }
+
+    // the view stays open for the data until s2p_free_data()
+    for (size_t c = 0; c < S2P_CACHE_COLUMN_COUNT; c++) {
+        *columns[c].slot = columns[c].size > 0 ? (void *)(view.content + columns[c].offset) : NULL;
+    }
+    info->R_ref = header.R_ref;
+    info->data_block = (struct Uti_Block){0};
+    info->spline_block = (struct Uti_Block){0};
+    info->data_length = header.data_length;
+    info->data_capacity = header.data_length;
+    info->noise.length = header.noise_length;
+    info->noise.capacity = header.noise_length;
+    info->cached = true;
+    info->cache_view = view;
+    info->z11 = info->z12 = info->z21 = info->z22 = info->zGopt = (struct Complex_Array){0};
+    if (!s2p_derive_aos(info)) {
+        s2p_free_data(info);
+        return false;
+    }
+    if (calc_z) s2p_calc_z(info);
+
+    // the next load can skip the hash
+    if (touched) s2p_cache_write(info, source_size, source_mtime_ns, header.source_hash);
     return true;
 }
 
+void s2p_free_data(struct S2P_Info *info) {
+    if (!info->cached) {
+        uti_block_free(&info->data_block);
+        uti_block_free(&info->spline_block);
+        free(info->noise.freq); free(info->noise.Rn); free(info->noise.NFmin); free(info->noise.GammaOpt);
+        free(info->noise.Rn_a); free(info->noise.Rn_b); free(info->noise.NFmin_a); free(info->noise.NFmin_b);
+        free(info->noise.GammaOpt_a); free(info->noise.GammaOpt_b);
+    }
+    uti_file_view_close(&info->cache_view);
+    info->cached = false;
+    free(info->s11); free(info->s12); free(info->s21); free(info->s22);
+    free(info->z11.items); free(info->z12.items); free(info->z21.items); free(info->z22.items);
+    free(info->zGopt.items);
+    info->freq = NULL;
+    info->s = info->s_a = info->s_b = (struct Complex_2x2_SoA){0};
+    info->s11 = info->s12 = info->s21 = info->s22 = NULL;
+    info->noise = (struct Noise_Data){0};
+    info->z11 = info->z12 = info->z21 = info->z22 = info->zGopt = (struct Complex_Array){0};
+    info->data_length = info->data_capacity = 0;
+}
 
-bool parse_s2p_files(struct S2P_Info_Array *infos, bool calc_z) {
+struct S2P_Load_Job {
+    struct S2P_Info *infos;
+    bool calc_z;
+    bool *ok;
+};
+
+static void s2p_load_job(void *context, size_t index) {
+    struct S2P_Load_Job *job = context;
+    struct S2P_Info *info = &job->infos[index];
+    if (s2p_cache_load(info, job->calc_z)) {
+        job->ok[index] = true;
+        s2p_release_file_content(info);
+        return;
+    }
+    if (!info->file_content) {
+        struct Uti_File_View view;
+        job->ok[index] = uti_file_view_open(info->full_path, &view);
+        if (!job->ok[index]) return;
+        info->file_content = (char*)view.content;
+        info->file_content_size = view.size;
+        info->file_content_mapped = view.mapped;
+    }
+    job->ok[index] = parse_s2p_file(info, job->calc_z);
+    uint64_t source_size;
+    int64_t source_mtime_ns;
+    if (job->ok[index] && s2p_cache_enabled && uti_file_stat(info->full_path, &source_size, &source_mtime_ns) && source_size == info->file_content_size) {
+        s2p_cache_write(info, source_size, source_mtime_ns, uti_hash_bytes(info->file_content, info->file_content_size, 0));
+    }
+    s2p_release_file_content(info);
+}
 
-    for (size_t i = 0; i < infos->length; ++i) {
-        struct S2P_Info *info = &infos->items[i];
-        if (!parse_s2p_file(info, calc_z)) {
-            return false;
+bool s2p_load_files(struct S2P_Info *infos, size_t n_infos, bool calc_z, size_t n_threads) {
+    if (n_infos == 0) return true;
+    if (n_threads == 0) n_threads = uti_cpu_count();
+    n_threads = min(n_threads, n_infos);
+
+    struct S2P_Load_Job job = {infos, calc_z, malloc(sizeof(bool) * n_infos)};
+    struct Uti_Thread_Pool *pool = uti_thread_pool_create(n_threads);
+    if (!job.ok || !pool) {
+        printf("ERROR: s2p_load_files(): could not start the threads\n");
+        free(job.ok);
+        if (pool) uti_thread_pool_destroy(pool);
+        return false;
+    }
+    uti_thread_pool_run(pool, s2p_load_job, &job, n_infos);
+    uti_thread_pool_destroy(pool);
+
+    bool ok = true;
+    size_t n_cached = 0;
+    for (size_t i = 0; i < n_infos; i++) {
+        if (job.ok[i] && infos[i].cached) n_cached++;
+        if (!job.ok[i]) {
+            printf("ERROR: could not load s2p file %s\n", infos[i].full_path);
+            ok = false;
         }
     }
+    free(job.ok);
+    if (s2p_cache_enabled) printf("INFO: %zu of %zu s2p files from the cache in %s\n", n_cached, n_infos, s2p_cache_dir_internal);
+    return ok;
+}
+
+bool parse_s2p_files(struct S2P_Info_Array *infos, bool calc_z) {
+
+    if (!s2p_load_files(infos->items, infos->length, calc_z, 0)) {
+        return false;
+    }
 
     printf("INFO: Parsed %zu s2p data sets.\n", infos->length);
     return true;
@@ -6,7 +6,9 @@
 
 #include "stddef.h"
 #include "stdbool.h"
+#include "stdint.h"
 #include "mma.h"
+#include "uti.h"
 
 struct Double_Array {
     double *items;
@@ -27,24 +29,47 @@ struct Noise_Data {
     struct Complex* GammaOpt;
     size_t length;
     size_t capacity;
+
+    // natural cubic spline coefficients over freq (length - 1 each), NULL for less than 2 points
+    double* Rn_a;
+    double* Rn_b;
+    double* NFmin_a;
+    double* NFmin_b;
+    struct Complex* GammaOpt_a;
+    struct Complex* GammaOpt_b;
 };
 
 struct S2P_Info {
     // must be here values
     double R_ref;
 
+    // freq and the S-parameters as planes (data_length each) in one cache line aligned block, the
+    // stage interpolation and the cascade consume the planes as they are
     double* freq;
+    struct Complex_2x2_SoA s;
+    struct Uti_Block data_block; // empty for cached data
+    size_t data_length;
+    size_t data_capacity;
+
+    // AoS copies of s, derived once after loading (for the views and the z-parameters)
     struct Complex* s11;
     struct Complex* s12;
     struct Complex* s21;
     struct Complex* s22;
-    size_t data_length;
-    size_t data_capacity;
+
+    // natural cubic spline coefficients of the planes of s (data_length - 1 each), NULL for less than 2 points.
+    // calculated once in parse_s2p_file(), evaluate with mma_spline_cubic_natural_2x2_soa_eval()
+    struct Complex_2x2_SoA s_a;
+    struct Complex_2x2_SoA s_b;
+    struct Uti_Block spline_block;
 
     char file_name[512];
     char full_path[512];
     char* file_content;
     size_t file_content_size;
+    bool file_content_mapped; // read-only mapping of the file, not \0 terminated
+    bool cached; // the data and the splines point into cache_view (read-only)
+    struct Uti_File_View cache_view; // the cache file, open while the data is used
 
     // maybe here values
     struct Noise_Data noise;
@@ -67,8 +92,30 @@ struct S2P_Info_Array {
 
 bool read_s2p_files_from_dir(const char* dir, struct S2P_Info_Array *infos);
 bool read_s2p_file(const char* file_name, const char* dir, struct S2P_Info *info);
+void s2p_set_file_path(struct S2P_Info *info, const char* file_name, const char* dir);
+// drops the content of read_s2p_file() once it is parsed (only for contents read by it)
+void s2p_release_file_content(struct S2P_Info *info);
+// parses and releases the contents of read_s2p_files_from_dir()
 bool parse_s2p_files(struct S2P_Info_Array *infos, bool calc_z);
+// Reads (infos without file_content, from full_path), parses and releases the files on n_threads
+// threads (0 for one per core). The pool hands out one file at a time from a shared counter, so a
+// thread that got small files just takes more of them and a few big files don't hold up the rest.
+// parse_s2p_file() keeps off the temp allocators, the files are independent.
+bool s2p_load_files(struct S2P_Info *infos, size_t n_infos, bool calc_z, size_t n_threads);
 bool parse_s2p_file(struct S2P_Info *info, bool calc_z);
+bool s2p_calc_splines(struct S2P_Info *info);
+// frees what parse_s2p_file() or s2p_cache_load() allocated, closes the cache view of cached data
+void s2p_free_data(struct S2P_Info *info);
+
+// Binary cache of the parsed files, used by s2p_load_files(). For a file dir/name.s2p the cache is
+// cache_dir/name.s2p.<hash of the path>.s2pc (cache_dir may be dir itself), NULL turns it off (the default).
+// It holds a header (R_ref, lengths, the source's size, mtime and content hash) and the columns as
+// parsed (the planes of s and their splines, freq in Hz), each aligned to a cache line. A cache is used
+// when the source has the same size and either the same mtime or the same content hash, the columns are
+// then mapped straight into the S2P_Info (the AoS copies of s are derived again).
+void s2p_set_cache_dir(const char *cache_dir);
+bool s2p_cache_load(struct S2P_Info *info, bool calc_z);
+bool s2p_cache_write(const struct S2P_Info *info, uint64_t source_size, int64_t source_mtime_ns, uint64_t source_hash);
 
 
 #endif // S2P_H_
\ No newline at end of file
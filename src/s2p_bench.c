@@ -0,0 +1,153 @@
+// Copyright (C) 2026 Benjamin Froelich
+// This file is part of https://github.com/bbeni/impedancer
+// For conditions of distribution and use, see copyright notice in project root.
+//
+// Microbenchmark of the Touchstone number parsing: the old way (copy every line into the temp arena
+// and sscanf() it) against uti_sv_parse_double() straight out of the content, and the whole
+// parse_s2p_file() on top. The content is generated, a multi MB file like the ones of a device library.
+//
+// Usage: s2p_bench [megabytes] [repetitions]
+#include "s2p.h"
+#include "uti.h"
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "time.h"
+
+static double seconds_now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+static char *generate_content(size_t megabytes, size_t *size_out) {
+    size_t capacity = megabytes * 1024 * 1024 + 4096;
+    char *content = malloc(capacity);
+    if (!content) return NULL;
+    size_t size = (size_t)snprintf(content, capacity, "! generated\n# GHz S MA R 50\n");
+    srand(1);
+    for (size_t row = 0; size + 256 < capacity - 4096; row++) {
+        double f = 0.001 * (double)(row + 1);
+        size += (size_t)snprintf(content + size, capacity - size, "%.6f", f);
+        for (size_t k = 0; k < 4; k++) {
+            double magnitude = (double)rand() / RAND_MAX * 10.0;
+            double angle = (double)rand() / RAND_MAX * 360.0 - 180.0;
+            size += (size_t)snprintf(content + size, capacity - size, " %.9g %.4f", magnitude, angle);
+        }
+        content[size++] = '\n';
+    }
+    content[size] = '\0';
+    *size_out = size;
+    return content;
+}
+
+// the lines as parse_s2p_file() saw them before: a temp copy and sscanf(), the numbers also go to
+// values if it is not NULL
+static double sum_sscanf(const char *content, size_t size, size_t *numbers, double *values) {
+    struct Uti_String_View sv = uti_sv_from_parts(content, size);
+    double sum = 0.0;
+    while (sv.length > 0) {
+        struct Uti_String_View line = uti_sv_trim(uti_sv_chop_by_delim(&sv, '\n'));
+        if (line.length == 0 || *line.text == '!' || *line.text == '#') continue;
+        char *line_cstr = uti_temp_strndup(line.text, line.length);
+        double val[9];
+        int scanned = sscanf(line_cstr, "%lf %lf %lf %lf %lf %lf %lf %lf %lf",
+                             &val[0], &val[1], &val[2], &val[3], &val[4], &val[5], &val[6], &val[7], &val[8]);
+        // a file of the library fits into the arena, the generated content of many MB does not
+        uti_temp_reset();
+        for (int i = 0; i < scanned; i++) sum += val[i];
+        if (values) memcpy(&values[*numbers], val, sizeof(double) * (size_t)(scanned > 0 ? scanned : 0));
+        *numbers += (size_t)(scanned > 0 ? scanned : 0);
+    }
+    return sum;
+}
+
+static double sum_sv(const char *content, size_t size, size_t *numbers, double *values) {
+    struct Uti_String_View sv = uti_sv_from_parts(content, size);
+    double sum = 0.0;
+    while (sv.length > 0) {
+        struct Uti_String_View line = uti_sv_trim(uti_sv_chop_by_delim(&sv, '\n'));
+        if (line.length == 0 || *line.text == '!' || *line.text == '#') continue;
+        double value;
+        for (int i = 0; i < 9 && uti_sv_parse_double(&line, &value); i++) {
+            sum += value;
+            if (values) values[*numbers] = value;
+            (*numbers)++;
+        }
+    }
+    return sum;
+}
+
+int main(int argc, char **argv) {
+    size_t megabytes = argc > 1 ? strtoull(argv[1], NULL, 10) : 4;
+    size_t repetitions = argc > 2 ? strtoull(argv[2], NULL, 10) : 5;
+    if (megabytes == 0 || repetitions == 0) {
+        printf("Usage: %s [megabytes] [repetitions]\n", argv[0]);
+        return 1;
+    }
+
+    size_t size;
+    char *content = generate_content(megabytes, &size);
+    if (!content) {
+        printf("ERROR: could not allocate %zu MB\n", megabytes);
+        return 1;
+    }
+    double mb = (double)size / (1024.0 * 1024.0);
+
+    // best of the repetitions, the sums keep the loops from being optimized away
+    double best_sscanf = 1e300, best_sv = 1e300, best_file = 1e300;
+    double sums[2] = {0};
+    size_t numbers[2] = {0};
+    for (size_t r = 0; r < repetitions; r++) {
+        double start = seconds_now();
+        numbers[0] = 0;
+        sums[0] = sum_sscanf(content, size, &numbers[0], NULL);
+        double t = seconds_now() - start;
+        if (t < best_sscanf) best_sscanf = t;
+
+        start = seconds_now();
+        numbers[1] = 0;
+        sums[1] = sum_sv(content, size, &numbers[1], NULL);
+        t = seconds_now() - start;
+        if (t < best_sv) best_sv = t;
+
+        struct S2P_Info info = {0};
+        info.file_content = content;
+        info.file_content_size = size;
+        start = seconds_now();
+        if (!parse_s2p_file(&info, false)) return 2;
+        t = seconds_now() - start;
+        if (t < best_file) best_file = t;
+        s2p_free_data(&info);
+    }
+
+    if (numbers[0] != numbers[1] || memcmp(&sums[0], &sums[1], sizeof(double)) != 0) {
+        printf("ERROR: the parsers disagree: %zu numbers sum %.17g (sscanf) vs %zu numbers sum %.17g\n", numbers[0], sums[0], numbers[1], sums[1]);
+        return 2;
+    }
+
+    // every number bitwise, outside of the timing
+    double *values[2] = {malloc(sizeof(double) * numbers[0]), malloc(sizeof(double) * numbers[0])};
+    if (!values[0] || !values[1]) {
+        printf("ERROR: could not allocate the %zu numbers to compare\n", numbers[0]);
+        return 1;
+    }
+    size_t counted[2] = {0};
+    sum_sscanf(content, size, &counted[0], values[0]);
+    sum_sv(content, size, &counted[1], values[1]);
+    for (size_t i = 0; i < numbers[0]; i++) {
+        if (memcmp(&values[0][i], &values[1][i], sizeof(double)) != 0) {
+            printf("ERROR: the parsers disagree on number %zu: %.17g (sscanf) vs %.17g\n", i, values[0][i], values[1][i]);
+            return 2;
+        }
+    }
+    free(values[0]);
+    free(values[1]);
+    printf("INFO: %.1f MB, %zu numbers\n", mb, numbers[0]);
+    printf("sscanf per line:      %8.1f MB/s\n", mb / best_sscanf);
+    printf("uti_sv_parse_double:  %8.1f MB/s (%.1fx)\n", mb / best_sv, best_sscanf / best_sv);
+    printf("parse_s2p_file:       %8.1f MB/s (with splines)\n", mb / best_file);
+    free(content);
+    return 0;
+}
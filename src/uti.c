@@ -11,6 +11,9 @@
 #include <assert.h>
 #include <ctype.h>
 #include <math.h>
+#include <locale.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "uti.h"
 
@@ -179,8 +182,20 @@ char* uti_trim(char *s)
 #ifdef __GNUC__
 #pragma GCC diagnostic pop
 #endif
+#include <malloc.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <process.h>
 #else //_WIN32
 #include "dirent.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
 #endif  //_WIN32
 
 bool uti_read_entire_file(const char *path, char** content, size_t* out_size) {
@@ -224,6 +239,174 @@ error:
 }
 
 
+static atomic_size_t tmp_file_counter;
+
+static bool write_entire_file_renamed(const char *path, const void *content, size_t size, bool durable) {
+    // unique per process and call, writers of the same path (threads or processes) don't share a tmp file
+#ifndef _WIN32
+    unsigned long pid = (unsigned long)getpid();
+#else
+    unsigned long pid = (unsigned long)_getpid();
+#endif
+    size_t n = atomic_fetch_add(&tmp_file_counter, 1);
+    size_t tmp_path_size = strlen(path) + 64;
+    char *tmp_path = malloc(tmp_path_size);
+    if (!tmp_path) {
+        printf("ERROR: malloc failed in %s:%d\n", __FILE__, __LINE__);
+        return false;
+    }
+    snprintf(tmp_path, tmp_path_size, "%s.%lu.%zu.tmp", path, pid, n);
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) goto error;
+    if (size > 0 && fwrite(content, size, 1, file) != 1) goto error;
+    if (fflush(file) != 0) goto error;
+#ifndef _WIN32
+    if (durable && fsync(fileno(file)) != 0) goto error;
+#else
+    if (durable && _commit(_fileno(file)) != 0) goto error;
+#endif
+    if (fclose(file) != 0) {
+        file = NULL;
+        goto error;
+    }
+    file = NULL;
+
+#ifndef _WIN32
+    if (rename(tmp_path, path) != 0) goto error;
+#else
+    if (!MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) goto error;
+#endif
+    free(tmp_path);
+    return true;
+
+error:
+    printf("ERROR: Could not write file %s: %s\n", path, strerror(errno));
+    if (file) fclose(file);
+    remove(tmp_path);
+    free(tmp_path);
+    return false;
+}
+
+bool uti_write_entire_file_atomic(const char *path, const void *content, size_t size) {
+    return write_entire_file_renamed(path, content, size, true);
+}
+
+bool uti_write_entire_file_replace(const char *path, const void *content, size_t size) {
+    return write_entire_file_renamed(path, content, size, false);
+}
+
+bool uti_truncate_file(const char *path, size_t size) {
+#ifndef _WIN32
+    bool ok = truncate(path, (off_t)size) == 0;
+#else
+    bool ok = false;
+    int fd = _open(path, _O_RDWR | _O_BINARY);
+    if (fd >= 0) {
+        ok = _chsize_s(fd, (long long)size) == 0;
+        _close(fd);
+    }
+#endif
+    if (!ok) printf("ERROR: Could not truncate file %s: %s\n", path, strerror(errno));
+    return ok;
+}
+
+bool uti_file_stat(const char *path, uint64_t *size, int64_t *mtime_ns) {
+#ifndef _WIN32
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) return false;
+#ifdef __APPLE__
+    *mtime_ns = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    *mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#else
+    struct __stat64 st;
+    if (_stat64(path, &st) != 0 || !(st.st_mode & _S_IFREG)) return false;
+    *mtime_ns = (int64_t)st.st_mtime * 1000000000;
+#endif
+    *size = (uint64_t)st.st_size;
+    return true;
+}
+
+// reads until the end, for files that can not seek (pipes)
+static bool read_entire_stream(FILE *file, char **content, size_t *out_size) {
+    size_t capacity = 1 << 16;
+    size_t size = 0;
+    char *buffer = malloc(capacity + 1);
+    while (buffer) {
+        size += fread(buffer + size, 1, capacity - size, file);
+        if (ferror(file)) break;
+        if (size < capacity) {
+            buffer[size] = '\0';
+            *content = buffer;
+            *out_size = size;
+            return true;
+        }
+        capacity *= 2;
+        char *grown = realloc(buffer, capacity + 1);
+        if (!grown) break;
+        buffer = grown;
+    }
+    free(buffer);
+    return false;
+}
+
+bool uti_file_view_open(const char *path, struct Uti_File_View *view) {
+    view->content = NULL;
+    view->size = 0;
+    view->mapped = false;
+
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("ERROR: Could not read file %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+            madvise(mapped, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+            close(fd);
+            view->content = mapped;
+            view->size = (size_t)st.st_size;
+            view->mapped = true;
+            return true;
+        }
+    }
+    close(fd);
+#endif
+
+    char *content;
+    size_t size;
+    FILE *file = fopen(path, "rb");
+    if (!file || !read_entire_stream(file, &content, &size)) {
+        printf("ERROR: Could not read file %s: %s\n", path, strerror(errno));
+        if (file) fclose(file);
+        return false;
+    }
+    fclose(file);
+    view->content = content;
+    view->size = size;
+    return true;
+}
+
+void uti_file_view_close(struct Uti_File_View *view) {
+    if (!view->content) return;
+#ifndef _WIN32
+    if (view->mapped) munmap((void *)view->content, view->size);
+    else free((void *)view->content);
+#else
+    free((void *)view->content);
+#endif
+    view->content = NULL;
+    view->size = 0;
+    view->mapped = false;
+}
+
 bool uti_read_entire_dir(const char *parent_dir, char*** children, size_t *children_count) {
     DIR* d;
 	d = opendir(parent_dir);
@@ -307,6 +490,284 @@ char *uti_temp_strndup(const char *s, size_t n) {
 
 // Adopted too
 
+bool uti_block_alloc(struct Uti_Block *block, size_t size, bool huge_pages) {
+    block->memory = NULL;
+    block->size = 0;
+    block->mapped = false;
+    if (size == 0) return true;
+
+#ifdef _WIN32
+    // large pages need a special privilege on windows, so they are not tried
+    (void)huge_pages;
+    block->memory = _aligned_malloc(size, UTI_CACHE_LINE_SIZE);
+    if (!block->memory) {
+        printf("ERROR: could not allocate %zu bytes\n", size);
+        return false;
+    }
+#else
+    if (huge_pages) {
+        size = (size + UTI_HUGE_PAGE_SIZE - 1) / UTI_HUGE_PAGE_SIZE * UTI_HUGE_PAGE_SIZE;
+#ifdef MAP_HUGETLB
+        void *mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mapped != MAP_FAILED) {
+            block->memory = mapped;
+            block->size = size;
+            block->mapped = true;
+            return true;
+        }
+#endif
+    }
+
+    size_t alignment = huge_pages ? UTI_HUGE_PAGE_SIZE : UTI_CACHE_LINE_SIZE;
+    if (posix_memalign(&block->memory, alignment, size) != 0) {
+        block->memory = NULL;
+        printf("ERROR: could not allocate %zu bytes\n", size);
+        return false;
+    }
+#ifdef MADV_HUGEPAGE
+    // no explicit huge pages reserved, ask for transparent ones
+    if (huge_pages) madvise(block->memory, size, MADV_HUGEPAGE);
+#endif
+#endif
+    block->size = size;
+    return true;
+}
+
+void uti_block_free(struct Uti_Block *block) {
+    if (!block->memory) return;
+#ifdef _WIN32
+    _aligned_free(block->memory);
+#else
+    if (block->mapped) munmap(block->memory, block->size);
+    else free(block->memory);
+#endif
+    block->memory = NULL;
+    block->size = 0;
+    block->mapped = false;
+}
+
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static uint64_t rotl64(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+void uti_rng_seed(struct Uti_Rng *rng, uint64_t seed, uint64_t stream) {
+    // every stream gets its own splitmix sequence, so neighbouring streams are not correlated
+    uint64_t x = seed ^ splitmix64(&stream);
+    for (size_t i = 0; i < 4; i++) rng->s[i] = splitmix64(&x);
+}
+
+uint64_t uti_rng_next(struct Uti_Rng *rng) {
+    uint64_t *s = rng->s;
+    uint64_t result = rotl64(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl64(s[3], 45);
+    return result;
+}
+
+double uti_rng_double(struct Uti_Rng *rng) {
+    // the upper 53 bits fill the mantissa
+    return (uti_rng_next(rng) >> 11) * 0x1.0p-53;
+}
+
+double uti_rng_range(struct Uti_Rng *rng, double min, double max) {
+    return min + (max - min) * uti_rng_double(rng);
+}
+
+size_t uti_rng_index(struct Uti_Rng *rng, size_t n) {
+    assert(n > 0);
+    return (size_t)(uti_rng_next(rng) % n);
+}
+
+double uti_rng_normal(struct Uti_Rng *rng) {
+    // Box-Muller, 1 - u keeps the logarithm finite
+    double u = 1.0 - uti_rng_double(rng);
+    double v = uti_rng_double(rng);
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+uint64_t uti_hash_bytes(const void *data, size_t size, uint64_t seed) {
+    const unsigned char *bytes = data;
+    uint64_t hash = seed ? seed : 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+size_t uti_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    long count = (long)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return count > 0 ? (size_t)count : 1;
+}
+
+struct Uti_Thread_Pool {
+    pthread_t *workers;
+    size_t n_workers;
+
+    pthread_mutex_t run_mutex; // one run at a time
+    pthread_mutex_t mutex;
+    pthread_cond_t work_available;
+    pthread_cond_t work_done;
+    size_t generation;     // incremented for every run, workers wait for a new one
+    size_t workers_busy;
+    bool quit;
+
+    // the current run
+    Uti_Job_Function job;
+    void *context;
+    size_t n_jobs;
+    atomic_size_t next_job;
+};
+
+static void uti_thread_pool_drain(struct Uti_Thread_Pool *pool, Uti_Job_Function job, void *context, size_t n_jobs) {
+    while (true) {
+        size_t job_index = atomic_fetch_add(&pool->next_job, 1);
+        if (job_index >= n_jobs) break;
+        job(context, job_index);
+    }
+}
+
+static void *uti_thread_pool_worker(void *arg) {
+    struct Uti_Thread_Pool *pool = arg;
+    size_t seen_generation = 0;
+
+    while (true) {
+        pthread_mutex_lock(&pool->mutex);
+        while (!pool->quit && pool->generation == seen_generation) {
+            pthread_cond_wait(&pool->work_available, &pool->mutex);
+        }
+        if (pool->quit) {
+            pthread_mutex_unlock(&pool->mutex);
+            break;
+        }
+        seen_generation = pool->generation;
+        Uti_Job_Function job = pool->job;
+        void *context = pool->context;
+        size_t n_jobs = pool->n_jobs;
+        pthread_mutex_unlock(&pool->mutex);
+
+        uti_thread_pool_drain(pool, job, context, n_jobs);
+
+        pthread_mutex_lock(&pool->mutex);
+        pool->workers_busy--;
+        if (pool->workers_busy == 0) pthread_cond_signal(&pool->work_done);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    return NULL;
+}
+
+struct Uti_Thread_Pool *uti_thread_pool_create(size_t n_threads) {
+    struct Uti_Thread_Pool *pool = calloc(1, sizeof(*pool));
+    if (!pool) {
+        printf("ERROR: uti_thread_pool_create(): out of memory\n");
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->run_mutex, NULL);
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work_available, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+    atomic_init(&pool->next_job, 0);
+
+    size_t n_workers = n_threads > 1 ? n_threads - 1 : 0;
+    pool->workers = malloc(sizeof(*pool->workers) * (n_workers + 1));
+    if (!pool->workers) {
+        printf("ERROR: uti_thread_pool_create(): out of memory\n");
+        pthread_cond_destroy(&pool->work_done);
+        pthread_cond_destroy(&pool->work_available);
+        pthread_mutex_destroy(&pool->mutex);
+        pthread_mutex_destroy(&pool->run_mutex);
+        free(pool);
+        return NULL;
+    }
+    for (size_t i = 0; i < n_workers; i++) {
+        if (pthread_create(&pool->workers[i], NULL, uti_thread_pool_worker, pool) != 0) {
+            printf("ERROR: uti_thread_pool_create(): could only start %zu of %zu worker threads\n", i, n_workers);
+            break;
+        }
+        pool->n_workers++;
+    }
+
+    return pool;
+}
+
+size_t uti_thread_pool_thread_count(const struct Uti_Thread_Pool *pool) {
+    return pool->n_workers + 1;
+}
+
+void uti_thread_pool_run(struct Uti_Thread_Pool *pool, Uti_Job_Function job, void *context, size_t n_jobs) {
+    if (n_jobs == 0) return;
+
+    pthread_mutex_lock(&pool->run_mutex);
+
+    // not worth waking anybody up
+    if (pool->n_workers == 0 || n_jobs == 1) {
+        for (size_t i = 0; i < n_jobs; i++) job(context, i);
+        pthread_mutex_unlock(&pool->run_mutex);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->job = job;
+    pool->context = context;
+    pool->n_jobs = n_jobs;
+    atomic_store(&pool->next_job, 0);
+    pool->workers_busy = pool->n_workers;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->mutex);
+
+    // the calling thread helps out
+    uti_thread_pool_drain(pool, job, context, n_jobs);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->workers_busy > 0) {
+        pthread_cond_wait(&pool->work_done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    pthread_mutex_unlock(&pool->run_mutex);
+}
+
+void uti_thread_pool_destroy(struct Uti_Thread_Pool *pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (size_t i = 0; i < pool->n_workers; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->work_done);
+    pthread_cond_destroy(&pool->work_available);
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_mutex_destroy(&pool->run_mutex);
+    free(pool->workers);
+    free(pool);
+}
+
 struct Uti_String_View uti_sv_chop_by_delim(struct Uti_String_View *sv, char delim)
 {
     size_t i = 0;
@@ -410,3 +871,131 @@ bool uti_sv_starts_with(struct Uti_String_View sv, struct Uti_String_View expect
     return false;
 }
 
+
+// 10^0 .. 10^22 are exact doubles
+static const double uti_exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// strtod() follows the locale of the process (a "," decimal point in some), the files always use "."
+#ifdef _WIN32
+static _locale_t uti_c_locale;
+#else
+static locale_t uti_c_locale;
+#endif
+static pthread_once_t uti_c_locale_once = PTHREAD_ONCE_INIT;
+
+static void uti_c_locale_create(void) {
+#ifdef _WIN32
+    uti_c_locale = _create_locale(LC_ALL, "C");
+#else
+    uti_c_locale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+#endif
+}
+
+static double uti_strtod_c(const char *text, char **end) {
+    pthread_once(&uti_c_locale_once, uti_c_locale_create);
+    if (!uti_c_locale) return strtod(text, end);
+#ifdef _WIN32
+    return _strtod_l(text, end, uti_c_locale);
+#else
+    return strtod_l(text, end, uti_c_locale);
+#endif
+}
+
+static bool uti_sv_parse_double_slow(struct Uti_String_View *sv, double *out) {
+    char stack_buffer[128];
+    size_t n = 0;
+    while (n < sv->length && !isspace(sv->text[n]) && sv->text[n] != '!') n++;
+    if (n == 0) return false;
+    // a long token (i.e. many zero digits) gets a heap copy, strtod() parses it like sscanf() would
+    char *buffer = n < sizeof(stack_buffer) ? stack_buffer : malloc(n + 1);
+    if (!buffer) {
+        printf("ERROR: uti_sv_parse_double(): out of memory\n");
+        return false;
+    }
+    memcpy(buffer, sv->text, n);
+    buffer[n] = '\0';
+    char *end;
+    double value = uti_strtod_c(buffer, &end);
+    size_t parsed = (size_t)(end - buffer);
+    if (buffer != stack_buffer) free(buffer);
+    if (parsed == 0) return false;
+    uti_sv_chop_left(sv, parsed);
+    *out = value;
+    return true;
+}
+
+bool uti_sv_parse_double(struct Uti_String_View *sv, double *out) {
+    struct Uti_String_View rest = uti_sv_trim_left(*sv);
+    const char *p = rest.text;
+    const char *end = rest.text + rest.length;
+
+    bool negative = false;
+    if (p < end && (*p == '+' || *p == '-')) negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int digits = 0; // significant digits in mantissa
+    int exponent = 0;
+    bool any_digit = false;
+    bool truncated = false; // a nonzero digit did not fit
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        any_digit = true;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            if (mantissa > 0) digits++;
+        } else {
+            exponent++;
+            truncated |= *p != '0';
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+            any_digit = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                if (mantissa > 0) digits++;
+                exponent--;
+            } else {
+                truncated |= *p != '0';
+            }
+        }
+    }
+    // inf, nan and hex floats
+    if (!any_digit || (p < end && (*p == 'x' || *p == 'X'))) {
+        *sv = rest;
+        return uti_sv_parse_double_slow(sv, out);
+    }
+
+    // the exponent only counts with a digit, "1e" is 1 followed by "e" like for strtod()
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        bool exponent_negative = false;
+        if (q < end && (*q == '+' || *q == '-')) exponent_negative = *q++ == '-';
+        if (q < end && *q >= '0' && *q <= '9') {
+            int value = 0;
+            for (; q < end && *q >= '0' && *q <= '9'; q++) {
+                if (value < 100000) value = value * 10 + (*q - '0');
+            }
+            exponent += exponent_negative ? -value : value;
+            p = q;
+        }
+    }
+
+    double value;
+    if (mantissa == 0 && !truncated) {
+        value = 0.0;
+    } else if (!truncated && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+        double m = (double)mantissa;
+        value = exponent >= 0 ? m * uti_exact_powers_of_ten[exponent] : m / uti_exact_powers_of_ten[-exponent];
+    } else {
+        *sv = rest;
+        return uti_sv_parse_double_slow(sv, out);
+    }
+
+    *out = negative ? -value : value;
+    uti_sv_chop_left(&rest, (size_t)(p - rest.text));
+    *sv = rest;
+    return true;
+}
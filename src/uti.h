@@ -6,6 +6,7 @@
 
 #include "stdbool.h"
 #include "stddef.h"
+#include "stdint.h"
 
 // render 0.0001 -> 100u etc.
 void uti_render_postfix_number(char* buffer, const size_t max_char_count, double number, int digits_after_comma);
@@ -19,6 +20,26 @@ char* uti_trim(char* s);
 
 // allocate space for file content + \0 terminator and read into it. out size is without \0 terminator.
 bool uti_read_entire_file(const char *path, char** content, size_t* out_size);
+// writes a tmp file next to path (its own for every call, so concurrent writers of path don't clash), flushes
+// it to the disk and renames it over path: readers see the old or the new content
+bool uti_write_entire_file_atomic(const char *path, const void *content, size_t size);
+// the same without the flush to the disk, a crash may lose the new content (for caches)
+bool uti_write_entire_file_replace(const char *path, const void *content, size_t size);
+bool uti_truncate_file(const char *path, size_t size);
+// size and modification time (ns since the epoch, seconds resolution on windows) of a regular file.
+// Quietly false if there is none, for probing cache files.
+bool uti_file_stat(const char *path, uint64_t *size, int64_t *mtime_ns);
+
+// Read-only view of a whole file. Regular files are mapped (with sequential read-ahead) and cost no
+// copy, pipes and the like are read into memory, as is everything on windows. The content is not
+// \0 terminated when mapped, close the view as soon as the content is parsed.
+struct Uti_File_View {
+    const char *content;
+    size_t size;
+    bool mapped;
+};
+bool uti_file_view_open(const char *path, struct Uti_File_View *view);
+void uti_file_view_close(struct Uti_File_View *view);
 bool uti_read_entire_dir(const char *parent_dir, char*** children, size_t *children_count);
 
 // Adopted from nob.h:
@@ -29,6 +50,45 @@ void *uti_temp_alloc(size_t requested_size);
 char *uti_temp_strndup(const char *s, size_t n);
 // end temp allocator stuff
 
+// Persistent worker pool:
+// uti_thread_pool_run() hands out the job indices 0 .. n_jobs - 1 to the workers and the calling
+// thread and returns when all jobs are done. Runs from different threads are serialized, don't
+// call uti_thread_pool_run() from inside a job. Jobs must not use the temp allocators.
+typedef void (*Uti_Job_Function)(void *context, size_t job_index);
+struct Uti_Thread_Pool;
+size_t uti_cpu_count(void);
+// n_threads includes the calling thread, so 1 means no workers are started
+struct Uti_Thread_Pool *uti_thread_pool_create(size_t n_threads);
+size_t uti_thread_pool_thread_count(const struct Uti_Thread_Pool *pool);
+void uti_thread_pool_run(struct Uti_Thread_Pool *pool, Uti_Job_Function job, void *context, size_t n_jobs);
+void uti_thread_pool_destroy(struct Uti_Thread_Pool *pool);
+
+// Memory blocks aligned to a cache line. With huge_pages the block is backed by huge pages where the
+// system allows it (explicit huge pages first, then transparent ones), otherwise by normal pages.
+#define UTI_CACHE_LINE_SIZE 64
+#define UTI_HUGE_PAGE_SIZE (2*1024*1024)
+struct Uti_Block {
+    void *memory;
+    size_t size;
+    bool mapped; // from mmap(), not from the aligned allocator
+};
+bool uti_block_alloc(struct Uti_Block *block, size_t size, bool huge_pages);
+void uti_block_free(struct Uti_Block *block);
+
+// Small random number generator (xoshiro256**) with independent streams, for threads that need their
+// own reproducible sequence instead of the global rand(). The same seed and stream give the same numbers.
+struct Uti_Rng {
+    uint64_t s[4];
+};
+void uti_rng_seed(struct Uti_Rng *rng, uint64_t seed, uint64_t stream);
+uint64_t uti_rng_next(struct Uti_Rng *rng);
+double uti_rng_double(struct Uti_Rng *rng); // [0, 1)
+double uti_rng_range(struct Uti_Rng *rng, double min, double max); // [min, max)
+size_t uti_rng_index(struct Uti_Rng *rng, size_t n); // [0, n)
+double uti_rng_normal(struct Uti_Rng *rng); // standard normal distribution
+
+// 64 bit FNV-1a of the bytes, continuing from seed (0 to start)
+uint64_t uti_hash_bytes(const void *data, size_t size, uint64_t seed);
 
 struct Uti_String_View {
     const char* text;
@@ -45,6 +105,11 @@ struct Uti_String_View uti_sv_from_cstr(const char *cstr);
 bool uti_sv_eq(struct Uti_String_View a, struct Uti_String_View b);
 bool uti_sv_end_with(struct Uti_String_View sv, const char *cstr);
 bool uti_sv_starts_with(struct Uti_String_View sv, struct Uti_String_View expected_prefix);
+// Parses the number at the start of sv (after blanks) like strtod() and moves sv behind it, false if
+// there is none. Decimals of up to 19 significant digits and exponents within +-22 are converted
+// directly and exactly rounded (both factors are exact doubles, one multiplication or division rounds
+// correctly), longer or huge numbers, inf and nan go through strtod() in the "C" locale.
+bool uti_sv_parse_double(struct Uti_String_View *sv, double *out);
 
 #ifndef max
 #define max(a,b) ((a) > (b) ? (a) : (b))